@@ -0,0 +1,1151 @@
+/*
+
+Filename: bench.c
+
+Description: Microbenchmarks for the List operations and pool key lookups, a pool shared
+             by several threads, pushes onto an MPSC queue from several threads, the kernel
+             operations built on them, the page table walk, page replacement, copy-on-write
+             fork, the buddy frame allocator and page cache lookups.
+             Every benchmark is calibrated (which doubles as warmup) until one sample takes at
+             least the target time, then timed over several samples. Results are written as
+             CSV to stdout, one row per benchmark and size, so runs from two commits can be
+             diffed directly. Anything the code under test prints goes to /dev/null.
+             Where the hardware counters can be read (perf_event_open), the last-level cache
+             misses per operation over the samples are reported too; the column is left empty
+             otherwise.
+
+Usage: kbench [--quick] [--samples N] [--target-ms N] [--max-procs N] [--filter <substring>]
+
+*/
+
+
+#include "PCB.h"
+#include "Replacement.h"
+#include "MpscQueue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define BENCH_MAX_SAMPLES 64
+#define BENCH_GROUP_SIZE 8
+#define BENCH_MAX_THREADS 16
+#define BENCH_THREAD_ITEMS 256      // Items each thread keeps on its list in list_pool_threads
+#define BENCH_MPSC_RING 1024        // Items each producer cycles through in mpsc_push
+#define BENCH_MPSC_BATCH 64         // Most items the consumer takes at once in mpsc_push
+
+// A benchmark builds its state for size n once, then run() is called repeatedly on it.
+// run() performs `rounds` rounds, reports how many operations that was, and returns the
+// time taken by the timed part only. It must leave the state ready for the next call.
+typedef void* (*SETUP_FN)(size_t n);
+typedef uint64_t (*RUN_FN)(void *state, size_t n, uint64_t rounds, uint64_t *ops);
+typedef void (*TEARDOWN_FN)(void *state);
+
+// What a benchmark's size n counts
+enum BenchSizes {
+    SIZES_LIST,         // List length
+    SIZES_PROCS,        // Processes
+    SIZES_THREADS       // Threads
+};
+
+typedef struct Bench_s Bench;
+struct Bench_s {
+    const char *name;
+    SETUP_FN setup;
+    RUN_FN run;
+    TEARDOWN_FN teardown;
+    enum BenchSizes sizes;
+};
+
+static int samples = 7;
+static uint64_t targetNs = 20000000;
+static size_t maxProcs = 1000000;
+static const char *filter = NULL;
+static FILE *results = NULL;
+static int missCounter = -1;        // perf event counting cache misses, -1 if unavailable
+
+static const size_t listLengths[] = { 16, 256, 4096, 65536, 1048576 };
+static const size_t procCounts[] = { 1000, 10000, 100000, 1000000 };
+static const size_t threadCounts[] = { 1, 2, 4, 8, BENCH_MAX_THREADS };
+
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+// ---------- LIST BENCHMARKS ----------
+
+typedef struct ListBench_s ListBench;
+struct ListBench_s {
+    ListPool pool;
+    List *list;
+    int *items;
+    void **ptrs;        // &items[i], for the batch operations
+};
+
+static void* listSetup(size_t n) {
+
+    ListBench *b = calloc(1, sizeof(ListBench));
+    if (ListPool_init(&b->pool, n, 2) == LIST_FAIL) {
+        free(b);
+        return NULL;
+    }
+    b->list = List_create(&b->pool);
+    b->items = malloc(n * sizeof(int));
+    b->ptrs = malloc(n * sizeof(void *));
+    for (size_t i = 0; i < n; i++) {
+        b->items[i] = (int)i;
+        b->ptrs[i] = &b->items[i];
+    }
+    return b;
+}
+
+// Same, but with the list already filled
+static void* listFilledSetup(size_t n) {
+
+    ListBench *b = listSetup(n);
+    if (b == NULL)
+        return NULL;
+    for (size_t i = 0; i < n; i++) {
+        List_append(b->list, &b->items[i]);
+    }
+    return b;
+}
+
+// Same, with each item keyed by its value
+static void* listKeyedSetup(size_t n) {
+
+    ListBench *b = listSetup(n);
+    if (b == NULL)
+        return NULL;
+    for (size_t i = 0; i < n; i++) {
+        List_append(b->list, &b->items[i]);
+        List_set_key(b->list, b->items[i]);
+    }
+    return b;
+}
+
+static void listTeardown(void *state) {
+
+    ListBench *b = state;
+    ListPool_destroy(&b->pool);
+    free(b->items);
+    free(b->ptrs);
+    free(b);
+}
+
+// Append n items to an empty list
+static uint64_t listAppendRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    uint64_t elapsed = 0;
+    for (uint64_t r = 0; r < rounds; r++) {
+        uint64_t start = nowNs();
+        for (size_t i = 0; i < n; i++) {
+            List_append(b->list, &b->items[i]);
+        }
+        elapsed += nowNs() - start;
+        while (List_trim(b->list) != NULL) {
+        }
+    }
+    *ops = rounds * n;
+    return elapsed;
+}
+
+// Remove every item of a list of length n, from the front
+static uint64_t listRemoveRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    uint64_t elapsed = 0;
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            List_append(b->list, &b->items[i]);
+        }
+        uint64_t start = nowNs();
+        List_first(b->list);
+        while (List_remove(b->list) != NULL) {
+        }
+        elapsed += nowNs() - start;
+    }
+    *ops = rounds * n;
+    return elapsed;
+}
+
+// Append n items to an empty list in one batch
+static uint64_t listAppendNRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    uint64_t elapsed = 0;
+    for (uint64_t r = 0; r < rounds; r++) {
+        uint64_t start = nowNs();
+        List_append_n(b->list, b->ptrs, (int)n);
+        elapsed += nowNs() - start;
+        List_free(b->list, NULL);
+        b->list = List_create(&b->pool);
+    }
+    *ops = rounds * n;
+    return elapsed;
+}
+
+// Take every item of a list of length n into an array in one batch
+static uint64_t listDrainRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    void **out = malloc(n * sizeof(void *));
+    uint64_t elapsed = 0;
+    for (uint64_t r = 0; r < rounds; r++) {
+        List_append_n(b->list, b->ptrs, (int)n);
+        uint64_t start = nowNs();
+        if (List_drain(b->list, out, (int)n) != (int)n) {
+            fprintf(stderr, "list_drain: short drain\n");
+        }
+        elapsed += nowNs() - start;
+    }
+    free(out);
+    *ops = rounds * n;
+    return elapsed;
+}
+
+// Fill a list of length n and free it, leaving its items alone. Only the fill is per item.
+static uint64_t listFreeRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            List_append(b->list, &b->items[i]);
+        }
+        List_free(b->list, NULL);
+        b->list = List_create(&b->pool);
+    }
+    *ops = rounds * n;
+    return nowNs() - start;
+}
+
+// Move the back half of a list of length n onto another list and back again, one splice of
+//  n / 2 items each way
+static uint64_t listSpliceRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    List *other = List_create(&b->pool);
+    Node *middle = b->list->head;
+    for (size_t i = 0; i < n / 2; i++) {
+        middle = List_node_next(b->list, middle);
+    }
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        List_splice_range(other, b->list, middle, b->list->tail, (int)(n - n / 2));
+        List_splice(b->list, other);
+    }
+    uint64_t elapsed = nowNs() - start;
+    List_free(other, NULL);
+    *ops = rounds * 2;
+    return elapsed;
+}
+
+static bool intMatches(void *item, void *arg) {
+    return *(int *)item == *(int *)arg;
+}
+
+// Search a list of length n for its last item
+static uint64_t listSearchRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    int key = (int)n - 1;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        if (List_search(b->list, intMatches, &key) == NULL) {
+            fprintf(stderr, "list_search: item not found\n");
+        }
+    }
+    *ops = rounds;
+    return nowNs() - start;
+}
+
+// Find the last item of a list of length n by its key
+static uint64_t listFindKeyRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    int key = (int)n - 1;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        if (ListPool_find_key(&b->pool, key) == NULL) {
+            fprintf(stderr, "list_find_key: item not found\n");
+        }
+    }
+    *ops = rounds;
+    return nowNs() - start;
+}
+
+// Walk a list of length n with List_first/List_next
+static uint64_t listWalkRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    ListBench *b = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (void *item = List_first(b->list); item != NULL; item = List_next(b->list)) {
+        }
+    }
+    *ops = rounds * n;
+    return nowNs() - start;
+}
+
+
+// ---------- SHARED POOL BENCHMARKS ----------
+
+typedef struct PoolThreads_s PoolThreads;
+struct PoolThreads_s {
+    ListPool pool;
+    uint64_t rounds;
+};
+
+// One pool for n threads, each with its own list
+static void* poolThreadsSetup(size_t n) {
+
+    PoolThreads *b = calloc(1, sizeof(PoolThreads));
+    if (ListPool_init(&b->pool, n * (BENCH_THREAD_ITEMS + 2 * LIST_CACHE_BATCH), n) == LIST_FAIL) {
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+static void poolThreadsTeardown(void *state) {
+
+    PoolThreads *b = state;
+    ListPool_destroy(&b->pool);
+    free(b);
+}
+
+// Fill a list of its own from the shared pool and empty it, rounds times
+static void* poolThread(void *arg) {
+
+    PoolThreads *b = arg;
+    List *list = List_create(&b->pool);
+    for (uint64_t r = 0; r < b->rounds; r++) {
+        for (int i = 0; i < BENCH_THREAD_ITEMS; i++) {
+            if (List_append(list, b) == LIST_FAIL) {
+                fprintf(stderr, "list_pool_threads: pool exhausted\n");
+            }
+        }
+        List_first(list);
+        while (List_remove(list) != NULL) {
+        }
+    }
+    List_free(list, NULL);
+    ListPool_release_cache(&b->pool);
+    return NULL;
+}
+
+// n threads taking nodes from and giving them back to one pool at once. An operation is one
+//  append and one remove; the time is the wall time for all the threads to finish.
+static uint64_t poolThreadsRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    PoolThreads *b = state;
+    pthread_t threads[BENCH_MAX_THREADS];
+    b->rounds = rounds;
+    uint64_t start = nowNs();
+    for (size_t t = 0; t < n; t++) {
+        pthread_create(&threads[t], NULL, poolThread, b);
+    }
+    for (size_t t = 0; t < n; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    *ops = rounds * n * BENCH_THREAD_ITEMS;
+    return nowNs() - start;
+}
+
+
+// ---------- MPSC QUEUE BENCHMARKS ----------
+
+typedef struct MpscItem_s MpscItem;
+struct MpscItem_s {
+    MpscNode link;
+    atomic_bool queued;         // Pushed and not yet taken, so its producer must not reuse it
+};
+
+typedef struct MpscBench_s MpscBench;
+struct MpscBench_s {
+    bool locked;                // Push onto a List under a mutex instead, for comparison
+    MpscQueue queue;
+    ListPool pool;
+    List *list;
+    pthread_mutex_t lock;
+    MpscItem *items;            // BENCH_MPSC_RING per producer
+    uint64_t pushes;            // Per producer, this run
+};
+
+typedef struct MpscProducer_s MpscProducer;
+struct MpscProducer_s {
+    MpscBench *bench;
+    MpscItem *ring;
+};
+
+static void* mpscBenchSetup(size_t n, bool locked) {
+
+    MpscBench *b = calloc(1, sizeof(MpscBench));
+    b->locked = locked;
+    MpscQueue_init(&b->queue);
+    pthread_mutex_init(&b->lock, NULL);
+    b->items = calloc(n * BENCH_MPSC_RING, sizeof(MpscItem));
+    if (ListPool_init(&b->pool, n * BENCH_MPSC_RING + (n + 1) * 3 * LIST_CACHE_BATCH, 1) == LIST_FAIL) {
+        free(b->items);
+        free(b);
+        return NULL;
+    }
+    b->list = List_create(&b->pool);
+    return b;
+}
+
+// n producers pushing onto one lock-free queue
+static void* mpscSetup(size_t n) {
+    return mpscBenchSetup(n, false);
+}
+
+// n producers appending to one List under a mutex
+static void* mpscLockedSetup(size_t n) {
+    return mpscBenchSetup(n, true);
+}
+
+static void mpscTeardown(void *state) {
+
+    MpscBench *b = state;
+    ListPool_destroy(&b->pool);
+    pthread_mutex_destroy(&b->lock);
+    free(b->items);
+    free(b);
+}
+
+// Push b->pushes items, cycling through the producer's ring and waiting for an item to be
+//  taken before pushing it again
+static void* mpscProducer(void *arg) {
+
+    MpscProducer *p = arg;
+    MpscBench *b = p->bench;
+    for (uint64_t i = 0; i < b->pushes; i++) {
+        MpscItem *item = &p->ring[i % BENCH_MPSC_RING];
+        while (atomic_load_explicit(&item->queued, memory_order_acquire)) {
+            sched_yield();
+        }
+        atomic_store_explicit(&item->queued, true, memory_order_relaxed);
+        if (b->locked) {
+            pthread_mutex_lock(&b->lock);
+            List_append(b->list, item);
+            pthread_mutex_unlock(&b->lock);
+        }
+        else {
+            MpscQueue_push(&b->queue, &item->link);
+        }
+    }
+    if (b->locked)
+        ListPool_release_cache(&b->pool);
+    return NULL;
+}
+
+// n producers each pushing rounds * BENCH_MPSC_RING items while this thread takes them off in
+//  batches of up to BENCH_MPSC_BATCH. The time is the wall time until every item is taken.
+static uint64_t mpscPushRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    MpscBench *b = state;
+    pthread_t threads[BENCH_MAX_THREADS];
+    MpscProducer producers[BENCH_MAX_THREADS];
+    MpscNode *nodes[BENCH_MPSC_BATCH];
+    void *items[BENCH_MPSC_BATCH];
+    uint64_t total = rounds * BENCH_MPSC_RING * n;
+    uint64_t taken = 0;
+    b->pushes = rounds * BENCH_MPSC_RING;
+
+    uint64_t start = nowNs();
+    for (size_t t = 0; t < n; t++) {
+        producers[t].bench = b;
+        producers[t].ring = &b->items[t * BENCH_MPSC_RING];
+        pthread_create(&threads[t], NULL, mpscProducer, &producers[t]);
+    }
+    while (taken < total) {
+        int got;
+        if (b->locked) {
+            pthread_mutex_lock(&b->lock);
+            got = List_drain(b->list, items, BENCH_MPSC_BATCH);
+            pthread_mutex_unlock(&b->lock);
+        }
+        else {
+            got = MpscQueue_drain(&b->queue, nodes, BENCH_MPSC_BATCH);
+            for (int i = 0; i < got; i++) {
+                items[i] = MPSC_ITEM(nodes[i], MpscItem, link);
+            }
+        }
+        for (int i = 0; i < got; i++) {
+            atomic_store_explicit(&((MpscItem *)items[i])->queued, false, memory_order_release);
+        }
+        taken += got;
+        if (got == 0)
+            sched_yield();
+    }
+    for (size_t t = 0; t < n; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    *ops = total;
+    return nowNs() - start;
+}
+
+
+// ---------- KERNEL BENCHMARKS ----------
+
+// A silent kernel holding n processes in the lowest priority ready queue
+static Kernel* kernelWithProcs(size_t n, size_t extraNodes) {
+
+    KernelConfig config;
+    KernelConfig_default(&config);
+    config.max_nodes = (unsigned int)(n + extraNodes + 16);
+    config.kstack_pages = 0;        // Kernel stacks would bound n by the simulated memory
+    Kernel *k = Kernel_create(&config, NULL, NULL);
+    if (k == NULL)
+        return NULL;
+    int first;
+    if (n > 0 && create_n(k, 2, (int)n, &first) != (int)n) {
+        Kernel_destroy(k);
+        return NULL;
+    }
+    return k;
+}
+
+static void* kernelSetup(size_t n) {
+    return kernelWithProcs(n, 0);
+}
+
+// A, B at high priority over n background processes, A running and B blocked in receive
+static void* kernelPingPongSetup(size_t n) {
+
+    Kernel *k = kernelWithProcs(0, n);
+    if (k == NULL)
+        return NULL;
+    create(k, 0);       // A, runs immediately in place of init
+    create(k, 0);       // B
+    int first;
+    create_n(k, 2, (int)n, &first);
+    quantum(k);         // B runs
+    receive(k);         // B blocks, A runs
+    return k;
+}
+
+// A, B at high priority over n background processes, A running, semaphore 0 at zero
+static void* kernelSemSetup(size_t n) {
+
+    Kernel *k = kernelWithProcs(0, n);
+    if (k == NULL)
+        return NULL;
+    create(k, 0);
+    create(k, 0);
+    int first;
+    create_n(k, 2, (int)n, &first);
+    new_Sem(k, 0, 0);
+    return k;
+}
+
+// A at high priority running, with n forked children that have been killed and not yet
+//  waited for
+static void* kernelParentSetup(size_t n) {
+
+    Kernel *k = kernelWithProcs(0, 0);
+    if (k == NULL)
+        return NULL;
+    create(k, 0);
+    for (size_t i = 0; i < n; i++) {
+        kill_proc(k, fork_proc(k));
+    }
+    return k;
+}
+
+// n processes, the first BENCH_GROUP_SIZE of them in process group 1
+static void* kernelGroupSetup(size_t n) {
+
+    Kernel *k = kernelWithProcs(n, 0);
+    if (k == NULL)
+        return NULL;
+    for (int pid = 2; pid <= BENCH_GROUP_SIZE; pid++) {
+        setpgid_proc(k, pid, 1);
+    }
+    return k;
+}
+
+static void kernelTeardown(void *state) {
+    Kernel_destroy(state);
+}
+
+// Look up the process at the back of the last ready queue
+static uint64_t findProcessRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    Kernel *k = state;
+    int pid = (int)k->pid_curr - 1;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        if (Kernel_find_process(k, pid) == NULL) {
+            fprintf(stderr, "find_process: pid %i not found\n", pid);
+        }
+    }
+    *ops = rounds;
+    return nowNs() - start;
+}
+
+// Create a process and kill it again
+static uint64_t createKillRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    Kernel *k = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        int pid = create(k, 2);
+        kill_proc(k, pid);
+    }
+    *ops = rounds;
+    return nowNs() - start;
+}
+
+// A forks a child, kills it and reaps it. The child is linked into and out of lists of n
+//  siblings, which must not cost more for a larger n.
+static uint64_t forkWaitRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    Kernel *k = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        kill_proc(k, fork_proc(k));
+        wait_proc(k);
+    }
+    *ops = rounds;
+    return nowNs() - start;
+}
+
+// Stop process group 1 and continue it. Each delivery takes a member off the ready queue or
+//  the stopped queue by its node, so the cost per member must not grow with n.
+static uint64_t groupSignalRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    Kernel *k = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        signal_proc(k, -1, SIGNAL_STOP);
+        signal_proc(k, -1, SIGNAL_CONT);
+    }
+    *ops = rounds * 2 * BENCH_GROUP_SIZE;
+    return nowNs() - start;
+}
+
+// One pass over a ready queue of n processes, reading what a scheduler compares: state,
+//  priority and how long each has been ready. Only the first cache line of each control
+//  block is touched.
+static uint64_t readyScanRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    Kernel *k = state;
+    List *queue = k->ready_lists[2];
+    int oldest = -1;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        uint64_t since = UINT64_MAX;
+        for (PCB *process = List_first(queue); process != NULL; process = List_next(queue)) {
+            if (process->state == READY && process->priority == 2 && process->ready_time < since) {
+                since = process->ready_time;
+                oldest = process->pid;
+            }
+        }
+    }
+    uint64_t elapsed = nowNs() - start;
+    if (oldest == -1) {
+        fprintf(stderr, "ready_scan: no ready process\n");
+    }
+    *ops = rounds * n;
+    return elapsed;
+}
+
+// Expire the running process's quantum
+static uint64_t quantumRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    Kernel *k = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        quantum(k);
+    }
+    *ops = rounds;
+    return nowNs() - start;
+}
+
+// A sends to B, B receives and replies, B blocks in receive again so A runs
+static uint64_t sendReplyRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    Kernel *k = state;
+    int a = k->current->pid;
+    int b = a + 1;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        send_msg(k, b, "ping\n");
+        receive(k);
+        reply(k, a, "pong\n");
+        receive(k);
+    }
+    *ops = rounds;
+    return nowNs() - start;
+}
+
+// A and B take turns blocking on semaphore 0 and waking each other
+static uint64_t semPingPongRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    Kernel *k = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        sem_P(k, 0);
+        sem_V(k, 0);
+        sem_P(k, 0);
+        sem_V(k, 0);
+    }
+    *ops = rounds * 2;      // P/V pairs
+    return nowNs() - start;
+}
+
+
+// ---------- VIRTUAL MEMORY BENCHMARKS ----------
+
+typedef struct VMBench_s VMBench;
+struct VMBench_s {
+    FrameTable frames;
+    AddressSpace as;
+    AddressSpace child;         // For vm_fork
+};
+
+// An address space with numFrames resident pages, 0 to numFrames-1, filling every frame
+static void* vmPolicySetup(size_t numFrames, const ReplacementPolicy *policy) {
+
+    VMBench *b = calloc(1, sizeof(VMBench));
+    if (b == NULL || FrameTable_init(&b->frames, numFrames, policy) == -1) {
+        free(b);
+        return NULL;
+    }
+    AddressSpace_init(&b->as, &b->frames);
+    for (size_t i = 0; i < numFrames; i++) {
+        int frame = FrameTable_alloc(&b->frames, &b->as, i);
+        AddressSpace_map(&b->as, i, frame, false);
+    }
+    return b;
+}
+
+static void* vmSetup(size_t n) {
+    return vmPolicySetup(n, &Replacement_clock);
+}
+
+// Half of n pages resident, the other half will have to be faulted in
+static void* vmClockSetup(size_t n) {
+    return vmPolicySetup(n > 1 ? n / 2 : 1, &Replacement_clock);
+}
+
+static void* vmAgingSetup(size_t n) {
+    return vmPolicySetup(n > 1 ? n / 2 : 1, &Replacement_aging);
+}
+
+static void* vmArcSetup(size_t n) {
+    return vmPolicySetup(n > 1 ? n / 2 : 1, &Replacement_arc);
+}
+
+static void vmTeardown(void *state) {
+
+    VMBench *b = state;
+    AddressSpace_destroy(&b->as);
+    FrameTable_destroy(&b->frames);
+    free(b);
+}
+
+// Touch n resident pages in a scattered order (every access is a hit)
+static uint64_t vmAccessRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    VMBench *b = state;
+    uint64_t hits = 0;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        // n is a power of two, so an odd stride visits every page once
+        size_t page = r;
+        for (size_t i = 0; i < n; i++) {
+            page = (page + 40503) & (n - 1);
+            hits += AddressSpace_access(&b->as, (uint32_t)(page << VM_PAGE_SHIFT), i & 1);
+        }
+    }
+    uint64_t elapsed = nowNs() - start;
+    if (hits != rounds * n) {
+        fprintf(stderr, "vm_access: unexpected page fault\n");
+    }
+    *ops = rounds * n;
+    return elapsed;
+}
+
+// Touch n pages at random through n/2 frames, so about half the accesses fault and evict.
+// A fault is handled inline: a victim is chosen and the page is mapped into its frame. Each
+//  round is one tick of the replacement policy.
+static uint64_t vmReplaceRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    VMBench *b = state;
+    uint64_t x = 0x9e3779b97f4a7c15ull + b->frames.evictions;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            uint32_t vpn = (uint32_t)(x & (n - 1));
+            if (!AddressSpace_access(&b->as, vpn << VM_PAGE_SHIFT, i & 1)) {
+                int frame = FrameTable_evict(&b->frames, &b->as, vpn);
+                AddressSpace_map(&b->as, vpn, frame, i & 1);
+            }
+        }
+        FrameTable_tick(&b->frames);
+    }
+    *ops = rounds * n;
+    return nowNs() - start;
+}
+
+// Fork a process with n resident pages and let the child exit at once. The pages are shared,
+//  not copied, so each fork is a walk of the parent's page tables.
+static uint64_t vmForkRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    VMBench *b = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        AddressSpace_init(&b->child, &b->frames);
+        AddressSpace_fork(&b->child, &b->as);
+        AddressSpace_destroy(&b->child);
+    }
+    uint64_t elapsed = nowNs() - start;
+    if (b->frames.sharedPages != 0) {
+        fprintf(stderr, "vm_fork: pages still shared after the child exited\n");
+    }
+    *ops = rounds;
+    return elapsed;
+}
+
+// Buddy allocator churn over n frames: a ring of live blocks of 1-8 frames, each step frees
+//  the oldest block and allocates a new one, keeping memory about half full
+typedef struct BuddyBench_s BuddyBench;
+struct BuddyBench_s {
+    FrameTable frames;
+    AddressSpace owner;         // Only used as the owner of every block
+    int *blocks;
+    unsigned int *orders;
+    size_t numBlocks;
+    size_t oldest;
+    uint64_t rng;
+};
+
+static unsigned int buddyNextOrder(BuddyBench *b) {
+    b->rng ^= b->rng << 13;
+    b->rng ^= b->rng >> 7;
+    b->rng ^= b->rng << 17;
+    return (unsigned int)(b->rng & 3);
+}
+
+static void* buddySetup(size_t n) {
+
+    BuddyBench *b = calloc(1, sizeof(BuddyBench));
+    if (b == NULL || FrameTable_init(&b->frames, n, &Replacement_clock) == -1) {
+        free(b);
+        return NULL;
+    }
+    AddressSpace_init(&b->owner, &b->frames);
+    b->rng = 0x9e3779b97f4a7c15ull;
+
+    // Blocks average 3.75 frames, so n / 8 of them fill about half of memory
+    b->numBlocks = n / 8 > 0 ? n / 8 : 1;
+    b->blocks = malloc(b->numBlocks * sizeof(int));
+    b->orders = malloc(b->numBlocks * sizeof(unsigned int));
+    if (b->blocks == NULL || b->orders == NULL) {
+        free(b->blocks);
+        free(b->orders);
+        FrameTable_destroy(&b->frames);
+        free(b);
+        return NULL;
+    }
+    for (size_t i = 0; i < b->numBlocks; i++) {
+        b->orders[i] = buddyNextOrder(b);
+        b->blocks[i] = FrameTable_alloc_block(&b->frames, &b->owner, b->orders[i]);
+    }
+    return b;
+}
+
+static void buddyTeardown(void *state) {
+
+    BuddyBench *b = state;
+    free(b->blocks);
+    free(b->orders);
+    FrameTable_destroy(&b->frames);
+    free(b);
+}
+
+// One op is a release and an allocation
+static uint64_t buddyChurnRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    BuddyBench *b = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < b->numBlocks; i++) {
+            size_t slot = b->oldest;
+            b->oldest = (b->oldest + 1) % b->numBlocks;
+            if (b->blocks[slot] != VM_NO_FRAME)
+                FrameTable_free_block(&b->frames, b->blocks[slot], b->orders[slot]);
+            b->orders[slot] = buddyNextOrder(b);
+            b->blocks[slot] = FrameTable_alloc_block(&b->frames, &b->owner, b->orders[slot]);
+        }
+    }
+    *ops = rounds * b->numBlocks;
+    return nowNs() - start;
+}
+
+
+typedef struct CacheBench_s CacheBench;
+struct CacheBench_s {
+    PageCache cache;
+    uint64_t rng;
+    size_t span;                // Blocks read from: the cache size for hits, twice it for misses
+};
+
+static void* cachePolicySetup(size_t n, enum CachePolicy policy, size_t span) {
+
+    CacheBench *c = calloc(1, sizeof(CacheBench));
+    if (c == NULL || PageCache_init(&c->cache, (uint32_t)n, policy) == -1) {
+        free(c);
+        return NULL;
+    }
+    c->rng = 0x9e3779b97f4a7c15ull;
+    c->span = span;
+
+    // Fill the cache with the first n blocks, all up to date
+    for (size_t b = 0; b < n; b++) {
+        uint32_t first, last;
+        PageCache_read(&c->cache, b / PAGECACHE_FILE_BLOCKS, b % PAGECACHE_FILE_BLOCKS, 1, &first, &last);
+        PageCache_filled(&c->cache, b / PAGECACHE_FILE_BLOCKS, b % PAGECACHE_FILE_BLOCKS, 1);
+    }
+    return c;
+}
+
+static void* cacheHitSetup(size_t n) {
+    return cachePolicySetup(n, CACHE_2Q, n);
+}
+
+static void* cacheLruMissSetup(size_t n) {
+    return cachePolicySetup(n, CACHE_LRU, 2 * n);
+}
+
+static void* cache2qMissSetup(size_t n) {
+    return cachePolicySetup(n, CACHE_2Q, 2 * n);
+}
+
+static void cacheTeardown(void *state) {
+
+    CacheBench *c = state;
+    PageCache_destroy(&c->cache);
+    free(c);
+}
+
+// One op is a one-block read of a random block in the span
+static uint64_t cacheReadRun(void *state, size_t n, uint64_t rounds, uint64_t *ops) {
+
+    CacheBench *c = state;
+    uint64_t start = nowNs();
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            c->rng ^= c->rng << 13;
+            c->rng ^= c->rng >> 7;
+            c->rng ^= c->rng << 17;
+            size_t b = (size_t)(c->rng % c->span);
+            uint32_t first, last;
+            if (PageCache_read(&c->cache, b / PAGECACHE_FILE_BLOCKS, b % PAGECACHE_FILE_BLOCKS, 1, &first, &last) > 0)
+                PageCache_filled(&c->cache, b / PAGECACHE_FILE_BLOCKS, b % PAGECACHE_FILE_BLOCKS, 1);
+        }
+    }
+    *ops = rounds * n;
+    return nowNs() - start;
+}
+
+
+static const Bench benches[] = {
+    { "list_append",        listSetup,           listAppendRun,  listTeardown,   SIZES_LIST },
+    { "list_remove",        listSetup,           listRemoveRun,  listTeardown,   SIZES_LIST },
+    { "list_append_n",      listSetup,           listAppendNRun, listTeardown,   SIZES_LIST },
+    { "list_drain",         listSetup,           listDrainRun,   listTeardown,   SIZES_LIST },
+    { "list_fill_free",     listSetup,           listFreeRun,    listTeardown,   SIZES_LIST },
+    { "list_splice",        listFilledSetup,     listSpliceRun,  listTeardown,   SIZES_LIST },
+    { "list_search",        listFilledSetup,     listSearchRun,  listTeardown,   SIZES_LIST },
+    { "list_find_key",      listKeyedSetup,      listFindKeyRun, listTeardown,   SIZES_LIST },
+    { "list_walk",          listFilledSetup,     listWalkRun,    listTeardown,   SIZES_LIST },
+    { "list_pool_threads",  poolThreadsSetup,    poolThreadsRun, poolThreadsTeardown, SIZES_THREADS },
+    { "mpsc_push",          mpscSetup,           mpscPushRun,    mpscTeardown,   SIZES_THREADS },
+    { "mpsc_push_locked",   mpscLockedSetup,     mpscPushRun,    mpscTeardown,   SIZES_THREADS },
+    { "find_process",       kernelSetup,         findProcessRun, kernelTeardown, SIZES_PROCS },
+    { "create_kill",        kernelSetup,         createKillRun,  kernelTeardown, SIZES_PROCS },
+    { "quantum_rotation",   kernelSetup,         quantumRun,     kernelTeardown, SIZES_PROCS },
+    { "ready_scan",         kernelSetup,         readyScanRun,   kernelTeardown, SIZES_PROCS },
+    { "send_reply",         kernelPingPongSetup, sendReplyRun,   kernelTeardown, SIZES_PROCS },
+    { "sem_pingpong",       kernelSemSetup,      semPingPongRun, kernelTeardown, SIZES_PROCS },
+    { "fork_wait",          kernelParentSetup,   forkWaitRun,    kernelTeardown, SIZES_PROCS },
+    { "group_signal",       kernelGroupSetup,    groupSignalRun, kernelTeardown, SIZES_PROCS },
+    { "vm_access",          vmSetup,             vmAccessRun,    vmTeardown,     SIZES_LIST },
+    { "vm_replace_clock",   vmClockSetup,        vmReplaceRun,   vmTeardown,     SIZES_LIST },
+    { "vm_replace_aging",   vmAgingSetup,        vmReplaceRun,   vmTeardown,     SIZES_LIST },
+    { "vm_replace_arc",     vmArcSetup,          vmReplaceRun,   vmTeardown,     SIZES_LIST },
+    { "vm_fork",            vmSetup,             vmForkRun,      vmTeardown,     SIZES_LIST },
+    { "buddy_churn",        buddySetup,          buddyChurnRun,  buddyTeardown,  SIZES_LIST },
+    { "cache_read_hit",     cacheHitSetup,       cacheReadRun,   cacheTeardown,  SIZES_LIST },
+    { "cache_read_lru",     cacheLruMissSetup,   cacheReadRun,   cacheTeardown,  SIZES_LIST },
+    { "cache_read_2q",      cache2qMissSetup,    cacheReadRun,   cacheTeardown,  SIZES_LIST },
+};
+
+
+// Start counting last-level cache misses of this process, if the kernel allows it
+static void openMissCounter() {
+
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    missCounter = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+// Reset and start the miss counter
+static void startMisses() {
+
+#ifdef __linux__
+    if (missCounter != -1) {
+        ioctl(missCounter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(missCounter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+// Stop the miss counter and read it. Returns false if misses are not being counted.
+static bool stopMisses(uint64_t *misses) {
+
+#ifdef __linux__
+    if (missCounter != -1) {
+        ioctl(missCounter, PERF_EVENT_IOC_DISABLE, 0);
+        return read(missCounter, misses, sizeof(*misses)) == sizeof(*misses);
+    }
+#endif
+    return false;
+}
+
+static void runBench(const Bench *bench, size_t n) {
+
+    void *state = bench->setup(n);
+    if (state == NULL) {
+        fprintf(stderr, "%s: setup failed for n=%zu\n", bench->name, n);
+        return;
+    }
+
+    // Calibrate: double the rounds until one sample is long enough. This is also the warmup.
+    uint64_t rounds = 1;
+    uint64_t ops = 0;
+    while (bench->run(state, n, rounds, &ops) < targetNs && rounds < (1ull << 40)) {
+        rounds *= 2;
+    }
+
+    // Misses are counted over the whole of each sample, including any untimed part of run()
+    double nsPerOp[BENCH_MAX_SAMPLES];
+    double sum = 0;
+    uint64_t misses = 0;
+    startMisses();
+    for (int s = 0; s < samples; s++) {
+        uint64_t elapsed = bench->run(state, n, rounds, &ops);
+        nsPerOp[s] = (double)elapsed / ops;
+        sum += nsPerOp[s];
+    }
+    bool counted = stopMisses(&misses);
+    bench->teardown(state);
+
+    qsort(nsPerOp, samples, sizeof(double), compareDouble);
+    fprintf(results, "%s,%zu,%llu,%d,%.2f,%.2f,%.2f,%.2f,", bench->name, n,
+            (unsigned long long)ops, samples, nsPerOp[0], nsPerOp[samples / 2],
+            sum / samples, nsPerOp[samples - 1]);
+    if (counted) {
+        fprintf(results, "%.3f", (double)misses / ((double)ops * samples));
+    }
+    fprintf(results, "\n");
+    fflush(results);
+}
+
+int main(int argc, char *argv[]) {
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            samples = 3;
+            targetNs = 5000000;
+            maxProcs = 100000;
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            samples = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc) {
+            targetNs = (uint64_t)atol(argv[++i]) * 1000000;
+        }
+        else if (strcmp(argv[i], "--max-procs") == 0 && i + 1 < argc) {
+            maxProcs = (size_t)atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--quick] [--samples N] [--target-ms N] [--max-procs N] [--filter <substring>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (samples < 1 || samples > BENCH_MAX_SAMPLES) {
+        fprintf(stderr, "Error: samples must be between 1 and %d\n", BENCH_MAX_SAMPLES);
+        return 1;
+    }
+
+    // Results keep the real stdout; anything the code under test prints is discarded
+    results = fdopen(dup(fileno(stdout)), "w");
+    if (results == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "Error: Could not redirect output\n");
+        return 1;
+    }
+
+    openMissCounter();
+    fprintf(results, "benchmark,n,ops_per_sample,samples,ns_per_op_min,ns_per_op_median,ns_per_op_mean,ns_per_op_max,cache_misses_per_op\n");
+    for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+        const Bench *bench = &benches[b];
+        if (filter != NULL && strstr(bench->name, filter) == NULL)
+            continue;
+
+        const size_t *sizes = listLengths;
+        size_t numSizes = sizeof(listLengths) / sizeof(listLengths[0]);
+        if (bench->sizes == SIZES_PROCS) {
+            sizes = procCounts;
+            numSizes = sizeof(procCounts) / sizeof(procCounts[0]);
+        }
+        else if (bench->sizes == SIZES_THREADS) {
+            sizes = threadCounts;
+            numSizes = sizeof(threadCounts) / sizeof(threadCounts[0]);
+        }
+        for (size_t i = 0; i < numSizes; i++) {
+            if (bench->sizes == SIZES_PROCS && sizes[i] > maxProcs)
+                continue;
+            runBench(bench, sizes[i]);
+        }
+    }
+
+    fclose(results);
+    return 0;
+}
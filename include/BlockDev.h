@@ -0,0 +1,98 @@
+// Simulated block device
+// A disk of numBlocks blocks under a single head, serving one request at a time. A request
+// costs a seek, BLOCKDEV_SETTLE_TICKS plus up to BLOCKDEV_SEEK_TICKS in proportion to the
+// distance the head moves (nothing if it is already there), and a transfer of one tick per
+// BLOCKDEV_BLOCKS_PER_TICK blocks. The head is left after the last block transferred.
+//
+// A process that issues I/O blocks on the device's wait queue, in arrival order. Whenever the
+// device goes idle, the I/O scheduler picks the next request from the queue:
+//
+// fifo     - Arrival order.
+// scan     - Elevator (LOOK): the head keeps moving the same way, taking the nearest request
+//            ahead of it, and turns around when there is none.
+// deadline - scan, except that a request waiting past its deadline (BLOCKDEV_READ_DEADLINE
+//            ticks for reads, BLOCKDEV_WRITE_DEADLINE for writes) goes first, oldest first.
+//
+// Picking a request walks the wait queue once, so it is linear in the queue length.
+//
+// While the device is idle, the page cache may also use it to write back dirty pages, with no
+// process waiting (see PageCache.h).
+
+#ifndef _BLOCKDEV_H_
+#define _BLOCKDEV_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "List.h"
+#include "Histogram.h"
+#include "KernelSim.h"
+
+#define BLOCKDEV_SETTLE_TICKS 1
+#define BLOCKDEV_SEEK_TICKS 8           // Extra ticks to seek across the whole disk
+#define BLOCKDEV_BLOCKS_PER_TICK 16
+#define BLOCKDEV_READ_DEADLINE 50
+#define BLOCKDEV_WRITE_DEADLINE 250
+
+typedef struct PCB_s PCB;
+
+// One request, kept in the process that issued it
+typedef struct BlockRequest_s BlockRequest;
+struct BlockRequest_s {
+    uint32_t block;             // First block
+    uint32_t count;             // Blocks transferred
+    bool write;
+    bool fill;                  // A page cache read: the cached blocks are up to date once it completes
+    uint64_t issued;            // Virtual time the request was queued
+    uint64_t deadline;
+};
+
+typedef struct BlockDev_s BlockDev;
+struct BlockDev_s {
+    uint32_t numBlocks;
+    enum IOScheduler sched;
+    List *queue;                // Processes waiting for the device, in arrival order
+    PCB *active;                // Process whose request is being served, NULL if none
+    bool busy;                  // Serving a request (its process may since have been killed)
+    uint64_t busyUntil;         // Virtual time the request being served completes
+    uint32_t head;              // Block under the head
+    bool up;                    // Direction the elevator is moving in
+
+    uint64_t reads;             // Completed requests, and write-backs started
+    uint64_t writes;
+    uint64_t blocksRead;
+    uint64_t blocksWritten;
+    uint64_t busyTicks;         // Time spent serving requests
+    uint64_t seekBlocks;        // Total distance moved by the head
+    uint64_t expired;           // Requests served late because their deadline had passed
+    Histogram latency;          // Time from issue to completion
+};
+
+// Make an idle disk of numBlocks blocks, its wait queue taken from pool.
+// Returns 0 on success, -1 if the queue could not be allocated.
+int BlockDev_init(BlockDev *dev, ListPool *pool, uint32_t numBlocks, enum IOScheduler sched);
+
+// Queue process, whose disk request has been filled in, and start serving it if the device
+//  is idle. Returns 0 on success, -1 if the wait queue is full.
+int BlockDev_submit(BlockDev *dev, PCB *process, uint64_t now);
+
+// Returns the process whose request has completed by now, NULL if there is none; the next
+//  request is started. Call once per tick, until it returns NULL.
+PCB* BlockDev_complete(BlockDev *dev, uint64_t now);
+
+// Start a write of count blocks at block with no process waiting for it (a page cache
+//  write-back) on an idle device.
+void BlockDev_writeback(BlockDev *dev, uint32_t block, uint32_t count, uint64_t now);
+
+// Take process off the device, whether it is waiting or being served. A transfer in progress
+//  still runs to completion. Returns false if the process is not on the device.
+bool BlockDev_cancel(BlockDev *dev, PCB *process);
+
+// Number of processes blocked on the device, including the one being served
+int BlockDev_waiting(BlockDev *dev);
+
+// Ticks to serve a request of count blocks at block with the head at head
+uint64_t BlockDev_cost(BlockDev *dev, uint32_t head, uint32_t block, uint32_t count);
+
+// Name of a scheduler, NULL if there is none
+const char* BlockDev_sched_name(enum IOScheduler sched);
+
+#endif
@@ -0,0 +1,28 @@
+// Kernel checkpoints
+// A checkpoint is a compact binary snapshot of a whole kernel: every PCB with its pending
+// message and reply, the order of every ready, waiting and semaphore queue, the semaphore
+// values, the virtual clock, the metrics counters and the latency histograms. Restoring maps
+// the file and rebuilds the kernel in one pass, without replaying any commands, so a long
+// soak run can be resumed (or tried against another scheduler configuration) instantly.
+//
+// The format is the in-memory layout of the host; a checkpoint is only meant to be restored
+// by the same build on the same kind of machine.
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+#include <stdio.h>
+#include "KernelSim.h"
+
+// Write a checkpoint of k to path. The file is replaced atomically.
+// Returns the number of bytes written, -1 on failure (including after the init process
+//  has been killed, as there is nothing left to save).
+long Checkpoint_write(Kernel *k, const char *path);
+
+// Make a new kernel from the checkpoint at path. config may be NULL to use the configuration
+//  the checkpoint was taken with; otherwise its quantum and semaphore wake policy take effect
+//  from now on, its number of priorities must match the checkpoint and its node pool must be
+//  large enough for every queued process. in and out are as for Kernel_create.
+// Returns NULL on failure or if the file is not a valid checkpoint.
+Kernel* Checkpoint_restore(const char *path, const KernelConfig *config, FILE *in, FILE *out);
+
+#endif
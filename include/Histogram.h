@@ -0,0 +1,42 @@
+// Log-linear (HDR-style) latency histogram
+// Every power-of-two range is split into HIST_SUB_COUNT linear sub-buckets, so a recorded
+// value is reported with a relative error of at most 1 / HIST_SUB_COUNT. Recording is a
+// handful of integer operations and the memory footprint is fixed.
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_NUM_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+#define HIST_NAME_LEN 32
+
+typedef struct Histogram_s Histogram;
+struct Histogram_s {
+    char name[HIST_NAME_LEN];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+    uint64_t buckets[HIST_NUM_BUCKETS];
+};
+
+// Reset the histogram and give it a name to print with.
+void Histogram_init(Histogram *hist, const char *name);
+
+// Record one value. Constant time.
+void Histogram_record(Histogram *hist, uint64_t value);
+
+// Add every value recorded in src to dst.
+void Histogram_merge(Histogram *dst, const Histogram *src);
+
+// Returns the value at or below which p percent of the recorded values fall (0 < p <= 100).
+// Returns 0 if nothing has been recorded.
+uint64_t Histogram_percentile(Histogram *hist, double p);
+
+// Print a one-line summary (count, min, percentiles, max, mean) of the histogram.
+void Histogram_print(Histogram *hist, FILE *out);
+
+#endif
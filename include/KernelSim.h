@@ -0,0 +1,216 @@
+// Embeddable kernel simulator API (libkernelsim.a)
+// Drives the scheduler in-process, without the interactive input loop of sim. Every kernel is
+// independent: separate kernels may be used from separate threads, a single kernel may not.
+//
+// Each operation below is one command and advances the kernel's virtual clock by one tick,
+// exactly as the same command typed into sim would. Operations return -1 on failure.
+
+#ifndef _KERNELSIM_H_
+#define _KERNELSIM_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define KERNELSIM_MAX_PRIORITIES 8
+#define KERNELSIM_NUM_SEMAPHORES 5
+
+typedef struct Kernel_s Kernel;
+
+// Which waiter a semaphore V operation unblocks
+enum SemWakePolicy {
+    SEM_WAKE_FIFO,          // Longest waiting process
+    SEM_WAKE_LIFO,          // Most recently blocked process
+    SEM_WAKE_PRIORITY       // Highest priority process, FIFO among equals
+};
+
+// Which resident page is evicted when a page fault finds no free frame (see Replacement.h)
+enum PageReplacement {
+    PAGE_REPLACE_CLOCK,     // Second chance on the accessed bit
+    PAGE_REPLACE_AGING,     // Approximate LRU from periodically sampled accessed bits
+    PAGE_REPLACE_ARC        // Adaptive Replacement Cache
+};
+
+// Order in which requests waiting for the disk are served (see BlockDev.h)
+enum IOScheduler {
+    IO_SCHED_FIFO,          // Arrival order
+    IO_SCHED_SCAN,          // Elevator: the head sweeps across the disk and back
+    IO_SCHED_DEADLINE       // Elevator, but requests past their deadline go first
+};
+
+// Which clean page the page cache evicts to make room (see PageCache.h)
+enum CachePolicy {
+    CACHE_LRU,              // Least recently used
+    CACHE_2Q                // LRU, for pages seen twice; pages seen once go through a FIFO
+};
+
+// Tunable kernel parameters, fixed for the lifetime of a kernel
+typedef struct KernelConfig_s KernelConfig;
+struct KernelConfig_s {
+    int num_priorities;             // Ready queues (priority levels), 1 to KERNELSIM_MAX_PRIORITIES
+    unsigned int quantum;           // Ticks a process runs before it is preempted, 0 = only on Q
+    enum SemWakePolicy sem_wake;
+    unsigned int max_nodes;         // Size of the list node pool, which bounds the queued processes
+    unsigned int num_frames;        // Simulated physical memory, in pages
+    unsigned int fault_ticks;       // Ticks a page fault keeps a process blocked on I/O
+    enum PageReplacement replacement;
+    unsigned int kstack_pages;      // Contiguous frames every process holds, rounded up to a power of two
+    unsigned int disk_blocks;       // Size of the simulated disk
+    enum IOScheduler io_sched;
+    unsigned int cache_pages;       // Size of the page cache, at least PAGECACHE_MIN_PAGES
+    enum CachePolicy cache_policy;
+    unsigned int swap_slots;        // Size of the swap area in pages, 0 = none (dirty pages are dropped)
+    unsigned int swap_ticks;        // Ticks the swap device takes to transfer one page, at least 1
+    bool load_control;              // Swap out whole ready processes while paging thrashes
+};
+
+// Signals that can be sent to a process or a process group
+enum Signal {
+    SIGNAL_KILL = 1,        // Kill, as K does
+    SIGNAL_TERM,            // Terminate
+    SIGNAL_STOP,            // Stop: taken off the CPU and the ready queues until continued
+    SIGNAL_CONT,            // Continue a stopped process
+    SIGNAL_USR              // User signal, handled when the process next runs
+};
+
+enum KernelSimProcState {
+    KERNELSIM_RUNNING,
+    KERNELSIM_READY,
+    KERNELSIM_BLOCKED,
+    KERNELSIM_SWAPPED,              // Ready, but swapped out or being swapped back in
+    KERNELSIM_ZOMBIE,               // Exited, not yet waited for by its parent
+    KERNELSIM_STOPPED               // Stopped by a signal
+};
+
+enum KernelSimWaitState {
+    KERNELSIM_WAITING_SEND,         // Blocked in receive
+    KERNELSIM_WAITING_REPLY,        // Blocked in send
+    KERNELSIM_WAITING_SEM,
+    KERNELSIM_WAITING_IO,           // Blocked on a page fault
+    KERNELSIM_WAITING_DISK,         // Blocked on a disk request
+    KERNELSIM_WAITING_CHILD         // Blocked in wait
+};
+
+// Snapshot of the whole kernel
+typedef struct KernelSimState_s KernelSimState;
+struct KernelSimState_s {
+    uint64_t clock;                 // Virtual clock in ticks
+    bool exited;                    // The init process has been killed
+    int running_pid;                // -1 once the simulation has exited
+    int num_processes;              // Including init
+    int num_priorities;
+    int ready_length[KERNELSIM_MAX_PRIORITIES];
+    int waiting_send_length;
+    int waiting_reply_length;
+    int waiting_io_length;
+    int waiting_disk_length;        // Including the request being served
+    int swapped_length;             // Swapped out or being swapped back in
+    int waiting_child_length;
+    int zombies;
+    int stopped_length;
+    int num_groups;                 // Process groups with members
+    unsigned int free_frames;
+    unsigned int largest_free_block;        // In frames
+    bool sem_created[KERNELSIM_NUM_SEMAPHORES];
+    int sem_value[KERNELSIM_NUM_SEMAPHORES];
+    int sem_waiting_length[KERNELSIM_NUM_SEMAPHORES];
+};
+
+// Snapshot of one process
+typedef struct KernelSimProc_s KernelSimProc;
+struct KernelSimProc_s {
+    int pid;
+    int priority;
+    enum KernelSimProcState state;
+    enum KernelSimWaitState wait_state;     // Only meaningful when state is KERNELSIM_BLOCKED
+    bool has_message;                       // A received message has not been read yet
+    int message_src;                        // Sender of that message, -1 if there is none
+    bool has_reply;                         // A reply has not been delivered yet
+    unsigned int resident_pages;
+    uint64_t page_faults;
+    int parent_pid;                         // -1 for init
+    unsigned int num_children;              // Live children
+    unsigned int num_zombies;               // Children that have exited and not been waited for
+    int pgid;                               // Process group, -1 for init
+    unsigned int pending_signals;           // User signals not handled yet
+};
+
+
+// Fill in the default configuration (3 priorities, no automatic quantum, FIFO semaphores,
+// 4096 frames, clock page replacement, 5 tick page faults, 2 frame kernel stacks, a 65536
+// block disk with FIFO I/O scheduling, a 1024 page 2q page cache, 16384 swap slots at 2 ticks
+// a page, load control on).
+void KernelSim_default_config(KernelConfig *config);
+
+// Make a new kernel with only the init process running. config may be NULL for the defaults.
+// Reports are written to out as sim would print them, or not at all if out is NULL.
+// Returns NULL on failure or if the configuration is invalid.
+Kernel* KernelSim_init(const KernelConfig *config, FILE *out);
+
+// Free the kernel and every process in it.
+void KernelSim_destroy(Kernel *k);
+
+// Run commands written exactly as they would be typed into sim, one value per line,
+// e.g. "C\n1\n" or "S\n2\nhello\n". Several commands may be given at once.
+// Returns the result of the last command (the new pid for C and F), -1 if it failed.
+int KernelSim_dispatch(Kernel *k, const char *commands);
+
+// Let one tick pass without a command (the running process keeps running, and may be
+// preempted if a quantum length is configured).
+void KernelSim_step(Kernel *k);
+
+// The individual commands. create and fork return the new pid.
+int KernelSim_create(Kernel *k, int priority);
+int KernelSim_fork(Kernel *k);
+// Create or fork count processes in one command, without reporting each. Returns the number
+//  made, their pids consecutive from *first.
+int KernelSim_create_n(Kernel *k, int priority, int count, int *first);
+int KernelSim_fork_n(Kernel *k, int count, int *first);
+int KernelSim_kill(Kernel *k, int pid);
+int KernelSim_exit(Kernel *k);
+// Wait for a child of the running process to exit. Returns the pid of the child reaped, 0 if
+//  the process blocked until one exits.
+int KernelSim_wait(Kernel *k);
+// Send a signal to the process pid, or to every process in group -pid if pid is negative.
+//  Returns the number of processes it took effect on.
+int KernelSim_signal(Kernel *k, int pid, enum Signal signal);
+// Move the process pid into group pgid, or into a new group of its own if pgid is pid
+int KernelSim_setpgid(Kernel *k, int pid, int pgid);
+int KernelSim_quantum(Kernel *k);
+int KernelSim_send(Kernel *k, int pid, const char *msg);
+int KernelSim_receive(Kernel *k);
+int KernelSim_reply(Kernel *k, int pid, const char *msg);
+int KernelSim_new_sem(Kernel *k, int sem_id, int value);
+int KernelSim_sem_P(Kernel *k, int sem_id);
+int KernelSim_sem_V(Kernel *k, int sem_id);
+
+// Access count consecutive pages of the running process, starting at vaddr. Stops at the first
+// page fault, which blocks the process. Returns the number of pages accessed without a fault.
+int KernelSim_access(Kernel *k, uint32_t vaddr, int count, bool write);
+
+// Read or write count blocks of the disk starting at block, on behalf of the running process,
+// which blocks until the request completes.
+int KernelSim_disk(Kernel *k, uint32_t block, int count, bool write);
+
+// Read or write count blocks of a file starting at block, through the page cache, on behalf
+// of the running process. It blocks only if a read misses or a write is throttled.
+// Returns 1 if the process blocked, 0 if not.
+int KernelSim_file(Kernel *k, int file, uint32_t block, int count, bool write);
+
+// Fill in a snapshot of the kernel. Does not advance the clock.
+void KernelSim_query(Kernel *k, KernelSimState *state);
+
+// Fill in a snapshot of the process with the given pid, which may be a zombie. Does not advance
+//  the clock.
+// Returns 0 on success, -1 if there is no such process.
+int KernelSim_query_proc(Kernel *k, int pid, KernelSimProc *proc);
+
+// Write a binary checkpoint of the whole kernel to path. Does not advance the clock.
+// Returns the size of the checkpoint in bytes, -1 on failure.
+long KernelSim_checkpoint(Kernel *k, const char *path);
+
+// Make a new kernel from a checkpoint. config may be NULL to keep the checkpointed
+// configuration; otherwise its number of priorities must match the checkpoint.
+// Returns NULL on failure.
+Kernel* KernelSim_restore(const char *path, const KernelConfig *config, FILE *out);
+
+#endif
@@ -0,0 +1,100 @@
+// Kernel metrics counters
+// The counters are bumped inline by the kernel; queue gauges are filled in just before the
+// metrics are printed or written out.
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+#include <stdint.h>
+#include <stdio.h>
+#include "KernelSim.h"
+
+#define METRICS_NUM_WAIT_KINDS 6    // Indexed by enum WaitState (send, reply, semaphore, page I/O, disk, child)
+#define METRICS_NUM_SIGNALS 5       // Indexed by enum Signal - 1 (kill, term, stop, cont, usr)
+#define METRICS_NUM_FIXED_QUEUES 7  // send, reply, page I/O, disk, swapped, child and stopped waits
+#define METRICS_MAX_QUEUES (KERNELSIM_MAX_PRIORITIES + 1 + METRICS_NUM_FIXED_QUEUES + KERNELSIM_NUM_SEMAPHORES)
+#define METRICS_QUEUE_NAME_LEN 16
+#define METRICS_NAME_LEN 16
+
+typedef struct MetricsQueue_s MetricsQueue;
+struct MetricsQueue_s {
+    char name[METRICS_QUEUE_NAME_LEN];
+    int length;
+    int peak;
+};
+
+typedef struct Metrics_s Metrics;
+struct Metrics_s {
+    uint64_t creates;
+    uint64_t forks;
+    uint64_t kills;
+    uint64_t zombies;               // Exited processes whose parents have not waited for them
+    uint64_t reaps;                 // Zombies freed, by a parent's wait or by init
+    uint64_t reparents;             // Live children handed to init when their parent exited
+    unsigned int groups;            // Process groups with members
+    uint64_t signals[METRICS_NUM_SIGNALS];  // Deliveries to a process, by signal
+    uint64_t signals_handled;       // User signals handled by the processes they were sent to
+    uint64_t context_switches;
+    uint64_t blocks[METRICS_NUM_WAIT_KINDS];
+    uint64_t send_slot_busy;        // Sends that failed because the target's message slot was full
+    uint64_t pool_exhaustions;      // Node requests made while the list node pool was full
+    uint64_t page_accesses;         // Simulated memory accesses, hits and faults
+    uint64_t page_faults;
+    unsigned int frames_total;      // Physical frame gauges
+    unsigned int frames_free;
+    unsigned int frames_largest_free;       // Largest free buddy block
+    uint64_t evictions;             // Resident pages given up to make room for a faulting page
+    uint64_t dirty_evictions;       // Evicted pages that had been written to
+    uint64_t cow_faults;            // Writes to pages shared since a fork
+    uint64_t cow_copies;            // Of those, the ones that had to copy the page
+    uint64_t fork_shared;           // Pages shared by fork instead of copied
+    unsigned int frames_saved;      // Frames that would hold copies of still-shared pages
+    char replacement[METRICS_NAME_LEN];     // Page replacement policy
+    uint64_t disk_reads;            // Completed disk requests
+    uint64_t disk_writes;
+    uint64_t disk_blocks_read;
+    uint64_t disk_blocks_written;
+    uint64_t disk_busy_ticks;       // Time the disk spent serving requests
+    uint64_t disk_seek_blocks;      // Distance moved by the disk head
+    uint64_t disk_expired;          // Requests the deadline scheduler served because they were late
+    char io_sched[METRICS_NAME_LEN];        // I/O scheduler
+    char cache_policy[METRICS_NAME_LEN];    // Page cache eviction policy
+    unsigned int cache_capacity;    // Page cache size, in pages
+    unsigned int cache_resident;
+    unsigned int cache_dirty;
+    uint64_t cache_hits;            // Blocks read from the page cache
+    uint64_t cache_misses;          // Blocks read from the disk
+    uint64_t cache_ghost_hits;      // Misses on pages 2q remembered
+    uint64_t cache_evictions;
+    uint64_t cache_overwrites;      // Writes absorbed by pages that were already dirty
+    uint64_t cache_throttled;       // Writes the cache did not absorb
+    uint64_t cache_writebacks;      // Batched write-backs of dirty pages
+    uint64_t cache_writeback_blocks;
+    unsigned int swap_slots;        // Swap area size, in pages
+    unsigned int swap_used;         // Slots holding a page
+    uint64_t swap_outs;             // Pages written to swap
+    uint64_t swap_ins;              // Pages read back from swap
+    uint64_t swap_full;             // Dirty pages dropped because swap was full
+    uint64_t swap_busy_ticks;       // Time the swap device spent on transfers
+    uint64_t swap_process_outs;     // Whole processes swapped out by load control
+    uint64_t swap_process_ins;
+    uint64_t clock;                 // Virtual clock at the time of the snapshot
+
+    int num_queues;
+    int queues_dropped;             // Gauges added after queues was full
+    MetricsQueue queues[METRICS_MAX_QUEUES];
+};
+
+// Add a queue gauge to the snapshot.
+// Returns 0 on success, -1 once METRICS_MAX_QUEUES is reached; the gauge is then counted in
+//  queues_dropped, which is printed.
+int Metrics_add_queue(Metrics *metrics, const char *name, int length, int peak);
+
+// Print the counters and queue gauges in a human-readable form.
+void Metrics_print(Metrics *metrics, FILE *out);
+
+// Write the counters and queue gauges to path in the Prometheus text exposition format.
+// The file is replaced atomically so a scraper never sees a partial write.
+// Returns 0 on success, -1 on failure.
+int Metrics_write_prometheus(Metrics *metrics, const char *path);
+
+#endif
@@ -0,0 +1,51 @@
+// Lock-free multi-producer, single-consumer queue
+// Any number of threads may push at once and one thread pops, with no lock on either side.
+// It is meant for handing PCBs or messages to the thread that owns a List (a run queue, a
+// mailbox) from other threads: they push, and the owner drains a bounded batch at a time and
+// moves it onto the List itself.
+//
+// The links are intrusive: an item embeds an MpscNode, so a push allocates nothing and cannot
+// fail, and an item is on at most one queue per node it embeds. A push is a single atomic
+// exchange of the tail followed by linking the old tail to the new node (Vyukov's queue), so
+// producers never wait for each other or for the consumer. Between those two steps the new
+// node, and any pushed after it, cannot yet be reached; the consumer sees the queue end early
+// and picks them up on a later pop.
+
+#ifndef _MPSCQUEUE_H_
+#define _MPSCQUEUE_H_
+#include <stdatomic.h>
+#include <stddef.h>
+
+// The item an MpscNode is embedded in, as member, of type
+#define MPSC_ITEM(node, type, member) ((type *)((char *)(node) - offsetof(type, member)))
+
+typedef struct MpscNode_s MpscNode;
+struct MpscNode_s {
+    _Atomic(MpscNode *) next;
+};
+
+// The producers' tail and the consumer's head are a cache line apart, so pushes do not keep
+// taking the line the consumer reads away from it.
+typedef struct MpscQueue_s MpscQueue;
+struct MpscQueue_s {
+    _Atomic(MpscNode *) tail;       // Node pushed last
+    char pad[64 - sizeof(_Atomic(MpscNode *))];
+    MpscNode *head;                 // Next node to pop, the stub if the queue has been emptied
+    MpscNode stub;                  // Stands in for a node while the queue is empty
+};
+
+// Make an empty queue.
+void MpscQueue_init(MpscQueue *q);
+
+// Add node to the end of q. Any thread may push at any time.
+void MpscQueue_push(MpscQueue *q, MpscNode *node);
+
+// Take the node at the front of q. Returns NULL if q is empty, or if the next node's push has
+//  not finished. Only one thread may pop (or drain) at a time.
+MpscNode* MpscQueue_pop(MpscQueue *q);
+
+// Take up to max nodes off the front of q into out, in the order they were pushed.
+// Returns the number taken. Only one thread may drain (or pop) at a time.
+int MpscQueue_drain(MpscQueue *q, MpscNode **out, int max);
+
+#endif
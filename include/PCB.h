@@ -2,31 +2,67 @@
 #ifndef _PCB_H_
 #define _PCB_H_
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "List.h"
+#include "Histogram.h"
+#include "Metrics.h"
+#include "VM.h"
+#include "BlockDev.h"
+#include "PageCache.h"
+#include "KernelSim.h"
 
 
-#define NUM_SEMAPHORE 5
-#define NUM_READY_LIST 3
+#define NUM_SEMAPHORE KERNELSIM_NUM_SEMAPHORES
+#define NUM_READY_LIST 3        // Default number of priority levels
+#define MAX_READY_LIST KERNELSIM_MAX_PRIORITIES     // Most priority levels a kernel can be configured with
 #define NUM_WAITING_LIST 2
 
+// Load control: every SWAP_INTERVAL ticks, a ready process is swapped out if page faults had to
+//  evict at least SWAP_HIGH_EVICTIONS pages in the interval, or one is swapped back in if they
+//  evicted at most SWAP_LOW_EVICTIONS
+#define SWAP_INTERVAL 16
+#define SWAP_HIGH_EVICTIONS 8
+#define SWAP_LOW_EVICTIONS 2
+
+#define NUM_SIGNALS (SIGNAL_USR + 1)
+#define EXIT_KILLED (-SIGNAL_KILL)      // Exit status of a process killed by a signal is minus the signal
+#define PGROUP_MIN_BUCKETS 16
+
 enum ProcState {
     RUNNING,
     READY,
-    BLOCKED
+    BLOCKED,
+    SWAPPED,            // Ready, but swapped out or being swapped back in
+    ZOMBIE,             // Exited, holding its exit status until its parent waits for it
+    STOPPED             // Stopped by a signal, on the stopped queue until continued
 };
 
 enum WaitState {
     WAITING_SEND,
     WAITING_REPLY,
-    WAITING_SEM
+    WAITING_SEM,
+    WAITING_IO,         // Page fault
+    WAITING_DISK,
+    WAITING_CHILD       // Waiting for a child to exit
 };
 
-typedef struct PCB_s PCB;
-struct PCB_s {
-    int pid;
-    int priority;
-    enum ProcState state;
-    enum WaitState waitState;
+// A process group: the processes a signal sent to the group reaches. Groups are found by pgid
+//  through a chained hash table, and their members are linked through the PCBs, so delivering
+//  to a group only touches its members.
+typedef struct ProcGroup_s ProcGroup;
+struct ProcGroup_s {
+    int pgid;
+    PCB *members;               // Newest first
+    unsigned int size;
+    ProcGroup *hashNext;        // Next group in the same hash bucket
+};
+
+// Messages held for a process. Most processes never use IPC, so this is kept out of line and
+//  only allocated when a message or reply is first delivered to the process.
+typedef struct Mailbox_s Mailbox;
+struct Mailbox_s {
     char *proc_message;
     int msg_src;
 
@@ -35,92 +71,424 @@ struct PCB_s {
     int reply_src;
 };
 
+// The fields the scheduler reads on every pass over a queue come first and fill exactly one
+//  cache line, and control blocks are allocated on a cache line boundary (Kernel_alloc_pcb),
+//  so walking a queue touches one line per process. Everything after them is cold.
+#define PCB_ALIGN 64
+
+struct PCB_s {
+    _Alignas(PCB_ALIGN) int pid;
+    int priority;
+    enum ProcState state;
+    enum WaitState waitState;
+    Node *queue_node;           // Its node on the queue it is on, so it can be taken off in O(1)
+
+    // Virtual clock timestamps used by the latency histograms
+    uint64_t ready_time;    // When the process last entered a ready queue
+    uint64_t block_time;    // When the process last blocked (send, receive, semaphore or I/O)
+
+    Mailbox *mail;              // NULL until a message or reply is delivered to it
+    ProcGroup *group;           // NULL for init and zombies
+    unsigned int sig_pending;   // User signals not handled yet
+    int sem_id;                 // The semaphore it is blocked on while WAITING_SEM
+
+    // ------ Cold ------
+    AddressSpace mem;
+    int kstack;                 // First frame of the kernel stack block, VM_NO_FRAME if none
+    unsigned int kstack_order;  // The block is 2^kstack_order frames
+
+    // The page being read in while the process is blocked on I/O
+    uint32_t io_vpn;
+    int io_frame;
+    bool io_write;
+    uint64_t io_done;       // Virtual time the read completes
+
+    BlockRequest disk;      // The request the process is blocked on while WAITING_DISK
+
+    // While SWAPPED
+    unsigned int swap_pages;    // Pages written to swap when it was swapped out
+    uint64_t swap_done;         // Virtual time it is back in memory, 0 until it is swapped in
+
+    // Process tree. A child is linked into one of its parent's two lists through its sibling
+    //  links, newest first, so that linking, unlinking and reaping a child take O(1).
+    PCB *parent;                // NULL for init
+    PCB *children;              // Live children
+    PCB *zombies;               // Children that have exited and not been waited for
+    PCB *prev_sibling;
+    PCB *next_sibling;
+    unsigned int num_children;
+    unsigned int num_zombies;
+    int exit_status;            // While ZOMBIE: 0 if it exited, minus the signal if it was killed
+
+    PCB *group_prev;            // Links on the group's member list
+    PCB *group_next;
+};
+
+_Static_assert(offsetof(PCB, mem) == PCB_ALIGN, "the hot fields of PCB must fill one cache line");
+
 typedef struct semaphore_t sem_t;
 struct semaphore_t {
     bool sem_init;
     int sem_value;
     List *pList;        // Processes blocked on this semaphore
+    Histogram wait_hist;    // Time processes spent blocked on this semaphore
+};
+
+// All state of one simulated kernel. Every kernel operation takes the kernel it acts on, so
+//  independent kernels share nothing and can run on separate threads.
+// (KernelConfig and the Kernel typedef live in the public KernelSim.h)
+struct Kernel_s {
+    KernelConfig config;
+    PCB *current;
+    PCB *init;
+    unsigned int pid_curr;
+    bool initMade;
+    unsigned int sem_num;
+    int proc_count;
+    bool exit_loop;
+    int last_result;            // Result of the last command read by checkInput
+
+    ListPool pool;                                  // Nodes and heads of all the lists below
+    sem_t sem_array[NUM_SEMAPHORE];
+    List *ready_lists[MAX_READY_LIST + 1];          // 0 - high priority, 1 - normal priority, 2 - low priority, last - init
+    List *waiting_lists[NUM_WAITING_LIST];          // 0 - waiting for send, 1 - waiting for reply
+    List *io_list;                                  // Blocked on a page fault, in completion order
+    BlockDev disk;                                  // Simulated disk and its wait queue
+    PageCache cache;                                // File blocks cached in front of the disk
+    List *swap_list;                                // Swapped out, in the order they went
+    List *wait_list;                                // Waiting for a child to exit
+    List *stopped_list;                             // Stopped by a signal, in the order they stopped
+    int zombie_count;                               // Zombies anywhere in the process tree
+
+    ProcGroup **group_buckets;                      // Hash table of the process groups by pgid
+    unsigned int group_mask;                        // Buckets - 1, a power of two minus one
+    unsigned int num_groups;
+
+    FrameTable frames;                              // Simulated physical memory and swap area
+    uint64_t swap_busy_until;   // Virtual time the swap device finishes the transfers queued on it
+    uint64_t swap_charged;      // Pages written to swap whose transfers have been queued
+    uint64_t swap_evictions;    // Evictions when the current load control interval began
+
+    uint64_t sim_time;          // Virtual clock, advanced once per command
+    Histogram ready_hist;       // Time from entering a ready queue to running
+    Histogram reply_hist;       // Send to reply round-trip time
+    Histogram mailbox_hist;     // Time blocked in receive until a message arrives
+
+    PCB *slice_owner;           // Process whose time slice is being measured for the quantum
+    uint64_t slice_start;
+
+    Metrics metrics;
+    const char *metrics_path;   // Prometheus text dump, written every metrics_interval ticks
+    unsigned int metrics_interval;
+
+    FILE *in;                   // Command input
+    FILE *out;                  // Reports, NULL to run silently
 };
 
 // Create a process and put it on the appropriate ready queue.
 // Reports: success or failure, the pid of created process on success.
-int create(int priority);
+int create(Kernel *k, int priority);
 
 // Copy the currently running process and put it on the ready Q corresponding to the
 //  original process' priority. Attempting to Fork the "init" process (see below) should fail.
 // Reports: Success or failure, the pid of the resulting process on success.
-int fork();
+int fork_proc(Kernel *k);
+
+// Create count processes at the given priority in one operation. If init is running, the
+//  first takes over from it as with C; the rest are queued on a staging list and spliced onto
+//  the ready queue at once.
+// Reports: Nothing per process, only failure.
+// Returns the number created, with consecutive pids from *first; -1 if none could be.
+int create_n(Kernel *k, int priority, int count, int *first);
+
+// Fork the running process count times in one operation, splicing the children onto its
+//  ready queue at once.
+// Reports: Nothing per process, only failure.
+// Returns the number forked, with consecutive pids from *first; -1 if none could be.
+int fork_n(Kernel *k, int count, int *first);
 
 // Kill the named process and remove it from the system.
 // Reports: Action taken as well as success or failure.
-int kill(int pid);
+int kill_proc(Kernel *k, int pid);
 
 // Kill the currently running process.
 // Reports: Process scheduling information (which process now gets control of the cpu).
-void exit_proc();
+void exit_proc(Kernel *k);
+
+// Wait for a child of the running process to exit. A child that has exited already is reaped
+//  at once; otherwise the process blocks until one does. Children of init are reaped as they
+//  exit, so init cannot wait.
+// Reports: The child reaped and its exit status, or that the process blocked.
+// Returns the pid of the reaped child, 0 if the process blocked, -1 on failure.
+int wait_proc(Kernel *k);
+
+// Send a signal to process pid, or to every member of process group -pid if pid is negative.
+//  Terminate and kill end a process as K does, stop takes a running or ready process off the
+//  CPU and the ready queues, continue makes a stopped one ready again, and a user signal is
+//  handled the next time the process runs.
+// Reports: What the signal did to each process.
+// Returns the number of processes the signal took effect on, -1 on failure.
+int signal_proc(Kernel *k, int pid, enum Signal signal);
+
+// Move process pid into process group pgid, which must exist unless pgid is pid, in which case
+//  the process leads a new group. A created process leads its own group; a forked one joins
+//  its parent's.
+// Reports: Success or failure.
+int setpgid_proc(Kernel *k, int pid, int pgid);
 
 // Time quantum of the running process expires.
 // Reports: Action taken (process scheduling information).
-void quantum();
+void quantum(Kernel *k);
 
 // Send a message to another process, block until reply.
 // Reports: success or failure, scheduling information, and reply source and text (once
 //  reply arrives).
-int send(int pid, char *msg);
+int send_msg(Kernel *k, int pid, char *msg);
 
 // Receive a message, block until one arrives
 // Reports: Scheduling information, message text, source of message.
-void receive();
+void receive(Kernel *k);
 
 // Unblocks sender and delivers reply.
 // Reports: Success or failure.
-int reply(int pid, char *msg);
+int reply(Kernel *k, int pid, char *msg);
 
 // Initialize the named semaphore with the value given. IDs can take a value from 0 to 4. 
 //  This can only be done once for a semaphore - subsequent attempts result in error.
 // Reports: Action taken as well as success or failure.
-int new_Sem(int semaphore, unsigned int init);
+int new_Sem(Kernel *k, int semaphore, int init);
 
 // Execute the semaphore P operation on behalf of the running process. Assume semaphore 
 //  IDs to be numbered 0 through 4.
 // Reports: Action taken (blocked or not) as well as success or failure.
-int sem_P(int sem_id);
+int sem_P(Kernel *k, int sem_id);
 
 // Execute the semaphore V operation on behalf of the running process. Assume semaphore 
 //  IDs to be numbered 0 through 4.
-int sem_V(int sem_id);
+int sem_V(Kernel *k, int sem_id);
+
+// Access count consecutive pages of the running process, starting at vaddr. A page that is
+//  not resident faults: the process blocks on the I/O queue until the page has been read in.
+// Reports: Pages accessed, and the fault if there was one.
+// Returns the number of pages accessed before a fault, -1 on failure.
+int access_mem(Kernel *k, uint32_t vaddr, int count, bool write);
+
+// Read or write count blocks of the disk starting at block, on behalf of the running process.
+//  The process blocks on the disk's wait queue until the I/O scheduler has served the request.
+// Reports: The request, and the process that runs next.
+// Returns 1 on success, -1 on failure.
+int disk_io(Kernel *k, uint32_t block, int count, bool write);
+
+// Read or write count blocks of file starting at block, through the page cache, on behalf of
+//  the running process. A read blocks on the disk only if some blocks miss, and then reads
+//  from the first missing block to the last. A write is absorbed by the cache, unless too much
+//  of it is dirty, in which case the process blocks writing its blocks through.
+// Reports: Whether the cache served the request, and the process that runs next if it blocked.
+// Returns 1 if the process blocked, 0 if not, -1 on failure.
+int file_io(Kernel *k, int file, uint32_t block, int count, bool write);
 
 // Dump complete state information of process to screen.
-void procinfo(int pid);
+void procinfo(Kernel *k, int pid);
 
 // Display all process queues and their contents
-void totalinfo();
+void totalinfo(Kernel *k);
+
+// Display the scheduling-latency and blocking-time histograms (times in virtual clock ticks)
+void histinfo(Kernel *k);
+
+// Display the kernel metrics counters and queue lengths
+void metricsinfo(Kernel *k);
+
+// Display free physical memory by buddy block order, and how fragmented it is
+void meminfo(Kernel *k);
+
+// Write the metrics in Prometheus text format to path every interval ticks (0 = only at
+//  exit), so that soak runs can be scraped while they run.
+void setMetricsFile(Kernel *k, const char *path, unsigned int interval);
+
+// Bring the metrics of the kernel up to date (clock, pool and queue gauges)
+void snapshotMetrics(Kernel *k);
+
+// Run every command in the given stream, written as it would be typed into sim, stopping
+//  early if the init process is killed. Returns the result of the last command.
+int runCommands(Kernel *k, FILE *in);
+
+// Every command is one tick of the virtual clock
+void Kernel_tick_begin(Kernel *k);
+
+// Work done after every command: I/O completions, quantum expiry and the periodic metrics dump
+void Kernel_tick_end(Kernel *k);
+
+// Returns the process with the given pid, running or queued, or NULL if there is none
+PCB* Kernel_find_process(Kernel *k, int pid);
+
+// Returns the zombie with the given pid, or NULL if there is none. Zombies are on no queue,
+//  so this walks the process tree: O(processes).
+PCB* Kernel_find_zombie(Kernel *k, int pid);
+
+// The live process after process in a preorder walk of the process tree from init, NULL
+//  at the end. Zombies are leaves, reached through their parents' zombies lists.
+PCB* Kernel_next_in_tree(Kernel *k, PCB *process);
+
+// Returns process group pgid, NULL if there is none. With create, a missing group is made
+//  (NULL if it cannot be allocated).
+ProcGroup* Kernel_find_group(Kernel *k, int pgid, bool create);
+
+// Add process to the front of group's members
+void Kernel_join_group(ProcGroup *group, PCB *process);
+
+// Name of a signal, NULL if there is none
+const char* Kernel_signal_name(enum Signal signal);
+
+// Allocate a zeroed control block on a cache line boundary, NULL on failure. Free it with free().
+PCB* Kernel_alloc_pcb(void);
+
+// The process's mailbox, allocated empty if it has none yet; NULL if it cannot be allocated
+Mailbox* Kernel_open_mailbox(PCB *process);
+
+// Free the process's mailbox and any message and reply still in it
+void Kernel_free_mailbox(PCB *process);
 
 
 // --------- -UTILITY FUNCTIONS----------
 
+// Print to the kernel's output stream
+static void kprintf(Kernel *k, const char *format, ...);
+
 // Dequeue from list
 static void* dequeue(List * list);
 
-// Initialize all lists
-void initProgram(List * readyTop, List * readyNorm, List * readyLow, List * readyInit, List * waitingSend, List * waitingReceive);
+// Fill in the default kernel configuration
+void KernelConfig_default(KernelConfig *config);
+
+// Allocate a kernel with its own list pool, queues and init process.
+// config may be NULL for the defaults. Commands are read from in and all reports are
+//  written to out (NULL for a silent kernel).
+// Returns NULL on failure or if the configuration is invalid.
+Kernel* Kernel_create(const KernelConfig *config, FILE *in, FILE *out);
+
+// Free every process, queue and the list pool of a kernel
+void Kernel_destroy(Kernel *k);
+
+// Run the simulation, taking commands from the kernel's input stream until the init
+//  process is killed or the input ends
+void initProgram(Kernel *k);
 
 // Take input from the keyboard
-static void checkInput();
+// Returns false at the end of the input
+static bool checkInput(Kernel *k);
 
 // Free a process control block
 static void freeProcess(PCB *pList);
 
-static PCB* nextProcess();
+// Release everything a process holds except its control block
+static void releaseProcess(PCB *process);
+
+// Add child to the list of parent's children its state calls for (zombies or live children)
+static void linkChild(PCB *parent, PCB *child);
+
+// Take child off its parent's list
+static void unlinkChild(PCB *child);
+
+// Hand the live children of an exiting process to init, and free its zombies
+static void reparentChildren(Kernel *k, PCB *process);
+
+// Remove a process, already off every queue, from the system. A child of init is freed;
+//  any other becomes a zombie with the given exit status, and is reaped at once if its
+//  parent is waiting.
+static void exitProcess(Kernel *k, PCB *process, int status);
+
+// Free a zombie child of parent and report its exit status. Returns its pid.
+static int reapChild(Kernel *k, PCB *parent, PCB *child);
+
+// Kill the named process with the given exit status. Returns 1 on success, -1 on failure.
+static int killProcess(Kernel *k, int pid, int status);
+
+// Kill a live process other than init with the given exit status
+static void terminateProcess(Kernel *k, PCB *process, int status);
+
+// Append process to a queue, remembering its node so that it can be taken off in O(1).
+// Returns LIST_SUCCESS, or LIST_FAIL if the node pool is exhausted.
+static int enqueue(List *list, PCB *process);
+
+// Take a live process other than the running one off the queue it is waiting on
+static void dequeueProcess(Kernel *k, PCB *process);
+
+// Take process out of its group, freeing the group once it is empty
+static void leaveGroup(Kernel *k, PCB *process);
+
+// Make the group hash table twice as large. Returns false if it cannot be allocated.
+static bool growGroups(Kernel *k);
+
+// Apply a signal to one process. Returns true if it took effect.
+static bool deliverSignal(Kernel *k, PCB *process, enum Signal signal);
+
+// Handle the user signals pending for a process that is about to run
+static void handleSignals(Kernel *k, PCB *process);
 
-// Search the relevant queues for the given pid
-static PCB *findProcess(int pid);
+static void freeProcessItem(void *item);
+
+static PCB* nextProcess(Kernel *k);
+
+// The queued process with the given pid (or init, or the one the disk is serving), found by
+//  its key in the list node pool
+static PCB *findProcess(Kernel *k, int pid);
 
 // Helper function to print process information to the screen
-static void procinfo_helper(PCB *process);
+static void procinfo_helper(Kernel *k, PCB *process);
+
+static bool readyListEmpty(Kernel *k);
+
+static PCB* semWakeNext(Kernel *k, List *waiting);
+
+static void writeMetricsFile(Kernel *k);
+
+// Allocate a control block with an empty address space and a kernel stack, but no pid.
+// Reports: Failure. Returns NULL on failure.
+static PCB* allocProcess(Kernel *k);
+
+// Give a process its kernel stack block, evicting pages (or swapping out processes, with load
+//  control) if no free block is large enough. Returns 0 on success, -1 if memory is exhausted.
+static int allocKernelStack(Kernel *k, PCB *process);
+
+// Handle a fault on page vpn of the running process and block it on the I/O queue
+static int pageFault(Kernel *k, uint32_t vpn, bool write);
+
+// Wake the processes whose page reads have completed
+static void completeIO(Kernel *k);
+
+// Wake the process whose disk request has completed, if there is one
+static void completeDisk(Kernel *k);
+
+// Block the running process on a disk request. Returns 0 on success, -1 if the wait queue is full.
+static int submitDisk(Kernel *k, uint32_t block, uint32_t count, bool write, bool fill);
+
+// Start writing back dirty cached pages if the disk is idle and a write-back is due
+static void flushCache(Kernel *k);
+
+// Make a process whose wait has completed ready, or let it run if only init is running
+static void unblockIO(Kernel *k, PCB *process);
+
+// Queue transfers of count pages on the swap device. Returns the time they complete.
+static uint64_t swapTransfer(Kernel *k, uint64_t count);
+
+// Queue the writes of pages evicted to swap since the last call. Returns the time they
+//  complete, 0 if there were none.
+static uint64_t chargeSwap(Kernel *k);
+
+// Swap out the lowest priority ready process with the most resident pages, keeping at least
+//  two processes besides init in memory. Returns false if there is none to swap out.
+static bool swapOutVictim(Kernel *k);
+
+// Start swapping in a swapped out process. Returns false if its kernel stack does not fit.
+static bool swapIn(Kernel *k, PCB *process);
+
+// Make the processes whose swap-in has completed ready, and apply load control
+static void balanceSwap(Kernel *k);
 
-static bool readyListEmpty();
+// The frame table policy for a configured page replacement, NULL if there is none
+static const ReplacementPolicy* replacementPolicy(enum PageReplacement replacement);
 
-static void exit_sim();
+static void exit_sim(Kernel *k);
 
 #endif
\ No newline at end of file
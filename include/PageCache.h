@@ -0,0 +1,133 @@
+// Page cache
+// Blocks of files on the simulated disk, cached in memory. The disk is divided into files of
+// PAGECACHE_FILE_BLOCKS contiguous blocks each, and a cached page is named by its (file, block)
+// pair. Lookups go through a chained hash index, so finding a page takes O(1) on average.
+//
+// Pages live in a fixed array and are linked by index, like frames. Eviction is one of:
+//
+// lru - Every page is on one list in order of last use; the least recently used clean page
+//       is evicted.
+// 2q  - A page read for the first time goes on a FIFO (A1in) holding at most a quarter of the
+//       cache. When it falls out, its name is remembered on a ghost list (A1out). Only a page
+//       seen again, while it is still resident or remembered, is promoted to the LRU list (Am),
+//       so a single scan of cold blocks cannot flush the pages that are reused.
+//
+// Writes are absorbed: the pages are updated and marked dirty, and the writer goes on. Dirty
+// pages are kept on a list, oldest first, and are never evicted. A background flusher writes
+// them back while the disk is idle, once the oldest has been dirty for PAGECACHE_EXPIRE_TICKS
+// or a tenth of the cache is dirty; each write-back takes the oldest dirty page together with
+// the dirty pages on either side of it, up to PAGECACHE_MAX_BATCH contiguous blocks. A write
+// that would leave more than half the cache dirty is not absorbed: the writer has to write its
+// blocks through to the disk itself, which throttles writers to the speed of the disk.
+
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "KernelSim.h"
+
+#define PAGECACHE_FILE_BLOCKS 1024      // Blocks per file
+#define PAGECACHE_MAX_IO 64             // Largest read or write, in blocks
+#define PAGECACHE_MIN_PAGES (4 * PAGECACHE_MAX_IO)
+#define PAGECACHE_MAX_BATCH 128         // Largest write-back, in blocks
+#define PAGECACHE_EXPIRE_TICKS 30       // Age at which a dirty page is written back
+#define PAGECACHE_NIL 0xffffffffu       // End of a list or hash chain
+
+// Lists a cache entry can be on
+enum CacheQueue {
+    CACHE_FREE,                 // Unused entries
+    CACHE_A1IN,                 // Resident, seen once (2q only)
+    CACHE_AM,                   // Resident, in order of last use
+    CACHE_A1OUT,                // Ghosts: names of pages recently evicted from A1in (2q only)
+    CACHE_NUM_QUEUES
+};
+
+typedef struct CachePage_s CachePage;
+struct CachePage_s {
+    uint32_t file;
+    uint32_t block;
+    uint32_t hashNext;          // Next entry in the same hash bucket
+    uint32_t prev;              // Links on the list for queue, most recent first
+    uint32_t next;
+    uint32_t dirtyPrev;         // Links on the dirty list, oldest first
+    uint32_t dirtyNext;
+    uint64_t dirtySince;        // Virtual time the page was first written since it was clean
+    uint8_t queue;
+    bool dirty;
+    bool uptodate;              // The page holds the block's data; false while it is read in
+};
+
+typedef struct CacheList_s CacheList;
+struct CacheList_s {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t length;
+};
+
+typedef struct PageCache_s PageCache;
+struct PageCache_s {
+    CachePage *pages;           // capacity resident pages plus outCap ghosts
+    uint32_t *buckets;          // First entry of each hash chain
+    uint32_t bucketMask;
+    uint32_t capacity;          // Resident pages
+    uint32_t inCap;             // Most pages on A1in before it is evicted from
+    uint32_t outCap;            // Most ghosts on A1out
+    enum CachePolicy policy;
+    CacheList lists[CACHE_NUM_QUEUES];
+    uint32_t dirtyHead;
+    uint32_t dirtyTail;
+    uint32_t numDirty;
+
+    uint64_t hits;              // Blocks read from the cache
+    uint64_t misses;            // Blocks that had to be read from the disk
+    uint64_t ghostHits;         // Of the misses, the ones 2q remembered
+    uint64_t evictions;
+    uint64_t overwrites;        // Writes to pages that were already dirty, absorbed for free
+    uint64_t throttled;         // Writes that had to go through to the disk
+    uint64_t writebacks;        // Write-backs of dirty pages
+    uint64_t writebackBlocks;   // Blocks they wrote
+};
+
+// Make an empty cache of capacity pages.
+// Returns 0 on success, -1 on failure.
+int PageCache_init(PageCache *pc, uint32_t capacity, enum CachePolicy policy);
+
+// Release the memory held by the cache.
+void PageCache_destroy(PageCache *pc);
+
+// Resident pages
+uint32_t PageCache_resident(PageCache *pc);
+
+// Look up count blocks of file from block, counting hits and misses. The missing blocks are
+//  cached but not yet up to date. Returns the number missing, and if there are any, the
+//  first and last of them in first and last.
+uint32_t PageCache_read(PageCache *pc, uint32_t file, uint32_t block, uint32_t count, uint32_t *first, uint32_t *last);
+
+// Mark count cached blocks of file from block up to date, once they have been read in.
+void PageCache_filled(PageCache *pc, uint32_t file, uint32_t block, uint32_t count);
+
+// Write count blocks of file from block into the cache at virtual time now.
+// Returns true if the write was absorbed, false if it would leave too much of the cache dirty:
+//  the pages are then up to date but clean, and the caller has to write the blocks through.
+bool PageCache_write(PageCache *pc, uint32_t file, uint32_t block, uint32_t count, uint64_t now);
+
+// Drop any cached copies of count blocks of file from block, dirty or not.
+void PageCache_invalidate(PageCache *pc, uint32_t file, uint32_t block, uint32_t count);
+
+// Take the next write-back that is due at virtual time now: the oldest dirty page and the
+//  contiguous dirty pages around it, which are marked clean. Returns false if none is due.
+bool PageCache_flush(PageCache *pc, uint64_t now, uint32_t *file, uint32_t *block, uint32_t *count);
+
+// Add a page at the least recent end of queue (CACHE_A1IN, CACHE_AM or CACHE_A1OUT), to
+//  rebuild a cache in a known order. Returns 0 on success, -1 if the page is cached already or
+//  the queue is full.
+int PageCache_restore_page(PageCache *pc, uint32_t file, uint32_t block, enum CacheQueue queue, bool uptodate);
+
+// Mark a resident page dirty since virtual time since, as the newest dirty page.
+// Returns 0 on success, -1 if the page is not resident or is dirty already.
+int PageCache_restore_dirty(PageCache *pc, uint32_t file, uint32_t block, uint64_t since);
+
+// Name of a policy, NULL if there is none
+const char* PageCache_policy_name(enum CachePolicy policy);
+
+#endif
@@ -0,0 +1,23 @@
+// Page replacement policies for the frame table (see ReplacementPolicy in VM.h)
+//
+// clock - One reference bit per page (the accessed bit); the hand clears set bits and evicts
+//         the first page whose bit is clear.
+// aging - Approximate LRU. Every REPLACEMENT_AGING_INTERVAL ticks each page's 8-bit age is
+//         shifted right with its accessed bit shifted in at the top. Pages are kept in one
+//         list per age value, so the victim (the lowest age) is found without a scan.
+// arc   - Adaptive Replacement Cache: recently used (T1) and frequently used (T2) pages, with
+//         ghost lists of recently evicted pages steering the split between the two.
+//
+// Victim selection is O(1), amortized for clock.
+
+#ifndef _REPLACEMENT_H_
+#define _REPLACEMENT_H_
+#include "VM.h"
+
+#define REPLACEMENT_AGING_INTERVAL 8
+
+extern const ReplacementPolicy Replacement_clock;
+extern const ReplacementPolicy Replacement_aging;
+extern const ReplacementPolicy Replacement_arc;
+
+#endif
@@ -0,0 +1,231 @@
+// Virtual memory
+// Every process has a two-level page table over a 32-bit virtual address space. Leaf tables
+// are allocated the first time a page in their range is touched, so an address space costs
+// nothing until it is used. Physical memory is a table of frames, each of which remembers the
+// page mapped into it.
+//
+// An access that finds its page present is a hit: two array lookups and a few bit operations.
+// Anything else is a page fault, which the kernel handles (see pageFault in PCB.c). When no
+// frame is free, the frame table's replacement policy picks a resident page to evict.
+//
+// Free frames are managed by a buddy allocator: a block of 2^order frames starts at a multiple
+// of its size, and is kept on the free list for its order. An allocation splits the smallest
+// large enough block in halves; a release merges the block with its buddy for as long as the
+// buddy is free too. Both take O(log n) steps. Pages take single frames; every process also
+// holds a block for its kernel stack, so memory fragments as processes come and go.
+//
+// Fork is copy-on-write: the child gets a copy of the parent's page tables, and every
+// resident page is shared by both and marked PTE_COW. A frame counts the entries that map it.
+// The first write to a shared page copies it to a frame of the writer's own (or just takes
+// the page back if no one else maps it any more). Since a shared page is at the same address
+// in every process that maps it, the address spaces descended from one process are kept in a
+// ring, and walking the ring finds every mapping of a shared frame when it is evicted.
+//
+// An evicted page that was written to goes to the swap area, if it has one: it takes a slot,
+// and every entry that mapped the page names the slot instead, with PTE_SWAPPED. The next
+// access faults the page back in from its slot, which is then released, and since swap no
+// longer holds a copy the page counts as written to. A clean page is simply dropped, as is a
+// dirty one when no slot is free. Slots are handed out lowest first from a bitmap.
+
+#ifndef _VM_H_
+#define _VM_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VM_PAGE_SHIFT 12
+#define VM_PAGE_SIZE (1u << VM_PAGE_SHIFT)
+#define VM_L1_BITS 10
+#define VM_L2_BITS 10
+#define VM_L1_ENTRIES (1u << VM_L1_BITS)
+#define VM_L2_ENTRIES (1u << VM_L2_BITS)
+#define VM_NUM_PAGES (VM_L1_ENTRIES * VM_L2_ENTRIES)
+
+// Page table entry bits. The frame number is kept above PTE_FRAME_SHIFT.
+#define PTE_PRESENT  0x1        // Mapped to a frame
+#define PTE_ACCESSED 0x2        // Set on every access
+#define PTE_DIRTY    0x4        // Set on every write
+#define PTE_COW      0x8        // Shared with a fork relative; the next write copies the page
+#define PTE_SWAPPED  0x10       // Not present: the page is in the swap slot kept above PTE_FRAME_SHIFT
+#define PTE_FRAME_SHIFT 12
+#define PTE_FLAGS_MASK ((1u << PTE_FRAME_SHIFT) - 1)
+
+#define VM_NO_FRAME -1
+#define FRAME_NIL 0xffffffffu   // End of a frame list
+#define VM_KERNEL_PAGE 0xffffffffu  // vpn of a frame in a kernel stack block, never mapped
+#define VM_MAX_ORDER (32 - PTE_FRAME_SHIFT)     // Largest block: every frame a PTE can name
+#define VM_MAX_SWAP_SLOTS (1u << (32 - PTE_FRAME_SHIFT))    // Every slot a PTE can name
+
+typedef uint32_t pte_t;
+
+typedef struct AddressSpace_s AddressSpace;
+typedef struct FrameTable_s FrameTable;
+
+typedef struct Frame_s Frame;
+struct Frame_s {
+    AddressSpace *owner;        // NULL while the frame is free; one of the mappings if shared
+    uint32_t vpn;               // Page mapped into the frame, or VM_KERNEL_PAGE
+    uint32_t refs;              // Page table entries mapping the frame
+
+    // While the frame is in use the links belong to the replacement policy; while it heads a
+    //  free block they link the free list for the block's order
+    uint32_t prev;
+    uint32_t next;
+    uint8_t queue;              // Policy list holding the frame, 0 if it is not tracked
+    uint8_t age;
+    uint8_t freeOrder;          // 1 + order of the free block this frame heads, 0 if none
+};
+
+// Page replacement policy. A frame is tracked from the time a page is mapped into it until
+//  it is chosen as a victim or released by its owner.
+typedef struct ReplacementPolicy_s ReplacementPolicy;
+struct ReplacementPolicy_s {
+    const char *name;
+    int (*init)(FrameTable *ft);                        // 0 on success, -1 on failure
+    void (*destroy)(FrameTable *ft);
+    void (*mapped)(FrameTable *ft, unsigned int frame);
+    void (*released)(FrameTable *ft, unsigned int frame);
+    // Choose a tracked frame to evict to make room for page vpn of owner, and stop tracking it.
+    // Returns VM_NO_FRAME if no frame can be evicted.
+    int (*victim)(FrameTable *ft, AddressSpace *owner, uint32_t vpn);
+    void (*hit)(FrameTable *ft, unsigned int frame);    // Every hit, NULL if the accessed bit is enough
+    void (*tick)(FrameTable *ft);                       // Once per tick, may be NULL
+};
+
+// Simulated physical memory
+struct FrameTable_s {
+    Frame *frames;
+    unsigned int numFrames;
+    unsigned int numFree;       // Free frames, in blocks of every order
+    uint32_t freeLists[VM_MAX_ORDER + 1];       // First free block of each order
+    unsigned int freeBlocks[VM_MAX_ORDER + 1];  // Length of each free list
+
+    const ReplacementPolicy *policy;
+    void *policyState;
+    uint64_t evictions;
+    uint64_t dirtyEvictions;    // Evicted pages that had been written to
+    uint64_t cowFaults;         // Writes to shared pages
+    uint64_t cowCopies;         // Of those, the ones that had to copy the page
+    uint64_t forkShared;        // Pages shared by fork instead of copied
+    unsigned int sharedPages;   // Mappings of shared frames beyond the first, i.e. frames saved
+
+    // Swap area
+    uint32_t *slotRefs;         // Page table entries naming each slot
+    uint64_t *slotUsed;         // Bitmap of the slots in use
+    unsigned int numSlots;
+    unsigned int slotsUsed;
+    unsigned int slotHint;      // Every word of the bitmap below this one is full
+    uint64_t swapOuts;          // Pages written to swap
+    uint64_t swapIns;           // Pages read back from swap
+    uint64_t swapFull;          // Dirty pages dropped because no slot was free
+};
+
+struct AddressSpace_s {
+    FrameTable *frames;         // Where this address space's pages live
+    pte_t **dir;                // VM_L1_ENTRIES leaf tables, NULL until first used
+    unsigned int rss;           // Resident pages, shared or not
+    uint64_t accesses;
+    uint64_t faults;
+
+    // The ring of address spaces descended from the same process, the only ones this one can
+    //  share frames with. family names the ring (the kernel uses the pid of its first process).
+    AddressSpace *familyPrev;
+    AddressSpace *familyNext;
+    uint32_t family;
+};
+
+// Allocate a frame table with numFrames free frames, managed by the given replacement policy.
+// Returns 0 on success, -1 on failure.
+int FrameTable_init(FrameTable *ft, unsigned int numFrames, const ReplacementPolicy *policy);
+
+// Give the frame table a swap area of numSlots page slots, all free. Without one, evicted
+//  pages are always dropped. Returns 0 on success, -1 on failure.
+int FrameTable_init_swap(FrameTable *ft, unsigned int numSlots);
+
+// Release the memory held by the frame table and its swap area.
+void FrameTable_destroy(FrameTable *ft);
+
+// Take a free frame and give it to owner for page vpn.
+// Returns the frame number, VM_NO_FRAME if there are no free frames.
+int FrameTable_alloc(FrameTable *ft, AddressSpace *owner, uint32_t vpn);
+
+// Take a free block of 2^order contiguous frames for the kernel stack of owner.
+// Returns the first frame of the block, VM_NO_FRAME if no free block is large enough.
+int FrameTable_alloc_block(FrameTable *ft, AddressSpace *owner, unsigned int order);
+
+// Evict the page the replacement policy chooses and give its frame to owner for page vpn.
+// The evicted page is unmapped from its address space.
+// Returns the frame number, VM_NO_FRAME if nothing can be evicted.
+int FrameTable_evict(FrameTable *ft, AddressSpace *owner, uint32_t vpn);
+
+// Evict the page the replacement policy chooses and free its frame, so that free blocks can
+//  merge. Returns false if nothing can be evicted.
+bool FrameTable_reclaim(FrameTable *ft);
+
+// Return a frame that is not mapped to the free lists.
+void FrameTable_free(FrameTable *ft, int frame);
+
+// Return a block from FrameTable_alloc_block to the free lists.
+void FrameTable_free_block(FrameTable *ft, int frame, unsigned int order);
+
+// Order of the largest free block, -1 if no frame is free.
+int FrameTable_largest_free_order(FrameTable *ft);
+
+// Empty the free lists, as if every frame were in use, so that frames can be claimed directly.
+void FrameTable_clear_free(FrameTable *ft);
+
+// Rebuild the free lists from the frame owners after frames were claimed directly, and start
+//  tracking every resident page in the replacement policy.
+void FrameTable_rebuild_free(FrameTable *ft);
+
+// Put the block of 2^order unowned frames at frame at the head of its free list, to rebuild
+//  the free lists in a known order after FrameTable_clear_free. The block is not merged.
+void FrameTable_add_free(FrameTable *ft, int frame, unsigned int order);
+
+// Periodic work of the replacement policy, once per tick of the virtual clock.
+void FrameTable_tick(FrameTable *ft);
+
+// Count one more page table entry naming swap slot, to rebuild a swap area directly.
+// Returns 0 on success, -1 if there is no such slot.
+int FrameTable_claim_slot(FrameTable *ft, uint32_t slot);
+
+// Make an empty address space whose pages live in the frames of ft.
+void AddressSpace_init(AddressSpace *as, FrameTable *ft);
+
+// Free every page table of the address space, every frame and swap slot no other address
+//  space maps, and leave its family.
+void AddressSpace_destroy(AddressSpace *as);
+
+// Make child, an empty address space, a copy-on-write copy of parent in parent's family: the
+//  page tables are copied and every resident page is shared, as is every page in swap. Takes time in proportion to the
+//  size of parent's page tables, not its memory.
+// Returns 0 on success, -1 if a page table could not be allocated (the pages shared so far
+//  stay shared).
+int AddressSpace_fork(AddressSpace *child, AddressSpace *parent);
+
+// Put as, an address space with no pages, in the family of relative.
+void AddressSpace_join(AddressSpace *as, AddressSpace *relative);
+
+// Returns the entry for page vpn, or NULL if its leaf table has not been allocated.
+// With create, the leaf table is allocated if needed (NULL only if allocation fails).
+pte_t* AddressSpace_pte(AddressSpace *as, uint32_t vpn, bool create);
+
+// Touch the page holding vaddr. A write to a shared page copies it first, which may evict a
+//  page. Returns true on a hit, false if the page is not present (or no frame could be found
+//  for the copy) and the kernel has to handle a fault.
+bool AddressSpace_access(AddressSpace *as, uint32_t vaddr, bool write);
+
+// Map page vpn to frame, as if it had just been accessed, and start tracking the frame in the
+//  replacement policy. A page coming back from swap gives up its slot.
+// Returns 0 on success, -1 if the page table could not be allocated.
+int AddressSpace_map(AddressSpace *as, uint32_t vpn, int frame, bool write);
+
+// Swap out every resident page only as maps: pages that were written to go to swap (or stay
+//  resident if it is full), clean ones are dropped, and their frames are freed. Pages shared
+//  with relatives stay. Returns the number of pages written to swap.
+unsigned int AddressSpace_swap_out(AddressSpace *as);
+
+// Read back up to limit pages that only as has in swap, evicting other pages to make room,
+//  and map them. Returns the number of pages read.
+unsigned int AddressSpace_swap_in(AddressSpace *as, unsigned int limit);
+
+#endif
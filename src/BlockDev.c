@@ -0,0 +1,176 @@
+#include "BlockDev.h"
+#include "PCB.h"
+#include <stdlib.h>
+
+
+// The waiting request the elevator reaches next, NULL if the queue is empty. Turns the
+//  elevator around if nothing is ahead of it.
+static Node* scanNext(BlockDev *dev) {
+
+    for (int pass = 0; pass < 2; pass++) {
+        Node *best = NULL;
+        for (Node *node = dev->queue->head; node != NULL; node = List_node_next(dev->queue, node)) {
+            uint32_t block = ((PCB *)node->item)->disk.block;
+            if (dev->up ? block < dev->head : block > dev->head)
+                continue;
+            if (best == NULL || (dev->up ? block < ((PCB *)best->item)->disk.block : block > ((PCB *)best->item)->disk.block))
+                best = node;
+        }
+        if (best != NULL || dev->queue->head == NULL)
+            return best;
+        dev->up = !dev->up;
+    }
+    return NULL;
+}
+
+// The waiting request with the earliest deadline, if it has passed
+static Node* expiredNext(BlockDev *dev, uint64_t now) {
+
+    Node *best = NULL;
+    for (Node *node = dev->queue->head; node != NULL; node = List_node_next(dev->queue, node)) {
+        uint64_t deadline = ((PCB *)node->item)->disk.deadline;
+        if (deadline <= now && (best == NULL || deadline < ((PCB *)best->item)->disk.deadline))
+            best = node;
+    }
+    return best;
+}
+
+// Move the head and keep the device busy for a transfer
+static void start(BlockDev *dev, uint32_t block, uint32_t count, uint64_t now) {
+
+    uint64_t cost = BlockDev_cost(dev, dev->head, block, count);
+    dev->seekBlocks += block > dev->head ? block - dev->head : dev->head - block;
+    dev->head = block + count - 1;
+    dev->busyTicks += cost;
+    dev->busyUntil = now + cost;
+    dev->busy = true;
+}
+
+// Start serving the request the scheduler picks, if any
+static void dispatch(BlockDev *dev, uint64_t now) {
+
+    dev->busy = false;
+    dev->active = NULL;
+    if (dev->queue->head == NULL)
+        return;
+
+    Node *next = NULL;
+    if (dev->sched == IO_SCHED_DEADLINE && (next = expiredNext(dev, now)) != NULL) {
+        dev->expired++;
+    }
+    else if (dev->sched == IO_SCHED_FIFO) {
+        next = dev->queue->head;
+    }
+    else {
+        next = scanNext(dev);
+    }
+    dev->queue->current = next;
+    PCB *process = List_remove(dev->queue);
+    start(dev, process->disk.block, process->disk.count, now);
+    dev->active = process;
+}
+
+int BlockDev_init(BlockDev *dev, ListPool *pool, uint32_t numBlocks, enum IOScheduler sched) {
+
+    dev->numBlocks = numBlocks;
+    dev->sched = sched;
+    dev->active = NULL;
+    dev->busy = false;
+    dev->busyUntil = 0;
+    dev->head = 0;
+    dev->up = true;
+    dev->reads = 0;
+    dev->writes = 0;
+    dev->blocksRead = 0;
+    dev->blocksWritten = 0;
+    dev->busyTicks = 0;
+    dev->seekBlocks = 0;
+    dev->expired = 0;
+    Histogram_init(&dev->latency, "disk request");
+    dev->queue = List_create(pool);
+    return dev->queue != NULL ? 0 : -1;
+}
+
+int BlockDev_submit(BlockDev *dev, PCB *process, uint64_t now) {
+
+    BlockRequest *req = &process->disk;
+    req->issued = now;
+    req->deadline = now + (req->write ? BLOCKDEV_WRITE_DEADLINE : BLOCKDEV_READ_DEADLINE);
+    if (List_append(dev->queue, process) == LIST_FAIL)
+        return -1;
+    List_set_key(dev->queue, process->pid);
+    process->queue_node = dev->queue->tail;
+    if (!dev->busy)
+        dispatch(dev, now);
+    return 0;
+}
+
+PCB* BlockDev_complete(BlockDev *dev, uint64_t now) {
+
+    while (dev->busy && dev->busyUntil <= now) {
+        PCB *process = dev->active;
+        dispatch(dev, now);
+
+        // A killed process leaves its transfer behind
+        if (process == NULL)
+            continue;
+        BlockRequest *req = &process->disk;
+        if (req->write) {
+            dev->writes++;
+            dev->blocksWritten += req->count;
+        }
+        else {
+            dev->reads++;
+            dev->blocksRead += req->count;
+        }
+        Histogram_record(&dev->latency, now - req->issued);
+        return process;
+    }
+    return NULL;
+}
+
+void BlockDev_writeback(BlockDev *dev, uint32_t block, uint32_t count, uint64_t now) {
+
+    start(dev, block, count, now);
+    dev->active = NULL;
+    dev->writes++;
+    dev->blocksWritten += count;
+}
+
+bool BlockDev_cancel(BlockDev *dev, PCB *process) {
+
+    if (dev->busy && dev->active == process) {
+        dev->active = NULL;
+        return true;
+    }
+    if (process->queue_node == NULL || process->queue_node->item != process)
+        return false;
+    dev->queue->current = process->queue_node;
+    List_remove(dev->queue);
+    return true;
+}
+
+int BlockDev_waiting(BlockDev *dev) {
+    return List_count(dev->queue) + (dev->active != NULL);
+}
+
+uint64_t BlockDev_cost(BlockDev *dev, uint32_t head, uint32_t block, uint32_t count) {
+
+    uint64_t distance = block > head ? block - head : head - block;
+    uint64_t seek = distance == 0 ? 0
+        : BLOCKDEV_SETTLE_TICKS + (distance * BLOCKDEV_SEEK_TICKS + dev->numBlocks - 1) / dev->numBlocks;
+    return seek + (count + BLOCKDEV_BLOCKS_PER_TICK - 1) / BLOCKDEV_BLOCKS_PER_TICK;
+}
+
+const char* BlockDev_sched_name(enum IOScheduler sched) {
+
+    switch (sched) {
+        case IO_SCHED_FIFO:
+            return "fifo";
+        case IO_SCHED_SCAN:
+            return "scan";
+        case IO_SCHED_DEADLINE:
+            return "deadline";
+    }
+    return NULL;
+}
@@ -0,0 +1,1256 @@
+/*
+
+Filename: Checkpoint.c
+
+Description: Binary checkpoints of a whole kernel, and restoring them in bulk from a mapped file.
+
+Layout: a fixed CheckpointHeader, then one CheckpointProc per process (init first, then the
+        running process if it is not init, then the process the disk is serving if there is
+        one, then the members of every queue in queue order, then the zombies in process tree
+        order), then a (child, parent) link for every process but init in process tree order,
+        then a (pid, pgid) membership for every live process but init, each process group's
+        members in list order, then the page table entries in use by each process in the same order, then the free
+        buddy blocks of every order in free list order, then the page cache entries of each
+        cache queue most recent first, then the dirty cache pages oldest first, then the
+        non-empty histogram buckets, then the message strings.
+
+*/
+
+
+#include "Checkpoint.h"
+#include "PCB.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CHECKPOINT_MAGIC "KSIMCKPT"
+#define CHECKPOINT_VERSION 11
+#define CHECKPOINT_NO_STRING 0xffffffffu
+
+// Queues in the order their members are stored: the ready queues (only the first
+//  num_priorities are used), the init queue, the two waiting queues, the I/O queue, the disk
+//  queue, the swapped out processes, the processes waiting for a child and the semaphores
+#define CHECKPOINT_INIT_QUEUE MAX_READY_LIST
+#define CHECKPOINT_WAITING_QUEUE (MAX_READY_LIST + 1)
+#define CHECKPOINT_IO_QUEUE (CHECKPOINT_WAITING_QUEUE + NUM_WAITING_LIST)
+#define CHECKPOINT_DISK_QUEUE (CHECKPOINT_IO_QUEUE + 1)
+#define CHECKPOINT_SWAP_QUEUE (CHECKPOINT_DISK_QUEUE + 1)
+#define CHECKPOINT_WAIT_QUEUE (CHECKPOINT_SWAP_QUEUE + 1)
+#define CHECKPOINT_STOP_QUEUE (CHECKPOINT_WAIT_QUEUE + 1)
+#define CHECKPOINT_SEM_QUEUE (CHECKPOINT_STOP_QUEUE + 1)
+#define CHECKPOINT_NUM_QUEUES (CHECKPOINT_SEM_QUEUE + NUM_SEMAPHORE)
+
+// The three kernel histograms, the disk's, then one per semaphore
+#define CHECKPOINT_NUM_HISTS (4 + NUM_SEMAPHORE)
+
+typedef struct CheckpointHist_s CheckpointHist;
+struct CheckpointHist_s {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+    uint32_t numBuckets;        // Non-empty buckets stored for this histogram
+    uint32_t pad;
+};
+
+typedef struct CheckpointBucket_s CheckpointBucket;
+struct CheckpointBucket_s {
+    uint32_t index;
+    uint32_t pad;
+    uint64_t count;
+};
+
+typedef struct CheckpointProc_s CheckpointProc;
+struct CheckpointProc_s {
+    int32_t pid;
+    int32_t priority;
+    int32_t state;
+    int32_t waitState;
+    int32_t msgSrc;
+    int32_t replySrc;
+    uint32_t msgOffset;         // Offsets into the string section, CHECKPOINT_NO_STRING if none
+    uint32_t replyOffset;
+    uint64_t readyTime;
+    uint64_t blockTime;
+    uint32_t numPages;          // Page table entries stored for this process
+    uint32_t ioVpn;
+    int32_t ioFrame;
+    uint32_t ioWrite;
+    uint64_t ioDone;
+    uint64_t accesses;
+    uint64_t faults;
+    int32_t kstack;
+    uint32_t kstackOrder;
+    uint32_t family;
+    uint32_t swapPages;
+    uint32_t diskBlock;
+    uint32_t diskCount;
+    uint32_t diskWrite;
+    uint32_t diskFill;
+    uint64_t diskIssued;
+    uint64_t diskDeadline;
+    uint64_t swapDone;
+    int32_t exitStatus;
+    uint32_t sigPending;
+};
+
+// Process tree order: a preorder walk of the live processes from init, with the live children
+//  of each process followed by its zombies, each in list order
+typedef struct CheckpointLink_s CheckpointLink;
+struct CheckpointLink_s {
+    int32_t pid;
+    int32_t parent;
+};
+
+typedef struct CheckpointMember_s CheckpointMember;
+struct CheckpointMember_s {
+    int32_t pid;
+    int32_t pgid;
+};
+
+typedef struct CheckpointPage_s CheckpointPage;
+struct CheckpointPage_s {
+    uint32_t vpn;
+    pte_t pte;
+};
+
+typedef struct CheckpointFreeBlock_s CheckpointFreeBlock;
+struct CheckpointFreeBlock_s {
+    uint32_t frame;
+    uint32_t order;
+};
+
+typedef struct CheckpointCachePage_s CheckpointCachePage;
+struct CheckpointCachePage_s {
+    uint32_t file;
+    uint32_t block;
+    uint32_t queue;             // enum CacheQueue
+    uint32_t uptodate;
+};
+
+typedef struct CheckpointCacheDirty_s CheckpointCacheDirty;
+struct CheckpointCacheDirty_s {
+    uint32_t file;
+    uint32_t block;
+    uint64_t since;
+};
+
+// Open-addressing table of the first restored address space of each family
+typedef struct CheckpointFamilies_s CheckpointFamilies;
+struct CheckpointFamilies_s {
+    AddressSpace **slots;
+    uint32_t mask;
+};
+
+// Open-addressing table of the restored processes by pid
+typedef struct CheckpointPids_s CheckpointPids;
+struct CheckpointPids_s {
+    PCB **slots;
+    uint32_t mask;
+};
+
+// Growable array of page entries, filled while the processes are saved
+typedef struct CheckpointPages_s CheckpointPages;
+struct CheckpointPages_s {
+    CheckpointPage *pages;
+    uint64_t count;
+    uint64_t cap;
+    bool failed;
+};
+
+typedef struct CheckpointHeader_s CheckpointHeader;
+struct CheckpointHeader_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;        // Guards against a checkpoint from a different build
+    uint32_t procSize;
+
+    int32_t numPriorities;
+    uint32_t quantum;
+    int32_t semWake;
+    uint32_t maxNodes;
+    uint32_t numFrames;
+    uint32_t faultTicks;
+    int32_t replacement;
+    uint32_t kstackPages;
+    uint32_t diskBlocks;
+    int32_t ioSched;
+    uint32_t cachePages;
+    int32_t cachePolicy;
+    uint32_t swapSlots;
+    uint32_t swapTicks;
+    uint32_t loadControl;
+
+    uint32_t pidCurr;
+    uint32_t semNum;
+    int32_t procCount;
+    int32_t lastResult;
+    int32_t currentPid;
+    int32_t sliceOwnerPid;      // -1 if there is none
+    uint64_t simTime;
+    uint64_t sliceStart;
+    uint64_t poolExhaustions;
+    uint64_t evictions;
+    uint64_t dirtyEvictions;
+    uint64_t cowFaults;
+    uint64_t cowCopies;
+    uint64_t forkShared;
+
+    int32_t diskActivePid;      // -1 if the disk is not serving a live process
+    uint32_t diskBusy;
+    uint64_t diskBusyUntil;
+    uint32_t diskHead;
+    uint32_t diskUp;
+    uint64_t diskReads;
+    uint64_t diskWrites;
+    uint64_t diskBlocksRead;
+    uint64_t diskBlocksWritten;
+    uint64_t diskBusyTicks;
+    uint64_t diskSeekBlocks;
+    uint64_t diskExpired;
+
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+    uint64_t cacheGhostHits;
+    uint64_t cacheEvictions;
+    uint64_t cacheOverwrites;
+    uint64_t cacheThrottled;
+    uint64_t cacheWritebacks;
+    uint64_t cacheWritebackBlocks;
+
+    uint64_t swapBusyUntil;
+    uint64_t swapCharged;
+    uint64_t swapEvictions;
+    uint64_t swapOuts;
+    uint64_t swapIns;
+    uint64_t swapFull;
+
+    uint32_t queueCount[CHECKPOINT_NUM_QUEUES];
+    int32_t queuePeak[CHECKPOINT_NUM_QUEUES];
+    uint8_t semInit[NUM_SEMAPHORE];
+    int32_t semValue[NUM_SEMAPHORE];
+
+    uint32_t numProcs;
+    uint32_t numZombies;        // The last numZombies processes
+    uint64_t numPages;
+    uint32_t numFreeBlocks;
+    uint32_t numCachePages;
+    uint32_t numCacheDirty;
+    uint32_t numBuckets;
+    uint64_t stringsSize;
+
+    Metrics metrics;
+    CheckpointHist hists[CHECKPOINT_NUM_HISTS];
+};
+
+
+// START OF PRIVATE FUNCTIONS -------
+
+// The queue with the given checkpoint queue number, NULL if the kernel does not have it
+static List* Checkpoint_queue(Kernel *k, int q) {
+
+    if (q < k->config.num_priorities)
+        return k->ready_lists[q];
+    if (q == CHECKPOINT_INIT_QUEUE)
+        return k->ready_lists[k->config.num_priorities];
+    if (q >= CHECKPOINT_WAITING_QUEUE && q < CHECKPOINT_IO_QUEUE)
+        return k->waiting_lists[q - CHECKPOINT_WAITING_QUEUE];
+    if (q == CHECKPOINT_IO_QUEUE)
+        return k->io_list;
+    if (q == CHECKPOINT_DISK_QUEUE)
+        return k->disk.queue;
+    if (q == CHECKPOINT_SWAP_QUEUE)
+        return k->swap_list;
+    if (q == CHECKPOINT_WAIT_QUEUE)
+        return k->wait_list;
+    if (q == CHECKPOINT_STOP_QUEUE)
+        return k->stopped_list;
+    if (q >= CHECKPOINT_SEM_QUEUE && q < CHECKPOINT_NUM_QUEUES)
+        return k->sem_array[q - CHECKPOINT_SEM_QUEUE].pList;
+    return NULL;
+}
+
+static Histogram* Checkpoint_hist(Kernel *k, int h) {
+
+    if (h == 0)
+        return &k->ready_hist;
+    if (h == 1)
+        return &k->reply_hist;
+    if (h == 2)
+        return &k->mailbox_hist;
+    if (h == 3)
+        return &k->disk.latency;
+    return &k->sem_array[h - 4].wait_hist;
+}
+
+// Strings are stored with their terminator; returns the offset of str
+static uint32_t Checkpoint_add_string(char **strings, uint64_t *size, uint64_t *cap, const char *str) {
+
+    if (str == NULL)
+        return CHECKPOINT_NO_STRING;
+
+    size_t len = strlen(str) + 1;
+    if (*size + len > *cap) {
+        uint64_t newCap = *cap * 2 + len;
+        char *grown = realloc(*strings, newCap);
+        if (grown == NULL)
+            return CHECKPOINT_NO_STRING;
+        *strings = grown;
+        *cap = newCap;
+    }
+    memcpy(*strings + *size, str, len);
+    uint32_t offset = (uint32_t)*size;
+    *size += len;
+    return offset;
+}
+
+// Append every page table entry in use by as
+static uint32_t Checkpoint_save_pages(CheckpointPages *out, AddressSpace *as) {
+
+    uint32_t saved = 0;
+    if (as->dir == NULL)
+        return 0;
+
+    for (uint32_t i = 0; i < VM_L1_ENTRIES; i++) {
+        pte_t *leaf = as->dir[i];
+        for (uint32_t j = 0; leaf != NULL && j < VM_L2_ENTRIES; j++) {
+            if (leaf[j] == 0)
+                continue;
+            if (out->count == out->cap) {
+                uint64_t newCap = out->cap * 2 + 256;
+                CheckpointPage *grown = realloc(out->pages, newCap * sizeof(CheckpointPage));
+                if (grown == NULL) {
+                    out->failed = true;
+                    return saved;
+                }
+                out->pages = grown;
+                out->cap = newCap;
+            }
+            out->pages[out->count].vpn = (i << VM_L2_BITS) | j;
+            out->pages[out->count].pte = leaf[j];
+            out->count++;
+            saved++;
+        }
+    }
+    return saved;
+}
+
+static void Checkpoint_save_proc(CheckpointProc *rec, PCB *process, char **strings, uint64_t *size, uint64_t *cap, CheckpointPages *pages) {
+
+    rec->pid = process->pid;
+    rec->priority = process->priority;
+    rec->state = process->state;
+    rec->waitState = process->waitState;
+    Mailbox *mail = process->mail;
+    rec->msgSrc = mail != NULL ? mail->msg_src : -1;
+    rec->replySrc = mail != NULL ? mail->reply_src : -1;
+    rec->msgOffset = Checkpoint_add_string(strings, size, cap, mail != NULL ? mail->proc_message : NULL);
+    rec->replyOffset = Checkpoint_add_string(strings, size, cap, mail != NULL ? mail->reply_msg : NULL);
+    rec->readyTime = process->ready_time;
+    rec->blockTime = process->block_time;
+    rec->numPages = Checkpoint_save_pages(pages, &process->mem);
+    rec->ioVpn = process->io_vpn;
+    rec->ioFrame = process->io_frame;
+    rec->ioWrite = process->io_write;
+    rec->ioDone = process->io_done;
+    rec->accesses = process->mem.accesses;
+    rec->faults = process->mem.faults;
+    rec->kstack = process->kstack;
+    rec->kstackOrder = process->kstack_order;
+    rec->family = process->mem.family;
+    rec->swapPages = process->swap_pages;
+    rec->swapDone = process->swap_done;
+    rec->exitStatus = process->exit_status;
+    rec->sigPending = process->sig_pending;
+    rec->diskBlock = process->disk.block;
+    rec->diskCount = process->disk.count;
+    rec->diskWrite = process->disk.write;
+    rec->diskFill = process->disk.fill;
+    rec->diskIssued = process->disk.issued;
+    rec->diskDeadline = process->disk.deadline;
+}
+
+// Returns a copy of the string at offset, NULL for no string. Sets *ok to false if the
+//  offset does not point at a terminated string inside the string section.
+static char* Checkpoint_load_string(const char *strings, uint64_t size, uint32_t offset, bool *ok) {
+
+    if (offset == CHECKPOINT_NO_STRING)
+        return NULL;
+    if (offset >= size || memchr(strings + offset, '\0', size - offset) == NULL) {
+        *ok = false;
+        return NULL;
+    }
+    char *copy = strdup(strings + offset);
+    if (copy == NULL)
+        *ok = false;
+    return copy;
+}
+
+// Claim frame for page vpn of as. Fails if the frame does not exist or is already taken.
+static bool Checkpoint_claim_frame(FrameTable *ft, AddressSpace *as, uint32_t vpn, int32_t frame) {
+
+    if (frame < 0 || (uint32_t)frame >= ft->numFrames || ft->frames[frame].owner != NULL)
+        return false;
+    ft->frames[frame].owner = as;
+    ft->frames[frame].vpn = vpn;
+    return true;
+}
+
+// Claim the kernel stack block of 2^order frames at frame for as. Fails if it is not a
+//  possible buddy block or any of its frames is already taken.
+static bool Checkpoint_claim_block(FrameTable *ft, AddressSpace *as, int32_t frame, uint32_t order) {
+
+    if (order > VM_MAX_ORDER || frame < 0 || ((uint32_t)frame & ((1u << order) - 1)) != 0
+        || (uint64_t)frame + (1u << order) > ft->numFrames)
+        return false;
+    for (uint32_t i = 0; i < 1u << order; i++) {
+        if (ft->frames[frame + i].owner != NULL)
+            return false;
+    }
+    for (uint32_t i = 0; i < 1u << order; i++) {
+        ft->frames[frame + i].owner = as;
+        ft->frames[frame + i].vpn = VM_KERNEL_PAGE;
+    }
+    return true;
+}
+
+// Map the shared page vpn of as to frame, which a relative has already claimed. Fails unless
+//  the entry is copy-on-write and the relative maps the same page.
+static bool Checkpoint_share_frame(FrameTable *ft, AddressSpace *as, uint32_t vpn, int32_t frame, pte_t entry) {
+
+    if (frame < 0 || (uint32_t)frame >= ft->numFrames || !(entry & PTE_COW))
+        return false;
+    Frame *f = &ft->frames[frame];
+    if (f->owner == NULL || f->owner == as || f->refs == 0 || f->vpn != vpn || f->owner->family != as->family)
+        return false;
+    f->refs++;
+    ft->sharedPages++;
+    return true;
+}
+
+// Put as in the family saved for it, after the first restored member of the family
+static void Checkpoint_join_family(CheckpointFamilies *families, AddressSpace *as, uint32_t family) {
+
+    uint32_t h = (family * 0x9e3779b1u) & families->mask;
+    while (families->slots[h] != NULL && families->slots[h]->family != family) {
+        h = (h + 1) & families->mask;
+    }
+    if (families->slots[h] == NULL) {
+        as->family = family;
+        families->slots[h] = as;
+    }
+    else {
+        AddressSpace_join(as, families->slots[h]);
+    }
+}
+
+// Rebuild the page table of process from its entries at *pages, claiming their frames, or
+//  sharing them with the relatives restored before it
+static bool Checkpoint_load_pages(Kernel *k, PCB *process, const CheckpointProc *rec, CheckpointFamilies *families, const CheckpointPage **pages, const CheckpointPage *end) {
+
+    uint32_t count = rec->numPages;
+    Checkpoint_join_family(families, &process->mem, rec->family);
+
+    for (uint32_t i = 0; i < count; i++, (*pages)++) {
+        if (*pages >= end || (*pages)->vpn >= VM_NUM_PAGES)
+            return false;
+        pte_t entry = (*pages)->pte;
+        pte_t *pte = AddressSpace_pte(&process->mem, (*pages)->vpn, true);
+        if (pte == NULL)
+            return false;
+        if (entry & PTE_PRESENT) {
+            int32_t frame = (int32_t)(entry >> PTE_FRAME_SHIFT);
+            if (Checkpoint_claim_frame(&k->frames, &process->mem, (*pages)->vpn, frame))
+                k->frames.frames[frame].refs = 1;
+            else if (!Checkpoint_share_frame(&k->frames, &process->mem, (*pages)->vpn, frame, entry))
+                return false;
+            process->mem.rss++;
+        }
+        else if ((entry & PTE_SWAPPED) && FrameTable_claim_slot(&k->frames, entry >> PTE_FRAME_SHIFT) == -1) {
+            return false;
+        }
+        *pte = entry;
+    }
+
+    if (rec->kstack != VM_NO_FRAME) {
+        if (!Checkpoint_claim_block(&k->frames, &process->mem, rec->kstack, rec->kstackOrder))
+            return false;
+        process->kstack = rec->kstack;
+        process->kstack_order = rec->kstackOrder;
+    }
+
+    // The page being read in already has its frame. If it cannot be claimed, the process must
+    //  not release it when it is freed.
+    if (process->state == BLOCKED && process->waitState == WAITING_IO
+        && !Checkpoint_claim_frame(&k->frames, &process->mem, process->io_vpn, process->io_frame)) {
+        process->state = READY;
+        return false;
+    }
+    return true;
+}
+
+// Save the entries of every page cache queue, most recent first, then the dirty pages,
+//  oldest first. Returns false if the arrays could not be allocated.
+static bool Checkpoint_save_cache(PageCache *pc, CheckpointHeader *header, CheckpointCachePage **pages, CheckpointCacheDirty **dirty) {
+
+    header->numCachePages = PageCache_resident(pc) + pc->lists[CACHE_A1OUT].length;
+    header->numCacheDirty = pc->numDirty;
+    *pages = malloc((header->numCachePages > 0 ? header->numCachePages : 1) * sizeof(CheckpointCachePage));
+    *dirty = malloc((header->numCacheDirty > 0 ? header->numCacheDirty : 1) * sizeof(CheckpointCacheDirty));
+    if (*pages == NULL || *dirty == NULL)
+        return false;
+
+    uint32_t n = 0;
+    for (int q = CACHE_A1IN; q <= CACHE_A1OUT; q++) {
+        for (uint32_t idx = pc->lists[q].head; idx != PAGECACHE_NIL; idx = pc->pages[idx].next) {
+            (*pages)[n].file = pc->pages[idx].file;
+            (*pages)[n].block = pc->pages[idx].block;
+            (*pages)[n].queue = (uint32_t)q;
+            (*pages)[n].uptodate = pc->pages[idx].uptodate;
+            n++;
+        }
+    }
+    n = 0;
+    for (uint32_t idx = pc->dirtyHead; idx != PAGECACHE_NIL; idx = pc->pages[idx].dirtyNext) {
+        (*dirty)[n].file = pc->pages[idx].file;
+        (*dirty)[n].block = pc->pages[idx].block;
+        (*dirty)[n].since = pc->pages[idx].dirtySince;
+        n++;
+    }
+    return true;
+}
+
+// Rebuild the page cache from the saved entries. A kernel restored with a smaller cache or
+//  another policy keeps what fits: 2q's first-time pages join the LRU list, and clean pages
+//  that do not fit are dropped. Returns false if an entry is invalid or a dirty page is lost.
+static bool Checkpoint_load_cache(Kernel *k, const CheckpointCachePage *pages, uint32_t numPages,
+                                  const CheckpointCacheDirty *dirty, uint32_t numDirty) {
+
+    PageCache *pc = &k->cache;
+    uint32_t numFiles = k->disk.numBlocks / PAGECACHE_FILE_BLOCKS;
+    for (uint32_t i = 0; i < numPages; i++) {
+        enum CacheQueue queue = (enum CacheQueue)pages[i].queue;
+        if (pages[i].file >= numFiles || pages[i].block >= PAGECACHE_FILE_BLOCKS
+            || pages[i].queue < CACHE_A1IN || pages[i].queue > CACHE_A1OUT)
+            return false;
+        if (pc->policy == CACHE_LRU && queue == CACHE_A1IN)
+            queue = CACHE_AM;
+        PageCache_restore_page(pc, pages[i].file, pages[i].block, queue, pages[i].uptodate != 0);
+    }
+    for (uint32_t i = 0; i < numDirty; i++) {
+        if (PageCache_restore_dirty(pc, dirty[i].file, dirty[i].block, dirty[i].since) == -1)
+            return false;
+    }
+    return true;
+}
+
+// Replace the free lists with the saved ones, if they cover exactly the unowned frames. The
+//  lists are pushed from the tail, so each ends up in its saved order.
+static bool Checkpoint_load_free(FrameTable *ft, const CheckpointFreeBlock *blocks, uint32_t count) {
+
+    uint8_t *covered = calloc(ft->numFrames > 0 ? ft->numFrames : 1, 1);
+    if (covered == NULL)
+        return false;
+
+    bool ok = true;
+    uint64_t frames = 0;
+    for (uint32_t b = 0; ok && b < count; b++) {
+        uint32_t frame = blocks[b].frame;
+        uint32_t order = blocks[b].order;
+        ok = order <= VM_MAX_ORDER && (frame & ((1u << order) - 1)) == 0 && (uint64_t)frame + (1u << order) <= ft->numFrames
+            && (b == 0 || order >= blocks[b - 1].order);
+        for (uint32_t i = 0; ok && i < 1u << order; i++) {
+            ok = ft->frames[frame + i].owner == NULL && !covered[frame + i];
+            covered[frame + i] = 1;
+        }
+        frames += 1u << order;
+    }
+    ok = ok && frames == ft->numFree;
+
+    if (ok) {
+        FrameTable_clear_free(ft);
+        for (uint32_t b = count; b-- > 0; ) {
+            FrameTable_add_free(ft, (int)blocks[b].frame, blocks[b].order);
+        }
+    }
+    free(covered);
+    return ok;
+}
+
+static bool Checkpoint_load_proc(PCB *process, const CheckpointProc *rec, const char *strings, uint64_t size, int numPriorities, bool zombie) {
+
+    bool ok = true;
+    process->pid = rec->pid;
+    process->priority = rec->priority;
+    process->state = (enum ProcState)rec->state;
+    process->waitState = (enum WaitState)rec->waitState;
+    char *message = Checkpoint_load_string(strings, size, rec->msgOffset, &ok);
+    char *reply = Checkpoint_load_string(strings, size, rec->replyOffset, &ok);
+    if (message != NULL || reply != NULL || rec->msgSrc != -1) {
+        Mailbox *mail = Kernel_open_mailbox(process);
+        if (mail != NULL) {
+            mail->proc_message = message;
+            mail->msg_src = rec->msgSrc;
+            mail->reply_msg = reply;
+            mail->reply_src = rec->replySrc;
+        }
+        else {
+            free(message);
+            free(reply);
+            ok = false;
+        }
+    }
+    process->ready_time = rec->readyTime;
+    process->block_time = rec->blockTime;
+    process->io_vpn = rec->ioVpn;
+    process->io_frame = rec->ioFrame;
+    process->io_write = rec->ioWrite != 0;
+    process->io_done = rec->ioDone;
+    process->mem.accesses = rec->accesses;
+    process->mem.faults = rec->faults;
+    process->kstack = VM_NO_FRAME;      // Set once its frames are claimed
+    process->kstack_order = 0;
+    process->disk.block = rec->diskBlock;
+    process->disk.count = rec->diskCount;
+    process->disk.write = rec->diskWrite != 0;
+    process->disk.fill = rec->diskFill != 0;
+    process->disk.issued = rec->diskIssued;
+    process->disk.deadline = rec->diskDeadline;
+    process->swap_pages = rec->swapPages;
+    process->swap_done = rec->swapDone;
+    process->exit_status = rec->exitStatus;
+    process->sig_pending = rec->sigPending;
+
+    if (rec->pid < 0 || rec->state < RUNNING || rec->state > STOPPED || rec->waitState < WAITING_SEND || rec->waitState > WAITING_CHILD)
+        ok = false;
+    // A zombie holds nothing but its exit status
+    if ((rec->state == ZOMBIE) != zombie || (zombie && (rec->numPages != 0 || rec->kstack != VM_NO_FRAME)))
+        ok = false;
+    if (rec->pid != 0 && (rec->priority < 0 || rec->priority >= numPriorities))
+        ok = false;
+    return ok;
+}
+
+// Add process to the table. Fails if another process has its pid.
+static bool Checkpoint_add_pid(CheckpointPids *pids, PCB *process) {
+
+    uint32_t h = ((uint32_t)process->pid * 0x9e3779b1u) & pids->mask;
+    while (pids->slots[h] != NULL) {
+        if (pids->slots[h]->pid == process->pid)
+            return false;
+        h = (h + 1) & pids->mask;
+    }
+    pids->slots[h] = process;
+    return true;
+}
+
+static PCB* Checkpoint_find_pid(CheckpointPids *pids, int32_t pid) {
+
+    uint32_t h = ((uint32_t)pid * 0x9e3779b1u) & pids->mask;
+    while (pids->slots[h] != NULL && pids->slots[h]->pid != pid) {
+        h = (h + 1) & pids->mask;
+    }
+    return pids->slots[h];
+}
+
+// Append the link of every child of process to links: its live children, then its zombies
+static void Checkpoint_save_links(CheckpointLink *links, uint32_t *n, PCB *process) {
+
+    for (PCB *child = process->children; child != NULL; child = child->next_sibling) {
+        links[*n].pid = child->pid;
+        links[*n].parent = process->pid;
+        (*n)++;
+    }
+    for (PCB *child = process->zombies; child != NULL; child = child->next_sibling) {
+        links[*n].pid = child->pid;
+        links[*n].parent = process->pid;
+        (*n)++;
+    }
+}
+
+// Rebuild the process tree from the links of the numProcs restored processes: the queued
+//  ones and the zombies. The links are taken last to first and each child is pushed on the
+//  front of its parent's list, so the lists end up in their saved order. Fails unless every
+//  process but init gets exactly one live parent and all of them can be reached from init.
+//  The process groups are rebuilt from the members the same way; every live process but init
+//  has to be in exactly one.
+static bool Checkpoint_load_tree(Kernel *k, const CheckpointLink *links, uint32_t numProcs, PCB **zombies, uint32_t numZombies,
+                                 const CheckpointMember *members) {
+
+    CheckpointPids pids = { NULL, 1 };
+    while (pids.mask < 2 * numProcs) {
+        pids.mask <<= 1;
+    }
+    pids.slots = calloc(pids.mask, sizeof(PCB *));
+    pids.mask--;
+    if (pids.slots == NULL)
+        return false;
+
+    bool ok = Checkpoint_add_pid(&pids, k->init);
+    if (k->current != k->init)
+        ok = ok && Checkpoint_add_pid(&pids, k->current);
+    if (k->disk.active != NULL)
+        ok = ok && Checkpoint_add_pid(&pids, k->disk.active);
+    for (int q = 0; ok && q < CHECKPOINT_NUM_QUEUES; q++) {
+        List *queue = Checkpoint_queue(k, q);
+        for (Node *node = queue != NULL && q != CHECKPOINT_INIT_QUEUE ? queue->head : NULL; ok && node != NULL; node = List_node_next(queue, node)) {
+            ok = Checkpoint_add_pid(&pids, node->item);
+        }
+    }
+    for (uint32_t i = 0; ok && i < numZombies; i++) {
+        ok = Checkpoint_add_pid(&pids, zombies[i]);
+    }
+
+    for (uint32_t i = numProcs - 1; ok && i-- > 0; ) {
+        PCB *child = Checkpoint_find_pid(&pids, links[i].pid);
+        PCB *parent = Checkpoint_find_pid(&pids, links[i].parent);
+        ok = child != NULL && parent != NULL && child != k->init && child->parent == NULL && parent->state != ZOMBIE;
+        if (!ok)
+            break;
+
+        PCB **head = child->state == ZOMBIE ? &parent->zombies : &parent->children;
+        child->parent = parent;
+        child->next_sibling = *head;
+        if (*head != NULL)
+            (*head)->prev_sibling = child;
+        *head = child;
+        if (child->state == ZOMBIE)
+            parent->num_zombies++;
+        else
+            parent->num_children++;
+    }
+
+    uint32_t numMembers = numProcs - numZombies - 1;
+    for (uint32_t i = numMembers; ok && i-- > 0; ) {
+        PCB *process = Checkpoint_find_pid(&pids, members[i].pid);
+        ProcGroup *group = NULL;
+        ok = process != NULL && process != k->init && process->state != ZOMBIE && process->group == NULL && members[i].pgid > 0
+            && (group = Kernel_find_group(k, members[i].pgid, true)) != NULL;
+        if (ok)
+            Kernel_join_group(group, process);
+    }
+    free(pids.slots);
+
+    // A cycle of parents would be cut off from init
+    uint32_t reached = 0;
+    for (PCB *process = k->init; ok && process != NULL; process = Kernel_next_in_tree(k, process)) {
+        reached += 1 + process->num_zombies;
+    }
+    k->zombie_count = (int)numZombies;
+    return ok && reached == numProcs;
+}
+
+// END OF PRIVATE FUNCTIONS ---------
+
+
+// Write a checkpoint of k to path. The file is replaced atomically.
+long Checkpoint_write(Kernel *k, const char *path) {
+
+    if (k->exit_loop || k->init == NULL)
+        return -1;
+
+    CheckpointHeader *header = calloc(1, sizeof(CheckpointHeader));
+    if (header == NULL)
+        return -1;
+
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->version = CHECKPOINT_VERSION;
+    header->headerSize = sizeof(CheckpointHeader);
+    header->procSize = sizeof(CheckpointProc);
+    header->numPriorities = k->config.num_priorities;
+    header->quantum = k->config.quantum;
+    header->semWake = k->config.sem_wake;
+    header->maxNodes = k->config.max_nodes;
+    header->numFrames = k->config.num_frames;
+    header->faultTicks = k->config.fault_ticks;
+    header->replacement = k->config.replacement;
+    header->kstackPages = k->config.kstack_pages;
+    header->diskBlocks = k->config.disk_blocks;
+    header->ioSched = k->config.io_sched;
+    header->cachePages = k->config.cache_pages;
+    header->cachePolicy = k->config.cache_policy;
+    header->swapSlots = k->config.swap_slots;
+    header->swapTicks = k->config.swap_ticks;
+    header->loadControl = k->config.load_control;
+    header->pidCurr = k->pid_curr;
+    header->semNum = k->sem_num;
+    header->procCount = k->proc_count;
+    header->lastResult = k->last_result;
+    header->currentPid = k->current->pid;
+    header->sliceOwnerPid = k->slice_owner != NULL ? k->slice_owner->pid : -1;
+    header->simTime = k->sim_time;
+    header->sliceStart = k->slice_start;
+    header->poolExhaustions = k->pool.poolExhaustions;
+    header->evictions = k->frames.evictions;
+    header->dirtyEvictions = k->frames.dirtyEvictions;
+    header->cowFaults = k->frames.cowFaults;
+    header->cowCopies = k->frames.cowCopies;
+    header->forkShared = k->frames.forkShared;
+    header->diskActivePid = k->disk.active != NULL ? k->disk.active->pid : -1;
+    header->diskBusy = k->disk.busy;
+    header->diskBusyUntil = k->disk.busyUntil;
+    header->diskHead = k->disk.head;
+    header->diskUp = k->disk.up;
+    header->diskReads = k->disk.reads;
+    header->diskWrites = k->disk.writes;
+    header->diskBlocksRead = k->disk.blocksRead;
+    header->diskBlocksWritten = k->disk.blocksWritten;
+    header->diskBusyTicks = k->disk.busyTicks;
+    header->diskSeekBlocks = k->disk.seekBlocks;
+    header->diskExpired = k->disk.expired;
+    header->cacheHits = k->cache.hits;
+    header->cacheMisses = k->cache.misses;
+    header->cacheGhostHits = k->cache.ghostHits;
+    header->cacheEvictions = k->cache.evictions;
+    header->cacheOverwrites = k->cache.overwrites;
+    header->cacheThrottled = k->cache.throttled;
+    header->cacheWritebacks = k->cache.writebacks;
+    header->cacheWritebackBlocks = k->cache.writebackBlocks;
+    header->swapBusyUntil = k->swap_busy_until;
+    header->swapCharged = k->swap_charged;
+    header->swapEvictions = k->swap_evictions;
+    header->swapOuts = k->frames.swapOuts;
+    header->swapIns = k->frames.swapIns;
+    header->swapFull = k->frames.swapFull;
+    for (int i = 0; i < NUM_SEMAPHORE; i++) {
+        header->semInit[i] = k->sem_array[i].sem_init;
+        header->semValue[i] = k->sem_array[i].sem_value;
+    }
+    header->metrics = k->metrics;
+
+    // Processes: init, the running process, the disk's, then every queue in order, then the
+    //  zombies, which are on no queue. The init queue only ever holds init, so only its length
+    //  is kept.
+    header->numZombies = (uint32_t)k->zombie_count;
+    header->numProcs = 1 + (k->current != k->init) + (k->disk.active != NULL) + header->numZombies;
+    for (int q = 0; q < CHECKPOINT_NUM_QUEUES; q++) {
+        List *queue = Checkpoint_queue(k, q);
+        if (queue != NULL) {
+            header->queueCount[q] = List_count(queue);
+            header->queuePeak[q] = List_peak(queue);
+            if (q != CHECKPOINT_INIT_QUEUE)
+                header->numProcs += List_count(queue);
+        }
+    }
+
+    CheckpointProc *procs = calloc(header->numProcs, sizeof(CheckpointProc));
+    CheckpointLink *links = malloc(header->numProcs * sizeof(CheckpointLink));
+    CheckpointMember *members = malloc(header->numProcs * sizeof(CheckpointMember));
+    uint64_t stringsCap = 4096;
+    char *strings = malloc(stringsCap);
+    CheckpointPages pages = { NULL, 0, 0, false };
+    if (procs == NULL || links == NULL || members == NULL || strings == NULL) {
+        free(header);
+        free(procs);
+        free(links);
+        free(members);
+        free(strings);
+        return -1;
+    }
+
+    uint32_t n = 0;
+    Checkpoint_save_proc(&procs[n++], k->init, &strings, &header->stringsSize, &stringsCap, &pages);
+    if (k->current != k->init)
+        Checkpoint_save_proc(&procs[n++], k->current, &strings, &header->stringsSize, &stringsCap, &pages);
+    if (k->disk.active != NULL)
+        Checkpoint_save_proc(&procs[n++], k->disk.active, &strings, &header->stringsSize, &stringsCap, &pages);
+    for (int q = 0; q < CHECKPOINT_NUM_QUEUES; q++) {
+        List *queue = Checkpoint_queue(k, q);
+        if (queue == NULL || q == CHECKPOINT_INIT_QUEUE)
+            continue;
+        for (Node *node = queue->head; node != NULL; node = List_node_next(queue, node)) {
+            Checkpoint_save_proc(&procs[n++], node->item, &strings, &header->stringsSize, &stringsCap, &pages);
+        }
+    }
+    uint32_t numLinks = 0;
+    for (PCB *process = k->init; process != NULL; process = Kernel_next_in_tree(k, process)) {
+        for (PCB *zombie = process->zombies; zombie != NULL; zombie = zombie->next_sibling) {
+            Checkpoint_save_proc(&procs[n++], zombie, &strings, &header->stringsSize, &stringsCap, &pages);
+        }
+        Checkpoint_save_links(links, &numLinks, process);
+    }
+    uint32_t numMembers = 0;
+    for (uint32_t i = 0; i <= k->group_mask; i++) {
+        for (ProcGroup *group = k->group_buckets[i]; group != NULL; group = group->hashNext) {
+            for (PCB *process = group->members; process != NULL; process = process->group_next) {
+                members[numMembers].pid = process->pid;
+                members[numMembers].pgid = group->pgid;
+                numMembers++;
+            }
+        }
+    }
+
+    header->numPages = pages.count;
+
+    // The free lists are kept in order, so a restored kernel hands out the same frames
+    for (int order = 0; order <= VM_MAX_ORDER; order++) {
+        header->numFreeBlocks += k->frames.freeBlocks[order];
+    }
+    CheckpointFreeBlock *freeBlocks = malloc((header->numFreeBlocks > 0 ? header->numFreeBlocks : 1) * sizeof(CheckpointFreeBlock));
+    if (freeBlocks == NULL) {
+        free(header);
+        free(procs);
+        free(links);
+        free(members);
+        free(strings);
+        free(pages.pages);
+        return -1;
+    }
+    uint32_t numFreeBlocks = 0;
+    for (int order = 0; order <= VM_MAX_ORDER; order++) {
+        for (uint32_t frame = k->frames.freeLists[order]; frame != FRAME_NIL; frame = k->frames.frames[frame].next) {
+            freeBlocks[numFreeBlocks].frame = frame;
+            freeBlocks[numFreeBlocks].order = (uint32_t)order;
+            numFreeBlocks++;
+        }
+    }
+
+    CheckpointCachePage *cachePages = NULL;
+    CheckpointCacheDirty *cacheDirty = NULL;
+    if (!Checkpoint_save_cache(&k->cache, header, &cachePages, &cacheDirty)) {
+        free(cachePages);
+        free(cacheDirty);
+        free(freeBlocks);
+        free(header);
+        free(procs);
+        free(links);
+        free(members);
+        free(strings);
+        free(pages.pages);
+        return -1;
+    }
+
+    // Histograms are mostly empty, so only the non-empty buckets are kept
+    for (int h = 0; h < CHECKPOINT_NUM_HISTS; h++) {
+        Histogram *hist = Checkpoint_hist(k, h);
+        header->hists[h].count = hist->count;
+        header->hists[h].min = hist->min;
+        header->hists[h].max = hist->max;
+        header->hists[h].sum = hist->sum;
+        for (int b = 0; b < HIST_NUM_BUCKETS; b++) {
+            if (hist->buckets[b] != 0)
+                header->hists[h].numBuckets++;
+        }
+        header->numBuckets += header->hists[h].numBuckets;
+    }
+
+    char tmpPath[4096];
+    FILE *out = NULL;
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) < (int)sizeof(tmpPath))
+        out = fopen(tmpPath, "wb");
+    bool ok = out != NULL && !pages.failed && numMembers == header->numProcs - header->numZombies - 1;
+    if (out != NULL) {
+        ok = fwrite(header, sizeof(CheckpointHeader), 1, out) == 1;
+        ok = ok && fwrite(procs, sizeof(CheckpointProc), header->numProcs, out) == header->numProcs;
+        ok = ok && fwrite(links, sizeof(CheckpointLink), numLinks, out) == numLinks;
+        ok = ok && fwrite(members, sizeof(CheckpointMember), numMembers, out) == numMembers;
+        ok = ok && fwrite(pages.pages, sizeof(CheckpointPage), pages.count, out) == pages.count;
+        ok = ok && fwrite(freeBlocks, sizeof(CheckpointFreeBlock), numFreeBlocks, out) == numFreeBlocks;
+        ok = ok && fwrite(cachePages, sizeof(CheckpointCachePage), header->numCachePages, out) == header->numCachePages;
+        ok = ok && fwrite(cacheDirty, sizeof(CheckpointCacheDirty), header->numCacheDirty, out) == header->numCacheDirty;
+        for (int h = 0; ok && h < CHECKPOINT_NUM_HISTS; h++) {
+            Histogram *hist = Checkpoint_hist(k, h);
+            for (uint32_t b = 0; ok && b < HIST_NUM_BUCKETS; b++) {
+                if (hist->buckets[b] != 0) {
+                    CheckpointBucket bucket = { b, 0, hist->buckets[b] };
+                    ok = fwrite(&bucket, sizeof(CheckpointBucket), 1, out) == 1;
+                }
+            }
+        }
+        ok = ok && fwrite(strings, 1, header->stringsSize, out) == header->stringsSize;
+        ok = (fclose(out) == 0) && ok;
+        ok = ok && rename(tmpPath, path) == 0;
+        if (!ok)
+            remove(tmpPath);
+    }
+
+    long bytes = sizeof(CheckpointHeader) + (long)header->numProcs * sizeof(CheckpointProc) + (long)numLinks * sizeof(CheckpointLink)
+        + (long)numMembers * sizeof(CheckpointMember)
+        + (long)header->numPages * sizeof(CheckpointPage) + (long)header->numFreeBlocks * sizeof(CheckpointFreeBlock)
+        + (long)header->numCachePages * sizeof(CheckpointCachePage) + (long)header->numCacheDirty * sizeof(CheckpointCacheDirty)
+        + (long)header->numBuckets * sizeof(CheckpointBucket) + (long)header->stringsSize;
+    free(header);
+    free(freeBlocks);
+    free(cachePages);
+    free(cacheDirty);
+    free(procs);
+    free(links);
+    free(members);
+    free(strings);
+    free(pages.pages);
+    return ok ? bytes : -1;
+}
+
+// Make a new kernel from the checkpoint at path.
+Kernel* Checkpoint_restore(const char *path, const KernelConfig *config, FILE *in, FILE *out) {
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(CheckpointHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t fileSize = st.st_size;
+    const char *map = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    // Check the header, and that the sections it describes fit the file exactly
+    const CheckpointHeader *header = (const CheckpointHeader *)map;
+    bool ok = memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) == 0
+        && header->version == CHECKPOINT_VERSION
+        && header->headerSize == sizeof(CheckpointHeader)
+        && header->procSize == sizeof(CheckpointProc)
+        && header->numProcs >= 1 && header->numZombies < header->numProcs;
+    uint64_t procsEnd = sizeof(CheckpointHeader) + (uint64_t)header->numProcs * sizeof(CheckpointProc);
+    uint64_t linksEnd = procsEnd + (uint64_t)(header->numProcs - 1) * sizeof(CheckpointLink);
+    uint64_t membersEnd = linksEnd + (uint64_t)(header->numProcs - header->numZombies - 1) * sizeof(CheckpointMember);
+    uint64_t pagesEnd = membersEnd + header->numPages * sizeof(CheckpointPage);
+    uint64_t freeEnd = pagesEnd + (uint64_t)header->numFreeBlocks * sizeof(CheckpointFreeBlock);
+    uint64_t cacheEnd = freeEnd + (uint64_t)header->numCachePages * sizeof(CheckpointCachePage);
+    uint64_t dirtyEnd = cacheEnd + (uint64_t)header->numCacheDirty * sizeof(CheckpointCacheDirty);
+    uint64_t bucketsEnd = dirtyEnd + (uint64_t)header->numBuckets * sizeof(CheckpointBucket);
+    ok = ok && header->numPages <= fileSize && bucketsEnd + header->stringsSize == fileSize;
+
+    KernelConfig restored;
+    restored.num_priorities = header->numPriorities;
+    restored.quantum = header->quantum;
+    restored.sem_wake = (enum SemWakePolicy)header->semWake;
+    restored.max_nodes = header->maxNodes;
+    restored.num_frames = header->numFrames;
+    restored.fault_ticks = header->faultTicks;
+    restored.replacement = (enum PageReplacement)header->replacement;
+    restored.kstack_pages = header->kstackPages;
+    restored.disk_blocks = header->diskBlocks;
+    restored.io_sched = (enum IOScheduler)header->ioSched;
+    restored.cache_pages = header->cachePages;
+    restored.cache_policy = (enum CachePolicy)header->cachePolicy;
+    restored.swap_slots = header->swapSlots;
+    restored.swap_ticks = header->swapTicks;
+    restored.load_control = header->loadControl != 0;
+    if (config != NULL) {
+        ok = ok && config->num_priorities == header->numPriorities;
+        restored = *config;
+    }
+
+    Kernel *k = ok ? Kernel_create(&restored, in, out) : NULL;
+    CheckpointFamilies families = { NULL, 1 };
+    while (k != NULL && families.mask < 2 * header->numProcs) {
+        families.mask <<= 1;
+    }
+    families.slots = k != NULL ? calloc(families.mask, sizeof(AddressSpace *)) : NULL;
+    families.mask--;
+    if (families.slots == NULL) {
+        if (k != NULL)
+            Kernel_destroy(k);
+        munmap((void *)map, fileSize);
+        return NULL;
+    }
+
+    const CheckpointProc *procs = (const CheckpointProc *)(map + sizeof(CheckpointHeader));
+    const CheckpointLink *links = (const CheckpointLink *)(map + procsEnd);
+    const CheckpointMember *members = (const CheckpointMember *)(map + linksEnd);
+    const CheckpointPage *pages = (const CheckpointPage *)(map + membersEnd);
+    const CheckpointPage *pagesStop = (const CheckpointPage *)(map + pagesEnd);
+    const CheckpointFreeBlock *freeBlocks = (const CheckpointFreeBlock *)(map + pagesEnd);
+    const CheckpointCachePage *cachePages = (const CheckpointCachePage *)(map + freeEnd);
+    const CheckpointCacheDirty *cacheDirty = (const CheckpointCacheDirty *)(map + cacheEnd);
+    const CheckpointBucket *buckets = (const CheckpointBucket *)(map + dirtyEnd);
+    const char *strings = map + bucketsEnd;
+
+    // Every frame is taken until the free lists are rebuilt from the claimed frames, so that
+    //  tearing down a half-restored kernel frees each claimed frame exactly once. The kernel
+    //  stack Kernel_create gave init is given up for the one in the checkpoint.
+    FrameTable_clear_free(&k->frames);
+    if (k->init->kstack != VM_NO_FRAME) {
+        for (uint32_t i = 0; i < 1u << k->init->kstack_order; i++) {
+            k->frames.frames[k->init->kstack + i].owner = NULL;
+        }
+        k->init->kstack = VM_NO_FRAME;
+    }
+
+    k->pid_curr = header->pidCurr;
+    k->sem_num = header->semNum;
+    k->proc_count = header->procCount;
+    k->last_result = header->lastResult;
+    k->sim_time = header->simTime;
+    k->slice_start = header->sliceStart;
+    k->pool.poolExhaustions = header->poolExhaustions;
+    k->frames.evictions = header->evictions;
+    k->frames.dirtyEvictions = header->dirtyEvictions;
+    k->frames.cowFaults = header->cowFaults;
+    k->frames.cowCopies = header->cowCopies;
+    k->frames.forkShared = header->forkShared;
+    k->disk.busy = header->diskBusy != 0;
+    k->disk.busyUntil = header->diskBusyUntil;
+    k->disk.head = header->diskHead;
+    k->disk.up = header->diskUp != 0;
+    k->disk.reads = header->diskReads;
+    k->disk.writes = header->diskWrites;
+    k->disk.blocksRead = header->diskBlocksRead;
+    k->disk.blocksWritten = header->diskBlocksWritten;
+    k->disk.busyTicks = header->diskBusyTicks;
+    k->disk.seekBlocks = header->diskSeekBlocks;
+    k->disk.expired = header->diskExpired;
+    k->cache.hits = header->cacheHits;
+    k->cache.misses = header->cacheMisses;
+    k->cache.ghostHits = header->cacheGhostHits;
+    k->cache.evictions = header->cacheEvictions;
+    k->cache.overwrites = header->cacheOverwrites;
+    k->cache.throttled = header->cacheThrottled;
+    k->cache.writebacks = header->cacheWritebacks;
+    k->cache.writebackBlocks = header->cacheWritebackBlocks;
+    k->swap_busy_until = header->swapBusyUntil;
+    k->swap_charged = header->swapCharged;
+    k->swap_evictions = header->swapEvictions;
+    k->frames.swapOuts = header->swapOuts;
+    k->frames.swapIns = header->swapIns;
+    k->frames.swapFull = header->swapFull;
+    k->metrics = header->metrics;
+
+    for (int i = 0; i < NUM_SEMAPHORE; i++) {
+        if (header->semInit[i]) {
+            k->sem_array[i].sem_init = true;
+            k->sem_array[i].sem_value = header->semValue[i];
+            k->sem_array[i].pList = List_create(&k->pool);
+        }
+    }
+
+    // Kernel_create made init; the rest are allocated and queued in one pass over the records
+    ok = Checkpoint_load_proc(k->init, &procs[0], strings, header->stringsSize, k->config.num_priorities, false) && procs[0].pid == 0
+        && Checkpoint_load_pages(k, k->init, &procs[0], &families, &pages, pagesStop);
+    k->init->priority = k->config.num_priorities;
+    uint32_t n = 1;
+    if (ok && header->currentPid != 0) {
+        k->current = Kernel_alloc_pcb();
+        if (k->current != NULL)
+            AddressSpace_init(&k->current->mem, &k->frames);
+        ok = k->current != NULL && Checkpoint_load_proc(k->current, &procs[n], strings, header->stringsSize, k->config.num_priorities, false);
+        ok = ok && k->current->pid == header->currentPid
+            && Checkpoint_load_pages(k, k->current, &procs[n], &families, &pages, pagesStop);
+        n++;
+    }
+    if (ok && header->diskActivePid != -1) {
+        k->disk.active = Kernel_alloc_pcb();
+        if (k->disk.active != NULL)
+            AddressSpace_init(&k->disk.active->mem, &k->frames);
+        ok = k->disk.active != NULL && n < header->numProcs
+            && Checkpoint_load_proc(k->disk.active, &procs[n], strings, header->stringsSize, k->config.num_priorities, false);
+        ok = ok && k->disk.active->pid == header->diskActivePid && k->disk.busy
+            && Checkpoint_load_pages(k, k->disk.active, &procs[n], &families, &pages, pagesStop);
+        n++;
+    }
+    if (ok && header->sliceOwnerPid == 0)
+        k->slice_owner = k->init;
+    else if (ok && header->sliceOwnerPid == k->current->pid)
+        k->slice_owner = k->current;
+
+    for (int q = 0; ok && q < CHECKPOINT_NUM_QUEUES; q++) {
+        List *queue = Checkpoint_queue(k, q);
+        if (queue == NULL) {
+            ok = header->queueCount[q] == 0;
+            continue;
+        }
+        for (uint32_t i = 0; ok && i < header->queueCount[q]; i++) {
+            PCB *process = k->init;
+            if (q != CHECKPOINT_INIT_QUEUE) {
+                ok = n < header->numProcs && (process = Kernel_alloc_pcb()) != NULL;
+                if (!ok)
+                    break;
+                AddressSpace_init(&process->mem, &k->frames);
+                // A process that is not queued yet must be freed here. Its frames are only
+                //  claimed once it is queued, so that freeing it does not release them twice.
+                if (!Checkpoint_load_proc(process, &procs[n], strings, header->stringsSize, k->config.num_priorities, false)
+                    || List_append(queue, process) == LIST_FAIL) {
+                    Kernel_free_mailbox(process);
+                    free(process);
+                    ok = false;
+                    break;
+                }
+                ok = Checkpoint_load_pages(k, process, &procs[n], &families, &pages, pagesStop)
+                    && (process->state == BLOCKED && process->waitState == WAITING_CHILD) == (q == CHECKPOINT_WAIT_QUEUE)
+                    && (process->state == STOPPED) == (q == CHECKPOINT_STOP_QUEUE);
+                List_set_key(queue, process->pid);
+                process->queue_node = queue->tail;
+                if (q >= CHECKPOINT_SEM_QUEUE)
+                    process->sem_id = q - CHECKPOINT_SEM_QUEUE;
+                n++;
+                if (header->sliceOwnerPid == process->pid)
+                    k->slice_owner = process;
+            }
+            else if (List_append(queue, process) == LIST_FAIL) {
+                ok = false;
+            }
+            else {
+                List_set_key(queue, process->pid);
+            }
+        }
+        if (ok && header->queuePeak[q] > queue->peakCount)
+            queue->peakCount = header->queuePeak[q];
+    }
+
+    // Zombies are only on their parents' lists, so they are held here until the tree is built
+    PCB **zombies = calloc(header->numZombies > 0 ? header->numZombies : 1, sizeof(PCB *));
+    uint32_t numZombies = 0;
+    ok = ok && zombies != NULL && n + header->numZombies == header->numProcs;
+    while (ok && numZombies < header->numZombies) {
+        PCB *zombie = Kernel_alloc_pcb();
+        if (zombie == NULL) {
+            ok = false;
+            break;
+        }
+        AddressSpace_init(&zombie->mem, &k->frames);
+        zombies[numZombies++] = zombie;
+        ok = Checkpoint_load_proc(zombie, &procs[n], strings, header->stringsSize, k->config.num_priorities, true);
+        n++;
+    }
+    ok = ok && n == header->numProcs && pages == pagesStop;
+    ok = ok && Checkpoint_load_tree(k, links, header->numProcs, zombies, numZombies, members);
+    if (!ok) {
+        for (uint32_t i = 0; i < numZombies; i++) {
+            if (zombies[i]->parent != NULL)
+                zombies[i]->parent->zombies = NULL;
+        }
+        for (uint32_t i = 0; i < numZombies; i++) {
+            Kernel_free_mailbox(zombies[i]);
+            free(zombies[i]);
+        }
+    }
+    free(zombies);
+
+    // The replacement policy's history is not saved; resident pages start out tracked as if
+    //  they had just been read in, in frame order
+    FrameTable_rebuild_free(&k->frames);
+    ok = ok && Checkpoint_load_free(&k->frames, freeBlocks, header->numFreeBlocks);
+    ok = ok && Checkpoint_load_cache(k, cachePages, header->numCachePages, cacheDirty, header->numCacheDirty);
+
+    for (int h = 0; ok && h < CHECKPOINT_NUM_HISTS; h++) {
+        Histogram *hist = Checkpoint_hist(k, h);
+        hist->count = header->hists[h].count;
+        hist->min = header->hists[h].min;
+        hist->max = header->hists[h].max;
+        hist->sum = header->hists[h].sum;
+        for (uint32_t b = 0; b < header->hists[h].numBuckets; b++, buckets++) {
+            if (buckets >= (const CheckpointBucket *)(map + bucketsEnd) || buckets->index >= HIST_NUM_BUCKETS) {
+                ok = false;
+                break;
+            }
+            hist->buckets[buckets->index] = buckets->count;
+        }
+    }
+
+    munmap((void *)map, fileSize);
+    free(families.slots);
+    if (!ok) {
+        Kernel_destroy(k);
+        return NULL;
+    }
+    return k;
+}
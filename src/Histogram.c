@@ -0,0 +1,109 @@
+#include "Histogram.h"
+#include <string.h>
+
+
+// START OF PRIVATE FUNCTIONS -------
+
+// Values below HIST_SUB_COUNT get a bucket each. Above that, the position of the most
+//  significant bit picks the group and the next HIST_SUB_BITS bits pick the sub-bucket.
+static unsigned int Histogram_index(uint64_t value) {
+
+    if (value < HIST_SUB_COUNT)
+        return (unsigned int)value;
+
+    unsigned int msb = 63 - __builtin_clzll(value);
+    unsigned int group = msb - HIST_SUB_BITS + 1;
+    unsigned int sub = (unsigned int)(value >> (group - 1)) - HIST_SUB_COUNT;
+    return group * HIST_SUB_COUNT + sub;
+}
+
+// Largest value that maps to the given bucket
+static uint64_t Histogram_bucket_high(unsigned int index) {
+
+    if (index < HIST_SUB_COUNT)
+        return index;
+
+    unsigned int group = index / HIST_SUB_COUNT;
+    uint64_t sub = index % HIST_SUB_COUNT;
+    uint64_t low = (sub + HIST_SUB_COUNT) << (group - 1);
+    return low + ((uint64_t)1 << (group - 1)) - 1;
+}
+
+// END OF PRIVATE FUNCTIONS ---------
+
+
+void Histogram_init(Histogram *hist, const char *name) {
+
+    memset(hist, 0, sizeof(Histogram));
+    strncpy(hist->name, name, HIST_NAME_LEN - 1);
+    hist->min = UINT64_MAX;
+}
+
+void Histogram_record(Histogram *hist, uint64_t value) {
+
+    hist->buckets[Histogram_index(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+void Histogram_merge(Histogram *dst, const Histogram *src) {
+
+    if (src->count == 0)
+        return;
+
+    for (unsigned int i = 0; i < HIST_NUM_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+uint64_t Histogram_percentile(Histogram *hist, double p) {
+
+    if (hist->count == 0)
+        return 0;
+
+    // Rank of the value we are looking for, rounded up so that p = 100 gives the maximum
+    uint64_t rank = (uint64_t)(p / 100.0 * hist->count);
+    if ((double)rank < p / 100.0 * hist->count)
+        rank++;
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < HIST_NUM_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t high = Histogram_bucket_high(i);
+            return high < hist->max ? high : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+void Histogram_print(Histogram *hist, FILE *out) {
+
+    if (hist->count == 0) {
+        fprintf(out, "    %-20s count=0\n", hist->name);
+        return;
+    }
+
+    fprintf(out, "    %-20s count=%llu min=%llu p50=%llu p90=%llu p99=%llu p99.9=%llu max=%llu mean=%.2f\n",
+            hist->name,
+            (unsigned long long)hist->count,
+            (unsigned long long)hist->min,
+            (unsigned long long)Histogram_percentile(hist, 50.0),
+            (unsigned long long)Histogram_percentile(hist, 90.0),
+            (unsigned long long)Histogram_percentile(hist, 99.0),
+            (unsigned long long)Histogram_percentile(hist, 99.9),
+            (unsigned long long)hist->max,
+            (double)hist->sum / hist->count);
+}
@@ -0,0 +1,237 @@
+/*
+
+Filename: KernelSim.c
+
+Description: The embeddable API of libkernelsim.a. Thin wrappers that run kernel operations
+             as single commands, without the interactive input loop.
+
+*/
+
+
+#include "KernelSim.h"
+#include "PCB.h"
+#include "Checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// START OF PRIVATE FUNCTIONS -------
+
+// Bracket one operation with the clock tick and between-command work of sim's input loop
+#define KERNELSIM_COMMAND(k, op)        \
+    do {                                \
+        if ((k)->exit_loop)             \
+            return -1;                  \
+        Kernel_tick_begin(k);           \
+        int rv_ = (op);                 \
+        (k)->last_result = rv_;         \
+        Kernel_tick_end(k);             \
+        return rv_;                     \
+    } while (0)
+
+static int KernelSim_exit_helper(Kernel *k) {
+
+    if (k->current == NULL)
+        return -1;
+    exit_proc(k);
+    return 1;
+}
+
+static int KernelSim_quantum_helper(Kernel *k) {
+    quantum(k);
+    return 1;
+}
+
+static int KernelSim_receive_helper(Kernel *k) {
+    receive(k);
+    return 1;
+}
+
+// END OF PRIVATE FUNCTIONS ---------
+
+
+void KernelSim_default_config(KernelConfig *config) {
+    KernelConfig_default(config);
+}
+
+Kernel* KernelSim_init(const KernelConfig *config, FILE *out) {
+    return Kernel_create(config, NULL, out);
+}
+
+void KernelSim_destroy(Kernel *k) {
+    Kernel_destroy(k);
+}
+
+int KernelSim_dispatch(Kernel *k, const char *commands) {
+
+    size_t len = strlen(commands);
+    if (k->exit_loop || len == 0)
+        return -1;
+
+    FILE *in = fmemopen((void *)commands, len, "r");
+    if (in == NULL)
+        return -1;
+
+    int rv = runCommands(k, in);
+    fclose(in);
+    return rv;
+}
+
+void KernelSim_step(Kernel *k) {
+
+    if (k->exit_loop)
+        return;
+    Kernel_tick_begin(k);
+    Kernel_tick_end(k);
+}
+
+int KernelSim_create(Kernel *k, int priority) {
+    KERNELSIM_COMMAND(k, create(k, priority));
+}
+
+int KernelSim_fork(Kernel *k) {
+    KERNELSIM_COMMAND(k, fork_proc(k));
+}
+
+int KernelSim_create_n(Kernel *k, int priority, int count, int *first) {
+    KERNELSIM_COMMAND(k, create_n(k, priority, count, first));
+}
+
+int KernelSim_fork_n(Kernel *k, int count, int *first) {
+    KERNELSIM_COMMAND(k, fork_n(k, count, first));
+}
+
+int KernelSim_kill(Kernel *k, int pid) {
+
+    // Same validation as the K command
+    if (pid < 0 || pid > (int)k->pid_curr)
+        return -1;
+    KERNELSIM_COMMAND(k, kill_proc(k, pid));
+}
+
+int KernelSim_exit(Kernel *k) {
+    KERNELSIM_COMMAND(k, KernelSim_exit_helper(k));
+}
+
+int KernelSim_wait(Kernel *k) {
+    KERNELSIM_COMMAND(k, wait_proc(k));
+}
+
+int KernelSim_signal(Kernel *k, int pid, enum Signal signal) {
+    KERNELSIM_COMMAND(k, signal_proc(k, pid, signal));
+}
+
+int KernelSim_setpgid(Kernel *k, int pid, int pgid) {
+    KERNELSIM_COMMAND(k, setpgid_proc(k, pid, pgid));
+}
+
+int KernelSim_quantum(Kernel *k) {
+    KERNELSIM_COMMAND(k, KernelSim_quantum_helper(k));
+}
+
+int KernelSim_send(Kernel *k, int pid, const char *msg) {
+    KERNELSIM_COMMAND(k, send_msg(k, pid, (char *)msg));
+}
+
+int KernelSim_receive(Kernel *k) {
+    KERNELSIM_COMMAND(k, KernelSim_receive_helper(k));
+}
+
+int KernelSim_reply(Kernel *k, int pid, const char *msg) {
+    KERNELSIM_COMMAND(k, reply(k, pid, (char *)msg));
+}
+
+int KernelSim_new_sem(Kernel *k, int sem_id, int value) {
+
+    // A negative value would count waiters that are not on the semaphore's list
+    if (value < 0)
+        return -1;
+    KERNELSIM_COMMAND(k, new_Sem(k, sem_id, value));
+}
+
+int KernelSim_sem_P(Kernel *k, int sem_id) {
+    KERNELSIM_COMMAND(k, sem_P(k, sem_id));
+}
+
+int KernelSim_sem_V(Kernel *k, int sem_id) {
+    KERNELSIM_COMMAND(k, sem_V(k, sem_id));
+}
+
+int KernelSim_access(Kernel *k, uint32_t vaddr, int count, bool write) {
+    KERNELSIM_COMMAND(k, access_mem(k, vaddr, count, write));
+}
+
+int KernelSim_disk(Kernel *k, uint32_t block, int count, bool write) {
+    KERNELSIM_COMMAND(k, disk_io(k, block, count, write));
+}
+
+int KernelSim_file(Kernel *k, int file, uint32_t block, int count, bool write) {
+    KERNELSIM_COMMAND(k, file_io(k, file, block, count, write));
+}
+
+void KernelSim_query(Kernel *k, KernelSimState *state) {
+
+    memset(state, 0, sizeof(KernelSimState));
+    state->clock = k->sim_time;
+    state->exited = k->exit_loop;
+    state->running_pid = k->current != NULL ? k->current->pid : -1;
+    state->num_processes = k->exit_loop ? 0 : k->proc_count;
+    state->num_priorities = k->config.num_priorities;
+    for (int i = 0; i < k->config.num_priorities; i++) {
+        state->ready_length[i] = List_count(k->ready_lists[i]);
+    }
+    state->waiting_send_length = List_count(k->waiting_lists[0]);
+    state->waiting_reply_length = List_count(k->waiting_lists[1]);
+    state->waiting_io_length = List_count(k->io_list);
+    state->waiting_disk_length = BlockDev_waiting(&k->disk);
+    state->swapped_length = List_count(k->swap_list);
+    state->waiting_child_length = List_count(k->wait_list);
+    state->zombies = k->zombie_count;
+    state->stopped_length = List_count(k->stopped_list);
+    state->num_groups = (int)k->num_groups;
+    state->free_frames = k->frames.numFree;
+    int order = FrameTable_largest_free_order(&k->frames);
+    state->largest_free_block = order >= 0 ? 1u << order : 0;
+    for (int i = 0; i < NUM_SEMAPHORE; i++) {
+        if (k->sem_array[i].sem_init == true) {
+            state->sem_created[i] = true;
+            state->sem_value[i] = k->sem_array[i].sem_value;
+            state->sem_waiting_length[i] = List_count(k->sem_array[i].pList);
+        }
+    }
+}
+
+int KernelSim_query_proc(Kernel *k, int pid, KernelSimProc *proc) {
+
+    PCB *process = Kernel_find_process(k, pid);
+    if (process == NULL)
+        process = Kernel_find_zombie(k, pid);
+    if (process == NULL)
+        return -1;
+
+    proc->pid = process->pid;
+    proc->priority = process->priority;
+    proc->state = (enum KernelSimProcState)process->state;
+    proc->wait_state = (enum KernelSimWaitState)process->waitState;
+    Mailbox *mail = process->mail;
+    proc->has_message = mail != NULL && mail->proc_message != NULL;
+    proc->message_src = proc->has_message ? mail->msg_src : -1;
+    proc->has_reply = mail != NULL && mail->reply_msg != NULL;
+    proc->resident_pages = process->mem.rss;
+    proc->page_faults = process->mem.faults;
+    proc->parent_pid = process->parent != NULL ? process->parent->pid : -1;
+    proc->num_children = process->num_children;
+    proc->num_zombies = process->num_zombies;
+    proc->pgid = process->group != NULL ? process->group->pgid : -1;
+    proc->pending_signals = process->sig_pending;
+    return 0;
+}
+
+long KernelSim_checkpoint(Kernel *k, const char *path) {
+    return Checkpoint_write(k, path);
+}
+
+Kernel* KernelSim_restore(const char *path, const KernelConfig *config, FILE *out) {
+    return Checkpoint_restore(path, config, NULL, out);
+}
@@ -1,65 +1,236 @@
 #include "List.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <pthread.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 
-static Node nodePool[LIST_MAX_NUM_NODES];
-static List listPool[LIST_MAX_NUM_HEADS];
-static unsigned int totalNodeCount = 0;    // Keeps track of the total number of nodes used
-static unsigned int totalListCount = 0;    // Keeps track of the total number of lists used
-static unsigned int nodesFreed = 0;
-static unsigned int listsFreed = 0;
-static unsigned int unusedNodes[LIST_MAX_NUM_NODES];
-static unsigned int unusedLists[LIST_MAX_NUM_HEADS];
-
 
 // START OF PRIVATE FUNCTIONS -------
 
-// Used when creating a new node
-static Node * List_create_node() {
+// Index of node in the node pool, LIST_NIL for NULL
+static uint32_t List_node_index(ListPool * pool, Node * node) {
+    return node == NULL ? LIST_NIL : (uint32_t)(node - pool->nodePool);
+}
 
-    // This calculation allows us to find free nodes without having to search for them
-    unsigned int unusedNodesIndex = (totalNodeCount + nodesFreed) % LIST_MAX_NUM_NODES;
-    unsigned int nodePoolIndex = unusedNodes[unusedNodesIndex];
-    Node * newNode = &nodePool[nodePoolIndex];
-    totalNodeCount++;
+// The nodes a node links to, NULL at either end of its list
+static Node * List_next_node(ListPool * pool, Node * node) {
+    return node->next == LIST_NIL ? NULL : &pool->nodePool[node->next];
+}
+
+static Node * List_prev_node(ListPool * pool, Node * node) {
+    return node->prev == LIST_NIL ? NULL : &pool->nodePool[node->prev];
+}
+
+// Id of the next pool to be initialized. Ids are never reused, so a thread's memo of its
+//  cache cannot be mistaken for one in a new pool that happens to be at the same address.
+static atomic_ullong List_next_pool_id = 1;
+
+// A byte at an address unique to each running thread, which marks the caches it owns
+static _Thread_local char List_thread;
+
+// The cache this thread used last, and the id of its pool
+static _Thread_local unsigned long long List_memo_pool;
+static _Thread_local ListCache * List_memo_cache;
+
+// Find or claim the calling thread's cache in pool, and remember it. NULL if every cache is taken.
+static ListCache * List_claim_cache(ListPool * pool) {
+
+    // Only this thread ever stores its own mark, so the search needs no lock
+    ListCache * cache = NULL;
+    for (unsigned int i = 0; i < LIST_CACHE_THREADS && cache == NULL; i++) {
+        if (atomic_load(&pool->caches[i].owner) == &List_thread)
+            cache = &pool->caches[i];
+    }
+    if (cache == NULL) {
+        pthread_mutex_lock(&pool->lock);
+        for (unsigned int i = 0; i < LIST_CACHE_THREADS && cache == NULL; i++) {
+            if (atomic_load(&pool->caches[i].owner) == NULL) {
+                cache = &pool->caches[i];
+                atomic_store(&cache->owner, &List_thread);
+            }
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    List_memo_pool = pool->id;
+    List_memo_cache = cache;
+    return cache;
+}
+
+// The calling thread's cache in pool, claimed on first use. NULL if every cache is taken.
+static inline ListCache * List_thread_cache(ListPool * pool) {
+    return List_memo_pool == pool->id ? List_memo_cache : List_claim_cache(pool);
+}
+
+// Move up to count nodes off the front of the free chain onto the front of cache's chain.
+//  Called with the pool locked. Returns the number moved.
+static unsigned int List_cache_refill(ListPool * pool, ListCache * cache, unsigned int count) {
+
+    if (count > pool->maxNodes - pool->totalNodeCount)
+        count = pool->maxNodes - pool->totalNodeCount;
+    if (count == 0)
+        return 0;
+
+    uint32_t first = pool->freeNodes;
+    uint32_t last = first;
+    unsigned int touched = pool->nodesTouched;
+    for (unsigned int i = 1; ; i++) {
+        if (last >= touched)
+            touched = last + 1;
+        if (i == count)
+            break;
+        last = pool->nodePool[last].next;
+    }
+    pool->freeNodes = pool->nodePool[last].next;
+    pool->nodePool[last].next = cache->head;
+    if (cache->count == 0)
+        cache->tail = last;
+    cache->head = first;
+    cache->count += count;
+    pool->totalNodeCount += count;
+    pool->nodesTouched = touched;
+    return count;
+}
+
+// Push the chain of count nodes from head to tail on the front of the free chain at once
+static void List_pool_put(ListPool * pool, uint32_t head, uint32_t tail, unsigned int count) {
+
+    pthread_mutex_lock(&pool->lock);
+    pool->nodePool[tail].next = pool->freeNodes;
+    pool->freeNodes = head;
+    pool->totalNodeCount -= count;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Make cache's full chain its spare, handing the old spare back to the pool
+static void List_cache_swap_out(ListPool * pool, ListCache * cache) {
+
+    if (cache->spare != LIST_NIL)
+        List_pool_put(pool, cache->spare, cache->spareTail, cache->spareCount);
+    cache->spare = cache->head;
+    cache->spareTail = cache->tail;
+    cache->spareCount = cache->count;
+    cache->head = LIST_NIL;
+    cache->count = 0;
+}
+
+// Put cache's spare chain in front of the one it takes from
+static void List_cache_swap_in(ListCache * cache, Node * nodePool) {
+
+    nodePool[cache->spareTail].next = cache->head;
+    if (cache->count == 0)
+        cache->tail = cache->spareTail;
+    cache->head = cache->spare;
+    cache->count += cache->spareCount;
+    cache->spare = LIST_NIL;
+    cache->spareCount = 0;
+}
+
+// Take one node from the free chain for a thread without a cache. Returns NULL if there is none.
+static Node * List_pool_take(ListPool * pool) {
+
+    Node * newNode = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->freeNodes == LIST_NIL) {
+        pool->poolExhaustions++;
+    }
+    else {
+        uint32_t index = pool->freeNodes;
+        newNode = &pool->nodePool[index];
+        pool->freeNodes = newNode->next;
+        pool->totalNodeCount++;
+        if (index >= pool->nodesTouched)
+            pool->nodesTouched = index + 1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return newNode;
+}
+
+// Used when creating a new node. Returns NULL if the node pool is exhausted.
+static Node * List_create_node(ListPool * pool) {
+
+    ListCache * cache = List_thread_cache(pool);
+    if (cache == NULL)
+        return List_pool_take(pool);
+
+    if (cache->count == 0) {
+        if (cache->spare != LIST_NIL) {
+            List_cache_swap_in(cache, pool->nodePool);
+        }
+        else {
+            pthread_mutex_lock(&pool->lock);
+            unsigned int got = List_cache_refill(pool, cache, LIST_CACHE_BATCH);
+            if (got == 0)
+                pool->poolExhaustions++;
+            pthread_mutex_unlock(&pool->lock);
+            if (got == 0)
+                return NULL;
+        }
+    }
+
+    // Take the first node out of the cache
+    Node * newNode = &pool->nodePool[cache->head];
+    cache->head = newNode->next;
+    cache->count--;
     return newNode;
 }
 
-// Used when creating a new list
-static List * List_create_helper() {
+// Used when creating a new list. Called with the pool locked.
+static List * List_create_helper(ListPool * pool) {
 
     // This calculation allows us to find free nodes without having to search for them
-    unsigned int unusedListsIndex = (totalListCount + listsFreed) % LIST_MAX_NUM_HEADS;
-    unsigned int listPoolIndex = unusedLists[unusedListsIndex];
-    List * newList = &listPool[listPoolIndex];
+    unsigned int unusedListsIndex = (pool->totalListCount + pool->listsFreed) % pool->maxLists;
+    unsigned int listPoolIndex = pool->unusedLists[unusedListsIndex];
+    List * newList = &pool->listPool[listPoolIndex];
+    newList->pool = pool;
     newList->current = NULL;
     newList->head = NULL;
     newList->tail = NULL;
     newList->itemCount = 0;
     newList->oob = LIST_OOB_START;
-    totalListCount++;
+    newList->peakCount = 0;
+    newList->keyed = false;
+    pool->totalListCount++;
     return newList;
 }
 
-static void List_free_node(Node * node) {
+// Push the chain of count nodes from head to tail on the front of this thread's cache at
+//  once. A long chain goes straight back to the free chain instead, under one lock.
+static void List_free_chain(ListPool * pool, Node * head, Node * tail, int count) {
+
+    ListCache * cache = List_thread_cache(pool);
+    uint32_t headIndex = List_node_index(pool, head);
+    uint32_t tailIndex = List_node_index(pool, tail);
+    if (cache == NULL || count >= LIST_CACHE_BATCH) {
+        List_pool_put(pool, headIndex, tailIndex, count);
+        return;
+    }
+    if (cache->count >= LIST_CACHE_BATCH)
+        List_cache_swap_out(pool, cache);
+    tail->next = cache->head;
+    if (cache->count == 0)
+        cache->tail = tailIndex;
+    cache->head = headIndex;
+    cache->count += count;
+}
+
+static void List_free_node(ListPool * pool, Node * node) {
 
-    // Essentially, once we have used the maximum number of nodes, we loop around to the
-    //  beginning of the node pool to reuse the nodes that were freed
-    unsigned int unusedNodesIndex = node->index;
-    // Get rid of all the stored data (except for the index) so that the node can be reused
+    // Get rid of the stored data and push the node on the front of this thread's cache
+    unsigned int nodePoolIndex = List_node_index(pool, node);
     node->item = NULL;
-    node->next = NULL;
-    node->prev = NULL;
-    node = NULL;
-    unusedNodes[nodesFreed % LIST_MAX_NUM_NODES] = unusedNodesIndex;
-    nodesFreed++;
-    totalNodeCount--;
+    node->prev = LIST_NIL;
+    pool->keys[nodePoolIndex] = LIST_NO_KEY;
+    List_free_chain(pool, node, node, 1);
 }
 
 // This is only called if the list holds zero items
 static void List_free_helper(List * list) {
 
+    ListPool * pool = list->pool;
+
     // Essentially, once we have used the maximum number of lists, we loop around to the
     //  beginning of the list pool to reuse the lists that were freed
     unsigned int unusedListsIndex = list->index;
@@ -68,20 +239,66 @@ static void List_free_helper(List * list) {
     list->tail = NULL;
     list->itemCount = 0;
     list = NULL;
-    unusedLists[listsFreed % LIST_MAX_NUM_HEADS] = unusedListsIndex;
-    listsFreed++;
-    totalListCount--;
+    pthread_mutex_lock(&pool->lock);
+    pool->unusedLists[pool->listsFreed % pool->maxLists] = unusedListsIndex;
+    pool->listsFreed++;
+    pool->totalListCount--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Used whenever an item is added, keeps track of the longest the list has been
+static void List_count_up(List * pList) {
+
+    pList->itemCount++;
+    if (pList->itemCount > pList->peakCount)
+        pList->peakCount = pList->itemCount;
 }
 
 // Used whenever inserting into an empty list
-static void List_insert_into_empty(List * pList, void * item) {
+static void List_insert_into_empty(List * pList, Node * newNode, void * item) {
 
-    Node * newNode = List_create_node();
     pList->current = newNode;
     pList->current->item = item;
+    pList->current->next = LIST_NIL;
+    pList->current->prev = LIST_NIL;
     pList->head = pList->current;
     pList->tail = pList->current;
-    pList->itemCount++;
+    List_count_up(pList);
+}
+
+// Index of the first of keys[start..end) equal to key, end if there is none
+static unsigned int List_scan_keys(const int32_t * keys, unsigned int start, unsigned int end, int32_t key) {
+
+    unsigned int i = start;
+#if defined(__AVX2__)
+    // 32 keys per pass, 8 to a compare
+    __m256i needle = _mm256_set1_epi32(key);
+    for (; i + 32 <= end; i += 32) {
+        __m256i a = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(keys + i)), needle);
+        __m256i b = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(keys + i + 8)), needle);
+        __m256i c = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(keys + i + 16)), needle);
+        __m256i d = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(keys + i + 24)), needle);
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d))) != 0)
+            break;
+    }
+#elif defined(__SSE2__)
+    // 16 keys per pass, 4 to a compare
+    __m128i needle = _mm_set1_epi32(key);
+    for (; i + 16 <= end; i += 16) {
+        __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(keys + i)), needle);
+        __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(keys + i + 4)), needle);
+        __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(keys + i + 8)), needle);
+        __m128i d = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(keys + i + 12)), needle);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0)
+            break;
+    }
+#endif
+    // The block holding the match, and whatever is left over
+    for (; i < end; i++) {
+        if (keys[i] == key)
+            return i;
+    }
+    return end;
 }
 
 // Used when printing list, for testing purposes
@@ -91,40 +308,118 @@ static void List_print(List * pList) {
     printf("Current contents: ");
     while (temp != NULL) {
         printf("%p ", temp->item);
-        temp = temp->next;
+        temp = List_next_node(pList->pool, temp);
     }
     temp = NULL;
     printf("\n");
-    printf("Total nodes used: %d\n", totalNodeCount);
+    printf("Total nodes used: %d\n", pList->pool->totalNodeCount);
 }
 
 // END OF PRIVATE FUNCTIONS ---------
 
 
-// Makes a new, empty list, and returns its reference on success. 
-// Returns a NULL pointer on failure.
-List* List_create() {
+// Allocates the node and list pools of a ListPool with room for maxNodes nodes and maxLists lists.
+// Returns 0 on success, -1 on failure.
+int ListPool_init(ListPool* pool, unsigned int maxNodes, unsigned int maxLists) {
 
-    // If this is the FIRST list to be created, initialize the "unused" arrays
-    // Note that these index values should never change after this point
-    if ((totalListCount + listsFreed) == 0) {
-        for (int i = 0; i < LIST_MAX_NUM_NODES; i++) {
-            unusedNodes[i] = i;
-            nodePool[i].index = i;
-        }
-        for (int i = 0; i < LIST_MAX_NUM_HEADS; i++) {
-            unusedLists[i] = i;
-            listPool[i].index = i;
-        }
+    // Node links are 32-bit indices, with LIST_NIL reserved for the end of a list
+    if (maxNodes >= LIST_NIL)
+        return LIST_FAIL;
+
+    pool->maxNodes = maxNodes;
+    pool->maxLists = maxLists;
+    pool->totalNodeCount = 0;
+    pool->totalListCount = 0;
+    pool->listsFreed = 0;
+    pool->poolExhaustions = 0;
+    pool->nodesTouched = 0;
+    pool->id = atomic_fetch_add(&List_next_pool_id, 1);
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->nodePool = malloc(maxNodes * sizeof(Node));
+    pool->listPool = malloc(maxLists * sizeof(List));
+    pool->unusedLists = malloc(maxLists * sizeof(unsigned int));
+    pool->keys = malloc(maxNodes * sizeof(int32_t));
+    pool->caches = aligned_alloc(_Alignof(ListCache), LIST_CACHE_THREADS * sizeof(ListCache));
+
+    if (pool->nodePool == NULL || pool->listPool == NULL || pool->unusedLists == NULL || pool->keys == NULL
+        || pool->caches == NULL) {
+        ListPool_destroy(pool);
+        return LIST_FAIL;
     }
 
-    if (totalListCount < LIST_MAX_NUM_HEADS) {
-        List * newList = List_create_helper();
-        return newList;
+    // Chain every node into the free chain, in index order
+    for (unsigned int i = 0; i < maxNodes; i++) {
+        pool->nodePool[i].item = NULL;
+        pool->nodePool[i].next = i + 1 < maxNodes ? i + 1 : LIST_NIL;
+        pool->nodePool[i].prev = LIST_NIL;
+        pool->keys[i] = LIST_NO_KEY;
+    }
+    pool->freeNodes = maxNodes > 0 ? 0 : LIST_NIL;
+
+    for (unsigned int i = 0; i < LIST_CACHE_THREADS; i++) {
+        atomic_init(&pool->caches[i].owner, NULL);
+        pool->caches[i].head = LIST_NIL;
+        pool->caches[i].count = 0;
+        pool->caches[i].spare = LIST_NIL;
+        pool->caches[i].spareCount = 0;
+    }
+
+    // Initialize the "unused" list array
+    // Note that these index values should never change after this point
+    for (unsigned int i = 0; i < maxLists; i++) {
+        pool->unusedLists[i] = i;
+        pool->listPool[i].index = i;
     }
+    return LIST_SUCCESS;
+}
+
+// Releases the memory held by pool. Every list and node taken from it becomes invalid.
+void ListPool_destroy(ListPool* pool) {
+
+    free(pool->nodePool);
+    free(pool->listPool);
+    free(pool->unusedLists);
+    free(pool->keys);
+    free(pool->caches);
+    pthread_mutex_destroy(&pool->lock);
+    pool->nodePool = NULL;
+    pool->listPool = NULL;
+    pool->unusedLists = NULL;
+    pool->keys = NULL;
+    pool->caches = NULL;
+}
+
+// Hands the calling thread's cached nodes back to pool and gives up its cache.
+void ListPool_release_cache(ListPool* pool) {
+
+    ListCache * cache = List_thread_cache(pool);
+    List_memo_pool = 0;
+    List_memo_cache = NULL;
+    if (cache == NULL)
+        return;
+
+    if (cache->count > 0)
+        List_pool_put(pool, cache->head, cache->tail, cache->count);
+    if (cache->spare != LIST_NIL)
+        List_pool_put(pool, cache->spare, cache->spareTail, cache->spareCount);
+    cache->head = LIST_NIL;
+    cache->count = 0;
+    cache->spare = LIST_NIL;
+    cache->spareCount = 0;
+    atomic_store(&cache->owner, NULL);
+}
+
+// Makes a new, empty list in pool, and returns its reference on success. 
+// Returns a NULL pointer on failure.
+List* List_create(ListPool* pool) {
 
     // If we already have the max number of lists, return NULL
-    return NULL;
+    List * newList = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->totalListCount < pool->maxLists)
+        newList = List_create_helper(pool);
+    pthread_mutex_unlock(&pool->lock);
+    return newList;
 }
 
 // Returns the number of items in pList.
@@ -132,6 +427,46 @@ int List_count(List* pList) {
     return pList->itemCount;
 }
 
+// Returns the largest number of items pList has held since it was created.
+int List_peak(List* pList) {
+    return pList->peakCount;
+}
+
+// Returns the number of times a node was requested while pool's node pool was exhausted.
+unsigned long long List_pool_exhaustions(ListPool* pool) {
+
+    pthread_mutex_lock(&pool->lock);
+    unsigned long long exhaustions = pool->poolExhaustions;
+    pthread_mutex_unlock(&pool->lock);
+    return exhaustions;
+}
+
+// Returns the node after node in pList, NULL if node is the last.
+Node* List_node_next(List* pList, Node* node) {
+    return List_next_node(pList->pool, node);
+}
+
+// Gives pList's current item an integer search key. The key is dropped when the item is removed.
+void List_set_key(List* pList, int32_t key) {
+
+    if (pList->current != NULL) {
+        pList->pool->keys[List_node_index(pList->pool, pList->current)] = key;
+        pList->keyed = true;
+    }
+}
+
+// Returns a node of pool whose item has the given key, or NULL if there is none.
+Node* ListPool_find_key(ListPool* pool, int32_t key) {
+
+    if (key == LIST_NO_KEY)
+        return NULL;
+    pthread_mutex_lock(&pool->lock);
+    unsigned int touched = pool->nodesTouched;
+    pthread_mutex_unlock(&pool->lock);
+    unsigned int index = List_scan_keys(pool->keys, 0, touched, key);
+    return index < touched ? &pool->nodePool[index] : NULL;
+}
+
 // Returns a pointer to the first item in pList and makes the first item the current item.
 // Returns NULL and sets current item to NULL if list is empty.
 void* List_first(List* pList) {
@@ -182,7 +517,7 @@ void* List_next(List* pList) {
         return pList->current->item;
     }
 
-    pList->current = pList->current->next;
+    pList->current = List_next_node(pList->pool, pList->current);
     return pList->current->item;
 }
 
@@ -210,7 +545,7 @@ void* List_prev(List* pList) {
         return pList->current->item;
     }
 
-    pList->current = pList->current->prev;
+    pList->current = List_prev_node(pList->pool, pList->current);
     return pList->current->item;
 }
 
@@ -231,33 +566,33 @@ void* List_curr(List* pList) {
 int List_insert_after(List* pList, void* pItem) {
 
     // If the available nodes are exhausted
-    if (totalNodeCount == LIST_MAX_NUM_NODES)
+    Node * newNode = List_create_node(pList->pool);
+    if (newNode == NULL)
         return LIST_FAIL;
 
     // If the list is currently empty
     if (pList->itemCount == 0) {
-        List_insert_into_empty(pList, pItem);
+        List_insert_into_empty(pList, newNode, pItem);
         return LIST_SUCCESS;
     }
 
-    Node * newNode = List_create_node();
 
     // If the current node is at or beyond the end of the list...
     if (pList->current == pList->tail || (pList->current == NULL && pList->oob == LIST_OOB_END) ) {
         pList->current = newNode;
         pList->current->item = pItem;
-        pList->current->next = NULL;
-        pList->current->prev = pList->tail;
-        pList->tail->next = pList->current;
+        pList->current->next = LIST_NIL;
+        pList->current->prev = List_node_index(pList->pool, pList->tail);
+        pList->tail->next = List_node_index(pList->pool, pList->current);
         pList->tail = pList->current;
     }
     // If the current node is before the start of the list...
     else if (pList->current == NULL && pList->oob == LIST_OOB_START) {
         pList->current = newNode;
         pList->current->item = pItem;
-        pList->current->next = pList->head;
-        pList->current->prev = NULL;
-        pList->head->prev = pList->current;
+        pList->current->next = List_node_index(pList->pool, pList->head);
+        pList->current->prev = LIST_NIL;
+        pList->head->prev = List_node_index(pList->pool, pList->current);
         pList->head = pList->current;
     }
     // If the current node is none of the above...
@@ -266,13 +601,13 @@ int List_insert_after(List* pList, void* pItem) {
         pList->current = newNode;
         pList->current->item = pItem;
         pList->current->next = temp->next;
-        pList->current->prev = temp;
-        temp->next->prev = pList->current;
-        temp->next = pList->current;
+        pList->current->prev = List_node_index(pList->pool, temp);
+        List_next_node(pList->pool, temp)->prev = List_node_index(pList->pool, pList->current);
+        temp->next = List_node_index(pList->pool, pList->current);
         temp = NULL;
     }
 
-    pList->itemCount++;
+    List_count_up(pList);
     return LIST_SUCCESS;
 }
 
@@ -283,49 +618,49 @@ int List_insert_after(List* pList, void* pItem) {
 int List_insert_before(List* pList, void* pItem) {
     
     // If the available nodes are exhausted
-    if (totalNodeCount == LIST_MAX_NUM_NODES)
+    Node * newNode = List_create_node(pList->pool);
+    if (newNode == NULL)
         return LIST_FAIL;
 
     // If the list is currently empty
     if (pList->itemCount == 0) {
-        List_insert_into_empty(pList, pItem);
+        List_insert_into_empty(pList, newNode, pItem);
         return LIST_SUCCESS;
     }
 
-    Node * newNode = List_create_node();
 
     // If the current node is at or before the start of the list...
     if (pList->current == pList->head || (pList->current == NULL && pList->oob == LIST_OOB_START) ) {
         pList->current = newNode;
         pList->current->item = pItem;
-        pList->current->next = pList->head;
-        pList->current->prev = NULL;
-        pList->head->prev = pList->current;
+        pList->current->next = List_node_index(pList->pool, pList->head);
+        pList->current->prev = LIST_NIL;
+        pList->head->prev = List_node_index(pList->pool, pList->current);
         pList->head = pList->current;
     }
     // If the current node is after the end of the list...
     else if (pList->current == NULL && pList->oob == LIST_OOB_END) {
         pList->current = newNode;
         pList->current->item = pItem;
-        pList->current->next = NULL;
-        pList->current->prev = pList->tail;
-        pList->tail->next = pList->current;
+        pList->current->next = LIST_NIL;
+        pList->current->prev = List_node_index(pList->pool, pList->tail);
+        pList->tail->next = List_node_index(pList->pool, pList->current);
         pList->tail = pList->current;
     }
     // If the current node is none of the above...
     else {
         Node * temp = pList->current;
-        Node * tempPrev = pList->current->prev;
+        Node * tempPrev = List_prev_node(pList->pool, pList->current);
         pList->current = newNode;
         pList->current->item = pItem;
-        pList->current->next = temp;
+        pList->current->next = List_node_index(pList->pool, temp);
         pList->current->prev = temp->prev;
-        temp->prev->next = pList->current;
-        temp->prev = pList->current;
+        tempPrev->next = List_node_index(pList->pool, pList->current);
+        temp->prev = List_node_index(pList->pool, pList->current);
         temp = NULL;
     }
 
-    pList->itemCount++;
+    List_count_up(pList);
     return LIST_SUCCESS;
 }
 
@@ -334,27 +669,25 @@ int List_insert_before(List* pList, void* pItem) {
 int List_append(List* pList, void* pItem) {
     
     // If the node limit has been reached...
-    if (totalNodeCount == LIST_MAX_NUM_NODES) {
-        printf("Error: Max process limit reached\n");   // Specific to our PCB datatype
+    Node * newNode = List_create_node(pList->pool);
+    if (newNode == NULL)
         return LIST_FAIL;
-    }
 
 
     // If the list is empty...
     if (pList->itemCount == 0) {
-        List_insert_into_empty(pList, pItem);
+        List_insert_into_empty(pList, newNode, pItem);
         return LIST_SUCCESS;
     }
 
-    Node * newNode = List_create_node();
     pList->current = newNode;
     pList->current->item = pItem;
-    pList->current->next = NULL;
-    pList->current->prev = pList->tail;
-    pList->tail->next = pList->current;
+    pList->current->next = LIST_NIL;
+    pList->current->prev = List_node_index(pList->pool, pList->tail);
+    pList->tail->next = List_node_index(pList->pool, pList->current);
     pList->tail = pList->current;
 
-    pList->itemCount++;
+    List_count_up(pList);
     return LIST_SUCCESS;
 }
 
@@ -363,24 +696,82 @@ int List_append(List* pList, void* pItem) {
 int List_prepend(List* pList, void* pItem) {
 
     // If the node limit has been reached...
-    if (totalNodeCount == LIST_MAX_NUM_NODES)
+    Node * newNode = List_create_node(pList->pool);
+    if (newNode == NULL)
         return LIST_FAIL;
 
     // If the list is empty...
     if (pList->itemCount == 0) {
-        List_insert_into_empty(pList, pItem);
+        List_insert_into_empty(pList, newNode, pItem);
         return LIST_SUCCESS;
     }
 
-    Node * newNode = List_create_node();
     pList->current = newNode;
     pList->current->item = pItem;
-    pList->current->next = pList->head;
-    pList->current->prev = NULL;
-    pList->head->prev = pList->current;
+    pList->current->next = List_node_index(pList->pool, pList->head);
+    pList->current->prev = LIST_NIL;
+    pList->head->prev = List_node_index(pList->pool, pList->current);
     pList->head = pList->current;
 
-    pList->itemCount++;
+    List_count_up(pList);
+    return LIST_SUCCESS;
+}
+
+// Adds the n items of pItems to the end of pList, in order, and makes the last one current.
+// Returns 0 on success, -1 if the pool has fewer than n free nodes (nothing is added).
+int List_append_n(List* pList, void** pItems, int n) {
+
+    ListPool * pool = pList->pool;
+    if (n <= 0)
+        return n == 0 ? LIST_SUCCESS : LIST_FAIL;
+
+    // Top this thread's cache up to n nodes, from its spare and then from the free chain, all
+    //  under one lock
+    ListCache single = { .head = LIST_NIL, .count = 0, .spare = LIST_NIL };
+    ListCache * cache = List_thread_cache(pool);
+    if (cache == NULL)
+        cache = &single;
+    if (cache->count < (unsigned int)n && cache->spare != LIST_NIL)
+        List_cache_swap_in(cache, pool->nodePool);
+    if (cache->count < (unsigned int)n) {
+        unsigned int need = (unsigned int)n - cache->count;
+        pthread_mutex_lock(&pool->lock);
+        bool enough = pool->maxNodes - pool->totalNodeCount >= need;
+        if (enough)
+            List_cache_refill(pool, cache, need);
+        else
+            pool->poolExhaustions++;
+        pthread_mutex_unlock(&pool->lock);
+        if (!enough)
+            return LIST_FAIL;
+    }
+
+    // The first n nodes of the cache are already linked forwards in order, so only the items
+    //  and back links need filling in, and the chain cut after the last
+    uint32_t first = cache->head;
+    uint32_t index = first;
+    uint32_t prev = List_node_index(pool, pList->tail);
+    Node * node = NULL;
+    for (int i = 0; i < n; i++) {
+        node = &pool->nodePool[index];
+        node->item = pItems[i];
+        node->prev = prev;
+        prev = index;
+        index = node->next;
+    }
+    node->next = LIST_NIL;
+    cache->head = index;
+    cache->count -= n;
+
+    if (pList->tail != NULL)
+        pList->tail->next = first;
+    else
+        pList->head = &pool->nodePool[first];
+    pList->tail = node;
+    pList->current = node;
+    pList->itemCount += n;
+    if (pList->itemCount > pList->peakCount)
+        pList->peakCount = pList->itemCount;
     return LIST_SUCCESS;
 }
 
@@ -400,30 +791,30 @@ void* List_remove(List* pList) {
     if (pList->itemCount == 1) {
         pList->head = NULL;
         pList->tail = NULL;
-        List_free_node(pList->current);
+        List_free_node(pList->pool, pList->current);
     }
     // If the current node is the head
     else if (pList->current == pList->head) {
-        pList->head = pList->head->next;
-        pList->head->prev = NULL;
-        List_free_node(pList->current);
+        pList->head = List_next_node(pList->pool, pList->head);
+        pList->head->prev = LIST_NIL;
+        List_free_node(pList->pool, pList->current);
         pList->current = pList->head;
     }
     // If the current node is the tail
     else if (pList->current == pList->tail) {
-        pList->tail = pList->tail->prev;
-        pList->tail->next = NULL;
-        List_free_node(pList->current);
+        pList->tail = List_prev_node(pList->pool, pList->tail);
+        pList->tail->next = LIST_NIL;
+        List_free_node(pList->pool, pList->current);
         pList->oob = LIST_OOB_END;
         pList->current = NULL;
     }
     else {
-        Node * tempNext = pList->current->next;
-        Node * tempPrev = pList->current->prev;
-        tempPrev->next = tempNext;
-        List_free_node(pList->current);
+        Node * tempNext = List_next_node(pList->pool, pList->current);
+        Node * tempPrev = List_prev_node(pList->pool, pList->current);
+        tempPrev->next = List_node_index(pList->pool, tempNext);
+        List_free_node(pList->pool, pList->current);
         pList->current = tempNext;
-        pList->current->prev = tempPrev;
+        pList->current->prev = List_node_index(pList->pool, tempPrev);
     }
 
     pList->itemCount--;
@@ -445,12 +836,12 @@ void* List_trim(List* pList) {
     if (pList->itemCount == 1) {
         pList->head = NULL;
         pList->tail = NULL;
-        List_free_node(pList->current);
+        List_free_node(pList->pool, pList->current);
     }
     else {
-        pList->tail = pList->tail->prev;
-        pList->tail->next = NULL;
-        List_free_node(pList->current);
+        pList->tail = List_prev_node(pList->pool, pList->tail);
+        pList->tail->next = LIST_NIL;
+        List_free_node(pList->pool, pList->current);
         pList->current = pList->tail;
     }
 
@@ -458,6 +849,36 @@ void* List_trim(List* pList) {
     return tempItem;
 }
 
+// Take up to max items off the front of pList into pOut, in order, and hand their nodes back
+// to the pool as one chain. The new first item becomes current.
+// Returns the number of items taken.
+int List_drain(List* pList, void** pOut, int max) {
+
+    ListPool * pool = pList->pool;
+    int count = 0;
+    Node * last = NULL;
+    for (Node * node = pList->head; node != NULL && count < max; node = List_next_node(pool, node)) {
+        pOut[count++] = node->item;
+        if (pList->keyed)
+            pool->keys[List_node_index(pool, node)] = LIST_NO_KEY;
+        last = node;
+    }
+    if (count == 0)
+        return 0;
+
+    Node * first = pList->head;
+    pList->head = List_next_node(pool, last);
+    if (pList->head != NULL)
+        pList->head->prev = LIST_NIL;
+    else
+        pList->tail = NULL;
+    List_free_chain(pool, first, last, count);
+    pList->itemCount -= count;
+    pList->current = pList->head;
+    pList->oob = LIST_OOB_START;
+    return count;
+}
+
 // Adds pList2 to the end of pList1. The current pointer is set to the current pointer of pList1. 
 // pList2 no longer exists after the operation; its head is available
 // for future operations.
@@ -469,6 +890,9 @@ void List_concat(List* pList1, List* pList2) {
         pList1->tail = pList2->tail;
         pList1->itemCount = pList2->itemCount;
         pList1->oob = pList2->oob;
+        pList1->keyed = pList1->keyed || pList2->keyed;
+        if (pList1->itemCount > pList1->peakCount)
+            pList1->peakCount = pList1->itemCount;
         pList1 = pList2;
         List_free_helper(pList2);
         return;
@@ -479,14 +903,73 @@ void List_concat(List* pList1, List* pList2) {
         return;
     }
 
-    pList1->tail->next = pList2->head;
-    pList2->head->prev = pList1->tail;
+    pList1->tail->next = List_node_index(pList1->pool, pList2->head);
+    pList2->head->prev = List_node_index(pList1->pool, pList1->tail);
     pList1->tail = pList2->tail;
     pList1->itemCount += pList2->itemCount;
+    pList1->keyed = pList1->keyed || pList2->keyed;
+    if (pList1->itemCount > pList1->peakCount)
+        pList1->peakCount = pList1->itemCount;
 
     List_free_helper(pList2);
 }
 
+// Moves every item of pSrc to the end of pDest in O(1). pSrc is left empty but still exists.
+void List_splice(List* pDest, List* pSrc) {
+
+    if (pSrc->itemCount == 0)
+        return;
+    Node * current = pSrc->current;
+    enum ListOutOfBounds oob = pSrc->oob;
+    bool wasEmpty = pDest->itemCount == 0;
+    List_splice_range(pDest, pSrc, pSrc->head, pSrc->tail, pSrc->itemCount);
+    if (wasEmpty) {
+        pDest->current = current;
+        pDest->oob = oob;
+    }
+    pSrc->current = NULL;
+    pSrc->oob = LIST_OOB_START;
+}
+
+// Moves the count items of pSrc from pFirst to pLast to the end of pDest in O(1).
+void List_splice_range(List* pDest, List* pSrc, Node* pFirst, Node* pLast, int count) {
+
+    ListPool * pool = pSrc->pool;
+    Node * before = List_prev_node(pool, pFirst);
+    Node * after = List_next_node(pool, pLast);
+
+    // Close the gap in pSrc
+    if (before != NULL)
+        before->next = List_node_index(pool, after);
+    else
+        pSrc->head = after;
+    if (after != NULL)
+        after->prev = List_node_index(pool, before);
+    else
+        pSrc->tail = before;
+    pSrc->itemCount -= count;
+    pSrc->current = after;
+    if (after == NULL)
+        pSrc->oob = LIST_OOB_END;
+
+    // Link the range on after pDest's tail
+    pLast->next = LIST_NIL;
+    if (pDest->itemCount == 0) {
+        pFirst->prev = LIST_NIL;
+        pDest->head = pFirst;
+        pDest->current = pFirst;
+    }
+    else {
+        pFirst->prev = List_node_index(pool, pDest->tail);
+        pDest->tail->next = List_node_index(pool, pFirst);
+    }
+    pDest->tail = pLast;
+    pDest->itemCount += count;
+    pDest->keyed = pDest->keyed || pSrc->keyed;
+    if (pDest->itemCount > pDest->peakCount)
+        pDest->peakCount = pDest->itemCount;
+}
+
 // Delete pList. pItemFreeFn is a pointer to a routine that frees an item. 
 // It should be invoked (within List_free) as: (*pItemFreeFn)(itemToBeFreedFromNode);
 // pList and all its nodes no longer exists after the operation; its head and nodes are 
@@ -496,13 +979,15 @@ void List_free(List* pList, FREE_FN pItemFreeFn) {
 
     // If the list is not empty...
     if (pList->itemCount != 0) {
-        // Free all nodes
-        pList->current = pList->head;
-        while (pList->current != NULL) {
-            (*pItemFreeFn)(pList->current->item);
-            List_remove(pList);
-            pList->current = pList->head;
+        // Free the items and drop the keys, then hand all the nodes back at once
+        if (pItemFreeFn != NULL || pList->keyed) {
+            for (Node * node = pList->head; node != NULL; node = List_next_node(pList->pool, node)) {
+                if (pItemFreeFn != NULL)
+                    (*pItemFreeFn)(node->item);
+                pList->pool->keys[List_node_index(pList->pool, node)] = LIST_NO_KEY;
+            }
         }
+        List_free_chain(pList->pool, pList->head, pList->tail, pList->itemCount);
     }
     List_free_helper(pList);
 }
@@ -534,11 +1019,10 @@ void* List_search(List* pList, COMPARATOR_FN pComparator, void* pComparisonArg)
 
     while (pList->current != NULL) {
         // Check for a match
-        printf("Comparing...\n");
         if (pComparator(pList->current->item, pComparisonArg) == true)
             return pList->current->item;
         // If no match, advance
-        pList->current = pList->current->next;
+        pList->current = List_next_node(pList->pool, pList->current);
     }
 
     // If we reach the end of the list with no match...
@@ -0,0 +1,337 @@
+#include "Metrics.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *waitKindNames[METRICS_NUM_WAIT_KINDS] = { "send", "reply", "sem", "io", "disk", "child" };
+static const char *signalNames[METRICS_NUM_SIGNALS] = { "kill", "term", "stop", "cont", "usr" };
+
+
+int Metrics_add_queue(Metrics *metrics, const char *name, int length, int peak) {
+
+    if (metrics->num_queues >= METRICS_MAX_QUEUES) {
+        metrics->queues_dropped++;
+        return -1;
+    }
+
+    MetricsQueue *queue = &metrics->queues[metrics->num_queues];
+    strncpy(queue->name, name, METRICS_QUEUE_NAME_LEN - 1);
+    queue->name[METRICS_QUEUE_NAME_LEN - 1] = '\0';
+    queue->length = length;
+    queue->peak = peak;
+    metrics->num_queues++;
+    return 0;
+}
+
+void Metrics_print(Metrics *metrics, FILE *out) {
+
+    fprintf(out, "    Virtual clock:      %llu\n", (unsigned long long)metrics->clock);
+    fprintf(out, "    Creates:            %llu\n", (unsigned long long)metrics->creates);
+    fprintf(out, "    Forks:              %llu\n", (unsigned long long)metrics->forks);
+    fprintf(out, "    Kills:              %llu\n", (unsigned long long)metrics->kills);
+    fprintf(out, "    Zombies:            %llu (%llu reaped, %llu orphans reparented)\n", (unsigned long long)metrics->zombies,
+            (unsigned long long)metrics->reaps, (unsigned long long)metrics->reparents);
+    fprintf(out, "    Process groups:     %u\n", metrics->groups);
+    for (int i = 0; i < METRICS_NUM_SIGNALS; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "Signals (%s):", signalNames[i]);
+        fprintf(out, "    %-20s%llu\n", label, (unsigned long long)metrics->signals[i]);
+    }
+    fprintf(out, "    Signals handled:    %llu\n", (unsigned long long)metrics->signals_handled);
+    fprintf(out, "    Context switches:   %llu\n", (unsigned long long)metrics->context_switches);
+    for (int i = 0; i < METRICS_NUM_WAIT_KINDS; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "Blocks (%s):", waitKindNames[i]);
+        fprintf(out, "    %-20s%llu\n", label, (unsigned long long)metrics->blocks[i]);
+    }
+    fprintf(out, "    Send slot busy:     %llu\n", (unsigned long long)metrics->send_slot_busy);
+    fprintf(out, "    Pool exhaustions:   %llu\n", (unsigned long long)metrics->pool_exhaustions);
+    fprintf(out, "    Page accesses:      %llu\n", (unsigned long long)metrics->page_accesses);
+    fprintf(out, "    Page faults:        %llu\n", (unsigned long long)metrics->page_faults);
+    fprintf(out, "    Free frames:        %u of %u\n", metrics->frames_free, metrics->frames_total);
+    fprintf(out, "    Largest free block: %u frames\n", metrics->frames_largest_free);
+    fprintf(out, "    Page replacement:   %s\n", metrics->replacement);
+    fprintf(out, "    Evictions:          %llu (%llu dirty)\n",
+            (unsigned long long)metrics->evictions, (unsigned long long)metrics->dirty_evictions);
+    fprintf(out, "    COW faults:         %llu (%llu copied)\n",
+            (unsigned long long)metrics->cow_faults, (unsigned long long)metrics->cow_copies);
+    fprintf(out, "    Fork-shared pages:  %llu (%u frames saved now)\n",
+            (unsigned long long)metrics->fork_shared, metrics->frames_saved);
+    if (metrics->page_accesses > 0) {
+        fprintf(out, "    Page hit ratio:     %.4f\n",
+                1.0 - (double)metrics->page_faults / (double)metrics->page_accesses);
+    }
+    if (metrics->clock > 0) {
+        fprintf(out, "    Faults/1000 ticks:  %.2f\n", 1000.0 * (double)metrics->page_faults / (double)metrics->clock);
+    }
+    fprintf(out, "    I/O scheduler:      %s\n", metrics->io_sched);
+    fprintf(out, "    Disk requests:      %llu reads, %llu writes (%llu blocks)\n",
+            (unsigned long long)metrics->disk_reads, (unsigned long long)metrics->disk_writes,
+            (unsigned long long)(metrics->disk_blocks_read + metrics->disk_blocks_written));
+    if (metrics->disk_reads + metrics->disk_writes > 0) {
+        fprintf(out, "    Disk seek distance: %.1f blocks/request\n",
+                (double)metrics->disk_seek_blocks / (double)(metrics->disk_reads + metrics->disk_writes));
+        fprintf(out, "    Deadline expiries:  %llu\n", (unsigned long long)metrics->disk_expired);
+    }
+    if (metrics->clock > 0) {
+        fprintf(out, "    Disk utilization:   %.4f\n", (double)metrics->disk_busy_ticks / (double)metrics->clock);
+        fprintf(out, "    Disk throughput:    %.2f blocks/1000 ticks\n",
+                1000.0 * (double)(metrics->disk_blocks_read + metrics->disk_blocks_written) / (double)metrics->clock);
+    }
+    fprintf(out, "    Page cache:         %u of %u pages, %u dirty (%s)\n",
+            metrics->cache_resident, metrics->cache_capacity, metrics->cache_dirty, metrics->cache_policy);
+    if (metrics->cache_hits + metrics->cache_misses > 0) {
+        fprintf(out, "    Cache hit ratio:    %.4f (%llu ghost hits)\n",
+                (double)metrics->cache_hits / (double)(metrics->cache_hits + metrics->cache_misses),
+                (unsigned long long)metrics->cache_ghost_hits);
+    }
+    if (metrics->cache_writebacks > 0) {
+        fprintf(out, "    Cache write-backs:  %llu (%.2f blocks each)\n", (unsigned long long)metrics->cache_writebacks,
+                (double)metrics->cache_writeback_blocks / (double)metrics->cache_writebacks);
+    }
+    fprintf(out, "    Writes absorbed:    %llu overwrites, %llu throttled\n",
+            (unsigned long long)metrics->cache_overwrites, (unsigned long long)metrics->cache_throttled);
+    fprintf(out, "    Swap:               %u of %u slots used\n", metrics->swap_used, metrics->swap_slots);
+    fprintf(out, "    Swap pages:         %llu out, %llu in (%llu dropped, swap full)\n",
+            (unsigned long long)metrics->swap_outs, (unsigned long long)metrics->swap_ins,
+            (unsigned long long)metrics->swap_full);
+    fprintf(out, "    Processes swapped:  %llu out, %llu in\n",
+            (unsigned long long)metrics->swap_process_outs, (unsigned long long)metrics->swap_process_ins);
+    if (metrics->clock > 0) {
+        fprintf(out, "    Swap utilization:   %.4f\n", (double)metrics->swap_busy_ticks / (double)metrics->clock);
+    }
+    for (int i = 0; i < metrics->num_queues; i++) {
+        fprintf(out, "    Queue %-14s length %i, peak %i\n",
+                metrics->queues[i].name, metrics->queues[i].length, metrics->queues[i].peak);
+    }
+    if (metrics->queues_dropped > 0) {
+        fprintf(out, "    Queues not shown:   %i (more than %i gauges)\n", metrics->queues_dropped, METRICS_MAX_QUEUES);
+    }
+}
+
+int Metrics_write_prometheus(Metrics *metrics, const char *path) {
+
+    char tmpPath[4096];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) >= (int)sizeof(tmpPath))
+        return -1;
+
+    FILE *out = fopen(tmpPath, "w");
+    if (out == NULL)
+        return -1;
+
+    fprintf(out, "# HELP kernelsim_virtual_clock_ticks Virtual clock of the simulator.\n");
+    fprintf(out, "# TYPE kernelsim_virtual_clock_ticks counter\n");
+    fprintf(out, "kernelsim_virtual_clock_ticks %llu\n", (unsigned long long)metrics->clock);
+
+    fprintf(out, "# HELP kernelsim_creates_total Processes created.\n");
+    fprintf(out, "# TYPE kernelsim_creates_total counter\n");
+    fprintf(out, "kernelsim_creates_total %llu\n", (unsigned long long)metrics->creates);
+
+    fprintf(out, "# HELP kernelsim_forks_total Processes forked.\n");
+    fprintf(out, "# TYPE kernelsim_forks_total counter\n");
+    fprintf(out, "kernelsim_forks_total %llu\n", (unsigned long long)metrics->forks);
+
+    fprintf(out, "# HELP kernelsim_kills_total Processes killed or exited.\n");
+    fprintf(out, "# TYPE kernelsim_kills_total counter\n");
+    fprintf(out, "kernelsim_kills_total %llu\n", (unsigned long long)metrics->kills);
+
+    fprintf(out, "# HELP kernelsim_zombies Exited processes not yet waited for by their parents.\n");
+    fprintf(out, "# TYPE kernelsim_zombies gauge\n");
+    fprintf(out, "kernelsim_zombies %llu\n", (unsigned long long)metrics->zombies);
+
+    fprintf(out, "# HELP kernelsim_reaps_total Zombies freed by a parent's wait or by init.\n");
+    fprintf(out, "# TYPE kernelsim_reaps_total counter\n");
+    fprintf(out, "kernelsim_reaps_total %llu\n", (unsigned long long)metrics->reaps);
+
+    fprintf(out, "# HELP kernelsim_reparents_total Live children handed to init when their parent exited.\n");
+    fprintf(out, "# TYPE kernelsim_reparents_total counter\n");
+    fprintf(out, "kernelsim_reparents_total %llu\n", (unsigned long long)metrics->reparents);
+
+    fprintf(out, "# HELP kernelsim_process_groups Process groups with members.\n");
+    fprintf(out, "# TYPE kernelsim_process_groups gauge\n");
+    fprintf(out, "kernelsim_process_groups %u\n", metrics->groups);
+
+    fprintf(out, "# HELP kernelsim_signals_total Signals delivered to a process, by signal.\n");
+    fprintf(out, "# TYPE kernelsim_signals_total counter\n");
+    for (int i = 0; i < METRICS_NUM_SIGNALS; i++) {
+        fprintf(out, "kernelsim_signals_total{signal=\"%s\"} %llu\n",
+                signalNames[i], (unsigned long long)metrics->signals[i]);
+    }
+
+    fprintf(out, "# HELP kernelsim_signals_handled_total User signals handled by their processes.\n");
+    fprintf(out, "# TYPE kernelsim_signals_handled_total counter\n");
+    fprintf(out, "kernelsim_signals_handled_total %llu\n", (unsigned long long)metrics->signals_handled);
+
+    fprintf(out, "# HELP kernelsim_context_switches_total Switches of the running process.\n");
+    fprintf(out, "# TYPE kernelsim_context_switches_total counter\n");
+    fprintf(out, "kernelsim_context_switches_total %llu\n", (unsigned long long)metrics->context_switches);
+
+    fprintf(out, "# HELP kernelsim_blocks_total Processes blocked, by wait kind.\n");
+    fprintf(out, "# TYPE kernelsim_blocks_total counter\n");
+    for (int i = 0; i < METRICS_NUM_WAIT_KINDS; i++) {
+        fprintf(out, "kernelsim_blocks_total{kind=\"%s\"} %llu\n",
+                waitKindNames[i], (unsigned long long)metrics->blocks[i]);
+    }
+
+    fprintf(out, "# HELP kernelsim_send_slot_busy_total Sends failed because the target already held a message.\n");
+    fprintf(out, "# TYPE kernelsim_send_slot_busy_total counter\n");
+    fprintf(out, "kernelsim_send_slot_busy_total %llu\n", (unsigned long long)metrics->send_slot_busy);
+
+    fprintf(out, "# HELP kernelsim_pool_exhaustions_total Node requests made while the list node pool was full.\n");
+    fprintf(out, "# TYPE kernelsim_pool_exhaustions_total counter\n");
+    fprintf(out, "kernelsim_pool_exhaustions_total %llu\n", (unsigned long long)metrics->pool_exhaustions);
+
+    fprintf(out, "# HELP kernelsim_page_accesses_total Simulated memory accesses.\n");
+    fprintf(out, "# TYPE kernelsim_page_accesses_total counter\n");
+    fprintf(out, "kernelsim_page_accesses_total %llu\n", (unsigned long long)metrics->page_accesses);
+
+    fprintf(out, "# HELP kernelsim_page_faults_total Accesses to pages that were not resident.\n");
+    fprintf(out, "# TYPE kernelsim_page_faults_total counter\n");
+    fprintf(out, "kernelsim_page_faults_total %llu\n", (unsigned long long)metrics->page_faults);
+
+    fprintf(out, "# HELP kernelsim_frames_free Physical frames not holding a page.\n");
+    fprintf(out, "# TYPE kernelsim_frames_free gauge\n");
+    fprintf(out, "kernelsim_frames_free %u\n", metrics->frames_free);
+
+    fprintf(out, "# HELP kernelsim_frames_largest_free_block Frames in the largest free buddy block.\n");
+    fprintf(out, "# TYPE kernelsim_frames_largest_free_block gauge\n");
+    fprintf(out, "kernelsim_frames_largest_free_block %u\n", metrics->frames_largest_free);
+
+    fprintf(out, "# HELP kernelsim_frames_total Physical frames.\n");
+    fprintf(out, "# TYPE kernelsim_frames_total gauge\n");
+    fprintf(out, "kernelsim_frames_total %u\n", metrics->frames_total);
+
+    fprintf(out, "# HELP kernelsim_page_evictions_total Resident pages evicted to make room for a faulting page.\n");
+    fprintf(out, "# TYPE kernelsim_page_evictions_total counter\n");
+    fprintf(out, "kernelsim_page_evictions_total %llu\n", (unsigned long long)metrics->evictions);
+
+    fprintf(out, "# HELP kernelsim_page_dirty_evictions_total Evicted pages that had been written to.\n");
+    fprintf(out, "# TYPE kernelsim_page_dirty_evictions_total counter\n");
+    fprintf(out, "kernelsim_page_dirty_evictions_total %llu\n", (unsigned long long)metrics->dirty_evictions);
+
+    fprintf(out, "# HELP kernelsim_cow_faults_total Writes to pages shared since a fork.\n");
+    fprintf(out, "# TYPE kernelsim_cow_faults_total counter\n");
+    fprintf(out, "kernelsim_cow_faults_total %llu\n", (unsigned long long)metrics->cow_faults);
+
+    fprintf(out, "# HELP kernelsim_cow_copies_total Copy-on-write faults that copied the page.\n");
+    fprintf(out, "# TYPE kernelsim_cow_copies_total counter\n");
+    fprintf(out, "kernelsim_cow_copies_total %llu\n", (unsigned long long)metrics->cow_copies);
+
+    fprintf(out, "# HELP kernelsim_fork_shared_pages_total Pages shared by fork instead of copied.\n");
+    fprintf(out, "# TYPE kernelsim_fork_shared_pages_total counter\n");
+    fprintf(out, "kernelsim_fork_shared_pages_total %llu\n", (unsigned long long)metrics->fork_shared);
+
+    fprintf(out, "# HELP kernelsim_frames_saved Frames that copies of the still-shared pages would take.\n");
+    fprintf(out, "# TYPE kernelsim_frames_saved gauge\n");
+    fprintf(out, "kernelsim_frames_saved %u\n", metrics->frames_saved);
+
+    fprintf(out, "# HELP kernelsim_disk_requests_total Completed disk requests.\n");
+    fprintf(out, "# TYPE kernelsim_disk_requests_total counter\n");
+    fprintf(out, "kernelsim_disk_requests_total{op=\"read\"} %llu\n", (unsigned long long)metrics->disk_reads);
+    fprintf(out, "kernelsim_disk_requests_total{op=\"write\"} %llu\n", (unsigned long long)metrics->disk_writes);
+
+    fprintf(out, "# HELP kernelsim_disk_blocks_total Blocks transferred by completed disk requests.\n");
+    fprintf(out, "# TYPE kernelsim_disk_blocks_total counter\n");
+    fprintf(out, "kernelsim_disk_blocks_total{op=\"read\"} %llu\n", (unsigned long long)metrics->disk_blocks_read);
+    fprintf(out, "kernelsim_disk_blocks_total{op=\"write\"} %llu\n", (unsigned long long)metrics->disk_blocks_written);
+
+    fprintf(out, "# HELP kernelsim_disk_busy_ticks_total Virtual time the disk spent serving requests.\n");
+    fprintf(out, "# TYPE kernelsim_disk_busy_ticks_total counter\n");
+    fprintf(out, "kernelsim_disk_busy_ticks_total %llu\n", (unsigned long long)metrics->disk_busy_ticks);
+
+    fprintf(out, "# HELP kernelsim_disk_seek_blocks_total Distance moved by the disk head.\n");
+    fprintf(out, "# TYPE kernelsim_disk_seek_blocks_total counter\n");
+    fprintf(out, "kernelsim_disk_seek_blocks_total %llu\n", (unsigned long long)metrics->disk_seek_blocks);
+
+    fprintf(out, "# HELP kernelsim_disk_deadline_expired_total Requests served first because their deadline had passed.\n");
+    fprintf(out, "# TYPE kernelsim_disk_deadline_expired_total counter\n");
+    fprintf(out, "kernelsim_disk_deadline_expired_total %llu\n", (unsigned long long)metrics->disk_expired);
+
+    fprintf(out, "# HELP kernelsim_io_scheduler_info I/O scheduler of the disk.\n");
+    fprintf(out, "# TYPE kernelsim_io_scheduler_info gauge\n");
+    fprintf(out, "kernelsim_io_scheduler_info{scheduler=\"%s\"} 1\n", metrics->io_sched);
+
+    fprintf(out, "# HELP kernelsim_cache_lookups_total Blocks read through the page cache.\n");
+    fprintf(out, "# TYPE kernelsim_cache_lookups_total counter\n");
+    fprintf(out, "kernelsim_cache_lookups_total{result=\"hit\"} %llu\n", (unsigned long long)metrics->cache_hits);
+    fprintf(out, "kernelsim_cache_lookups_total{result=\"miss\"} %llu\n", (unsigned long long)metrics->cache_misses);
+
+    fprintf(out, "# HELP kernelsim_cache_ghost_hits_total Misses on pages the 2q ghost list remembered.\n");
+    fprintf(out, "# TYPE kernelsim_cache_ghost_hits_total counter\n");
+    fprintf(out, "kernelsim_cache_ghost_hits_total %llu\n", (unsigned long long)metrics->cache_ghost_hits);
+
+    fprintf(out, "# HELP kernelsim_cache_pages Pages in the page cache.\n");
+    fprintf(out, "# TYPE kernelsim_cache_pages gauge\n");
+    fprintf(out, "kernelsim_cache_pages{state=\"resident\"} %u\n", metrics->cache_resident);
+    fprintf(out, "kernelsim_cache_pages{state=\"dirty\"} %u\n", metrics->cache_dirty);
+    fprintf(out, "kernelsim_cache_pages{state=\"capacity\"} %u\n", metrics->cache_capacity);
+
+    fprintf(out, "# HELP kernelsim_cache_evictions_total Clean pages evicted from the page cache.\n");
+    fprintf(out, "# TYPE kernelsim_cache_evictions_total counter\n");
+    fprintf(out, "kernelsim_cache_evictions_total %llu\n", (unsigned long long)metrics->cache_evictions);
+
+    fprintf(out, "# HELP kernelsim_cache_overwrites_total Block writes absorbed by pages that were already dirty.\n");
+    fprintf(out, "# TYPE kernelsim_cache_overwrites_total counter\n");
+    fprintf(out, "kernelsim_cache_overwrites_total %llu\n", (unsigned long long)metrics->cache_overwrites);
+
+    fprintf(out, "# HELP kernelsim_cache_throttled_writes_total Writes the page cache did not absorb, which went through to the disk.\n");
+    fprintf(out, "# TYPE kernelsim_cache_throttled_writes_total counter\n");
+    fprintf(out, "kernelsim_cache_throttled_writes_total %llu\n", (unsigned long long)metrics->cache_throttled);
+
+    fprintf(out, "# HELP kernelsim_cache_writebacks_total Batched write-backs of dirty pages.\n");
+    fprintf(out, "# TYPE kernelsim_cache_writebacks_total counter\n");
+    fprintf(out, "kernelsim_cache_writebacks_total %llu\n", (unsigned long long)metrics->cache_writebacks);
+
+    fprintf(out, "# HELP kernelsim_cache_writeback_blocks_total Blocks written back by the page cache.\n");
+    fprintf(out, "# TYPE kernelsim_cache_writeback_blocks_total counter\n");
+    fprintf(out, "kernelsim_cache_writeback_blocks_total %llu\n", (unsigned long long)metrics->cache_writeback_blocks);
+
+    fprintf(out, "# HELP kernelsim_swap_slots Slots of the swap area.\n");
+    fprintf(out, "# TYPE kernelsim_swap_slots gauge\n");
+    fprintf(out, "kernelsim_swap_slots{state=\"used\"} %u\n", metrics->swap_used);
+    fprintf(out, "kernelsim_swap_slots{state=\"capacity\"} %u\n", metrics->swap_slots);
+
+    fprintf(out, "# HELP kernelsim_swap_pages_total Pages written to and read back from swap.\n");
+    fprintf(out, "# TYPE kernelsim_swap_pages_total counter\n");
+    fprintf(out, "kernelsim_swap_pages_total{op=\"out\"} %llu\n", (unsigned long long)metrics->swap_outs);
+    fprintf(out, "kernelsim_swap_pages_total{op=\"in\"} %llu\n", (unsigned long long)metrics->swap_ins);
+
+    fprintf(out, "# HELP kernelsim_swap_full_total Dirty pages dropped because no swap slot was free.\n");
+    fprintf(out, "# TYPE kernelsim_swap_full_total counter\n");
+    fprintf(out, "kernelsim_swap_full_total %llu\n", (unsigned long long)metrics->swap_full);
+
+    fprintf(out, "# HELP kernelsim_swap_busy_ticks_total Virtual time the swap device spent on transfers.\n");
+    fprintf(out, "# TYPE kernelsim_swap_busy_ticks_total counter\n");
+    fprintf(out, "kernelsim_swap_busy_ticks_total %llu\n", (unsigned long long)metrics->swap_busy_ticks);
+
+    fprintf(out, "# HELP kernelsim_process_swaps_total Whole processes swapped out and back in by load control.\n");
+    fprintf(out, "# TYPE kernelsim_process_swaps_total counter\n");
+    fprintf(out, "kernelsim_process_swaps_total{op=\"out\"} %llu\n", (unsigned long long)metrics->swap_process_outs);
+    fprintf(out, "kernelsim_process_swaps_total{op=\"in\"} %llu\n", (unsigned long long)metrics->swap_process_ins);
+
+    fprintf(out, "# HELP kernelsim_page_replacement_info Page replacement policy.\n");
+    fprintf(out, "# TYPE kernelsim_page_replacement_info gauge\n");
+    fprintf(out, "kernelsim_page_replacement_info{policy=\"%s\"} 1\n", metrics->replacement);
+
+    fprintf(out, "# HELP kernelsim_queue_length Current number of processes on a queue.\n");
+    fprintf(out, "# TYPE kernelsim_queue_length gauge\n");
+    for (int i = 0; i < metrics->num_queues; i++) {
+        fprintf(out, "kernelsim_queue_length{queue=\"%s\"} %i\n",
+                metrics->queues[i].name, metrics->queues[i].length);
+    }
+
+    fprintf(out, "# HELP kernelsim_queue_peak_length Largest number of processes a queue has held.\n");
+    fprintf(out, "# TYPE kernelsim_queue_peak_length gauge\n");
+    for (int i = 0; i < metrics->num_queues; i++) {
+        fprintf(out, "kernelsim_queue_peak_length{queue=\"%s\"} %i\n",
+                metrics->queues[i].name, metrics->queues[i].peak);
+    }
+
+    if (fclose(out) != 0)
+        return -1;
+
+    // Replace the old dump in one step
+    if (rename(tmpPath, path) != 0)
+        return -1;
+
+    return 0;
+}
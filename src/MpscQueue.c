@@ -0,0 +1,66 @@
+#include "MpscQueue.h"
+
+
+// Make an empty queue.
+void MpscQueue_init(MpscQueue *q) {
+
+    atomic_init(&q->stub.next, NULL);
+    atomic_init(&q->tail, &q->stub);
+    q->head = &q->stub;
+}
+
+// Add node to the end of q.
+void MpscQueue_push(MpscQueue *q, MpscNode *node) {
+
+    // Once node is the tail, the next push links on after it, so it must already end the queue
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    MpscNode *prev = atomic_exchange_explicit(&q->tail, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+// Take the node at the front of q. Returns NULL if q is empty or the next push is unfinished.
+MpscNode* MpscQueue_pop(MpscQueue *q) {
+
+    MpscNode *head = q->head;
+    MpscNode *next = atomic_load_explicit(&head->next, memory_order_acquire);
+
+    // Step over the stub
+    if (head == &q->stub) {
+        if (next == NULL)
+            return NULL;
+        q->head = next;
+        head = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        q->head = next;
+        return head;
+    }
+
+    // head looks like the last node. If it is not the tail, a push after it is half done.
+    if (head != atomic_load_explicit(&q->tail, memory_order_acquire))
+        return NULL;
+
+    // head is the last node: push the stub behind it so head can be taken without leaving the
+    //  queue with no node at all
+    MpscQueue_push(q, &q->stub);
+    next = atomic_load_explicit(&head->next, memory_order_acquire);
+    if (next != NULL) {
+        q->head = next;
+        return head;
+    }
+    return NULL;
+}
+
+// Take up to max nodes off the front of q into out, in order. Returns the number taken.
+int MpscQueue_drain(MpscQueue *q, MpscNode **out, int max) {
+
+    int count = 0;
+    while (count < max) {
+        MpscNode *node = MpscQueue_pop(q);
+        if (node == NULL)
+            break;
+        out[count++] = node;
+    }
+    return count;
+}
@@ -11,71 +11,91 @@ Description: An operating system simulation which supports a few basic OS comman
 
 
 #include "PCB.h"
+#include "Checkpoint.h"
+#include "Replacement.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdarg.h>
 
-static PCB *CURRENT = NULL;
-static PCB *INIT = NULL;
-static unsigned int PID_CURR = 0;
-static bool initMade = false;
-static unsigned int SEM_NUM = 0;
-static int proc_count = 0;
-static bool exit_loop = false;
+// Print to the kernel's output stream. A kernel without one runs silently.
+static void kprintf(Kernel *k, const char *format, ...) {
 
-static sem_t sem_array[NUM_SEMAPHORE]; 
-static List * ready_lists[NUM_READY_LIST];      // 0 - high priority, 1 - normal priority, 2 - low priority
-static List * waiting_lists[NUM_WAITING_LIST];  // 0 - waiting for send, 1 - waiting for reply
+    if (k->out == NULL)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(k->out, format, args);
+    va_end(args);
+}
 
 // Create a process and put it on the appropriate ready queue.
 // Reports: success or failure, the pid of created process on success.
-int create(int priority) {
+int create(Kernel *k, int priority) {
 
     // Check that the given priority is valid
-    if (priority < 0 || priority > 2 && initMade == true) {
+    if (priority < 0 || priority >= k->config.num_priorities && k->initMade == true) {
         return -1;
     }
 
-    PCB *newPCB = malloc(sizeof(PCB));
-    // If allocation fails
+    PCB *newPCB = allocProcess(k);
     if (newPCB == NULL) {
-        printf("Error: Memory allocation failed\n");
         return -1;
     }
 
     // Set member variables
-    newPCB->pid = PID_CURR;
-    PID_CURR++;
+    newPCB->pid = k->pid_curr;
+    k->pid_curr++;
+    newPCB->mem.family = (uint32_t)newPCB->pid;
     newPCB->priority = priority;
     newPCB->waitState = 2;
-    newPCB->msg_src = -1;
+
+    // A created process leads a new process group
+    ProcGroup *group = Kernel_find_group(k, newPCB->pid, true);
+    if (group == NULL) {
+        kprintf(k, "Error: Memory allocation failed\n");
+        freeProcess(newPCB);
+        return -1;
+    }
+    Kernel_join_group(group, newPCB);
 
     // If there are no processes currently running
-    if (CURRENT == NULL) {
+    if (k->current == NULL) {
         newPCB->state = RUNNING;
-        CURRENT = newPCB;
+        k->current = newPCB;
     }
     // If the currently running process is the init process
-    else if (CURRENT->priority == 3) {
-        INIT->state = READY;
+    else if (k->current == k->init) {
+        k->init->state = READY;
         newPCB->state = RUNNING;
-        if(List_append(ready_lists[CURRENT->priority], CURRENT) != -1) {
-            CURRENT = newPCB;
+        if(enqueue(k->ready_lists[k->current->priority], k->current) != -1) {
+            k->current = newPCB;
+            k->metrics.context_switches++;
         }
         else {
+            kprintf(k, "Error: Max process limit reached\n");
+            leaveGroup(k, newPCB);
+            freeProcess(newPCB);
             return -1;
         }
     }
     else {
         newPCB->state = READY;
-        if(List_append(ready_lists[newPCB->priority], newPCB) == -1) {
+        newPCB->ready_time = k->sim_time;
+        if(enqueue(k->ready_lists[newPCB->priority], newPCB) == -1) {
+            kprintf(k, "Error: Max process limit reached\n");
+            leaveGroup(k, newPCB);
+            freeProcess(newPCB);
             return -1;
         }
     }
 
     // Return pid of the created process
-    proc_count++;
+    linkChild(k->init, newPCB);
+    k->proc_count++;
+    k->metrics.creates++;
     return newPCB->pid;
 }
 
@@ -83,177 +103,353 @@ int create(int priority) {
 // original process' priority. Attempting to Fork the "init" process (see below) should fail.
 // Reports: Success or failure, the pid of the resulting process on success.
 // Returns -1 on failure, the pid on success
-int fork() {
+int fork_proc(Kernel *k) {
     
-    if (CURRENT == NULL || CURRENT->pid == 0) {
-        printf("Error: Cannot fork the init process\n");
+    if (k->current == NULL || k->current->pid == 0) {
+        kprintf(k, "Error: Cannot fork the init process\n");
         return -1;
     }
 
     // Create the new process
-    PCB *newPCB = malloc(sizeof(PCB));
-    newPCB->pid = PID_CURR;
-    PID_CURR++;
-    newPCB->priority = CURRENT->priority;
+    PCB *newPCB = allocProcess(k);
+    if (newPCB == NULL) {
+        return -1;
+    }
+
+    // The child shares every page of the parent until one of them writes to it
+    if (AddressSpace_fork(&newPCB->mem, &k->current->mem) == -1) {
+        kprintf(k, "Error: Memory allocation failed\n");
+        freeProcess(newPCB);
+        return -1;
+    }
+    newPCB->pid = k->pid_curr;
+    k->pid_curr++;
+    newPCB->priority = k->current->priority;
     newPCB->state = READY;
-    newPCB->waitState = CURRENT->waitState;
+    newPCB->waitState = k->current->waitState;
+    newPCB->ready_time = k->sim_time;
 
     // Enqueue the new process
-    if(List_append(ready_lists[newPCB->priority], newPCB) == -1) {
+    if(enqueue(k->ready_lists[newPCB->priority], newPCB) == -1) {
+        kprintf(k, "Error: Max process limit reached\n");
+        freeProcess(newPCB);
         return -1;
     }
     else {
-        proc_count++;
+        linkChild(k->current, newPCB);
+        if (k->current->group != NULL) {
+            Kernel_join_group(k->current->group, newPCB);
+        }
+        k->proc_count++;
+        k->metrics.forks++;
         return newPCB->pid;  
     }
 }
 
-// Kill the named process and remove it from the system.
-// Reports: Action taken as well as success or failure.
-int kill(int pid) {
-
-    PCB *toKill = NULL;
+// Create count processes at once, spliced onto the ready queue in one operation.
+// Reports: Nothing per process, only failure.
+// Returns the number created, their pids consecutive from *first; -1 if none could be.
+int create_n(Kernel *k, int priority, int count, int *first) {
 
-    // If user is requesting to kill the init process
-    if (pid == INIT->pid) {
-        if(proc_count == 1) {
-            // call exit
-            printf("Init process killed \n");
-            exit_sim();
-            return 1;
-        }
-        printf("Error: Cannot kill init process\n");
+    if (priority < 0 || priority >= k->config.num_priorities || count < 1) {
+        return -1;
+    }
+    List *batch = List_create(&k->pool);
+    if (batch == NULL) {
+        kprintf(k, "Error: Max process limit reached\n");
         return -1;
     }
 
-    if (CURRENT != NULL) {
-        // If we are requesting to kill the current process
-        if (CURRENT->pid == pid) {
-            toKill = CURRENT;
-            CURRENT = nextProcess();
-            freeProcess(toKill);
-            printf("Process %i killed\n", pid);
-            proc_count--;
-            return 1;
+    *first = k->pid_curr;
+    int made;
+    for (made = 0; made < count; made++) {
+        PCB *process = allocProcess(k);
+        if (process == NULL)
+            break;
+        process->pid = k->pid_curr;
+        k->pid_curr++;
+        process->mem.family = (uint32_t)process->pid;
+        process->priority = priority;
+        process->waitState = 2;
+
+        ProcGroup *group = Kernel_find_group(k, process->pid, true);
+        if (group == NULL) {
+            kprintf(k, "Error: Memory allocation failed\n");
+            freeProcess(process);
+            break;
+        }
+        Kernel_join_group(group, process);
+
+        // Only the first can take over from init
+        if (k->current == k->init) {
+            if (enqueue(k->ready_lists[k->config.num_priorities], k->init) == LIST_FAIL) {
+                kprintf(k, "Error: Max process limit reached\n");
+                leaveGroup(k, process);
+                freeProcess(process);
+                break;
+            }
+            k->init->state = READY;
+            process->state = RUNNING;
+            k->current = process;
+            k->metrics.context_switches++;
         }
+        else {
+            process->state = READY;
+            process->ready_time = k->sim_time;
+            if (enqueue(batch, process) == LIST_FAIL) {
+                kprintf(k, "Error: Max process limit reached\n");
+                leaveGroup(k, process);
+                freeProcess(process);
+                break;
+            }
+        }
+        linkChild(k->init, process);
     }
 
-    toKill = findProcess(pid); // Find the desired process. The list's "current" node is to be removed now
+    List_concat(k->ready_lists[priority], batch);
+    k->proc_count += made;
+    k->metrics.creates += made;
+    return made > 0 ? made : -1;
+}
+
+// Fork the running process count times, splicing the children onto its ready queue at once.
+// Reports: Nothing per process, only failure.
+// Returns the number forked, their pids consecutive from *first; -1 if none could be.
+int fork_n(Kernel *k, int count, int *first) {
 
-    if (toKill != NULL) {
-        // If the process is on a ready queue 
-        if (toKill->state == READY) {
-            List_remove(ready_lists[toKill->priority]);
-            freeProcess(toKill);
-        // If the process is on a waiting queue
-        } else {
-            // If the process is waiting on a send
-            if (toKill->waitState == WAITING_SEND) {
-                List_remove(waiting_lists[0]);
-                freeProcess(toKill);
-            }
-            else if (toKill->waitState == WAITING_REPLY) {
-                List_remove(waiting_lists[1]);
-                freeProcess(toKill);
-            }
-            // If the process is on a semaphore list
-            else {
-                for (int i = 0; i < 5; i++) {
-                    if(sem_array[i].sem_init == true) {
-                        if(List_curr(sem_array[i].pList) == toKill) {
-                            List_remove(sem_array[i].pList);
-                            freeProcess(toKill);
-                            sem_array[i].sem_value++;
-                            break;
-                        }
-                    }
-                }
-            }
+    if (k->current == NULL || k->current->pid == 0) {
+        kprintf(k, "Error: Cannot fork the init process\n");
+        return -1;
+    }
+    if (count < 1) {
+        return -1;
+    }
+    List *batch = List_create(&k->pool);
+    if (batch == NULL) {
+        kprintf(k, "Error: Max process limit reached\n");
+        return -1;
+    }
+
+    PCB *parent = k->current;
+    *first = k->pid_curr;
+    int made;
+    for (made = 0; made < count; made++) {
+        PCB *process = allocProcess(k);
+        if (process == NULL)
+            break;
+        if (AddressSpace_fork(&process->mem, &parent->mem) == -1) {
+            kprintf(k, "Error: Memory allocation failed\n");
+            freeProcess(process);
+            break;
+        }
+        process->pid = k->pid_curr;
+        k->pid_curr++;
+        process->priority = parent->priority;
+        process->state = READY;
+        process->waitState = parent->waitState;
+        process->ready_time = k->sim_time;
+        if (enqueue(batch, process) == LIST_FAIL) {
+            kprintf(k, "Error: Max process limit reached\n");
+            freeProcess(process);
+            break;
+        }
+        linkChild(parent, process);
+        if (parent->group != NULL) {
+            Kernel_join_group(parent->group, process);
         }
-        printf("Process %i killed\n", pid);
-        proc_count--;
-        return 1;
     }
 
-    // If we reach this line, process removal has failed
-    printf("Error: PCB not found\n");
-    return -1;
+    List_concat(k->ready_lists[parent->priority], batch);
+    k->proc_count += made;
+    k->metrics.forks += made;
+    return made > 0 ? made : -1;
+}
+
+// Kill the named process and remove it from the system.
+// Reports: Action taken as well as success or failure.
+int kill_proc(Kernel *k, int pid) {
+    return killProcess(k, pid, EXIT_KILLED);
 }
 
 // Kill the currently running process.
 // Reports: Process scheduling information (which process now gets control of the cpu).
-void exit_proc() {
+void exit_proc(Kernel *k) {
+
+    if (k->current != NULL) {
+        killProcess(k, k->current->pid, 0);
+    }
+}
+
+// Wait for a child of the running process to exit.
+// Reports: The child reaped and its exit status, or that the process blocked.
+// Returns the pid of the reaped child, 0 if the process blocked, -1 on failure.
+int wait_proc(Kernel *k) {
+
+    if (k->current == NULL || k->current == k->init) {
+        kprintf(k, "Error: The init process cannot wait\n");
+        return -1;
+    }
+
+    // A child that has exited already is reaped without blocking
+    PCB *process = k->current;
+    if (process->zombies != NULL) {
+        return reapChild(k, process, process->zombies);
+    }
+    if (process->children == NULL) {
+        kprintf(k, "Error: Process has no children\n");
+        return -1;
+    }
+
+    if (enqueue(k->wait_list, process) == LIST_FAIL) {
+        kprintf(k, "Error: Max process limit reached\n");
+        return -1;
+    }
+    process->state = BLOCKED;
+    process->waitState = WAITING_CHILD;
+    process->block_time = k->sim_time;
+    k->metrics.blocks[WAITING_CHILD]++;
+    kprintf(k, "Waiting for a child to exit, blocking process: \n");
+    procinfo_helper(k, process);
+
+    k->current = nextProcess(k);
+    return 0;
+}
+
+// Send a signal to a process, or to each member of a process group.
+// Reports: What the signal did to each process.
+// Returns the number of processes it took effect on, -1 on failure.
+int signal_proc(Kernel *k, int pid, enum Signal signal) {
+
+    if (Kernel_signal_name(signal) == NULL) {
+        kprintf(k, "Error: Not a valid signal\n");
+        return -1;
+    }
+    if (pid == 0) {
+        kprintf(k, "Error: Cannot signal the init process\n");
+        return -1;
+    }
+
+    if (pid > 0) {
+        PCB *process = Kernel_find_process(k, pid);
+        if (process == NULL) {
+            kprintf(k, "Error: PCB not found\n");
+            return -1;
+        }
+        return deliverSignal(k, process, signal) ? 1 : 0;
+    }
+
+    ProcGroup *group = Kernel_find_group(k, -pid, false);
+    if (group == NULL) {
+        kprintf(k, "Error: Process group not found\n");
+        return -1;
+    }
+
+    // A member killed by the signal leaves the group, and the last one frees it, so the next
+    //  member is taken before delivering
+    int delivered = 0;
+    PCB *next;
+    for (PCB *process = group->members; process != NULL; process = next) {
+        next = process->group_next;
+        if (deliverSignal(k, process, signal)) {
+            delivered++;
+        }
+    }
+    return delivered;
+}
+
+// Move a process into a process group, making the group if pgid is its own pid.
+// Reports: Success or failure.
+int setpgid_proc(Kernel *k, int pid, int pgid) {
+
+    if (pid == 0) {
+        kprintf(k, "Error: The init process has no process group\n");
+        return -1;
+    }
+    PCB *process = Kernel_find_process(k, pid);
+    if (process == NULL) {
+        kprintf(k, "Error: PCB not found\n");
+        return -1;
+    }
+    if (pgid < 1) {
+        kprintf(k, "Error: Invalid process group ID\n");
+        return -1;
+    }
 
-    if (CURRENT != NULL) {
-        kill(CURRENT->pid);
+    ProcGroup *group = Kernel_find_group(k, pgid, pgid == pid);
+    if (group == NULL) {
+        kprintf(k, pgid == pid ? "Error: Memory allocation failed\n" : "Error: Process group not found\n");
+        return -1;
     }
+    if (group != process->group) {
+        leaveGroup(k, process);
+        Kernel_join_group(group, process);
+    }
+    return 1;
 }
 
 // Time quantum of the running process expires.
 // Reports: Action taken (process scheduling information).
-void quantum() {
+void quantum(Kernel *k) {
     
-    if(CURRENT == INIT) {
-        printf("--New Current Process: \n");
-        procinfo_helper(CURRENT);
+    if(k->current == k->init) {
+        kprintf(k, "--New Current Process: \n");
+        procinfo_helper(k, k->current);
         return;
     }
 
-    CURRENT->state = READY;
-    printf("--Expired process: \n");
-    procinfo_helper(CURRENT);
+    k->current->state = READY;
+    kprintf(k, "--Expired process: \n");
+    procinfo_helper(k, k->current);
 
-    if (proc_count == 2 || readyListEmpty()) {
-        CURRENT->state = RUNNING;
-        printf("--New Current Process: \n");
-        procinfo_helper(CURRENT);
+    if (k->proc_count == 2 || readyListEmpty(k)) {
+        k->current->state = RUNNING;
+        kprintf(k, "--New Current Process: \n");
+        procinfo_helper(k, k->current);
         return;
     }
 
     // Find the next process to run, remove it from the appropriate queue
-    PCB *temp = nextProcess();
-
-    // Remove the new process from the appropriate queue
-    findProcess(temp->pid);
-    List_remove(ready_lists[temp->priority]);
+    PCB *temp = nextProcess(k);
 
     // Enqueue the current process to the appropriate queue, change to the new process
-    List_append(ready_lists[CURRENT->priority], CURRENT);
-    CURRENT = temp;
+    k->current->ready_time = k->sim_time;
+    enqueue(k->ready_lists[k->current->priority], k->current);
+    k->current = temp;
 
 }
 
 // Send a message to another process, block until reply.
 // Reports: success or failure, scheduling information, and reply source and text (once
 //  reply arrives).
-int send(int pid, char *msg) {
+int send_msg(Kernel *k, int pid, char *msg) {
     
     // If we try to send to the currently running process, operation fails
-    if (CURRENT->pid == pid) {
-        printf("Error: Cannot send to currently running process\n");
+    if (k->current->pid == pid) {
+        kprintf(k, "Error: Cannot send to currently running process\n");
         return -1;
     }
 
     // Look for the target
-    PCB* target = findProcess(pid);
+    PCB* target = findProcess(k, pid);
     if (target == NULL) {
-        printf("Error: PCB not found\n");
+        kprintf(k, "Error: PCB not found\n");
         return -1;
     }
 
     // If the target already has a message queued
-    if (target->proc_message != NULL) {
-        printf("Error: Target already has a message queued\n");
+    if (target->mail != NULL && target->mail->proc_message != NULL) {
+        kprintf(k, "Error: Target already has a message queued\n");
+        k->metrics.send_slot_busy++;
         return -1;
     }
 
     // We must not block the init process
-    if (target->state != BLOCKED && CURRENT == INIT) {
-        printf("Error: Cannot block the init process\n");
+    if (target->state != BLOCKED && k->current == k->init) {
+        kprintf(k, "Error: Cannot block the init process\n");
         return -1;
     }
-    else if (target->state == BLOCKED && target->waitState != WAITING_SEND && CURRENT == INIT) {
-        printf("Error: Cannot block the init process\n");
+    else if (target->state == BLOCKED && target->waitState != WAITING_SEND && k->current == k->init) {
+        kprintf(k, "Error: Cannot block the init process\n");
         return -1;
     }
 
@@ -263,34 +459,45 @@ int send(int pid, char *msg) {
         if (target->waitState == WAITING_SEND) {
             
             // Give the target process the message
-            target->proc_message = strdup(msg);
-            target->msg_src = CURRENT->pid;
+            Mailbox *mail = Kernel_open_mailbox(target);
+            if (mail == NULL) {
+                kprintf(k, "Error: Memory allocation failed\n");
+                return -1;
+            }
+            mail->proc_message = strdup(msg);
+            mail->msg_src = k->current->pid;
             target->state = READY;
+            target->ready_time = k->sim_time;
+            Histogram_record(&k->mailbox_hist, k->sim_time - target->block_time);
 
-            List_remove(waiting_lists[0]);  // Remove target process from the waiting queue (it is already waiting_list[1]'s current process)
-            if (List_append(ready_lists[target->priority], target) == -1) {
+            // Remove target process from the waiting queue
+            k->waiting_lists[0]->current = target->queue_node;
+            List_remove(k->waiting_lists[0]);
+            if (enqueue(k->ready_lists[target->priority], target) == -1) {
                 return -1;
             } 
 
             // If the currently running process is the init process, make the target the newly running process
-            if (CURRENT == INIT) {
-                dequeue(ready_lists[target->priority]);
+            if (k->current == k->init) {
+                dequeue(k->ready_lists[target->priority]);
                 target->state = RUNNING;
-                CURRENT = target;
+                k->current = target;
             }
 
             // Move the current process to waiting list
-            CURRENT->state = BLOCKED;
-            CURRENT->waitState = WAITING_REPLY;
-            if(List_append(waiting_lists[1], CURRENT) == -1) {
+            k->current->state = BLOCKED;
+            k->current->waitState = WAITING_REPLY;
+            k->current->block_time = k->sim_time;
+            k->metrics.blocks[WAITING_REPLY]++;
+            if(enqueue(k->waiting_lists[1], k->current) == -1) {
                 return -1;
             }
 
-            printf("--Blocking process: \n");
-            procinfo_helper(CURRENT);
+            kprintf(k, "--Blocking process: \n");
+            procinfo_helper(k, k->current);
                     
             // Run the next process in the queue
-            CURRENT = nextProcess();
+            k->current = nextProcess(k);
 
 
 
@@ -301,53 +508,62 @@ int send(int pid, char *msg) {
     }
     // If the target process is not blocked, or is waiting for a receive:
 
-    if (target->pid == CURRENT->msg_src) {
-        printf("Error: Target process is waiting for a receive from current process\n");
+    if (k->current->mail != NULL && target->pid == k->current->mail->msg_src) {
+        kprintf(k, "Error: Target process is waiting for a receive from current process\n");
+        return -1;
+    }
+
+    Mailbox *mail = Kernel_open_mailbox(target);
+    if (mail == NULL) {
+        kprintf(k, "Error: Memory allocation failed\n");
         return -1;
     }
 
     // Move the current process to waiting list
-    CURRENT->state = BLOCKED;
-    CURRENT->waitState = WAITING_REPLY;
-    if(List_append(waiting_lists[1], CURRENT) == -1) {
+    k->current->state = BLOCKED;
+    k->current->waitState = WAITING_REPLY;
+    k->current->block_time = k->sim_time;
+    k->metrics.blocks[WAITING_REPLY]++;
+    if(enqueue(k->waiting_lists[1], k->current) == -1) {
         return -1;
     }
 
     // Give the target process the message
-    target->proc_message = strdup(msg);
-    target->msg_src = CURRENT->pid;
+    mail->proc_message = strdup(msg);
+    mail->msg_src = k->current->pid;
 
-    printf("--Blocking process: \n");
-    procinfo_helper(CURRENT);
+    kprintf(k, "--Blocking process: \n");
+    procinfo_helper(k, k->current);
             
     // Run the next process in the queue
-    CURRENT = nextProcess();
+    k->current = nextProcess(k);
     
     return 1;
 }
 
 // Receive a message, block until one arrives
 // Reports: Scheduling information, message text, source of message.
-void receive() {
+void receive(Kernel *k) {
 
-    if (CURRENT == INIT) {
+    Mailbox *mail = k->current->mail;
+    if (k->current == k->init) {
         // We should never block the init process
-        if (CURRENT->proc_message == NULL) {
-            printf("Error: Cannot block the init process\n");
+        if (mail == NULL || mail->proc_message == NULL) {
+            kprintf(k, "Error: Cannot block the init process\n");
             return;
         }
     }
     
     // If the new process has a message, print it 
-    if (CURRENT->proc_message != NULL) {  
+    if (mail != NULL && mail->proc_message != NULL) {  
         
-        printf("Message received from process %i\n", CURRENT->msg_src);
-        printf("Received Message: %s\n", CURRENT->proc_message);
+        kprintf(k, "Message received from process %i\n", mail->msg_src);
+        kprintf(k, "Received Message: %s\n", mail->proc_message);
 
         // Clear the message information from the current process
-        free(CURRENT->proc_message);
-        CURRENT->proc_message = NULL;
-        CURRENT->msg_src = -1;
+        free(mail->proc_message);
+        mail->proc_message = NULL;
+        mail->msg_src = -1;
 
         return;
     }
@@ -355,15 +571,17 @@ void receive() {
     else {
         
         // Move current process to the waiting list
-        CURRENT->state = BLOCKED;
-        CURRENT->waitState = WAITING_SEND;
-        List_append(waiting_lists[0], CURRENT);
-        printf("--Blocking process: \n");
-        procinfo_helper(CURRENT);
+        k->current->state = BLOCKED;
+        k->current->waitState = WAITING_SEND;
+        k->current->block_time = k->sim_time;
+        k->metrics.blocks[WAITING_SEND]++;
+        enqueue(k->waiting_lists[0], k->current);
+        kprintf(k, "--Blocking process: \n");
+        procinfo_helper(k, k->current);
 
 
         // Run the next process in the queue
-        CURRENT = nextProcess();
+        k->current = nextProcess(k);
         
         return;
     }
@@ -371,47 +589,55 @@ void receive() {
 
 // Unblocks sender and delivers reply.
 // Reports: Success or failure.
-int reply(int pid, char *msg) {
+int reply(Kernel *k, int pid, char *msg) {
     
     // If we try to send to the currently running process, operation fails
-    if (CURRENT->pid == pid) {
-        printf("Error: Cannot reply to currently running process\n");
+    if (k->current->pid == pid) {
+        kprintf(k, "Error: Cannot reply to currently running process\n");
         return -1;
     }
 
     // Find the target in a list
-    PCB* target = findProcess(pid);
+    PCB* target = findProcess(k, pid);
     if(target == NULL) {
-        printf("Error: PCB not found\n");
+        kprintf(k, "Error: PCB not found\n");
         return -1;
     }
 
     // If the target already has a message queued
-    if (target->reply_msg != NULL) {
-        printf("Error: Target already has a message queued\n");
+    if (target->mail != NULL && target->mail->reply_msg != NULL) {
+        kprintf(k, "Error: Target already has a message queued\n");
         return -1;
     }
 
     // If the target has not been blocked by a send, we cannot reply to it
     if (target->state != BLOCKED || (target->state == BLOCKED && target->waitState != WAITING_REPLY)) {
-        printf("Error: Target is not waiting for a reply\n");
+        kprintf(k, "Error: Target is not waiting for a reply\n");
         return -1;
     }
 
     // If the target doesn't currently hold a message, reply with a message:
-    target->reply_msg = strdup(msg);
-    target->reply_src = CURRENT->pid;
+    Mailbox *mail = Kernel_open_mailbox(target);
+    if (mail == NULL) {
+        kprintf(k, "Error: Memory allocation failed\n");
+        return -1;
+    }
+    mail->reply_msg = strdup(msg);
+    mail->reply_src = k->current->pid;
         
     // Remove the target from the waiting list
-    List_remove(waiting_lists[1]);    
+    k->waiting_lists[1]->current = target->queue_node;
+    List_remove(k->waiting_lists[1]);
+    Histogram_record(&k->reply_hist, k->sim_time - target->block_time);
     target->state = READY;
-    if (List_append(ready_lists[target->priority], target) == -1) {
+    target->ready_time = k->sim_time;
+    if (enqueue(k->ready_lists[target->priority], target) == -1) {
         return -1;
     }
 
     // If the current process is the INIT process
-    if (CURRENT == INIT) {
-        CURRENT = nextProcess();
+    if (k->current == k->init) {
+        k->current = nextProcess(k);
     }
     
     // Return success
@@ -421,80 +647,89 @@ int reply(int pid, char *msg) {
 // Initialize the named semaphore with the value given. IDs can take a value from 0 to 4. 
 //  This can only be done once for a semaphore - subsequent attempts result in error.
 // Reports: Action taken as well as success or failure.
-int new_Sem(int sem_id, unsigned int init) {
+int new_Sem(Kernel *k, int sem_id, int init) {
 
     // Check for valid semaphore ID
     if (sem_id > 4 || sem_id < 0) {
-        printf("Error: Not a valid semaphore ID\n");
+        kprintf(k, "Error: Not a valid semaphore ID\n");
         return -1;
     }
     // Check that we have not created too many semaphores
-    if (SEM_NUM >= NUM_SEMAPHORE) {
-        printf("Error: Created too many semaphores\n");
+    if (k->sem_num >= NUM_SEMAPHORE) {
+        kprintf(k, "Error: Created too many semaphores\n");
         return -1;
     }
     // Check that we have not already created a semaphore with the given ID
-    if (sem_array[sem_id].pList != NULL) {
-        printf("Error: This semaphore has already been created!\n");
+    if (k->sem_array[sem_id].pList != NULL) {
+        kprintf(k, "Error: This semaphore has already been created!\n");
         return -1;
     }
     if (init < 0) {
-        printf("Error: Invalid initialization value\n");
+        kprintf(k, "Error: Invalid initialization value\n");
         return -1;
     }
 
-    sem_array[sem_id].sem_value = init;
-    sem_array[sem_id].sem_init = true;
-    sem_array[sem_id].pList = List_create();
-    SEM_NUM++;
+    List *waiting = List_create(&k->pool);
+    if (waiting == NULL) {
+        kprintf(k, "Error: Could not allocate the semaphore's waiting list\n");
+        return -1;
+    }
 
+    k->sem_array[sem_id].sem_value = init;
+    k->sem_array[sem_id].sem_init = true;
+    k->sem_array[sem_id].pList = waiting;
+    k->sem_num++;
+    return 1;
 }
 
 // Execute the semaphore P operation on behalf of the running process. Assume semaphore 
 //  IDs to be numbered 0 through 4.
 // Reports: Action taken (blocked or not) as well as success or failure.
-int sem_P(int sem_id) {
+int sem_P(Kernel *k, int sem_id) {
     
     // Check for valid semaphore ID
     if (sem_id > 4 || sem_id < 0) {
-        printf("Error: Invalid semaphore ID\n");
+        kprintf(k, "Error: Invalid semaphore ID\n");
         return -1;
     }
 
     // Check if semaphore has been created yet
-    if (sem_array[sem_id].pList == NULL) {
-        printf("Error: Semaphore has not been created yet\n");
+    if (k->sem_array[sem_id].pList == NULL) {
+        kprintf(k, "Error: Semaphore has not been created yet\n");
         return -1;
     }
 
     // Cannot block the init process
-    if (CURRENT == INIT) {
-        printf("Error: Cannot block the init process\n");
+    if (k->current == k->init) {
+        kprintf(k, "Error: Cannot block the init process\n");
         return -1;
     }
 
     // If sem value is greater than 0, decrement semaphore and return
-    if (sem_array[sem_id].sem_value > 0) {
-        sem_array[sem_id].sem_value--;
+    if (k->sem_array[sem_id].sem_value > 0) {
+        k->sem_array[sem_id].sem_value--;
         return 1;
     }
     else {
 
-        sem_array[sem_id].sem_value--;  // Decrement semaphore value
+        k->sem_array[sem_id].sem_value--;  // Decrement semaphore value
         
         // Update process information
-        CURRENT->waitState = WAITING_SEM;
-        CURRENT->state = BLOCKED;
+        k->current->waitState = WAITING_SEM;
+        k->current->sem_id = sem_id;
+        k->current->state = BLOCKED;
+        k->current->block_time = k->sim_time;
+        k->metrics.blocks[WAITING_SEM]++;
 
         // Add process to the waiting list of the semaphore
-        List_append(sem_array[sem_id].pList, CURRENT);
+        enqueue(k->sem_array[sem_id].pList, k->current);
 
         // Output action taken
-        printf("Blocking process: \n");
-        procinfo_helper(CURRENT);
+        kprintf(k, "Blocking process: \n");
+        procinfo_helper(k, k->current);
 
         // Run next process
-        CURRENT = nextProcess();
+        k->current = nextProcess(k);
 
         return 1;
     }
@@ -504,140 +739,495 @@ int sem_P(int sem_id) {
 // Execute the semaphore V operation on behalf of the running process. Assume semaphore 
 //  IDs to be numbered 0 through 4.
 // Reports: Action taken, as well as success or failure
-int sem_V(int sem_id) {
+int sem_V(Kernel *k, int sem_id) {
     
     // Check for valid semaphore ID
     if (sem_id > 4 || sem_id < 0) {
-        printf("Error: Invalid semaphore ID\n");
+        kprintf(k, "Error: Invalid semaphore ID\n");
         return -1;
     }
 
     // Check if semaphore has been created yet
-    if (sem_array[sem_id].pList == NULL) {
-        printf("Error: Semaphore has not been created yet\n");
+    if (k->sem_array[sem_id].pList == NULL) {
+        kprintf(k, "Error: Semaphore has not been created yet\n");
         return -1;
     }
 
     // Increment semaphore value
-    sem_array[sem_id].sem_value++;
+    k->sem_array[sem_id].sem_value++;
 
     // If there are processes waiting on this semaphore, unblock one process
-    if (sem_array[sem_id].sem_value <= 0) {
+    if (k->sem_array[sem_id].sem_value <= 0) {
         
-        PCB *temp = (PCB *)dequeue(sem_array[sem_id].pList);
+        PCB *temp = semWakeNext(k, k->sem_array[sem_id].pList);
+        if (temp == NULL) {
+            kprintf(k, "No processes waiting on this semaphore\n");
+            return 1;
+        }
+        Histogram_record(&k->sem_array[sem_id].wait_hist, k->sim_time - temp->block_time);
         temp->state = READY;
+        temp->ready_time = k->sim_time;
 
         
         // If the init process is currently running, set temp to running
-        if(CURRENT == INIT) {
-            INIT->state = READY;
+        if(k->current == k->init) {
+            k->init->state = READY;
             temp->state = RUNNING;
-            CURRENT = temp;
+            k->current = temp;
+            k->metrics.context_switches++;
         }
         // Else, send to appropriate queue
         else {
-            List_append(ready_lists[temp->priority], temp); 
+            enqueue(k->ready_lists[temp->priority], temp); 
         }
 
         // Output action taken
-        printf("Process unblocked: \n");
-        procinfo_helper(temp);
+        kprintf(k, "Process unblocked: \n");
+        procinfo_helper(k, temp);
 
         return 1;
     }
     // Otherwise there were no processes waiting on this semaphore
     else {
-        printf("No processes waiting on this semaphore\n");
+        kprintf(k, "No processes waiting on this semaphore\n");
         return 1;
     }
     
 }
 
+// Access count consecutive pages of the running process, starting at vaddr. A page that is
+//  not resident faults: the process blocks on the I/O queue until the page has been read in.
+// Reports: Pages accessed, and the fault if there was one.
+int access_mem(Kernel *k, uint32_t vaddr, int count, bool write) {
+
+    if (k->current == NULL || k->current == k->init) {
+        kprintf(k, "Error: The init process has no memory to access\n");
+        return -1;
+    }
+    if (count < 1) {
+        kprintf(k, "Error: Invalid number of pages\n");
+        return -1;
+    }
+
+    PCB *process = k->current;
+    int done;
+    for (done = 0; done < count; done++) {
+        uint32_t addr = vaddr + (uint32_t)done * VM_PAGE_SIZE;
+        k->metrics.page_accesses++;
+        if (!AddressSpace_access(&process->mem, addr, write)) {
+            if (pageFault(k, addr >> VM_PAGE_SHIFT, write) == -1) {
+                return -1;
+            }
+            break;
+        }
+    }
+    return done;
+}
+
+// Read or write count blocks of the disk starting at block, on behalf of the running process.
+//  The process blocks on the disk's wait queue until the I/O scheduler has served the request.
+// Reports: The request, and the process that runs next.
+int disk_io(Kernel *k, uint32_t block, int count, bool write) {
+
+    if (k->current == NULL || k->current == k->init) {
+        kprintf(k, "Error: Cannot block the init process\n");
+        return -1;
+    }
+    if (count < 1 || block >= k->disk.numBlocks || (uint32_t)count > k->disk.numBlocks - block) {
+        kprintf(k, "Error: Invalid disk range\n");
+        return -1;
+    }
+
+    if (submitDisk(k, block, (uint32_t)count, write, false) == -1)
+        return -1;
+
+    // The disk is written directly, so any cached copies of the blocks are stale
+    if (write) {
+        for (uint32_t b = block; b < block + (uint32_t)count; b++) {
+            PageCache_invalidate(&k->cache, b / PAGECACHE_FILE_BLOCKS, b % PAGECACHE_FILE_BLOCKS, 1);
+        }
+    }
+
+    kprintf(k, "Disk %s of %i blocks at %u, blocking process: \n", write ? "write" : "read", count, block);
+    procinfo_helper(k, k->current);
+
+    k->current = nextProcess(k);
+    return 1;
+}
+
+// Read or write count blocks of file starting at block, through the page cache, on behalf of
+//  the running process.
+int file_io(Kernel *k, int file, uint32_t block, int count, bool write) {
+
+    if (k->current == NULL || k->current == k->init) {
+        kprintf(k, "Error: Cannot block the init process\n");
+        return -1;
+    }
+    if (file < 0 || (uint32_t)file >= k->disk.numBlocks / PAGECACHE_FILE_BLOCKS || count < 1
+        || count > PAGECACHE_MAX_IO || block >= PAGECACHE_FILE_BLOCKS || (uint32_t)count > PAGECACHE_FILE_BLOCKS - block) {
+        kprintf(k, "Error: Invalid file range\n");
+        return -1;
+    }
+
+    uint32_t start = (uint32_t)file * PAGECACHE_FILE_BLOCKS;
+    if (write) {
+        if (PageCache_write(&k->cache, (uint32_t)file, block, (uint32_t)count, k->sim_time)) {
+            kprintf(k, "File write of %i blocks at %i:%u absorbed by the page cache\n", count, file, block);
+            return 0;
+        }
+        if (submitDisk(k, start + block, (uint32_t)count, true, false) == -1)
+            return -1;
+        kprintf(k, "File write of %i blocks at %i:%u throttled, writing through and blocking process: \n", count, file, block);
+    }
+    else {
+        uint32_t first, last;
+        uint32_t missing = PageCache_read(&k->cache, (uint32_t)file, block, (uint32_t)count, &first, &last);
+        if (missing == 0) {
+            kprintf(k, "File read of %i blocks at %i:%u served from the page cache\n", count, file, block);
+            return 0;
+        }
+        if (submitDisk(k, start + first, last - first + 1, false, true) == -1)
+            return -1;
+        kprintf(k, "File read of %i blocks at %i:%u missed %u, blocking process: \n", count, file, block, missing);
+    }
+    procinfo_helper(k, k->current);
+
+    k->current = nextProcess(k);
+    return 1;
+}
+
 // Dump complete state information of process to screen.
-void procinfo(int pid) {
+void procinfo(Kernel *k, int pid) {
 
-    printf("---PROCESS INFO---\n");
+    kprintf(k, "---PROCESS INFO---\n");
 
     PCB *temp = NULL;
 
     // Either the process is the currently running process, or it is stored in a list
-    if (CURRENT == NULL || CURRENT->pid != pid) {
-        temp = findProcess(pid);
-    } else if (CURRENT->pid == pid) {
-        temp = CURRENT;
+    if (k->current == NULL || k->current->pid != pid) {
+        temp = findProcess(k, pid);
+    } else if (k->current->pid == pid) {
+        temp = k->current;
     }
 
     if (temp != NULL) {
-        procinfo_helper(temp);
+        procinfo_helper(k, temp);
+        if (temp->parent != NULL) {
+            kprintf(k, "    Parent:             %i\n", temp->parent->pid);
+        }
+        kprintf(k, "    Children:           %u (%u exited)\n", temp->num_children + temp->num_zombies, temp->num_zombies);
+        if (temp->group != NULL) {
+            kprintf(k, "    Process group:      %i (%u members)\n", temp->group->pgid, temp->group->size);
+        }
+        if (temp->sig_pending != 0) {
+            kprintf(k, "    Pending signals:    %u\n", temp->sig_pending);
+        }
+        kprintf(k, "    Resident pages:     %u\n", temp->mem.rss);
+        kprintf(k, "    Page faults:        %llu\n", (unsigned long long)temp->mem.faults);
+        if (temp->kstack != VM_NO_FRAME) {
+            kprintf(k, "    Kernel stack:       frames %i-%i\n", temp->kstack, temp->kstack + (1 << temp->kstack_order) - 1);
+        }
+        if (temp->state == BLOCKED && temp->waitState == WAITING_DISK) {
+            kprintf(k, "    Disk request:       %s of %u blocks at %u%s\n", temp->disk.write ? "write" : "read", temp->disk.count,
+                    temp->disk.block, temp->disk.fill ? " (page cache fill)" : "");
+        }
+        if (temp->state == SWAPPED && temp->swap_done == 0) {
+            kprintf(k, "    Swapped out:        %u pages in swap\n", temp->swap_pages);
+        }
+        else if (temp->state == SWAPPED) {
+            kprintf(k, "    Swapping in:        ready at tick %llu\n", (unsigned long long)temp->swap_done);
+        }
     }
     else {
-        printf("Error: Process not found\n");
+        kprintf(k, "Error: Process not found\n");
     }
 }
 
 // Display all process queues and their contents
-void totalinfo() {
+void totalinfo(Kernel *k) {
     
-    printf("---TOTAL INFO---\n");
+    kprintf(k, "---TOTAL INFO---\n");
 
     // Display the currently running process
-    if (CURRENT != NULL) {
-        printf("--Current Process:\n");
-        procinfo_helper(CURRENT);
+    if (k->current != NULL) {
+        kprintf(k, "--Current Process:\n");
+        procinfo_helper(k, k->current);
     }
 
     // Display the ready lists
-    for (int i = 0; i <= 2; i++) {
-        List_first(ready_lists[i]);
-        printf("--Ready List %i:\n", i);
-        while (ready_lists[i]->current != NULL) {
+    for (int i = 0; i < k->config.num_priorities; i++) {
+        List_first(k->ready_lists[i]);
+        kprintf(k, "--Ready List %i:\n", i);
+        while (k->ready_lists[i]->current != NULL) {
             // Print process info
-            PCB *processPointer = ready_lists[i]->current->item;
-            procinfo_helper(processPointer);
+            PCB *processPointer = k->ready_lists[i]->current->item;
+            procinfo_helper(k, processPointer);
             // Advance
-            ready_lists[i]->current = ready_lists[i]->current->next;
+            k->ready_lists[i]->current = List_node_next(k->ready_lists[i], k->ready_lists[i]->current);
         }
     }
 
     // Display the waiting lists
     for (int i = 0; i <= 1; i++) {
-        List_first(waiting_lists[i]);
+        List_first(k->waiting_lists[i]);
 
         // For readability:
         if (i == 0) {
-            printf("--Waiting List for Send: \n");
+            kprintf(k, "--Waiting List for Send: \n");
         }
         else {
-            printf("--Waiting List for Reply: \n");
+            kprintf(k, "--Waiting List for Reply: \n");
         }
 
-        while (waiting_lists[i]->current != NULL) {
+        while (k->waiting_lists[i]->current != NULL) {
             // Print process info
-            PCB *processPointer = waiting_lists[i]->current->item;
-            procinfo_helper(processPointer);
+            PCB *processPointer = k->waiting_lists[i]->current->item;
+            procinfo_helper(k, processPointer);
             // Advance
-            waiting_lists[i]->current = waiting_lists[i]->current->next;
+            k->waiting_lists[i]->current = List_node_next(k->waiting_lists[i], k->waiting_lists[i]->current);
+        }
+    }
+
+    // Display the I/O waiting list
+    kprintf(k, "--Waiting List for I/O: \n");
+    for (PCB *processPointer = List_first(k->io_list); processPointer != NULL; processPointer = List_next(k->io_list)) {
+        procinfo_helper(k, processPointer);
+    }
+
+    // Display the disk wait queue, the request being served first
+    kprintf(k, "--Waiting List for Disk: \n");
+    if (k->disk.active != NULL) {
+        procinfo_helper(k, k->disk.active);
+    }
+    for (PCB *processPointer = List_first(k->disk.queue); processPointer != NULL; processPointer = List_next(k->disk.queue)) {
+        procinfo_helper(k, processPointer);
+    }
+
+    // Display the swapped out processes
+    kprintf(k, "--Swapped Out: \n");
+    for (PCB *processPointer = List_first(k->swap_list); processPointer != NULL; processPointer = List_next(k->swap_list)) {
+        procinfo_helper(k, processPointer);
+    }
+
+    // Display the processes waiting for a child
+    kprintf(k, "--Waiting List for Child: \n");
+    for (PCB *processPointer = List_first(k->wait_list); processPointer != NULL; processPointer = List_next(k->wait_list)) {
+        procinfo_helper(k, processPointer);
+    }
+
+    // Display the stopped processes
+    kprintf(k, "--Stopped: \n");
+    for (PCB *processPointer = List_first(k->stopped_list); processPointer != NULL; processPointer = List_next(k->stopped_list)) {
+        procinfo_helper(k, processPointer);
+    }
+
+    // Display the zombies, which are on no queue but their parents' lists
+    kprintf(k, "--Zombies: \n");
+    for (PCB *parent = k->init; parent != NULL; parent = Kernel_next_in_tree(k, parent)) {
+        for (PCB *processPointer = parent->zombies; processPointer != NULL; processPointer = processPointer->next_sibling) {
+            procinfo_helper(k, processPointer);
         }
     }
 
     // Display the semaphore lists
     for (int i = 0; i < 5; i++) {
-        if (sem_array[i].pList != NULL) {
+        if (k->sem_array[i].pList != NULL) {
             
-            List_first(sem_array[i].pList);
-            printf("--Semaphore List %i:\n", i);
-            while (sem_array[i].pList->current != NULL) {
+            List_first(k->sem_array[i].pList);
+            kprintf(k, "--Semaphore List %i:\n", i);
+            while (k->sem_array[i].pList->current != NULL) {
                 // Print process info
-                PCB *processPointer = sem_array[i].pList->current->item;
-                procinfo_helper(processPointer);
+                PCB *processPointer = k->sem_array[i].pList->current->item;
+                procinfo_helper(k, processPointer);
                 // Advance
-                sem_array[i].pList->current = sem_array[i].pList->current->next;
+                k->sem_array[i].pList->current = List_node_next(k->sem_array[i].pList, k->sem_array[i].pList->current);
             }
         }
     }
 
 }
 
+// Display the scheduling-latency and blocking-time histograms (times in virtual clock ticks)
+void histinfo(Kernel *k) {
+
+    kprintf(k, "---HISTOGRAM INFO--- (virtual clock: %llu ticks)\n", (unsigned long long)k->sim_time);
+    if (k->out == NULL)
+        return;
+    Histogram_print(&k->ready_hist, k->out);
+    Histogram_print(&k->reply_hist, k->out);
+    Histogram_print(&k->mailbox_hist, k->out);
+    for (int i = 0; i < NUM_SEMAPHORE; i++) {
+        if (k->sem_array[i].sem_init == true) {
+            Histogram_print(&k->sem_array[i].wait_hist, k->out);
+        }
+    }
+    if (k->disk.latency.count > 0) {
+        Histogram_print(&k->disk.latency, k->out);
+    }
+}
+
+// Display the kernel metrics counters and queue lengths
+void metricsinfo(Kernel *k) {
+
+    kprintf(k, "---METRICS INFO---\n");
+    if (k->out == NULL)
+        return;
+    snapshotMetrics(k);
+    Metrics_print(&k->metrics, k->out);
+}
+
+// Display free physical memory by buddy block order, and how fragmented it is
+void meminfo(Kernel *k) {
+
+    FrameTable *ft = &k->frames;
+    kprintf(k, "---MEMORY INFO---\n");
+    kprintf(k, "    Free frames:        %u of %u\n", ft->numFree, ft->numFrames);
+    kprintf(k, "    Order  Block size  Free blocks  Free frames\n");
+    int largest = FrameTable_largest_free_order(ft);
+    for (int order = 0; order <= largest; order++) {
+        kprintf(k, "    %5i  %10u  %11u  %11u\n", order, 1u << order, ft->freeBlocks[order], ft->freeBlocks[order] << order);
+    }
+    if (largest < 0) {
+        kprintf(k, "    No free frames\n");
+        return;
+    }
+
+    // External fragmentation: the share of free memory outside the largest free block, and
+    //  the share that cannot hold a kernel stack for a new process
+    unsigned int kstackOrder = 0;
+    while ((1u << kstackOrder) < k->config.kstack_pages) {
+        kstackOrder++;
+    }
+    unsigned int usable = 0;
+    for (int order = kstackOrder; order <= largest; order++) {
+        usable += ft->freeBlocks[order] << order;
+    }
+    kprintf(k, "    Largest free block: %u frames\n", 1u << largest);
+    kprintf(k, "    Fragmentation:      %.4f\n", 1.0 - (double)(1u << largest) / ft->numFree);
+    kprintf(k, "    Unusable for a %u-frame kernel stack: %.4f\n", 1u << kstackOrder, 1.0 - (double)usable / ft->numFree);
+}
+
+// Write the metrics in Prometheus text format to path every interval ticks, and at exit.
+void setMetricsFile(Kernel *k, const char *path, unsigned int interval) {
+    k->metrics_path = path;
+    k->metrics_interval = interval;
+}
+
+
+// Returns the process with the given pid, running or queued, or NULL if there is none
+PCB* Kernel_find_process(Kernel *k, int pid) {
+
+    if (k->current != NULL && k->current->pid == pid) {
+        return k->current;
+    }
+    return findProcess(k, pid);
+}
+
+PCB* Kernel_find_zombie(Kernel *k, int pid) {
+
+    for (PCB *parent = k->init; parent != NULL; parent = Kernel_next_in_tree(k, parent)) {
+        for (PCB *zombie = parent->zombies; zombie != NULL; zombie = zombie->next_sibling) {
+            if (zombie->pid == pid)
+                return zombie;
+        }
+    }
+    return NULL;
+}
+
+// The live process after process in a preorder walk of the process tree from init, NULL at the end
+PCB* Kernel_next_in_tree(Kernel *k, PCB *process) {
+
+    if (process->children != NULL) {
+        return process->children;
+    }
+    while (process != k->init && process->next_sibling == NULL) {
+        process = process->parent;
+    }
+    return process == k->init ? NULL : process->next_sibling;
+}
+
+// Process groups hash by pgid; pids are handed out in order, so the low bits spread them evenly
+ProcGroup* Kernel_find_group(Kernel *k, int pgid, bool create) {
+
+    for (ProcGroup *group = k->group_buckets[(unsigned int)pgid & k->group_mask]; group != NULL; group = group->hashNext) {
+        if (group->pgid == pgid)
+            return group;
+    }
+    if (!create)
+        return NULL;
+
+    // Keep the chains short by doubling the table once there are more groups than buckets
+    if (k->num_groups > k->group_mask) {
+        growGroups(k);
+    }
+    ProcGroup *group = calloc(1, sizeof(ProcGroup));
+    if (group == NULL)
+        return NULL;
+    group->pgid = pgid;
+    group->hashNext = k->group_buckets[(unsigned int)pgid & k->group_mask];
+    k->group_buckets[(unsigned int)pgid & k->group_mask] = group;
+    k->num_groups++;
+    return group;
+}
+
+void Kernel_join_group(ProcGroup *group, PCB *process) {
+
+    process->group = group;
+    process->group_prev = NULL;
+    process->group_next = group->members;
+    if (group->members != NULL) {
+        group->members->group_prev = process;
+    }
+    group->members = process;
+    group->size++;
+}
+
+const char* Kernel_signal_name(enum Signal signal) {
+
+    switch (signal) {
+        case SIGNAL_KILL:
+            return "kill";
+        case SIGNAL_TERM:
+            return "term";
+        case SIGNAL_STOP:
+            return "stop";
+        case SIGNAL_CONT:
+            return "cont";
+        case SIGNAL_USR:
+            return "usr";
+    }
+    return NULL;
+}
+
+PCB* Kernel_alloc_pcb(void) {
+
+    PCB *process = aligned_alloc(PCB_ALIGN, sizeof(PCB));
+    if (process != NULL)
+        memset(process, 0, sizeof(PCB));
+    return process;
+}
+
+Mailbox* Kernel_open_mailbox(PCB *process) {
+
+    if (process->mail == NULL && (process->mail = malloc(sizeof(Mailbox))) != NULL) {
+        process->mail->proc_message = NULL;
+        process->mail->msg_src = -1;
+        process->mail->reply_msg = NULL;
+        process->mail->reply_src = -1;
+    }
+    return process->mail;
+}
+
+void Kernel_free_mailbox(PCB *process) {
+
+    if (process->mail == NULL)
+        return;
+    free(process->mail->proc_message);
+    free(process->mail->reply_msg);
+    free(process->mail);
+    process->mail = NULL;
+}
+
 
 // PRIVATE FUNCTIONS
 
@@ -648,347 +1238,1453 @@ static void * dequeue(List * list) {
     return ret;
 }
 
-// Initialize all lists
-void initProgram(List * readyTop, List * readyNorm, List * readyLow, List * readyInit, List * waitingSend, List * waitingReceive) {
+// Fill in the default kernel configuration
+void KernelConfig_default(KernelConfig *config) {
+    config->num_priorities = NUM_READY_LIST;
+    config->quantum = 0;
+    config->sem_wake = SEM_WAKE_FIFO;
+    config->max_nodes = LIST_MAX_NUM_NODES;
+    config->num_frames = 4096;
+    config->fault_ticks = 5;
+    config->replacement = PAGE_REPLACE_CLOCK;
+    config->kstack_pages = 2;
+    config->disk_blocks = 65536;
+    config->io_sched = IO_SCHED_FIFO;
+    config->cache_pages = 1024;
+    config->cache_policy = CACHE_2Q;
+    config->swap_slots = 16384;
+    config->swap_ticks = 2;
+    config->load_control = true;
+}
 
-    ready_lists[0] = readyTop;
-    ready_lists[1] = readyNorm;
-    ready_lists[2] = readyLow;
-    ready_lists[3] = readyInit;
+// Allocate a kernel with its own list pool, queues and init process.
+// config may be NULL for the defaults. Commands are read from in and all reports are
+//  written to out (NULL for a silent kernel).
+// Returns NULL on failure or if the configuration is invalid.
+Kernel* Kernel_create(const KernelConfig *config, FILE *in, FILE *out) {
 
-    waiting_lists[0] = waitingSend;
-    waiting_lists[1] = waitingReceive;
+    Kernel *k = calloc(1, sizeof(Kernel));
+    if (k == NULL) {
+        return NULL;
+    }
+    if (config != NULL) {
+        k->config = *config;
+    }
+    else {
+        KernelConfig_default(&k->config);
+    }
+    if (k->config.num_priorities < 1 || k->config.num_priorities > MAX_READY_LIST || k->config.max_nodes == 0
+        || k->config.num_frames > (1u << (32 - PTE_FRAME_SHIFT)) || replacementPolicy(k->config.replacement) == NULL
+        || k->config.kstack_pages > (1u << VM_MAX_ORDER) || k->config.disk_blocks == 0
+        || BlockDev_sched_name(k->config.io_sched) == NULL || k->config.cache_pages < PAGECACHE_MIN_PAGES
+        || PageCache_policy_name(k->config.cache_policy) == NULL || k->config.swap_slots > VM_MAX_SWAP_SLOTS
+        || k->config.swap_ticks == 0) {
+        free(k);
+        return NULL;
+    }
+    k->in = in;
+    k->out = out;
+
+    // One list per ready queue, the init queue, the waiting queues, the I/O, disk, swap, wait
+    //  and stopped queues and each semaphore, and one to stage a burst of new processes on
+    if (ListPool_init(&k->pool, k->config.max_nodes, k->config.num_priorities + 1 + NUM_WAITING_LIST + 5 + NUM_SEMAPHORE + 1) == LIST_FAIL) {
+        free(k);
+        return NULL;
+    }
+    if (FrameTable_init(&k->frames, k->config.num_frames, replacementPolicy(k->config.replacement)) == -1) {
+        ListPool_destroy(&k->pool);
+        free(k);
+        return NULL;
+    }
+    if (FrameTable_init_swap(&k->frames, k->config.swap_slots) == -1) {
+        FrameTable_destroy(&k->frames);
+        ListPool_destroy(&k->pool);
+        free(k);
+        return NULL;
+    }
+    if (PageCache_init(&k->cache, k->config.cache_pages, k->config.cache_policy) == -1) {
+        FrameTable_destroy(&k->frames);
+        ListPool_destroy(&k->pool);
+        free(k);
+        return NULL;
+    }
+    k->group_buckets = calloc(PGROUP_MIN_BUCKETS, sizeof(ProcGroup *));
+    if (k->group_buckets == NULL) {
+        PageCache_destroy(&k->cache);
+        FrameTable_destroy(&k->frames);
+        ListPool_destroy(&k->pool);
+        free(k);
+        return NULL;
+    }
+    k->group_mask = PGROUP_MIN_BUCKETS - 1;
+
+    for (int i = 0; i <= k->config.num_priorities; i++) {
+        k->ready_lists[i] = List_create(&k->pool);
+    }
+    for (int i = 0; i < NUM_WAITING_LIST; i++) {
+        k->waiting_lists[i] = List_create(&k->pool);
+    }
+    k->io_list = List_create(&k->pool);
+    BlockDev_init(&k->disk, &k->pool, k->config.disk_blocks, k->config.io_sched);
+    k->swap_list = List_create(&k->pool);
+    k->wait_list = List_create(&k->pool);
+    k->stopped_list = List_create(&k->pool);
 
     for (int i = 0; i < 5; i++) {
-        sem_array[i].pList = NULL;    
-        sem_array[i].sem_init = false;
+        char name[HIST_NAME_LEN];
+        k->sem_array[i].pList = NULL;    
+        k->sem_array[i].sem_init = false;
+        snprintf(name, HIST_NAME_LEN, "sem %i wait", i);
+        Histogram_init(&k->sem_array[i].wait_hist, name);
     }
 
+    Histogram_init(&k->ready_hist, "ready->running");
+    Histogram_init(&k->reply_hist, "send->reply");
+    Histogram_init(&k->mailbox_hist, "mailbox wait");
+
     // Initialize the special init process
-    INIT = malloc(sizeof(PCB));
-    INIT->pid = PID_CURR;
-    PID_CURR++;
-    INIT->priority = 3;
-    INIT->state = RUNNING;
-    CURRENT = INIT;
-    initMade = true;
-    proc_count++;
-    exit_loop = false;
+    k->init = Kernel_alloc_pcb();
+    if (k->init == NULL) {
+        free(k->group_buckets);
+        PageCache_destroy(&k->cache);
+        FrameTable_destroy(&k->frames);
+        ListPool_destroy(&k->pool);
+        free(k);
+        return NULL;
+    }
+    AddressSpace_init(&k->init->mem, &k->frames);
+    if (allocKernelStack(k, k->init) == -1) {
+        free(k->init);
+        free(k->group_buckets);
+        PageCache_destroy(&k->cache);
+        FrameTable_destroy(&k->frames);
+        ListPool_destroy(&k->pool);
+        free(k);
+        return NULL;
+    }
+    k->init->pid = k->pid_curr;
+    k->pid_curr++;
+    k->init->priority = k->config.num_priorities;     // One below the lowest ready queue
+    k->init->state = RUNNING;
+    k->current = k->init;
+    k->initMade = true;
+    k->proc_count++;
+    k->exit_loop = false;
+
+    return k;
+}
 
-    // Start the input loop
-    while(!exit_loop) {
-        checkInput();
+// Free every process, queue and the list pool of a kernel
+void Kernel_destroy(Kernel *k) {
+
+    // Zombies are on no queue, only their parents' lists, so they go before their parents
+    for (PCB *parent = k->init; parent != NULL; parent = Kernel_next_in_tree(k, parent)) {
+        while (parent->zombies != NULL) {
+            PCB *zombie = parent->zombies;
+            parent->zombies = zombie->next_sibling;
+            freeProcess(zombie);
+        }
     }
-    printf("Exiting Simulation!\n");
-}
 
-static void checkInput() {
-    char input[20];
+    for (int i = 0; i < k->config.num_priorities; i++) {
+        List_free(k->ready_lists[i], freeProcessItem);
+    }
+    for (int i = 0; i < NUM_WAITING_LIST; i++) {
+        List_free(k->waiting_lists[i], freeProcessItem);
+    }
+    List_free(k->io_list, freeProcessItem);
+    List_free(k->disk.queue, freeProcessItem);
+    if (k->disk.active != NULL) {
+        freeProcess(k->disk.active);
+    }
+    List_free(k->swap_list, freeProcessItem);
+    List_free(k->wait_list, freeProcessItem);
+    List_free(k->stopped_list, freeProcessItem);
+    for (int i = 0; i < NUM_SEMAPHORE; i++) {
+        if (k->sem_array[i].pList != NULL) {
+            List_free(k->sem_array[i].pList, freeProcessItem);
+        }
+    }
+
+    // The init queue only ever holds references to the init process
+    List_free(k->ready_lists[k->config.num_priorities], NULL);
+
+    if (k->current != NULL && k->current != k->init) {
+        freeProcess(k->current);
+    }
+    if (k->init != NULL) {
+        freeProcess(k->init);
+    }
+
+    for (unsigned int i = 0; i <= k->group_mask; i++) {
+        while (k->group_buckets[i] != NULL) {
+            ProcGroup *group = k->group_buckets[i];
+            k->group_buckets[i] = group->hashNext;
+            free(group);
+        }
+    }
+    free(k->group_buckets);
+
+    PageCache_destroy(&k->cache);
+    FrameTable_destroy(&k->frames);
+    ListPool_destroy(&k->pool);
+    free(k);
+}
+
+// Run the simulation, taking commands from the kernel's input stream until the init
+//  process is killed or the input ends
+void initProgram(Kernel *k) {
+
+    // Start the input loop
+    while(!k->exit_loop && checkInput(k)) {
+    }
+    histinfo(k);
+    writeMetricsFile(k);
+    kprintf(k, "Exiting Simulation!\n");
+}
+
+static bool checkInput(Kernel *k) {
+    char input[20];
     char msg[256];
     char int_in[256];
     int int_input;
     int int_input2;
     int rv;
-    fgets(input, 20, stdin);
-    fflush(stdin);
+    bool checkpoint = false;
+    // End of input (e.g. a piped workload) ends the simulation
+    if (fgets(input, 20, k->in) == NULL) {
+        return false;
+    }
+    fflush(k->in);
     char command = input[0];
-    printf("---------------------------------------------------------------------------\n");
+    if (command != '\n') {
+        Kernel_tick_begin(k);
+    }
+    rv = 1;
+    kprintf(k, "---------------------------------------------------------------------------\n");
     switch (command) {
         case 'C':
-            printf("Enter process priority (0 = high, 1 = norm, 2 = low): ");
-            scanf("%d", &int_input);
-            if (create(int_input) == -1) {
-                printf("Failure: Could not create\n");
+            kprintf(k, "Enter process priority (0 = high, 1 = norm, 2 = low): ");
+            fscanf(k->in, "%d", &int_input);
+            rv = create(k, int_input);
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not create\n");
             }
             else {
-                printf("New process ID: %i\n", PID_CURR-1);
-                printf("Success: Create complete\n");
+                kprintf(k, "New process ID: %i\n", k->pid_curr-1);
+                kprintf(k, "Success: Create complete\n");
             }
             break;
         case 'F':
-            rv = fork();
+            rv = fork_proc(k);
             if(rv == -1) {
-                printf("Failure: Could not fork\n");
+                kprintf(k, "Failure: Could not fork\n");
             }
             else {
-                printf("New process ID: %i\n", rv);
-                printf("Success: Fork complete\n");
+                kprintf(k, "New process ID: %i\n", rv);
+                kprintf(k, "Success: Fork complete\n");
+            }
+            break;
+        case 'U':
+            kprintf(k, "Create or fork (c/f): ");
+            fscanf(k->in, " %c", &msg[0]);
+            kprintf(k, "Enter number of processes: ");
+            fscanf(k->in, "%d", &int_input);
+            int first = 0;
+            if (msg[0] == 'f' || msg[0] == 'F') {
+                rv = fork_n(k, int_input, &first);
+            }
+            else {
+                kprintf(k, "Enter process priority (0 = high, 1 = norm, 2 = low): ");
+                fscanf(k->in, "%d", &int_input2);
+                rv = create_n(k, int_input2, int_input, &first);
+            }
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not create processes\n");
+            }
+            else {
+                kprintf(k, "New process IDs: %i-%i\n", first, first + rv - 1);
+                kprintf(k, "Success: %i processes created\n", rv);
             }
             break;
         case 'K':
-            printf("Enter process ID: ");
-            scanf("%d", &int_input);
-            if (int_input > PID_CURR || int_input < 0) {
-                printf("Failure: Invalid input\n");
+            kprintf(k, "Enter process ID: ");
+            fscanf(k->in, "%d", &int_input);
+            if (int_input > k->pid_curr || int_input < 0) {
+                kprintf(k, "Failure: Invalid input\n");
+                rv = -1;
             } 
-            else if (kill(int_input) == -1) {
-                printf("Failure: Could not kill\n");
+            else if ((rv = kill_proc(k, int_input)) == -1) {
+                kprintf(k, "Failure: Could not kill\n");
             }
             else {
-                printf("Success: Kill complete\n");
+                kprintf(k, "Success: Kill complete\n");
             }
             break;
         case 'E':
-            exit_proc();
+            exit_proc(k);
+            break;
+        case 'J':
+            rv = wait_proc(k);
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not wait\n");
+            }
+            else if (rv == 0) {
+                kprintf(k, "Success: Waiting for a child\n");
+            }
+            else {
+                kprintf(k, "Success: Child %i reaped\n", rv);
+            }
+            break;
+        case 'G':
+            kprintf(k, "Enter process ID: ");
+            fscanf(k->in, "%d", &int_input);
+            kprintf(k, "Enter process group ID: ");
+            fscanf(k->in, "%d", &int_input2);
+            rv = setpgid_proc(k, int_input, int_input2);
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not set process group\n");
+            }
+            else {
+                kprintf(k, "Success: Process %i in process group %i\n", int_input, int_input2);
+            }
+            break;
+        case 'X':
+            kprintf(k, "Enter process ID (negative for a process group): ");
+            fscanf(k->in, "%d", &int_input);
+            kprintf(k, "Enter signal (kill/term/stop/cont/usr): ");
+            fscanf(k->in, "%15s", msg);
+            int sig = 0;
+            for (int i = SIGNAL_KILL; i < NUM_SIGNALS; i++) {
+                if (strcmp(msg, Kernel_signal_name(i)) == 0) {
+                    sig = i;
+                }
+            }
+            rv = signal_proc(k, int_input, sig);
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not signal\n");
+            }
+            else {
+                kprintf(k, "Success: Signal delivered to %i processes\n", rv);
+            }
             break;
         case 'Q':
-            quantum();
+            quantum(k);
             break;
         case 'S':
             char command;
-            printf("Enter process ID of receiver: ");
-            fgets(int_in, 256, stdin);
+            kprintf(k, "Enter process ID of receiver: ");
+            fgets(int_in, 256, k->in);
             int_input = atoi(&int_in[0]);
-            printf("Enter a message: ");
+            kprintf(k, "Enter a message: ");
             // scanf("%s", msg);
-            fflush(stdin);
-            fgets(msg, 256, stdin);
+            fflush(k->in);
+            fgets(msg, 256, k->in);
             command = msg[0];
-            if(send(int_input, msg) == -1) {
-                printf("Failure: Could not send\n");
+            rv = send_msg(k, int_input, msg);
+            if(rv == -1) {
+                kprintf(k, "Failure: Could not send\n");
             }
             else {
-                printf("Success: Send complete\n");
+                kprintf(k, "Success: Send complete\n");
             }
             break;
         case 'R':
-            receive();
+            receive(k);
             break;
         case 'Y':
-            printf("Enter process ID to reply to: ");
-            fgets(int_in, 256, stdin);
+            kprintf(k, "Enter process ID to reply to: ");
+            fgets(int_in, 256, k->in);
             int_input = atoi(&int_in[0]);
-            printf("Enter a message: ");
+            kprintf(k, "Enter a message: ");
             // scanf("%s", msg);
-            fflush(stdin);
-            fgets(msg, 256, stdin);
+            fflush(k->in);
+            fgets(msg, 256, k->in);
             command = msg[0];
             // unblock sender
-            if (reply(int_input, msg) == -1) {
-                printf("Failure: Could not reply\n");
+            rv = reply(k, int_input, msg);
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not reply\n");
             }
             else {
-                printf("Success: Reply complete\n");
+                kprintf(k, "Success: Reply complete\n");
             }
             break;
         case 'N':
-            printf("Enter the new semaphore ID: ");
-            scanf("%d", &int_input);
-            printf("Enter initial value of new semaphore: ");
-            scanf("%d", &int_input2);
+            kprintf(k, "Enter the new semaphore ID: ");
+            fscanf(k->in, "%d", &int_input);
+            kprintf(k, "Enter initial value of new semaphore: ");
+            fscanf(k->in, "%d", &int_input2);
             // need to figure out number
-            if(new_Sem(int_input, int_input2) == -1) {
-                printf("Failure: Semaphore was not created\n");
+            rv = new_Sem(k, int_input, int_input2);
+            if(rv == -1) {
+                kprintf(k, "Failure: Semaphore was not created\n");
             }
             else {
-                printf("Success: Semaphore created\n");
+                kprintf(k, "Success: Semaphore created\n");
             }
             break;
         case 'P':
-            printf("Enter a semaphore ID: ");
-            scanf("%d", &int_input);
-            if(sem_P(int_input) == -1) {
-                printf("Failure: Could not execute semaphore P\n");
+            kprintf(k, "Enter a semaphore ID: ");
+            fscanf(k->in, "%d", &int_input);
+            rv = sem_P(k, int_input);
+            if(rv == -1) {
+                kprintf(k, "Failure: Could not execute semaphore P\n");
             }
             else {
-                printf("Success: Semaphore P executed\n");
+                kprintf(k, "Success: Semaphore P executed\n");
             }
             break;
         case 'V':
-            printf("Enter a semaphore ID: ");
-            scanf("%d", &int_input);
-            if(sem_V(int_input) == -1) {
-                printf("Failure: Could not execute semaphore V\n");
+            kprintf(k, "Enter a semaphore ID: ");
+            fscanf(k->in, "%d", &int_input);
+            rv = sem_V(k, int_input);
+            if(rv == -1) {
+                kprintf(k, "Failure: Could not execute semaphore V\n");
+            }
+            else {
+                kprintf(k, "Success: Semaphore V executed\n");
+            }
+            break;
+        case 'A':
+            kprintf(k, "Enter virtual address: ");
+            fgets(int_in, 256, k->in);
+            uint32_t vaddr = (uint32_t)strtoul(int_in, NULL, 0);
+            kprintf(k, "Enter number of pages: ");
+            fscanf(k->in, "%d", &int_input);
+            kprintf(k, "Read or write (r/w): ");
+            fscanf(k->in, " %c", &msg[0]);
+            rv = access_mem(k, vaddr, int_input, msg[0] == 'w' || msg[0] == 'W');
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not access memory\n");
+            }
+            else {
+                kprintf(k, "Success: %i pages accessed\n", rv);
+            }
+            break;
+        case 'D':
+            kprintf(k, "Enter block number: ");
+            fgets(int_in, 256, k->in);
+            uint32_t block = (uint32_t)strtoul(int_in, NULL, 0);
+            kprintf(k, "Enter number of blocks: ");
+            fscanf(k->in, "%d", &int_input);
+            kprintf(k, "Read or write (r/w): ");
+            fscanf(k->in, " %c", &msg[0]);
+            rv = disk_io(k, block, int_input, msg[0] == 'w' || msg[0] == 'W');
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not issue disk I/O\n");
+            }
+            else {
+                kprintf(k, "Success: Disk I/O issued\n");
+            }
+            break;
+        case 'O':
+            kprintf(k, "Enter file number: ");
+            fscanf(k->in, "%d", &int_input);
+            int file = int_input;
+            kprintf(k, "Enter block number: ");
+            fscanf(k->in, "%d", &int_input);
+            uint32_t fileBlock = (uint32_t)int_input;
+            kprintf(k, "Enter number of blocks: ");
+            fscanf(k->in, "%d", &int_input);
+            kprintf(k, "Read or write (r/w): ");
+            fscanf(k->in, " %c", &msg[0]);
+            rv = file_io(k, file, fileBlock, int_input, msg[0] == 'w' || msg[0] == 'W');
+            if (rv == -1) {
+                kprintf(k, "Failure: Could not do file I/O\n");
             }
             else {
-                printf("Success: Semaphore V executed\n");
+                kprintf(k, "Success: File I/O %s\n", rv == 1 ? "issued" : "done");
             }
             break;
         case 'I':
-            printf("Enter a process ID: ");
-            scanf("%d", &int_input);
-            procinfo(int_input);
+            kprintf(k, "Enter a process ID: ");
+            fscanf(k->in, "%d", &int_input);
+            procinfo(k, int_input);
             break;
         case 'T':
-            totalinfo();
+            totalinfo(k);
+            break;
+        case 'H':
+            histinfo(k);
+            break;
+        case 'M':
+            metricsinfo(k);
+            break;
+        case 'B':
+            meminfo(k);
+            break;
+        case 'W':
+            kprintf(k, "Enter checkpoint file: ");
+            fgets(msg, 256, k->in);
+            msg[strcspn(msg, "\n")] = '\0';
+            // Written once the tick is over, so a restore resumes exactly at the next command
+            checkpoint = true;
+            break;
+        case '\n':
+            break;
+        default:
+            rv = -1;
             break;
     } 
     
     // To improve the readability of our outputs
-    if (command == 'E' || command == 'F' || command == 'Q' || command == 'R' || command == 'T' || command == 'S' || command == 'Y') {
-        printf("---------------------------------------------------------------------------\n");
+    if (command == 'A' || command == 'D' || command == 'O' || command == 'E' || command == 'F' || command == 'J' || command == 'U' || command == 'X' || command == 'Q' || command == 'R' || command == 'T' || command == 'H' || command == 'M' || command == 'S' || command == 'Y') {
+        kprintf(k, "---------------------------------------------------------------------------\n");
+    }
+
+    if (command != '\n') {
+        k->last_result = rv;
+        Kernel_tick_end(k);
     }
-    
 
+    if (checkpoint) {
+        long bytes = Checkpoint_write(k, msg);
+        if (bytes == -1) {
+            kprintf(k, "Failure: Could not write checkpoint\n");
+            k->last_result = -1;
+        }
+        else {
+            kprintf(k, "Success: Checkpoint written (%i processes, %li bytes)\n", k->proc_count, bytes);
+        }
+    }
+    return true;
 }
 
-// Free a process control block
-static void freeProcess(PCB *process) {
-    
-    if (process->proc_message != NULL) {
-       free(process->proc_message);
-       process->proc_message = NULL;
+// Run every command in the given stream, written as it would be typed into sim, stopping
+//  early if the init process is killed. Returns the result of the last command.
+int runCommands(Kernel *k, FILE *in) {
+
+    FILE *saved = k->in;
+    k->in = in;
+    k->last_result = -1;
+    while (!k->exit_loop && checkInput(k)) {
     }
-    if (process->reply_msg != NULL) {
-        free(process->reply_msg);
-        process->reply_msg = NULL;
+    k->in = saved;
+    return k->last_result;
+}
+
+// Every command is one tick of the virtual clock
+void Kernel_tick_begin(Kernel *k) {
+    k->sim_time++;
+}
+
+// Work done after every command: I/O completions, load control, page replacement bookkeeping,
+//  pending signals, quantum expiry and the periodic metrics dump
+void Kernel_tick_end(Kernel *k) {
+
+    completeIO(k);
+    completeDisk(k);
+    flushCache(k);
+    balanceSwap(k);
+    FrameTable_tick(&k->frames);
+
+    // User signals sent to a process that was not running are handled once it runs
+    if (k->current != NULL) {
+        handleSignals(k, k->current);
     }
+
+    // With a quantum length configured, preempt a process that has run for a full quantum
+    if (k->config.quantum != 0 && !k->exit_loop) {
+        if (k->current != k->slice_owner) {
+            k->slice_owner = k->current;
+            k->slice_start = k->sim_time;
+        }
+        else if (k->current != k->init && k->sim_time - k->slice_start >= k->config.quantum) {
+            quantum(k);
+            k->slice_owner = k->current;
+            k->slice_start = k->sim_time;
+        }
+    }
+
+    // Periodic metrics dump for soak runs
+    if (k->metrics_interval != 0 && k->sim_time % k->metrics_interval == 0) {
+        writeMetricsFile(k);
+    }
+}
+
+// Free a process control block
+static void freeProcess(PCB *process) {
+
+    releaseProcess(process);
     free(process);
     process = NULL;
 }
 
-// Called whenever we switch to a new process.
-// Outputs process scheduling information.
-static PCB* nextProcess() {
+// Release everything a process holds except its control block: its frames, kernel stack,
+//  swap slots and messages. A zombie keeps only its control block.
+static void releaseProcess(PCB *process) {
     
-    if (List_count(ready_lists[0]) != 0) {
-        PCB *ret = dequeue(ready_lists[0]);
-        ret->state = RUNNING;
-        printf("--New Current Process: \n");
-        procinfo_helper(ret);
+    // A page that was being read in has a frame but is not mapped yet
+    if (process->state == BLOCKED && process->waitState == WAITING_IO) {
+        FrameTable_free(process->mem.frames, process->io_frame);
+    }
+    if (process->kstack != VM_NO_FRAME) {
+        FrameTable_free_block(process->mem.frames, process->kstack, process->kstack_order);
+        process->kstack = VM_NO_FRAME;
+    }
+    AddressSpace_destroy(&process->mem);
+    Kernel_free_mailbox(process);
+}
 
-        // If ret holds a reply, print it to the screen immediately
-        if (ret->reply_msg != NULL) {
-            printf("Reply received from process %i\n", ret->reply_src);
-            printf("Reply message: %s\n", ret->reply_msg);
-            ret->reply_src = -1;
-            free(ret->reply_msg);
-            ret->reply_msg = NULL;
-        }
-        return ret;
+// Push child on the front of parent's zombies list if it is a zombie, its children otherwise
+static void linkChild(PCB *parent, PCB *child) {
+
+    PCB **head = child->state == ZOMBIE ? &parent->zombies : &parent->children;
+    child->parent = parent;
+    child->prev_sibling = NULL;
+    child->next_sibling = *head;
+    if (*head != NULL) {
+        (*head)->prev_sibling = child;
     }
-    else if(List_count(ready_lists[1]) != 0) {
-        PCB *ret = dequeue(ready_lists[1]);
-        ret->state = RUNNING;
-        printf("--New Current Process: \n");
-        procinfo_helper(ret);
+    *head = child;
+    if (child->state == ZOMBIE) {
+        parent->num_zombies++;
+    }
+    else {
+        parent->num_children++;
+    }
+}
 
-        // If ret holds a reply, print it to the screen immediately
-        if (ret->reply_msg != NULL) {
-            printf("Reply received from process %i\n", ret->reply_src);
-            printf("Reply message: %s\n", ret->reply_msg);
-            ret->reply_src = -1;
-            free(ret->reply_msg);
-            ret->reply_msg = NULL;
-        }
-        return ret;
+// Take child off whichever of its parent's lists it is on
+static void unlinkChild(PCB *child) {
+
+    PCB *parent = child->parent;
+    if (parent == NULL)
+        return;
+
+    if (child->prev_sibling != NULL) {
+        child->prev_sibling->next_sibling = child->next_sibling;
     }
-    else if(List_count(ready_lists[2]) != 0) {
-        PCB *ret = dequeue(ready_lists[2]);
-        ret->state = RUNNING;
-        printf("--New Current Process: \n");
-        procinfo_helper(ret);
+    else if (child->state == ZOMBIE) {
+        parent->zombies = child->next_sibling;
+    }
+    else {
+        parent->children = child->next_sibling;
+    }
+    if (child->next_sibling != NULL) {
+        child->next_sibling->prev_sibling = child->prev_sibling;
+    }
+    if (child->state == ZOMBIE) {
+        parent->num_zombies--;
+    }
+    else {
+        parent->num_children--;
+    }
+    child->parent = NULL;
+    child->prev_sibling = NULL;
+    child->next_sibling = NULL;
+}
 
-        // If ret holds a reply, print it to the screen immediately
-        if (ret->reply_msg != NULL) {
-            printf("Reply received from process %i\n", ret->reply_src);
-            printf("Reply message: %s\n", ret->reply_msg);
-            ret->reply_src = -1;
-            free(ret->reply_msg);
-            ret->reply_msg = NULL;
+// Orphans: init adopts the live children of an exiting process, and reaps its zombies
+static void reparentChildren(Kernel *k, PCB *process) {
+
+    while (process->zombies != NULL) {
+        PCB *child = process->zombies;
+        unlinkChild(child);
+        k->zombie_count--;
+        k->metrics.reaps++;
+        freeProcess(child);
+    }
+    while (process->children != NULL) {
+        PCB *child = process->children;
+        unlinkChild(child);
+        linkChild(k->init, child);
+        k->metrics.reparents++;
+    }
+}
+
+// Remove a process that is off every queue from the system. Init reaps its children as they
+//  exit; any other parent gets a zombie, reaped at once if the parent is waiting for it.
+static void exitProcess(Kernel *k, PCB *process, int status) {
+
+    leaveGroup(k, process);
+    reparentChildren(k, process);
+    PCB *parent = process->parent;
+    unlinkChild(process);
+    if (parent == k->init) {
+        freeProcess(process);
+        return;
+    }
+
+    releaseProcess(process);
+    process->state = ZOMBIE;
+    process->exit_status = status;
+    linkChild(parent, process);
+    k->zombie_count++;
+
+    if (parent->state == BLOCKED && parent->waitState == WAITING_CHILD) {
+        dequeueProcess(k, parent);
+        reapChild(k, parent, process);
+        unblockIO(k, parent);
+        kprintf(k, "Wait complete, process unblocked: \n");
+        procinfo_helper(k, parent);
+    }
+}
+
+// Free a zombie child of parent and report how it ended
+static int reapChild(Kernel *k, PCB *parent, PCB *child) {
+
+    int pid = child->pid;
+    if (child->exit_status == EXIT_KILLED) {
+        kprintf(k, "Child process %i was killed, reaped by process %i\n", pid, parent->pid);
+    }
+    else if (child->exit_status < 0) {
+        kprintf(k, "Child process %i was killed by signal %s, reaped by process %i\n", pid,
+                Kernel_signal_name(-child->exit_status), parent->pid);
+    }
+    else {
+        kprintf(k, "Child process %i exited with status %i, reaped by process %i\n", pid, child->exit_status, parent->pid);
+    }
+    unlinkChild(child);
+    k->zombie_count--;
+    k->metrics.reaps++;
+    freeProcess(child);
+    return pid;
+}
+
+// Kill the named process, leaving the given exit status for its parent
+static int killProcess(Kernel *k, int pid, int status) {
+
+    PCB *toKill = NULL;
+
+    // If user is requesting to kill the init process
+    if (pid == k->init->pid) {
+        if(k->proc_count == 1) {
+            // call exit
+            kprintf(k, "Init process killed \n");
+            exit_sim(k);
+            return 1;
         }
-        return ret;
+        kprintf(k, "Error: Cannot kill init process\n");
+        return -1;
+    }
+
+    toKill = Kernel_find_process(k, pid);
+    if (toKill == NULL) {
+        kprintf(k, "Error: PCB not found\n");
+        return -1;
+    }
+    terminateProcess(k, toKill, status);
+    return 1;
+}
+
+// Kill a process, running or queued, and remove it from the system
+static void terminateProcess(Kernel *k, PCB *process, int status) {
+
+    if (process == k->current) {
+        k->current = nextProcess(k);
     }
     else {
-        INIT->state = RUNNING;
-        printf("--New Current Process: \n");
-        procinfo_helper(INIT);
-        return INIT;
+        dequeueProcess(k, process);
     }
+    kprintf(k, "Process %i killed\n", process->pid);
+    exitProcess(k, process, status);
+    k->proc_count--;
+    k->metrics.kills++;
 }
 
-// Search the relevant queues for the given pid.
-// The queue's current node will now be the desired process.
-static PCB* findProcess(int pid) {
+// Append to a queue, keyed by pid for findProcess, remembering the process' node for dequeueProcess
+static int enqueue(List *list, PCB *process) {
 
-    // If we search for the init process
-    if (pid == 0) {
-        return INIT;
+    if (List_append(list, process) == LIST_FAIL)
+        return LIST_FAIL;
+    List_set_key(list, process->pid);
+    process->queue_node = list->tail;
+    return LIST_SUCCESS;
+}
+
+// Take a process off whichever queue its state puts it on, in O(1) but for the disk
+static void dequeueProcess(Kernel *k, PCB *process) {
+
+    List *queue;
+    if (process->state == READY) {
+        queue = k->ready_lists[process->priority];
+    }
+    else if (process->state == SWAPPED) {
+        queue = k->swap_list;
+    }
+    else if (process->state == STOPPED) {
+        queue = k->stopped_list;
+    }
+    else if (process->waitState == WAITING_SEND) {
+        queue = k->waiting_lists[0];
+    }
+    else if (process->waitState == WAITING_REPLY) {
+        queue = k->waiting_lists[1];
+    }
+    else if (process->waitState == WAITING_IO) {
+        queue = k->io_list;
     }
+    else if (process->waitState == WAITING_DISK) {
+        BlockDev_cancel(&k->disk, process);
+        process->queue_node = NULL;
+        return;
+    }
+    else if (process->waitState == WAITING_CHILD) {
+        queue = k->wait_list;
+    }
+    // A process blocked on a semaphore no longer counts against it
+    else {
+        queue = k->sem_array[process->sem_id].pList;
+        k->sem_array[process->sem_id].sem_value++;
+    }
+    queue->current = process->queue_node;
+    List_remove(queue);
+    process->queue_node = NULL;
+}
 
-    // Search the ready lists
-    for (int i = 0; i <= 2; i++) {
-        List_first(ready_lists[i]);
-        while (ready_lists[i]->current != NULL) {
-            // Check for a match
-            PCB *processPointer = ready_lists[i]->current->item;
-            if (processPointer->pid == pid)
-                return processPointer;
-            // If no match, advance
-            ready_lists[i]->current = ready_lists[i]->current->next;
-        }
-        // printf("Match not found in ready list %i...\n", i);  // Testing
+// Unlink a process from its group's members, and free the group if it was the last one
+static void leaveGroup(Kernel *k, PCB *process) {
+
+    ProcGroup *group = process->group;
+    if (group == NULL)
+        return;
+
+    if (process->group_prev != NULL) {
+        process->group_prev->group_next = process->group_next;
+    }
+    else {
+        group->members = process->group_next;
+    }
+    if (process->group_next != NULL) {
+        process->group_next->group_prev = process->group_prev;
     }
+    process->group = NULL;
+    process->group_prev = NULL;
+    process->group_next = NULL;
+    if (--group->size != 0)
+        return;
 
-    // Search the waiting lists
-    for (int i = 0; i <= 1; i++) {
-        List_first(waiting_lists[i]);
-        while (waiting_lists[i]->current != NULL) {
-            // Check for a match
-            PCB *processPointer = waiting_lists[i]->current->item;
-            if (processPointer->pid == pid)
-                return processPointer;
-            // If no match, advance
-            waiting_lists[i]->current = waiting_lists[i]->current->next;
+    ProcGroup **link = &k->group_buckets[(unsigned int)group->pgid & k->group_mask];
+    while (*link != group) {
+        link = &(*link)->hashNext;
+    }
+    *link = group->hashNext;
+    free(group);
+    k->num_groups--;
+}
+
+// Rehash the groups into twice as many buckets
+static bool growGroups(Kernel *k) {
+
+    unsigned int buckets = (k->group_mask + 1) * 2;
+    ProcGroup **table = calloc(buckets, sizeof(ProcGroup *));
+    if (table == NULL)
+        return false;
+
+    for (unsigned int i = 0; i <= k->group_mask; i++) {
+        while (k->group_buckets[i] != NULL) {
+            ProcGroup *group = k->group_buckets[i];
+            k->group_buckets[i] = group->hashNext;
+            group->hashNext = table[(unsigned int)group->pgid & (buckets - 1)];
+            table[(unsigned int)group->pgid & (buckets - 1)] = group;
         }
-        // printf("Match not found in waiting list %i...\n", i);    // Testing
     }
+    free(k->group_buckets);
+    k->group_buckets = table;
+    k->group_mask = buckets - 1;
+    return true;
+}
 
-    // Search the semaphore waiting lists
-    for(int i = 0; i <= 4; i++) {
-            if(sem_array[i].sem_init == true) {
-                List_first(sem_array[i].pList);
-                while (sem_array[i].pList->current != NULL) {
-                    // Check for a match
-                    PCB *processPointer = sem_array[i].pList->current->item;
-                    if (processPointer->pid == pid)
-                        return processPointer;
-                    // If no match, advance
-                    sem_array[i].pList->current = sem_array[i].pList->current->next;
+// Terminate and kill end the process, stop parks a running or ready process on the stopped
+//  queue, continue makes a stopped process ready again, and a user signal waits for the
+//  process to run
+static bool deliverSignal(Kernel *k, PCB *process, enum Signal signal) {
+
+    k->metrics.signals[signal - 1]++;
+    switch (signal) {
+        case SIGNAL_KILL:
+        case SIGNAL_TERM:
+            terminateProcess(k, process, -(int)signal);
+            return true;
+        case SIGNAL_STOP:
+            if (process->state != RUNNING && process->state != READY)
+                break;
+            // Join the stopped queue first, so a full pool leaves the process running or ready
+            Node *readyNode = process->queue_node;
+            if (enqueue(k->stopped_list, process) == LIST_FAIL) {
+                kprintf(k, "Error: Max process limit reached, process %i not stopped\n", process->pid);
+                return false;
             }
+            if (process == k->current) {
+                k->current = nextProcess(k);
+            }
+            else {
+                Node *stoppedNode = process->queue_node;
+                process->queue_node = readyNode;
+                dequeueProcess(k, process);
+                process->queue_node = stoppedNode;
+            }
+            process->state = STOPPED;
+            kprintf(k, "Process %i stopped\n", process->pid);
+            return true;
+        case SIGNAL_CONT:
+            if (process->state != STOPPED)
+                break;
+            dequeueProcess(k, process);
+            unblockIO(k, process);
+            kprintf(k, "Process %i continued: \n", process->pid);
+            procinfo_helper(k, process);
+            return true;
+        case SIGNAL_USR:
+            process->sig_pending++;
+            if (process == k->current) {
+                handleSignals(k, process);
+            }
+            else {
+                kprintf(k, "User signal pending for process %i\n", process->pid);
+            }
+            return true;
+    }
+    kprintf(k, "Process %i ignored signal %s\n", process->pid, Kernel_signal_name(signal));
+    return false;
+}
+
+// A process handles its user signals once it is running
+static void handleSignals(Kernel *k, PCB *process) {
+
+    if (process->sig_pending == 0)
+        return;
+    kprintf(k, "Process %i handled %u user signal%s\n", process->pid, process->sig_pending, process->sig_pending == 1 ? "" : "s");
+    k->metrics.signals_handled += process->sig_pending;
+    process->sig_pending = 0;
+}
+
+// FREE_FN wrapper used when tearing down the queues
+static void freeProcessItem(void *item) {
+    freeProcess((PCB *)item);
+}
+
+// Called whenever we switch to a new process.
+// Outputs process scheduling information.
+static PCB* nextProcess(Kernel *k) {
+    
+    k->metrics.context_switches++;
+
+    // Take the first process of the highest priority ready queue that has one
+    for (int i = 0; i < k->config.num_priorities; i++) {
+        if (List_count(k->ready_lists[i]) == 0) {
+            continue;
+        }
+
+        PCB *ret = dequeue(k->ready_lists[i]);
+        ret->state = RUNNING;
+        Histogram_record(&k->ready_hist, k->sim_time - ret->ready_time);
+        kprintf(k, "--New Current Process: \n");
+        procinfo_helper(k, ret);
+
+        // If ret holds a reply, print it to the screen immediately
+        Mailbox *mail = ret->mail;
+        if (mail != NULL && mail->reply_msg != NULL) {
+            kprintf(k, "Reply received from process %i\n", mail->reply_src);
+            kprintf(k, "Reply message: %s\n", mail->reply_msg);
+            mail->reply_src = -1;
+            free(mail->reply_msg);
+            mail->reply_msg = NULL;
         }
+        return ret;
     }
 
-    // If we reach this line, process with the given pid was not found
-    return NULL;
+    // Otherwise the init process runs
+    k->init->state = RUNNING;
+    kprintf(k, "--New Current Process: \n");
+    procinfo_helper(k, k->init);
+    return k->init;
+}
+
+// Look up a queued process by pid. Every queued process is keyed by its pid in the list node
+//  pool, so this is one scan of the pool's keys rather than a walk of every queue.
+static PCB* findProcess(Kernel *k, int pid) {
+
+    // If we search for the init process
+    if (pid == 0) {
+        return k->init;
+    }
+
+    // The process the disk is serving is on no queue
+    if (k->disk.active != NULL && k->disk.active->pid == pid) {
+        return k->disk.active;
+    }
+
+    Node *node = ListPool_find_key(&k->pool, pid);
+    return node != NULL ? node->item : NULL;
 }
 
 // Helper function to print process information to the screen
-static void procinfo_helper(PCB *process) {
+static void procinfo_helper(Kernel *k, PCB *process) {
 
-    printf("    Process ID:         %i\n", process->pid);
-    printf("    Process Priority:   %i\n", process->priority);
-    printf("    Process State:      ");
+    kprintf(k, "    Process ID:         %i\n", process->pid);
+    kprintf(k, "    Process Priority:   %i\n", process->priority);
+    kprintf(k, "    Process State:      ");
     if (process->state == RUNNING) {
-        printf("RUNNING\n");
+        kprintf(k, "RUNNING\n");
     } else if (process->state == READY) {
-        printf("READY\n");
+        kprintf(k, "READY\n");
+    } else if (process->state == SWAPPED) {
+        kprintf(k, "SWAPPED\n");
+    } else if (process->state == ZOMBIE) {
+        kprintf(k, "ZOMBIE\n");
+    } else if (process->state == STOPPED) {
+        kprintf(k, "STOPPED\n");
     } else {
-        printf("BLOCKED\n");
+        kprintf(k, "BLOCKED\n");
     }
 
     // Only print these sections if not null
-    if (process->proc_message != NULL) {
-        printf("    Process Message:    %s", process->proc_message);
+    if (process->mail != NULL && process->mail->proc_message != NULL) {
+        kprintf(k, "    Process Message:    %s", process->mail->proc_message);
     }
-    if (process->reply_msg != NULL) {
-        printf("    Reply Message:      %s", process->reply_msg);
+    if (process->mail != NULL && process->mail->reply_msg != NULL) {
+        kprintf(k, "    Reply Message:      %s", process->mail->reply_msg);
     }
     
-    printf("\n");
+    kprintf(k, "\n");
 }
 
-static bool readyListEmpty() {
-    for(int i = 0; i < 3; i++) {
-        if(List_count(ready_lists[i]) != 0){
+static bool readyListEmpty(Kernel *k) {
+    for(int i = 0; i < k->config.num_priorities; i++) {
+        if(List_count(k->ready_lists[i]) != 0){
             return false;
         }
     }
     return true;
 }
 
-static void exit_sim() {
-    freeProcess(INIT);
-    exit_loop = true;
+// Take the process to wake from a semaphore's waiting list, according to the wake policy
+static PCB* semWakeNext(Kernel *k, List *waiting) {
+
+    if (k->config.sem_wake == SEM_WAKE_LIFO) {
+        return List_trim(waiting);
+    }
+
+    if (k->config.sem_wake == SEM_WAKE_PRIORITY) {
+        // Highest priority waiter, the longest waiting one among equals
+        PCB *best = List_first(waiting);
+        Node *bestNode = waiting->current;
+        for (Node *node = waiting->head; node != NULL; node = List_node_next(waiting, node)) {
+            PCB *process = node->item;
+            if (process->priority < best->priority) {
+                best = process;
+                bestNode = node;
+            }
+        }
+        waiting->current = bestNode;
+        return List_remove(waiting);
+    }
+
+    return dequeue(waiting);
+}
+
+// Every ready list, the fixed wait queues and every semaphore fit in the queue gauges
+_Static_assert(MAX_READY_LIST + 1 + METRICS_NUM_FIXED_QUEUES + NUM_SEMAPHORE <= METRICS_MAX_QUEUES,
+               "Metrics cannot hold a gauge for every kernel queue");
+
+// Fill in the parts of the metrics that are read from the queues rather than counted
+void snapshotMetrics(Kernel *k) {
+
+    char name[METRICS_QUEUE_NAME_LEN];
+
+    k->metrics.clock = k->sim_time;
+    k->metrics.pool_exhaustions = List_pool_exhaustions(&k->pool);
+    k->metrics.frames_total = k->frames.numFrames;
+    k->metrics.frames_free = k->frames.numFree;
+    int largest = FrameTable_largest_free_order(&k->frames);
+    k->metrics.frames_largest_free = largest >= 0 ? 1u << largest : 0;
+    k->metrics.evictions = k->frames.evictions;
+    k->metrics.dirty_evictions = k->frames.dirtyEvictions;
+    k->metrics.cow_faults = k->frames.cowFaults;
+    k->metrics.cow_copies = k->frames.cowCopies;
+    k->metrics.fork_shared = k->frames.forkShared;
+    k->metrics.frames_saved = k->frames.sharedPages;
+    snprintf(k->metrics.replacement, METRICS_NAME_LEN, "%s", k->frames.policy->name);
+    k->metrics.disk_reads = k->disk.reads;
+    k->metrics.disk_writes = k->disk.writes;
+    k->metrics.disk_blocks_read = k->disk.blocksRead;
+    k->metrics.disk_blocks_written = k->disk.blocksWritten;
+    k->metrics.disk_busy_ticks = k->disk.busyTicks;
+    k->metrics.disk_seek_blocks = k->disk.seekBlocks;
+    k->metrics.disk_expired = k->disk.expired;
+    snprintf(k->metrics.io_sched, METRICS_NAME_LEN, "%s", BlockDev_sched_name(k->disk.sched));
+    snprintf(k->metrics.cache_policy, METRICS_NAME_LEN, "%s", PageCache_policy_name(k->cache.policy));
+    k->metrics.cache_capacity = k->cache.capacity;
+    k->metrics.cache_resident = PageCache_resident(&k->cache);
+    k->metrics.cache_dirty = k->cache.numDirty;
+    k->metrics.cache_hits = k->cache.hits;
+    k->metrics.cache_misses = k->cache.misses;
+    k->metrics.cache_ghost_hits = k->cache.ghostHits;
+    k->metrics.cache_evictions = k->cache.evictions;
+    k->metrics.cache_overwrites = k->cache.overwrites;
+    k->metrics.cache_throttled = k->cache.throttled;
+    k->metrics.cache_writebacks = k->cache.writebacks;
+    k->metrics.cache_writeback_blocks = k->cache.writebackBlocks;
+    k->metrics.swap_slots = k->frames.numSlots;
+    k->metrics.swap_used = k->frames.slotsUsed;
+    k->metrics.swap_outs = k->frames.swapOuts;
+    k->metrics.swap_ins = k->frames.swapIns;
+    k->metrics.swap_full = k->frames.swapFull;
+    k->metrics.zombies = (uint64_t)k->zombie_count;
+    k->metrics.groups = k->num_groups;
+    k->metrics.num_queues = 0;
+    k->metrics.queues_dropped = 0;
+    for (int i = 0; i < k->config.num_priorities; i++) {
+        snprintf(name, METRICS_QUEUE_NAME_LEN, "ready%i", i);
+        Metrics_add_queue(&k->metrics, name, List_count(k->ready_lists[i]), List_peak(k->ready_lists[i]));
+    }
+    Metrics_add_queue(&k->metrics, "waiting_send", List_count(k->waiting_lists[0]), List_peak(k->waiting_lists[0]));
+    Metrics_add_queue(&k->metrics, "waiting_reply", List_count(k->waiting_lists[1]), List_peak(k->waiting_lists[1]));
+    Metrics_add_queue(&k->metrics, "waiting_io", List_count(k->io_list), List_peak(k->io_list));
+    Metrics_add_queue(&k->metrics, "waiting_disk", BlockDev_waiting(&k->disk), List_peak(k->disk.queue));
+    Metrics_add_queue(&k->metrics, "swapped", List_count(k->swap_list), List_peak(k->swap_list));
+    Metrics_add_queue(&k->metrics, "waiting_child", List_count(k->wait_list), List_peak(k->wait_list));
+    Metrics_add_queue(&k->metrics, "stopped", List_count(k->stopped_list), List_peak(k->stopped_list));
+    for (int i = 0; i < NUM_SEMAPHORE; i++) {
+        if (k->sem_array[i].sem_init == true) {
+            snprintf(name, METRICS_QUEUE_NAME_LEN, "sem%i", i);
+            Metrics_add_queue(&k->metrics, name, List_count(k->sem_array[i].pList), List_peak(k->sem_array[i].pList));
+        }
+    }
+}
+
+// Write the Prometheus text dump, if one was requested
+static void writeMetricsFile(Kernel *k) {
+
+    if (k->metrics_path == NULL)
+        return;
+
+    snapshotMetrics(k);
+    if (Metrics_write_prometheus(&k->metrics, k->metrics_path) == -1) {
+        kprintf(k, "Error: Could not write metrics to %s\n", k->metrics_path);
+    }
+}
+
+static void exit_sim(Kernel *k) {
+    freeProcess(k->init);
+    k->init = NULL;
+    k->current = NULL;
+    k->exit_loop = true;
     return;
-}
\ No newline at end of file
+}
+
+// Allocate a control block and give it a kernel stack
+static PCB* allocProcess(Kernel *k) {
+
+    PCB *process = Kernel_alloc_pcb();
+    if (process == NULL) {
+        kprintf(k, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    AddressSpace_init(&process->mem, &k->frames);
+    if (allocKernelStack(k, process) == -1) {
+        kprintf(k, "Error: Out of physical memory\n");
+        free(process);
+        return NULL;
+    }
+    return process;
+}
+
+// Give a process its kernel stack block. When no free block is large enough, pages are
+//  evicted one at a time (freeing their frames lets free blocks merge) until one is, and after
+//  that, with load control, ready processes are swapped out.
+static int allocKernelStack(Kernel *k, PCB *process) {
+
+    process->kstack = VM_NO_FRAME;
+    process->kstack_order = 0;
+    if (k->config.kstack_pages == 0)
+        return 0;
+
+    while ((1u << process->kstack_order) < k->config.kstack_pages) {
+        process->kstack_order++;
+    }
+    int frame = FrameTable_alloc_block(&k->frames, &process->mem, process->kstack_order);
+    while (frame == VM_NO_FRAME && (FrameTable_reclaim(&k->frames) || (k->config.load_control && swapOutVictim(k)))) {
+        frame = FrameTable_alloc_block(&k->frames, &process->mem, process->kstack_order);
+    }
+    if (frame == VM_NO_FRAME)
+        return -1;
+    process->kstack = frame;
+    return 0;
+}
+
+// Handle a fault on page vpn of the running process: reserve a frame for the page and block
+//  the process on the I/O queue until the read completes
+static int pageFault(Kernel *k, uint32_t vpn, bool write) {
+
+    PCB *process = k->current;
+    process->mem.faults++;
+    k->metrics.page_faults++;
+
+    pte_t *pte = AddressSpace_pte(&process->mem, vpn, false);
+    bool swapped = pte != NULL && (*pte & PTE_SWAPPED);
+
+    // With every frame in use, the replacement policy gives up a resident page, and if there is
+    //  none to give up, load control frees the pages of a whole process
+    int frame = FrameTable_alloc(&k->frames, &process->mem, vpn);
+    if (frame == VM_NO_FRAME) {
+        frame = FrameTable_evict(&k->frames, &process->mem, vpn);
+    }
+    if (frame == VM_NO_FRAME && k->config.load_control && swapOutVictim(k)) {
+        frame = FrameTable_alloc(&k->frames, &process->mem, vpn);
+    }
+    if (frame == VM_NO_FRAME) {
+        kprintf(k, "Error: Out of physical memory\n");
+        return -1;
+    }
+
+    // A page in swap is read after the writes queued before it; any other page takes
+    //  fault_ticks, but not before a page evicted to make room has been written out
+    uint64_t written = chargeSwap(k);
+    uint64_t done = swapped ? swapTransfer(k, 1) : k->sim_time + k->config.fault_ticks;
+    if (written > done) {
+        done = written;
+    }
+
+    // Reads take different times, so the I/O queue is kept sorted by completion time
+    process->io_vpn = vpn;
+    process->io_frame = frame;
+    process->io_write = write;
+    process->io_done = done;
+    process->state = BLOCKED;
+    process->waitState = WAITING_IO;
+    process->block_time = k->sim_time;
+    PCB *before = List_last(k->io_list);
+    while (before != NULL && before->io_done > done) {
+        before = List_prev(k->io_list);
+    }
+    if (List_insert_after(k->io_list, process) == -1) {
+        FrameTable_free(&k->frames, frame);
+        process->state = RUNNING;
+        return -1;
+    }
+    List_set_key(k->io_list, process->pid);
+    process->queue_node = k->io_list->current;
+    k->metrics.blocks[WAITING_IO]++;
+
+    kprintf(k, "Page fault at 0x%x%s, blocking process for I/O: \n", vpn << VM_PAGE_SHIFT, swapped ? " (in swap)" : "");
+    procinfo_helper(k, process);
+
+    k->current = nextProcess(k);
+    return 1;
+}
+
+// Wake the processes whose page reads have completed by now
+static void completeIO(Kernel *k) {
+
+    if (k->exit_loop)
+        return;
+
+    PCB *process;
+    while ((process = List_first(k->io_list)) != NULL && process->io_done <= k->sim_time) {
+        List_remove(k->io_list);
+
+        // Without a page table for it, the page is dropped and will fault again
+        if (AddressSpace_map(&process->mem, process->io_vpn, process->io_frame, process->io_write) == -1) {
+            FrameTable_free(&k->frames, process->io_frame);
+        }
+        unblockIO(k, process);
+
+        kprintf(k, "Page read complete, process unblocked: \n");
+        procinfo_helper(k, process);
+    }
+}
+
+// Wake the process whose disk request has completed by now, and start the next request
+static void completeDisk(Kernel *k) {
+
+    if (k->exit_loop)
+        return;
+
+    PCB *process;
+    while ((process = BlockDev_complete(&k->disk, k->sim_time)) != NULL) {
+        BlockRequest *req = &process->disk;
+        if (req->fill) {
+            PageCache_filled(&k->cache, req->block / PAGECACHE_FILE_BLOCKS, req->block % PAGECACHE_FILE_BLOCKS, req->count);
+        }
+        unblockIO(k, process);
+        kprintf(k, "Disk %s complete, process unblocked: \n", process->disk.write ? "write" : "read");
+        procinfo_helper(k, process);
+    }
+}
+
+// Block the running process on a disk request
+static int submitDisk(Kernel *k, uint32_t block, uint32_t count, bool write, bool fill) {
+
+    PCB *process = k->current;
+    process->disk.block = block;
+    process->disk.count = count;
+    process->disk.write = write;
+    process->disk.fill = fill;
+    process->state = BLOCKED;
+    process->waitState = WAITING_DISK;
+    process->block_time = k->sim_time;
+    if (BlockDev_submit(&k->disk, process, k->sim_time) == -1) {
+        kprintf(k, "Error: Max process limit reached\n");
+        process->state = RUNNING;
+        return -1;
+    }
+    k->metrics.blocks[WAITING_DISK]++;
+    return 0;
+}
+
+// Write back dirty cached pages while the disk has nothing else to do
+static void flushCache(Kernel *k) {
+
+    if (k->exit_loop || k->disk.busy)
+        return;
+
+    uint32_t file, block, count;
+    if (PageCache_flush(&k->cache, k->sim_time, &file, &block, &count)) {
+        BlockDev_writeback(&k->disk, file * PAGECACHE_FILE_BLOCKS + block, count, k->sim_time);
+        kprintf(k, "Page cache writing back %u blocks at %u:%u\n", count, file, block);
+    }
+}
+
+// Make a process whose I/O has completed ready, or let it run if only init is running
+static void unblockIO(Kernel *k, PCB *process) {
+
+    process->state = READY;
+    process->ready_time = k->sim_time;
+
+    // If the init process is running, the woken process takes over
+    if (k->current == k->init) {
+        k->init->state = READY;
+        process->state = RUNNING;
+        k->current = process;
+        k->metrics.context_switches++;
+    }
+    else {
+        enqueue(k->ready_lists[process->priority], process);
+    }
+}
+
+// Queue transfers of count pages on the swap device, which does one page at a time in order
+static uint64_t swapTransfer(Kernel *k, uint64_t count) {
+
+    uint64_t start = k->swap_busy_until > k->sim_time ? k->swap_busy_until : k->sim_time;
+    k->swap_busy_until = start + count * k->config.swap_ticks;
+    k->metrics.swap_busy_ticks += count * k->config.swap_ticks;
+    return k->swap_busy_until;
+}
+
+// Queue the writes of the pages evicted to swap since the last call
+static uint64_t chargeSwap(Kernel *k) {
+
+    uint64_t pages = k->frames.swapOuts - k->swap_charged;
+    if (pages == 0)
+        return 0;
+    k->swap_charged = k->frames.swapOuts;
+    return swapTransfer(k, pages);
+}
+
+// Swap out the lowest priority ready process with the most resident pages
+static bool swapOutVictim(Kernel *k) {
+
+    if (k->proc_count - 1 - List_count(k->swap_list) <= 2)
+        return false;
+
+    Node *best = NULL;
+    List *queue = NULL;
+    for (int i = k->config.num_priorities - 1; i >= 0 && best == NULL; i--) {
+        queue = k->ready_lists[i];
+        for (Node *node = queue->head; node != NULL; node = List_node_next(queue, node)) {
+            if (best == NULL || ((PCB *)node->item)->mem.rss > ((PCB *)best->item)->mem.rss)
+                best = node;
+        }
+    }
+    if (best == NULL)
+        return false;
+    queue->current = best;
+    PCB *victim = List_remove(queue);
+
+    // Its private pages and kernel stack are written out; only the pages count against swap
+    unsigned int written = AddressSpace_swap_out(&victim->mem);
+    uint64_t transfer = 0;
+    if (victim->kstack != VM_NO_FRAME) {
+        FrameTable_free_block(&k->frames, victim->kstack, victim->kstack_order);
+        victim->kstack = VM_NO_FRAME;
+        transfer = 1u << victim->kstack_order;
+    }
+    chargeSwap(k);
+    swapTransfer(k, transfer);
+    victim->swap_pages = written;
+    victim->swap_done = 0;
+    victim->state = SWAPPED;
+    enqueue(k->swap_list, victim);
+    k->metrics.swap_process_outs++;
+
+    kprintf(k, "Memory overcommitted, process swapped out: \n");
+    procinfo_helper(k, victim);
+    return true;
+}
+
+// Start swapping in a process: its kernel stack and the pages it wrote out are read back, and
+//  it becomes ready once the swap device has them
+static bool swapIn(Kernel *k, PCB *process) {
+
+    if (allocKernelStack(k, process) == -1)
+        return false;
+    unsigned int read = AddressSpace_swap_in(&process->mem, process->swap_pages);
+    uint64_t transfer = read + (process->kstack != VM_NO_FRAME ? 1u << process->kstack_order : 0);
+
+    // Pages evicted to make room are written out first
+    chargeSwap(k);
+    process->swap_done = swapTransfer(k, transfer);
+    k->metrics.swap_process_ins++;
+
+    kprintf(k, "Swapping in process: \n");
+    procinfo_helper(k, process);
+    return true;
+}
+
+// Finish swap-ins, then every SWAP_INTERVAL ticks swap a process out while paging thrashes, or
+//  back in once it has calmed down. A process is also swapped in whenever nothing else can run.
+static void balanceSwap(Kernel *k) {
+
+    if (k->exit_loop)
+        return;
+    chargeSwap(k);
+
+    PCB *process;
+    while ((process = List_first(k->swap_list)) != NULL && process->swap_done != 0 && process->swap_done <= k->sim_time) {
+        List_remove(k->swap_list);
+        process->swap_done = 0;
+        unblockIO(k, process);
+        kprintf(k, "Swap in complete, process ready: \n");
+        procinfo_helper(k, process);
+    }
+
+    // Swap-ins go in the order processes were swapped out, one at a time
+    PCB *next = List_first(k->swap_list);
+    if (next != NULL && next->swap_done != 0)
+        next = NULL;
+    if (next != NULL && k->current == k->init && readyListEmpty(k)) {
+        swapIn(k, next);
+        return;
+    }
+
+    if (!k->config.load_control || k->sim_time % SWAP_INTERVAL != 0)
+        return;
+    uint64_t evictions = k->frames.evictions - k->swap_evictions;
+    k->swap_evictions = k->frames.evictions;
+    if (evictions >= SWAP_HIGH_EVICTIONS) {
+        swapOutVictim(k);
+    }
+    else if (evictions <= SWAP_LOW_EVICTIONS && next != NULL) {
+        swapIn(k, next);
+    }
+}
+
+// The frame table policy for a configured page replacement, NULL if there is none
+static const ReplacementPolicy* replacementPolicy(enum PageReplacement replacement) {
+
+    switch (replacement) {
+        case PAGE_REPLACE_CLOCK:
+            return &Replacement_clock;
+        case PAGE_REPLACE_AGING:
+            return &Replacement_aging;
+        case PAGE_REPLACE_ARC:
+            return &Replacement_arc;
+    }
+    return NULL;
+}
+
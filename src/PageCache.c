@@ -0,0 +1,392 @@
+#include "PageCache.h"
+#include <stdlib.h>
+
+
+// ---------- LISTS AND HASH INDEX ----------
+
+static uint32_t hashKey(PageCache *pc, uint32_t file, uint32_t block) {
+    uint64_t x = (((uint64_t)file << 32) | block) * 0x9e3779b97f4a7c15ull;
+    return (uint32_t)(x >> 32) & pc->bucketMask;
+}
+
+// The entry for (file, block), resident or a ghost, PAGECACHE_NIL if there is none
+static uint32_t lookup(PageCache *pc, uint32_t file, uint32_t block) {
+
+    uint32_t idx = pc->buckets[hashKey(pc, file, block)];
+    while (idx != PAGECACHE_NIL && (pc->pages[idx].file != file || pc->pages[idx].block != block)) {
+        idx = pc->pages[idx].hashNext;
+    }
+    return idx;
+}
+
+static void hashInsert(PageCache *pc, uint32_t idx) {
+
+    uint32_t *bucket = &pc->buckets[hashKey(pc, pc->pages[idx].file, pc->pages[idx].block)];
+    pc->pages[idx].hashNext = *bucket;
+    *bucket = idx;
+}
+
+static void hashRemove(PageCache *pc, uint32_t idx) {
+
+    uint32_t *link = &pc->buckets[hashKey(pc, pc->pages[idx].file, pc->pages[idx].block)];
+    while (*link != idx) {
+        link = &pc->pages[*link].hashNext;
+    }
+    *link = pc->pages[idx].hashNext;
+}
+
+static void listUnlink(PageCache *pc, uint32_t idx) {
+
+    CachePage *page = &pc->pages[idx];
+    CacheList *list = &pc->lists[page->queue];
+    if (page->prev != PAGECACHE_NIL)
+        pc->pages[page->prev].next = page->next;
+    else
+        list->head = page->next;
+    if (page->next != PAGECACHE_NIL)
+        pc->pages[page->next].prev = page->prev;
+    else
+        list->tail = page->prev;
+    list->length--;
+}
+
+static void listPushHead(PageCache *pc, enum CacheQueue queue, uint32_t idx) {
+
+    CachePage *page = &pc->pages[idx];
+    CacheList *list = &pc->lists[queue];
+    page->queue = queue;
+    page->prev = PAGECACHE_NIL;
+    page->next = list->head;
+    if (list->head != PAGECACHE_NIL)
+        pc->pages[list->head].prev = idx;
+    else
+        list->tail = idx;
+    list->head = idx;
+    list->length++;
+}
+
+static void listPushTail(PageCache *pc, enum CacheQueue queue, uint32_t idx) {
+
+    CachePage *page = &pc->pages[idx];
+    CacheList *list = &pc->lists[queue];
+    page->queue = queue;
+    page->next = PAGECACHE_NIL;
+    page->prev = list->tail;
+    if (list->tail != PAGECACHE_NIL)
+        pc->pages[list->tail].next = idx;
+    else
+        list->head = idx;
+    list->tail = idx;
+    list->length++;
+}
+
+static void markDirty(PageCache *pc, uint32_t idx, uint64_t now) {
+
+    CachePage *page = &pc->pages[idx];
+    page->dirty = true;
+    page->dirtySince = now;
+    page->dirtyNext = PAGECACHE_NIL;
+    page->dirtyPrev = pc->dirtyTail;
+    if (pc->dirtyTail != PAGECACHE_NIL)
+        pc->pages[pc->dirtyTail].dirtyNext = idx;
+    else
+        pc->dirtyHead = idx;
+    pc->dirtyTail = idx;
+    pc->numDirty++;
+}
+
+static void markClean(PageCache *pc, uint32_t idx) {
+
+    CachePage *page = &pc->pages[idx];
+    if (page->dirtyPrev != PAGECACHE_NIL)
+        pc->pages[page->dirtyPrev].dirtyNext = page->dirtyNext;
+    else
+        pc->dirtyHead = page->dirtyNext;
+    if (page->dirtyNext != PAGECACHE_NIL)
+        pc->pages[page->dirtyNext].dirtyPrev = page->dirtyPrev;
+    else
+        pc->dirtyTail = page->dirtyPrev;
+    page->dirty = false;
+    pc->numDirty--;
+}
+
+// Forget an entry that is on no list
+static void release(PageCache *pc, uint32_t idx) {
+
+    hashRemove(pc, idx);
+    listPushHead(pc, CACHE_FREE, idx);
+}
+
+
+// ---------- EVICTION ----------
+
+// Evict the least recently used clean page, from A1in first while it is over its share.
+// Returns false if every resident page is dirty.
+static bool evictOne(PageCache *pc) {
+
+    enum CacheQueue order[2] = { CACHE_AM, CACHE_A1IN };
+    if (pc->lists[CACHE_A1IN].length > pc->inCap) {
+        order[0] = CACHE_A1IN;
+        order[1] = CACHE_AM;
+    }
+    for (int i = 0; i < 2; i++) {
+        for (uint32_t idx = pc->lists[order[i]].tail; idx != PAGECACHE_NIL; idx = pc->pages[idx].prev) {
+            if (pc->pages[idx].dirty)
+                continue;
+            listUnlink(pc, idx);
+            pc->evictions++;
+            if (order[i] != CACHE_A1IN) {
+                release(pc, idx);
+                return true;
+            }
+
+            // 2q remembers the name for a while
+            pc->pages[idx].uptodate = false;
+            listPushHead(pc, CACHE_A1OUT, idx);
+            if (pc->lists[CACHE_A1OUT].length > pc->outCap) {
+                uint32_t ghost = pc->lists[CACHE_A1OUT].tail;
+                listUnlink(pc, ghost);
+                release(pc, ghost);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// The resident page for (file, block), cached (not up to date) if it was not resident; cached
+//  tells which, and ghost whether 2q remembered it. Returns PAGECACHE_NIL if there is no room.
+static uint32_t cachePage(PageCache *pc, uint32_t file, uint32_t block, bool *cached, bool *ghost) {
+
+    uint32_t idx = lookup(pc, file, block);
+    *cached = idx != PAGECACHE_NIL && pc->pages[idx].queue != CACHE_A1OUT;
+    *ghost = idx != PAGECACHE_NIL && !*cached;
+    if (*cached) {
+        // A1in is a FIFO; only Am is kept in order of use
+        if (pc->pages[idx].queue == CACHE_AM) {
+            listUnlink(pc, idx);
+            listPushHead(pc, CACHE_AM, idx);
+        }
+        return idx;
+    }
+
+    // Take the ghost off A1out first, so that making room cannot drop it
+    if (*ghost)
+        listUnlink(pc, idx);
+    if (PageCache_resident(pc) >= pc->capacity && !evictOne(pc)) {
+        if (*ghost)
+            release(pc, idx);
+        return PAGECACHE_NIL;
+    }
+    if (!*ghost) {
+        idx = pc->lists[CACHE_FREE].head;
+        listUnlink(pc, idx);
+        pc->pages[idx].file = file;
+        pc->pages[idx].block = block;
+        hashInsert(pc, idx);
+    }
+    pc->pages[idx].dirty = false;
+    pc->pages[idx].uptodate = false;
+    listPushHead(pc, *ghost || pc->policy == CACHE_LRU ? CACHE_AM : CACHE_A1IN, idx);
+    return idx;
+}
+
+static bool isDirty(PageCache *pc, uint32_t file, uint32_t block) {
+
+    uint32_t idx = lookup(pc, file, block);
+    return idx != PAGECACHE_NIL && pc->pages[idx].dirty;
+}
+
+
+// ---------- CACHE ----------
+
+int PageCache_init(PageCache *pc, uint32_t capacity, enum CachePolicy policy) {
+
+    pc->capacity = capacity;
+    pc->policy = policy;
+    pc->inCap = capacity / 4;
+    pc->outCap = policy == CACHE_2Q ? capacity / 2 : 0;
+    uint32_t numEntries = capacity + pc->outCap;
+    uint32_t numBuckets = 1;
+    while (numBuckets < numEntries) {
+        numBuckets <<= 1;
+    }
+    pc->bucketMask = numBuckets - 1;
+    pc->pages = calloc(numEntries, sizeof(CachePage));
+    pc->buckets = malloc(numBuckets * sizeof(uint32_t));
+    if (pc->pages == NULL || pc->buckets == NULL) {
+        free(pc->pages);
+        free(pc->buckets);
+        pc->pages = NULL;
+        pc->buckets = NULL;
+        return -1;
+    }
+    for (uint32_t b = 0; b < numBuckets; b++) {
+        pc->buckets[b] = PAGECACHE_NIL;
+    }
+    for (int q = 0; q < CACHE_NUM_QUEUES; q++) {
+        pc->lists[q].head = PAGECACHE_NIL;
+        pc->lists[q].tail = PAGECACHE_NIL;
+        pc->lists[q].length = 0;
+    }
+    for (uint32_t i = 0; i < numEntries; i++) {
+        listPushTail(pc, CACHE_FREE, i);
+    }
+    pc->dirtyHead = PAGECACHE_NIL;
+    pc->dirtyTail = PAGECACHE_NIL;
+    pc->numDirty = 0;
+    pc->hits = 0;
+    pc->misses = 0;
+    pc->ghostHits = 0;
+    pc->evictions = 0;
+    pc->overwrites = 0;
+    pc->throttled = 0;
+    pc->writebacks = 0;
+    pc->writebackBlocks = 0;
+    return 0;
+}
+
+void PageCache_destroy(PageCache *pc) {
+
+    free(pc->pages);
+    free(pc->buckets);
+    pc->pages = NULL;
+    pc->buckets = NULL;
+}
+
+uint32_t PageCache_resident(PageCache *pc) {
+    return pc->lists[CACHE_A1IN].length + pc->lists[CACHE_AM].length;
+}
+
+uint32_t PageCache_read(PageCache *pc, uint32_t file, uint32_t block, uint32_t count, uint32_t *first, uint32_t *last) {
+
+    uint32_t missing = 0;
+    for (uint32_t b = block; b < block + count; b++) {
+        bool cached, ghost;
+        uint32_t idx = cachePage(pc, file, b, &cached, &ghost);
+        if (cached && pc->pages[idx].uptodate) {
+            pc->hits++;
+            continue;
+        }
+        pc->misses++;
+        if (ghost)
+            pc->ghostHits++;
+        if (missing++ == 0)
+            *first = b;
+        *last = b;
+    }
+    return missing;
+}
+
+void PageCache_filled(PageCache *pc, uint32_t file, uint32_t block, uint32_t count) {
+
+    for (uint32_t b = block; b < block + count; b++) {
+        uint32_t idx = lookup(pc, file, b);
+        if (idx != PAGECACHE_NIL && pc->pages[idx].queue != CACHE_A1OUT)
+            pc->pages[idx].uptodate = true;
+    }
+}
+
+bool PageCache_write(PageCache *pc, uint32_t file, uint32_t block, uint32_t count, uint64_t now) {
+
+    // At most half the cache is dirty, so there are always clean pages to evict
+    bool absorb = pc->numDirty + count <= pc->capacity / 2;
+    if (!absorb)
+        pc->throttled++;
+
+    for (uint32_t b = block; b < block + count; b++) {
+        bool cached, ghost;
+        uint32_t idx = cachePage(pc, file, b, &cached, &ghost);
+        if (idx == PAGECACHE_NIL)
+            continue;
+        pc->pages[idx].uptodate = true;
+        if (absorb && pc->pages[idx].dirty)
+            pc->overwrites++;
+        else if (absorb)
+            markDirty(pc, idx, now);
+        else if (pc->pages[idx].dirty)
+            markClean(pc, idx);
+    }
+    return absorb;
+}
+
+void PageCache_invalidate(PageCache *pc, uint32_t file, uint32_t block, uint32_t count) {
+
+    for (uint32_t b = block; b < block + count; b++) {
+        uint32_t idx = lookup(pc, file, b);
+        if (idx == PAGECACHE_NIL)
+            continue;
+        if (pc->pages[idx].dirty)
+            markClean(pc, idx);
+        listUnlink(pc, idx);
+        release(pc, idx);
+    }
+}
+
+bool PageCache_flush(PageCache *pc, uint64_t now, uint32_t *file, uint32_t *block, uint32_t *count) {
+
+    if (pc->numDirty == 0)
+        return false;
+    CachePage *oldest = &pc->pages[pc->dirtyHead];
+    if (pc->numDirty <= pc->capacity / 10 && oldest->dirtySince + PAGECACHE_EXPIRE_TICKS > now)
+        return false;
+
+    uint32_t f = oldest->file;
+    uint32_t lo = oldest->block;
+    uint32_t hi = oldest->block;
+    while (hi - lo + 1 < PAGECACHE_MAX_BATCH && lo > 0 && isDirty(pc, f, lo - 1)) {
+        lo--;
+    }
+    while (hi - lo + 1 < PAGECACHE_MAX_BATCH && hi + 1 < PAGECACHE_FILE_BLOCKS && isDirty(pc, f, hi + 1)) {
+        hi++;
+    }
+    for (uint32_t b = lo; b <= hi; b++) {
+        markClean(pc, lookup(pc, f, b));
+    }
+
+    pc->writebacks++;
+    pc->writebackBlocks += hi - lo + 1;
+    *file = f;
+    *block = lo;
+    *count = hi - lo + 1;
+    return true;
+}
+
+int PageCache_restore_page(PageCache *pc, uint32_t file, uint32_t block, enum CacheQueue queue, bool uptodate) {
+
+    if (lookup(pc, file, block) != PAGECACHE_NIL)
+        return -1;
+    if (queue == CACHE_A1OUT ? pc->lists[CACHE_A1OUT].length >= pc->outCap
+        : (queue != CACHE_A1IN && queue != CACHE_AM) || PageCache_resident(pc) >= pc->capacity)
+        return -1;
+
+    uint32_t idx = pc->lists[CACHE_FREE].head;
+    listUnlink(pc, idx);
+    pc->pages[idx].file = file;
+    pc->pages[idx].block = block;
+    pc->pages[idx].dirty = false;
+    pc->pages[idx].uptodate = queue != CACHE_A1OUT && uptodate;
+    hashInsert(pc, idx);
+    listPushTail(pc, queue, idx);
+    return 0;
+}
+
+int PageCache_restore_dirty(PageCache *pc, uint32_t file, uint32_t block, uint64_t since) {
+
+    uint32_t idx = lookup(pc, file, block);
+    if (idx == PAGECACHE_NIL || pc->pages[idx].queue == CACHE_A1OUT || pc->pages[idx].dirty)
+        return -1;
+    markDirty(pc, idx, since);
+    return 0;
+}
+
+const char* PageCache_policy_name(enum CachePolicy policy) {
+
+    switch (policy) {
+        case CACHE_LRU:
+            return "lru";
+        case CACHE_2Q:
+            return "2q";
+    }
+    return NULL;
+}
@@ -0,0 +1,449 @@
+#include "Replacement.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+// START OF PRIVATE FUNCTIONS -------
+
+// A list of frames linked through their prev/next fields, LRU at the head, MRU at the tail
+typedef struct FrameList_s FrameList;
+struct FrameList_s {
+    uint32_t head;
+    uint32_t tail;
+    unsigned int count;
+};
+
+static void FrameList_init(FrameList *list) {
+    list->head = FRAME_NIL;
+    list->tail = FRAME_NIL;
+    list->count = 0;
+}
+
+static void FrameList_push(FrameTable *ft, FrameList *list, uint32_t frame) {
+
+    Frame *f = &ft->frames[frame];
+    f->prev = list->tail;
+    f->next = FRAME_NIL;
+    if (list->tail != FRAME_NIL)
+        ft->frames[list->tail].next = frame;
+    else
+        list->head = frame;
+    list->tail = frame;
+    list->count++;
+}
+
+static void FrameList_unlink(FrameTable *ft, FrameList *list, uint32_t frame) {
+
+    Frame *f = &ft->frames[frame];
+    if (f->prev != FRAME_NIL)
+        ft->frames[f->prev].next = f->next;
+    else
+        list->head = f->next;
+    if (f->next != FRAME_NIL)
+        ft->frames[f->next].prev = f->prev;
+    else
+        list->tail = f->prev;
+    list->count--;
+}
+
+static pte_t* Replacement_pte(FrameTable *ft, uint32_t frame) {
+    return AddressSpace_pte(ft->frames[frame].owner, ft->frames[frame].vpn, false);
+}
+
+
+// ---------- CLOCK ----------
+
+typedef struct ClockState_s ClockState;
+struct ClockState_s {
+    unsigned int hand;
+};
+
+static int Clock_init(FrameTable *ft) {
+    ft->policyState = calloc(1, sizeof(ClockState));
+    return ft->policyState != NULL ? 0 : -1;
+}
+
+static void Clock_destroy(FrameTable *ft) {
+    free(ft->policyState);
+}
+
+static void Clock_mapped(FrameTable *ft, unsigned int frame) {
+    ft->frames[frame].queue = 1;
+}
+
+static void Clock_released(FrameTable *ft, unsigned int frame) {
+    ft->frames[frame].queue = 0;
+}
+
+static int Clock_victim(FrameTable *ft, AddressSpace *owner, uint32_t vpn) {
+
+    ClockState *clock = ft->policyState;
+
+    // Two sweeps: the first may only clear accessed bits
+    for (unsigned int i = 0; i < 2 * ft->numFrames; i++) {
+        unsigned int frame = clock->hand;
+        clock->hand = (clock->hand + 1) % ft->numFrames;
+        if (ft->frames[frame].queue == 0)
+            continue;
+
+        pte_t *pte = Replacement_pte(ft, frame);
+        if (*pte & PTE_ACCESSED) {
+            *pte &= ~PTE_ACCESSED;
+            continue;
+        }
+        ft->frames[frame].queue = 0;
+        return (int)frame;
+    }
+    return VM_NO_FRAME;
+}
+
+
+// ---------- AGING ----------
+
+#define AGING_NUM_AGES 256
+
+typedef struct AgingState_s AgingState;
+struct AgingState_s {
+    FrameList ages[AGING_NUM_AGES];     // Tracked frames by age
+    uint64_t used[AGING_NUM_AGES / 64]; // Bit per non-empty age list
+    unsigned int ticks;
+};
+
+static void Aging_push(FrameTable *ft, AgingState *aging, unsigned int frame) {
+
+    uint8_t age = ft->frames[frame].age;
+    FrameList_push(ft, &aging->ages[age], frame);
+    aging->used[age / 64] |= 1ull << (age % 64);
+}
+
+static void Aging_unlink(FrameTable *ft, AgingState *aging, unsigned int frame) {
+
+    uint8_t age = ft->frames[frame].age;
+    FrameList_unlink(ft, &aging->ages[age], frame);
+    if (aging->ages[age].count == 0)
+        aging->used[age / 64] &= ~(1ull << (age % 64));
+}
+
+static int Aging_init(FrameTable *ft) {
+
+    AgingState *aging = calloc(1, sizeof(AgingState));
+    if (aging == NULL)
+        return -1;
+    for (int i = 0; i < AGING_NUM_AGES; i++) {
+        FrameList_init(&aging->ages[i]);
+    }
+    ft->policyState = aging;
+    return 0;
+}
+
+static void Aging_destroy(FrameTable *ft) {
+    free(ft->policyState);
+}
+
+static void Aging_mapped(FrameTable *ft, unsigned int frame) {
+
+    AgingState *aging = ft->policyState;
+    Frame *f = &ft->frames[frame];
+
+    // A page that was just read in counts as used in the latest interval
+    f->age = 0x80;
+    f->queue = 1;
+    Aging_push(ft, aging, frame);
+}
+
+static void Aging_released(FrameTable *ft, unsigned int frame) {
+
+    AgingState *aging = ft->policyState;
+    Aging_unlink(ft, aging, frame);
+    ft->frames[frame].queue = 0;
+}
+
+static int Aging_victim(FrameTable *ft, AddressSpace *owner, uint32_t vpn) {
+
+    // The oldest page heads the lowest non-empty age list
+    AgingState *aging = ft->policyState;
+    for (int word = 0; word < AGING_NUM_AGES / 64; word++) {
+        if (aging->used[word] != 0) {
+            uint32_t frame = aging->ages[word * 64 + __builtin_ctzll(aging->used[word])].head;
+            Aging_unlink(ft, aging, frame);
+            ft->frames[frame].queue = 0;
+            return (int)frame;
+        }
+    }
+    return VM_NO_FRAME;
+}
+
+// Shift every age right, with the accessed bit of the last interval coming in at the top
+static void Aging_tick(FrameTable *ft) {
+
+    AgingState *aging = ft->policyState;
+    if (++aging->ticks % REPLACEMENT_AGING_INTERVAL != 0)
+        return;
+
+    for (unsigned int frame = 0; frame < ft->numFrames; frame++) {
+        Frame *f = &ft->frames[frame];
+        if (f->queue == 0)
+            continue;
+
+        pte_t *pte = Replacement_pte(ft, frame);
+        uint8_t age = (f->age >> 1) | ((*pte & PTE_ACCESSED) ? 0x80 : 0);
+        *pte &= ~PTE_ACCESSED;
+        if (age != f->age) {
+            Aging_unlink(ft, aging, frame);
+            f->age = age;
+            Aging_push(ft, aging, frame);
+        }
+    }
+}
+
+
+// ---------- ARC ----------
+
+#define ARC_T1 1
+#define ARC_T2 2
+#define ARC_B1 1
+#define ARC_B2 2
+
+// A recently evicted page, remembered by its address space and page number
+typedef struct ArcGhost_s ArcGhost;
+struct ArcGhost_s {
+    AddressSpace *owner;
+    uint32_t vpn;
+    uint32_t prev;
+    uint32_t next;
+    uint32_t hashNext;
+    uint8_t list;           // ARC_B1, ARC_B2, or 0 while unused
+};
+
+typedef struct ArcGhostList_s ArcGhostList;
+struct ArcGhostList_s {
+    uint32_t head;          // LRU
+    uint32_t tail;          // MRU
+    unsigned int count;
+};
+
+typedef struct ArcState_s ArcState;
+struct ArcState_s {
+    FrameList t1;
+    FrameList t2;
+    unsigned int p;         // Target size of T1
+    ArcGhost *ghosts;       // Room for numFrames ghosts
+    ArcGhostList b1;
+    ArcGhostList b2;
+    uint32_t freeGhosts;    // Unused ghosts, linked through next
+    uint32_t *hash;         // Ghost chains by (owner, vpn)
+    uint32_t hashMask;
+};
+
+static uint32_t Arc_hash(ArcState *arc, AddressSpace *owner, uint32_t vpn) {
+
+    uint64_t key = ((uint64_t)(uintptr_t)owner * 0x9e3779b97f4a7c15ull) ^ vpn;
+    key ^= key >> 29;
+    return (uint32_t)(key * 0xbf58476d1ce4e5b9ull >> 32) & arc->hashMask;
+}
+
+static ArcGhostList* Arc_ghost_list(ArcState *arc, uint8_t list) {
+    return list == ARC_B1 ? &arc->b1 : &arc->b2;
+}
+
+static uint32_t Arc_ghost_find(ArcState *arc, AddressSpace *owner, uint32_t vpn) {
+
+    uint32_t g = arc->hash[Arc_hash(arc, owner, vpn)];
+    while (g != FRAME_NIL && (arc->ghosts[g].owner != owner || arc->ghosts[g].vpn != vpn)) {
+        g = arc->ghosts[g].hashNext;
+    }
+    return g;
+}
+
+static void Arc_ghost_remove(ArcState *arc, uint32_t g) {
+
+    ArcGhost *ghost = &arc->ghosts[g];
+    ArcGhostList *list = Arc_ghost_list(arc, ghost->list);
+
+    if (ghost->prev != FRAME_NIL)
+        arc->ghosts[ghost->prev].next = ghost->next;
+    else
+        list->head = ghost->next;
+    if (ghost->next != FRAME_NIL)
+        arc->ghosts[ghost->next].prev = ghost->prev;
+    else
+        list->tail = ghost->prev;
+    list->count--;
+
+    // Chains are short, the hash table has twice as many heads as there are ghosts
+    uint32_t *link = &arc->hash[Arc_hash(arc, ghost->owner, ghost->vpn)];
+    while (*link != g) {
+        link = &arc->ghosts[*link].hashNext;
+    }
+    *link = ghost->hashNext;
+
+    ghost->list = 0;
+    ghost->next = arc->freeGhosts;
+    arc->freeGhosts = g;
+}
+
+// Remember an evicted page at the MRU end of a ghost list, forgetting the oldest ghost if
+//  there is no room
+static void Arc_ghost_add(ArcState *arc, uint8_t which, AddressSpace *owner, uint32_t vpn) {
+
+    ArcGhostList *list = Arc_ghost_list(arc, which);
+    if (arc->freeGhosts == FRAME_NIL) {
+        ArcGhostList *victims = list->count > 0 ? list : Arc_ghost_list(arc, which == ARC_B1 ? ARC_B2 : ARC_B1);
+        Arc_ghost_remove(arc, victims->head);
+    }
+
+    uint32_t g = arc->freeGhosts;
+    ArcGhost *ghost = &arc->ghosts[g];
+    arc->freeGhosts = ghost->next;
+
+    ghost->owner = owner;
+    ghost->vpn = vpn;
+    ghost->list = which;
+    ghost->prev = list->tail;
+    ghost->next = FRAME_NIL;
+    if (list->tail != FRAME_NIL)
+        arc->ghosts[list->tail].next = g;
+    else
+        list->head = g;
+    list->tail = g;
+    list->count++;
+
+    uint32_t h = Arc_hash(arc, owner, vpn);
+    ghost->hashNext = arc->hash[h];
+    arc->hash[h] = g;
+}
+
+static int Arc_init(FrameTable *ft) {
+
+    ArcState *arc = calloc(1, sizeof(ArcState));
+    if (arc == NULL)
+        return -1;
+
+    unsigned int numGhosts = ft->numFrames > 0 ? ft->numFrames : 1;
+    uint32_t hashSize = 2;
+    while (hashSize < 2 * numGhosts) {
+        hashSize *= 2;
+    }
+    arc->ghosts = calloc(numGhosts, sizeof(ArcGhost));
+    arc->hash = malloc(hashSize * sizeof(uint32_t));
+    if (arc->ghosts == NULL || arc->hash == NULL) {
+        free(arc->ghosts);
+        free(arc->hash);
+        free(arc);
+        return -1;
+    }
+    arc->hashMask = hashSize - 1;
+    memset(arc->hash, 0xff, hashSize * sizeof(uint32_t));
+
+    FrameList_init(&arc->t1);
+    FrameList_init(&arc->t2);
+    arc->b1.head = arc->b1.tail = FRAME_NIL;
+    arc->b2.head = arc->b2.tail = FRAME_NIL;
+    for (uint32_t g = 0; g < numGhosts; g++) {
+        arc->ghosts[g].next = g + 1 < numGhosts ? g + 1 : FRAME_NIL;
+    }
+    arc->freeGhosts = 0;
+    ft->policyState = arc;
+    return 0;
+}
+
+static void Arc_destroy(FrameTable *ft) {
+
+    ArcState *arc = ft->policyState;
+    free(arc->ghosts);
+    free(arc->hash);
+    free(arc);
+}
+
+// A page read in on a ghost hit goes to T2, and moves the target size of T1 towards the list
+//  that would have kept it. Any other page starts in T1.
+static void Arc_mapped(FrameTable *ft, unsigned int frame) {
+
+    ArcState *arc = ft->policyState;
+    Frame *f = &ft->frames[frame];
+    uint32_t g = Arc_ghost_find(arc, f->owner, f->vpn);
+
+    if (g != FRAME_NIL && arc->ghosts[g].list == ARC_B1) {
+        unsigned int delta = arc->b1.count >= arc->b2.count ? 1 : arc->b2.count / arc->b1.count;
+        arc->p = arc->p + delta < ft->numFrames ? arc->p + delta : ft->numFrames;
+        Arc_ghost_remove(arc, g);
+        f->queue = ARC_T2;
+        FrameList_push(ft, &arc->t2, frame);
+    }
+    else if (g != FRAME_NIL) {
+        unsigned int delta = arc->b2.count >= arc->b1.count ? 1 : arc->b1.count / arc->b2.count;
+        arc->p = arc->p > delta ? arc->p - delta : 0;
+        Arc_ghost_remove(arc, g);
+        f->queue = ARC_T2;
+        FrameList_push(ft, &arc->t2, frame);
+    }
+    else {
+        // Keep T1 and its ghosts within the cache size
+        if (arc->t1.count + arc->b1.count >= ft->numFrames && arc->b1.count > 0)
+            Arc_ghost_remove(arc, arc->b1.head);
+        f->queue = ARC_T1;
+        FrameList_push(ft, &arc->t1, frame);
+    }
+}
+
+static void Arc_released(FrameTable *ft, unsigned int frame) {
+
+    ArcState *arc = ft->policyState;
+    FrameList_unlink(ft, ft->frames[frame].queue == ARC_T1 ? &arc->t1 : &arc->t2, frame);
+    ft->frames[frame].queue = 0;
+}
+
+static void Arc_hit(FrameTable *ft, unsigned int frame) {
+
+    ArcState *arc = ft->policyState;
+    Frame *f = &ft->frames[frame];
+    if (f->queue == 0)
+        return;
+
+    FrameList_unlink(ft, f->queue == ARC_T1 ? &arc->t1 : &arc->t2, frame);
+    f->queue = ARC_T2;
+    FrameList_push(ft, &arc->t2, frame);
+}
+
+static int Arc_victim(FrameTable *ft, AddressSpace *owner, uint32_t vpn) {
+
+    ArcState *arc = ft->policyState;
+    uint32_t g = Arc_ghost_find(arc, owner, vpn);
+    bool inB2 = g != FRAME_NIL && arc->ghosts[g].list == ARC_B2;
+
+    // REPLACE: take from T1 when it is over its target size
+    FrameList *from;
+    uint8_t ghostList;
+    if (arc->t1.count > 0 && (arc->t1.count > arc->p || (inB2 && arc->t1.count == arc->p) || arc->t2.count == 0)) {
+        from = &arc->t1;
+        ghostList = ARC_B1;
+    }
+    else if (arc->t2.count > 0) {
+        from = &arc->t2;
+        ghostList = ARC_B2;
+    }
+    else {
+        return VM_NO_FRAME;
+    }
+
+    uint32_t frame = from->head;
+    FrameList_unlink(ft, from, frame);
+    ft->frames[frame].queue = 0;
+    Arc_ghost_add(arc, ghostList, ft->frames[frame].owner, ft->frames[frame].vpn);
+    return (int)frame;
+}
+
+// END OF PRIVATE FUNCTIONS ---------
+
+
+const ReplacementPolicy Replacement_clock = {
+    "clock", Clock_init, Clock_destroy, Clock_mapped, Clock_released, Clock_victim, NULL, NULL
+};
+
+const ReplacementPolicy Replacement_aging = {
+    "aging", Aging_init, Aging_destroy, Aging_mapped, Aging_released, Aging_victim, NULL, Aging_tick
+};
+
+const ReplacementPolicy Replacement_arc = {
+    "arc", Arc_init, Arc_destroy, Arc_mapped, Arc_released, Arc_victim, Arc_hit, NULL
+};
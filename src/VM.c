@@ -0,0 +1,612 @@
+#include "VM.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+// Put the free block of 2^order frames starting at frame at the head of its free list
+static void pushFree(FrameTable *ft, uint32_t frame, unsigned int order) {
+
+    Frame *f = &ft->frames[frame];
+    f->freeOrder = (uint8_t)(order + 1);
+    f->prev = FRAME_NIL;
+    f->next = ft->freeLists[order];
+    if (f->next != FRAME_NIL)
+        ft->frames[f->next].prev = frame;
+    ft->freeLists[order] = frame;
+    ft->freeBlocks[order]++;
+    ft->numFree += 1u << order;
+}
+
+static void unlinkFree(FrameTable *ft, uint32_t frame) {
+
+    Frame *f = &ft->frames[frame];
+    unsigned int order = f->freeOrder - 1u;
+    if (f->prev != FRAME_NIL)
+        ft->frames[f->prev].next = f->next;
+    else
+        ft->freeLists[order] = f->next;
+    if (f->next != FRAME_NIL)
+        ft->frames[f->next].prev = f->prev;
+    f->freeOrder = 0;
+    ft->freeBlocks[order]--;
+    ft->numFree -= 1u << order;
+}
+
+// Take a free block of 2^order frames, splitting a larger one if needed.
+// Returns the first frame, VM_NO_FRAME if no free block is large enough.
+static int allocBlock(FrameTable *ft, unsigned int order) {
+
+    unsigned int from = order;
+    while (from <= VM_MAX_ORDER && ft->freeLists[from] == FRAME_NIL) {
+        from++;
+    }
+    if (from > VM_MAX_ORDER)
+        return VM_NO_FRAME;
+
+    // Keep the lower half, return the upper half of each split to the free lists
+    uint32_t frame = ft->freeLists[from];
+    unlinkFree(ft, frame);
+    while (from > order) {
+        from--;
+        pushFree(ft, frame + (1u << from), from);
+    }
+    return (int)frame;
+}
+
+// Return a block of 2^order frames, merging it with its buddy for as long as the buddy is free
+static void freeBlock(FrameTable *ft, uint32_t frame, unsigned int order) {
+
+    while (order < VM_MAX_ORDER) {
+        uint32_t buddy = frame ^ (1u << order);
+        if (buddy >= ft->numFrames || ft->frames[buddy].freeOrder != order + 1)
+            break;
+        unlinkFree(ft, buddy);
+        frame &= ~(1u << order);
+        order++;
+    }
+    pushFree(ft, frame, order);
+}
+
+// Free the run of frames [start, end) as the largest aligned blocks that fit
+static void freeRun(FrameTable *ft, uint32_t start, uint32_t end) {
+
+    while (start < end) {
+        unsigned int order = 0;
+        while (order < VM_MAX_ORDER && (start & (1u << order)) == 0 && start + (2u << order) <= end) {
+            order++;
+        }
+        pushFree(ft, start, order);
+        start += 1u << order;
+    }
+}
+
+// Take the lowest free swap slot. Returns FRAME_NIL if every slot is in use.
+static uint32_t allocSlot(FrameTable *ft) {
+
+    unsigned int words = (ft->numSlots + 63) / 64;
+    while (ft->slotHint < words && ft->slotUsed[ft->slotHint] == UINT64_MAX) {
+        ft->slotHint++;
+    }
+    if (ft->slotHint == words)
+        return FRAME_NIL;
+
+    uint32_t slot = ft->slotHint * 64 + (uint32_t)__builtin_ctzll(~ft->slotUsed[ft->slotHint]);
+    if (slot >= ft->numSlots)
+        return FRAME_NIL;
+    ft->slotUsed[slot / 64] |= 1ull << (slot % 64);
+    ft->slotsUsed++;
+    return slot;
+}
+
+// One entry fewer names slot. The slot is freed with its last entry.
+static void unrefSlot(FrameTable *ft, uint32_t slot) {
+
+    if (--ft->slotRefs[slot] != 0)
+        return;
+    ft->slotUsed[slot / 64] &= ~(1ull << (slot % 64));
+    ft->slotsUsed--;
+    if (slot / 64 < ft->slotHint)
+        ft->slotHint = slot / 64;
+}
+
+// The entry of as that maps frame at page vpn, NULL if as does not map it
+static pte_t* sharerPte(AddressSpace *as, uint32_t vpn, uint32_t frame) {
+
+    pte_t *pte = AddressSpace_pte(as, vpn, false);
+    if (pte == NULL || !(*pte & PTE_PRESENT) || (*pte >> PTE_FRAME_SHIFT) != frame)
+        return NULL;
+    return pte;
+}
+
+// Another address space in the family of as that maps frame, NULL if there is none
+static AddressSpace* otherSharer(AddressSpace *as, uint32_t vpn, uint32_t frame) {
+
+    for (AddressSpace *rel = as->familyNext; rel != as; rel = rel->familyNext) {
+        if (sharerPte(rel, vpn, frame) != NULL)
+            return rel;
+    }
+    return NULL;
+}
+
+// as no longer maps frame at page vpn. The frame is freed with its last mapping.
+static void unrefFrame(FrameTable *ft, AddressSpace *as, uint32_t vpn, uint32_t frame) {
+
+    Frame *f = &ft->frames[frame];
+    if (--f->refs == 0) {
+        FrameTable_free(ft, (int)frame);
+        return;
+    }
+    ft->sharedPages--;
+    if (f->owner == as)
+        f->owner = otherSharer(as, vpn, frame);
+}
+
+// Let the replacement policy pick a resident page, and unmap it from every address space
+static int evictVictim(FrameTable *ft, AddressSpace *owner, uint32_t vpn) {
+
+    int frame = ft->policy->victim(ft, owner, vpn);
+    if (frame == VM_NO_FRAME)
+        return VM_NO_FRAME;
+
+    // The page was written to if any of the entries mapping it says so
+    Frame *f = &ft->frames[frame];
+    AddressSpace *as = f->owner;
+    bool dirty = false;
+    uint32_t seen = 0;
+    do {
+        pte_t *pte = sharerPte(as, f->vpn, (uint32_t)frame);
+        if (pte != NULL) {
+            dirty |= (*pte & PTE_DIRTY) != 0;
+            seen++;
+        }
+        as = as->familyNext;
+    } while (seen < f->refs && as != f->owner);
+
+    // A written page goes to swap if there is room; otherwise it is simply dropped, and the
+    //  next access faults it back in
+    pte_t entry = 0;
+    uint32_t slot = dirty ? allocSlot(ft) : FRAME_NIL;
+    if (slot != FRAME_NIL) {
+        entry = ((pte_t)slot << PTE_FRAME_SHIFT) | PTE_SWAPPED;
+        ft->swapOuts++;
+    }
+    else if (dirty && ft->numSlots > 0) {
+        ft->swapFull++;
+    }
+
+    as = f->owner;
+    ft->sharedPages -= f->refs - 1;
+    do {
+        pte_t *pte = sharerPte(as, f->vpn, (uint32_t)frame);
+        if (pte != NULL) {
+            *pte = entry;
+            if (slot != FRAME_NIL)
+                ft->slotRefs[slot]++;
+            as->rss--;
+            f->refs--;
+        }
+        as = as->familyNext;
+    } while (f->refs > 0 && as != f->owner);
+    f->refs = 0;
+
+    if (dirty)
+        ft->dirtyEvictions++;
+    ft->evictions++;
+    return frame;
+}
+
+// Give as a page of its own for the shared page vpn it is writing to.
+// Returns false if the page has to be faulted in instead.
+static bool cowFault(AddressSpace *as, uint32_t vpn, pte_t *pte) {
+
+    FrameTable *ft = as->frames;
+    uint32_t shared = *pte >> PTE_FRAME_SHIFT;
+    ft->cowFaults++;
+
+    // Everyone else has copied the page or gone away already
+    if (ft->frames[shared].refs == 1) {
+        ft->frames[shared].owner = as;
+        *pte = (*pte & ~PTE_COW) | PTE_ACCESSED | PTE_DIRTY;
+        return true;
+    }
+
+    int frame = FrameTable_alloc(ft, as, vpn);
+    if (frame == VM_NO_FRAME)
+        frame = FrameTable_evict(ft, as, vpn);
+    if (frame == VM_NO_FRAME)
+        return false;
+
+    // The shared page itself may have been evicted to make room for the copy
+    if (!(*pte & PTE_PRESENT)) {
+        FrameTable_free(ft, frame);
+        return false;
+    }
+
+    unrefFrame(ft, as, vpn, shared);
+    *pte = ((pte_t)frame << PTE_FRAME_SHIFT) | PTE_PRESENT | PTE_ACCESSED | PTE_DIRTY;
+    ft->frames[frame].refs = 1;
+    ft->policy->mapped(ft, (unsigned int)frame);
+    ft->cowCopies++;
+    return true;
+}
+
+int FrameTable_init(FrameTable *ft, unsigned int numFrames, const ReplacementPolicy *policy) {
+
+    memset(ft, 0, sizeof(FrameTable));
+    ft->numFrames = numFrames;
+    ft->frames = calloc(numFrames > 0 ? numFrames : 1, sizeof(Frame));
+    if (ft->frames == NULL) {
+        return -1;
+    }
+    ft->policy = policy;
+    if (policy->init(ft) == -1) {
+        FrameTable_destroy(ft);
+        return -1;
+    }
+
+    FrameTable_clear_free(ft);
+    freeRun(ft, 0, numFrames);
+    return 0;
+}
+
+int FrameTable_init_swap(FrameTable *ft, unsigned int numSlots) {
+
+    if (numSlots > VM_MAX_SWAP_SLOTS)
+        return -1;
+    ft->slotRefs = calloc(numSlots > 0 ? numSlots : 1, sizeof(uint32_t));
+    ft->slotUsed = calloc(numSlots > 0 ? (numSlots + 63) / 64 : 1, sizeof(uint64_t));
+    if (ft->slotRefs == NULL || ft->slotUsed == NULL) {
+        free(ft->slotRefs);
+        free(ft->slotUsed);
+        ft->slotRefs = NULL;
+        ft->slotUsed = NULL;
+        return -1;
+    }
+    ft->numSlots = numSlots;
+    ft->slotsUsed = 0;
+    ft->slotHint = 0;
+    return 0;
+}
+
+void FrameTable_destroy(FrameTable *ft) {
+
+    if (ft->policy != NULL && ft->policyState != NULL) {
+        ft->policy->destroy(ft);
+    }
+    ft->policyState = NULL;
+    free(ft->frames);
+    ft->frames = NULL;
+    ft->numFrames = 0;
+    ft->numFree = 0;
+    free(ft->slotRefs);
+    free(ft->slotUsed);
+    ft->slotRefs = NULL;
+    ft->slotUsed = NULL;
+    ft->numSlots = 0;
+}
+
+int FrameTable_alloc(FrameTable *ft, AddressSpace *owner, uint32_t vpn) {
+
+    int frame = allocBlock(ft, 0);
+    if (frame == VM_NO_FRAME)
+        return VM_NO_FRAME;
+
+    ft->frames[frame].owner = owner;
+    ft->frames[frame].vpn = vpn;
+    return frame;
+}
+
+int FrameTable_alloc_block(FrameTable *ft, AddressSpace *owner, unsigned int order) {
+
+    if (order > VM_MAX_ORDER)
+        return VM_NO_FRAME;
+    int frame = allocBlock(ft, order);
+    if (frame == VM_NO_FRAME)
+        return VM_NO_FRAME;
+
+    for (uint32_t i = 0; i < 1u << order; i++) {
+        ft->frames[frame + i].owner = owner;
+        ft->frames[frame + i].vpn = VM_KERNEL_PAGE;
+    }
+    return frame;
+}
+
+int FrameTable_evict(FrameTable *ft, AddressSpace *owner, uint32_t vpn) {
+
+    int frame = evictVictim(ft, owner, vpn);
+    if (frame == VM_NO_FRAME)
+        return VM_NO_FRAME;
+
+    ft->frames[frame].owner = owner;
+    ft->frames[frame].vpn = vpn;
+    return frame;
+}
+
+bool FrameTable_reclaim(FrameTable *ft) {
+
+    int frame = evictVictim(ft, NULL, VM_KERNEL_PAGE);
+    if (frame == VM_NO_FRAME)
+        return false;
+
+    ft->frames[frame].owner = NULL;
+    freeBlock(ft, (uint32_t)frame, 0);
+    return true;
+}
+
+void FrameTable_free(FrameTable *ft, int frame) {
+
+    if (ft->frames[frame].queue != 0)
+        ft->policy->released(ft, (unsigned int)frame);
+    ft->frames[frame].owner = NULL;
+    ft->frames[frame].refs = 0;
+    freeBlock(ft, (uint32_t)frame, 0);
+}
+
+void FrameTable_free_block(FrameTable *ft, int frame, unsigned int order) {
+
+    for (uint32_t i = 0; i < 1u << order; i++) {
+        ft->frames[frame + i].owner = NULL;
+    }
+    freeBlock(ft, (uint32_t)frame, order);
+}
+
+int FrameTable_largest_free_order(FrameTable *ft) {
+
+    for (int order = VM_MAX_ORDER; order >= 0; order--) {
+        if (ft->freeLists[order] != FRAME_NIL)
+            return order;
+    }
+    return -1;
+}
+
+void FrameTable_clear_free(FrameTable *ft) {
+
+    for (unsigned int i = 0; i < ft->numFrames; i++) {
+        ft->frames[i].freeOrder = 0;
+    }
+    for (int order = 0; order <= VM_MAX_ORDER; order++) {
+        ft->freeLists[order] = FRAME_NIL;
+        ft->freeBlocks[order] = 0;
+    }
+    ft->numFree = 0;
+}
+
+void FrameTable_rebuild_free(FrameTable *ft) {
+
+    FrameTable_clear_free(ft);
+
+    // Runs of unowned frames become the largest blocks that fit, as if freed in one go
+    uint32_t runStart = 0;
+    for (uint32_t i = 0; i <= ft->numFrames; i++) {
+        Frame *f = i < ft->numFrames ? &ft->frames[i] : NULL;
+        if (f != NULL && f->owner == NULL)
+            continue;
+        freeRun(ft, runStart, i);
+        runStart = i + 1;
+
+        // Frames still being read in are tracked once they are mapped
+        if (f != NULL && f->queue == 0 && f->vpn != VM_KERNEL_PAGE) {
+            pte_t *pte = AddressSpace_pte(f->owner, f->vpn, false);
+            if (pte != NULL && (*pte & PTE_PRESENT) && (*pte >> PTE_FRAME_SHIFT) == i)
+                ft->policy->mapped(ft, i);
+        }
+    }
+}
+
+void FrameTable_add_free(FrameTable *ft, int frame, unsigned int order) {
+    pushFree(ft, (uint32_t)frame, order);
+}
+
+void FrameTable_tick(FrameTable *ft) {
+
+    if (ft->policy->tick != NULL)
+        ft->policy->tick(ft);
+}
+
+int FrameTable_claim_slot(FrameTable *ft, uint32_t slot) {
+
+    if (slot >= ft->numSlots)
+        return -1;
+    if (ft->slotRefs[slot]++ == 0) {
+        ft->slotUsed[slot / 64] |= 1ull << (slot % 64);
+        ft->slotsUsed++;
+    }
+    return 0;
+}
+
+void AddressSpace_init(AddressSpace *as, FrameTable *ft) {
+
+    memset(as, 0, sizeof(AddressSpace));
+    as->frames = ft;
+    as->familyPrev = as;
+    as->familyNext = as;
+}
+
+void AddressSpace_destroy(AddressSpace *as) {
+
+    if (as->dir != NULL) {
+        for (uint32_t i = 0; i < VM_L1_ENTRIES; i++) {
+            pte_t *leaf = as->dir[i];
+            if (leaf == NULL)
+                continue;
+            for (uint32_t j = 0; j < VM_L2_ENTRIES; j++) {
+                if (leaf[j] & PTE_PRESENT)
+                    unrefFrame(as->frames, as, (i << VM_L2_BITS) | j, leaf[j] >> PTE_FRAME_SHIFT);
+                else if (leaf[j] & PTE_SWAPPED)
+                    unrefSlot(as->frames, leaf[j] >> PTE_FRAME_SHIFT);
+            }
+            free(leaf);
+            as->dir[i] = NULL;
+        }
+        free(as->dir);
+        as->dir = NULL;
+    }
+    as->rss = 0;
+
+    as->familyPrev->familyNext = as->familyNext;
+    as->familyNext->familyPrev = as->familyPrev;
+    as->familyPrev = as;
+    as->familyNext = as;
+}
+
+int AddressSpace_fork(AddressSpace *child, AddressSpace *parent) {
+
+    FrameTable *ft = parent->frames;
+    AddressSpace_join(child, parent);
+    if (parent->dir == NULL)
+        return 0;
+
+    for (uint32_t i = 0; i < VM_L1_ENTRIES; i++) {
+        pte_t *leaf = parent->dir[i];
+        pte_t *copy = NULL;
+        for (uint32_t j = 0; leaf != NULL && j < VM_L2_ENTRIES; j++) {
+            if (!(leaf[j] & (PTE_PRESENT | PTE_SWAPPED)))
+                continue;
+            if (copy == NULL && (copy = AddressSpace_pte(child, i << VM_L2_BITS, true)) == NULL)
+                return -1;
+
+            // Each relative faults a page in swap back in on its own
+            if (leaf[j] & PTE_SWAPPED) {
+                copy[j] = leaf[j];
+                ft->slotRefs[leaf[j] >> PTE_FRAME_SHIFT]++;
+                continue;
+            }
+            leaf[j] |= PTE_COW;
+            copy[j] = leaf[j];
+            ft->frames[leaf[j] >> PTE_FRAME_SHIFT].refs++;
+            ft->sharedPages++;
+            ft->forkShared++;
+            child->rss++;
+        }
+    }
+    return 0;
+}
+
+void AddressSpace_join(AddressSpace *as, AddressSpace *relative) {
+
+    as->family = relative->family;
+    as->familyPrev = relative;
+    as->familyNext = relative->familyNext;
+    relative->familyNext->familyPrev = as;
+    relative->familyNext = as;
+}
+
+pte_t* AddressSpace_pte(AddressSpace *as, uint32_t vpn, bool create) {
+
+    uint32_t l1 = vpn >> VM_L2_BITS;
+    uint32_t l2 = vpn & (VM_L2_ENTRIES - 1);
+
+    if (as->dir == NULL) {
+        if (!create)
+            return NULL;
+        as->dir = calloc(VM_L1_ENTRIES, sizeof(pte_t *));
+        if (as->dir == NULL)
+            return NULL;
+    }
+    if (as->dir[l1] == NULL) {
+        if (!create)
+            return NULL;
+        as->dir[l1] = calloc(VM_L2_ENTRIES, sizeof(pte_t));
+        if (as->dir[l1] == NULL)
+            return NULL;
+    }
+    return &as->dir[l1][l2];
+}
+
+bool AddressSpace_access(AddressSpace *as, uint32_t vaddr, bool write) {
+
+    uint32_t vpn = vaddr >> VM_PAGE_SHIFT;
+    as->accesses++;
+
+    // The hit path: two table lookups, no allocation
+    pte_t *leaf = as->dir != NULL ? as->dir[vpn >> VM_L2_BITS] : NULL;
+    if (leaf == NULL)
+        return false;
+    pte_t *pte = &leaf[vpn & (VM_L2_ENTRIES - 1)];
+    if (!(*pte & PTE_PRESENT))
+        return false;
+
+    if (*pte & PTE_COW) {
+        if (write && !cowFault(as, vpn, pte))
+            return false;
+
+        // The policy only looks at the entry of the frame's owner
+        Frame *f = &as->frames->frames[*pte >> PTE_FRAME_SHIFT];
+        if (f->owner != as)
+            *AddressSpace_pte(f->owner, vpn, false) |= PTE_ACCESSED;
+    }
+    *pte |= write ? (PTE_ACCESSED | PTE_DIRTY) : PTE_ACCESSED;
+    if (as->frames->policy->hit != NULL)
+        as->frames->policy->hit(as->frames, *pte >> PTE_FRAME_SHIFT);
+    return true;
+}
+
+int AddressSpace_map(AddressSpace *as, uint32_t vpn, int frame, bool write) {
+
+    pte_t *pte = AddressSpace_pte(as, vpn, true);
+    if (pte == NULL)
+        return -1;
+
+    // Swap keeps no copy once the page is back, so it has to be written out again if evicted
+    if (*pte & PTE_SWAPPED) {
+        unrefSlot(as->frames, *pte >> PTE_FRAME_SHIFT);
+        as->frames->swapIns++;
+        write = true;
+    }
+    if (!(*pte & PTE_PRESENT))
+        as->rss++;
+    *pte = ((pte_t)frame << PTE_FRAME_SHIFT) | PTE_PRESENT | PTE_ACCESSED | (write ? PTE_DIRTY : 0);
+    as->frames->frames[frame].refs = 1;
+    as->frames->policy->mapped(as->frames, (unsigned int)frame);
+    return 0;
+}
+
+unsigned int AddressSpace_swap_out(AddressSpace *as) {
+
+    FrameTable *ft = as->frames;
+    unsigned int written = 0;
+    for (uint32_t i = 0; as->dir != NULL && i < VM_L1_ENTRIES; i++) {
+        pte_t *leaf = as->dir[i];
+        for (uint32_t j = 0; leaf != NULL && j < VM_L2_ENTRIES; j++) {
+            if (!(leaf[j] & PTE_PRESENT) || ft->frames[leaf[j] >> PTE_FRAME_SHIFT].refs != 1)
+                continue;
+
+            pte_t entry = 0;
+            if (leaf[j] & PTE_DIRTY) {
+                uint32_t slot = allocSlot(ft);
+                if (slot == FRAME_NIL)
+                    continue;
+                ft->slotRefs[slot] = 1;
+                entry = ((pte_t)slot << PTE_FRAME_SHIFT) | PTE_SWAPPED;
+                ft->swapOuts++;
+                written++;
+            }
+            FrameTable_free(ft, (int)(leaf[j] >> PTE_FRAME_SHIFT));
+            leaf[j] = entry;
+            as->rss--;
+        }
+    }
+    return written;
+}
+
+unsigned int AddressSpace_swap_in(AddressSpace *as, unsigned int limit) {
+
+    FrameTable *ft = as->frames;
+    unsigned int read = 0;
+    for (uint32_t i = 0; as->dir != NULL && i < VM_L1_ENTRIES && read < limit; i++) {
+        pte_t *leaf = as->dir[i];
+        for (uint32_t j = 0; leaf != NULL && j < VM_L2_ENTRIES && read < limit; j++) {
+            if (!(leaf[j] & PTE_SWAPPED) || ft->slotRefs[leaf[j] >> PTE_FRAME_SHIFT] != 1)
+                continue;
+            uint32_t vpn = (i << VM_L2_BITS) | j;
+            int frame = FrameTable_alloc(ft, as, vpn);
+            if (frame == VM_NO_FRAME)
+                frame = FrameTable_evict(ft, as, vpn);
+            if (frame == VM_NO_FRAME)
+                return read;
+            AddressSpace_map(as, vpn, frame, false);
+            read++;
+        }
+    }
+    return read;
+}
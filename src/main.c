@@ -11,6 +11,7 @@ Description: Please see the "Other Info" section in our README for more informat
 
 #include "List.h"
 #include "PCB.h"
+#include "Checkpoint.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,15 +20,116 @@ Description: Please see the "Other Info" section in our README for more informat
 
 
 int main(int argc, char *argv[]) {
-    
-    List* ready_top = List_create();
-    List* ready_norm = List_create();
-    List* ready_low = List_create();
-    List* ready_init = List_create();
-    List* waiting_send = List_create();
-    List* waiting_receive = List_create();
-
-    initProgram(ready_top, ready_norm, ready_low, ready_init, waiting_send, waiting_receive);
+
+    // Optional Prometheus text dump of the kernel metrics:
+    //  ./sim --metrics-file <path> [--metrics-interval <ticks>]
+    // and a larger node pool for big workloads: ./sim --max-nodes <n>
+    // physical memory and page replacement: ./sim --frames <n> --replacement clock|aging|arc
+    // the disk and its I/O scheduler: ./sim --disk-blocks <n> --io-sched fifo|scan|deadline
+    // the page cache in front of it: ./sim --cache-pages <n> --cache-policy lru|2q
+    // the swap area and load control: ./sim --swap-slots <n> --swap-ticks <n> --load-control on|off
+    // or resume from a checkpoint written by the W command: ./sim --restore <path>
+    const char *metricsPath = NULL;
+    const char *restorePath = NULL;
+    int metricsInterval = 0;
+    KernelConfig config;
+    KernelConfig_default(&config);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--metrics-file") == 0 && i + 1 < argc) {
+            metricsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            metricsInterval = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-nodes") == 0 && i + 1 < argc) {
+            config.max_nodes = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            config.num_frames = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--replacement") == 0 && i + 1 < argc && strcmp(argv[i + 1], "clock") == 0) {
+            config.replacement = PAGE_REPLACE_CLOCK;
+            i++;
+        }
+        else if (strcmp(argv[i], "--replacement") == 0 && i + 1 < argc && strcmp(argv[i + 1], "aging") == 0) {
+            config.replacement = PAGE_REPLACE_AGING;
+            i++;
+        }
+        else if (strcmp(argv[i], "--replacement") == 0 && i + 1 < argc && strcmp(argv[i + 1], "arc") == 0) {
+            config.replacement = PAGE_REPLACE_ARC;
+            i++;
+        }
+        else if (strcmp(argv[i], "--disk-blocks") == 0 && i + 1 < argc) {
+            config.disk_blocks = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--io-sched") == 0 && i + 1 < argc && strcmp(argv[i + 1], "fifo") == 0) {
+            config.io_sched = IO_SCHED_FIFO;
+            i++;
+        }
+        else if (strcmp(argv[i], "--io-sched") == 0 && i + 1 < argc && strcmp(argv[i + 1], "scan") == 0) {
+            config.io_sched = IO_SCHED_SCAN;
+            i++;
+        }
+        else if (strcmp(argv[i], "--io-sched") == 0 && i + 1 < argc && strcmp(argv[i + 1], "deadline") == 0) {
+            config.io_sched = IO_SCHED_DEADLINE;
+            i++;
+        }
+        else if (strcmp(argv[i], "--cache-pages") == 0 && i + 1 < argc) {
+            config.cache_pages = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cache-policy") == 0 && i + 1 < argc && strcmp(argv[i + 1], "lru") == 0) {
+            config.cache_policy = CACHE_LRU;
+            i++;
+        }
+        else if (strcmp(argv[i], "--cache-policy") == 0 && i + 1 < argc && strcmp(argv[i + 1], "2q") == 0) {
+            config.cache_policy = CACHE_2Q;
+            i++;
+        }
+        else if (strcmp(argv[i], "--swap-slots") == 0 && i + 1 < argc) {
+            config.swap_slots = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--swap-ticks") == 0 && i + 1 < argc) {
+            config.swap_ticks = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--load-control") == 0 && i + 1 < argc && strcmp(argv[i + 1], "on") == 0) {
+            config.load_control = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "--load-control") == 0 && i + 1 < argc && strcmp(argv[i + 1], "off") == 0) {
+            config.load_control = false;
+            i++;
+        }
+        else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restorePath = argv[++i];
+        }
+        else {
+            printf("Usage: %s [--metrics-file <path>] [--metrics-interval <ticks>] [--max-nodes <n>] [--frames <n>] [--replacement clock|aging|arc] [--disk-blocks <n>] [--io-sched fifo|scan|deadline] [--cache-pages <n>] [--cache-policy lru|2q] [--swap-slots <n>] [--swap-ticks <n>] [--load-control on|off] [--restore <path>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Kernel *kernel;
+    if (restorePath != NULL) {
+        // A restored kernel keeps the configuration it was checkpointed with
+        kernel = Checkpoint_restore(restorePath, NULL, stdin, stdout);
+        if (kernel == NULL) {
+            printf("Error: Could not restore the checkpoint %s\n", restorePath);
+            return 1;
+        }
+    }
+    else {
+        kernel = Kernel_create(&config, stdin, stdout);
+        if (kernel == NULL) {
+            printf("Error: Could not allocate the kernel\n");
+            return 1;
+        }
+    }
+    if (metricsPath != NULL) {
+        setMetricsFile(kernel, metricsPath, metricsInterval > 0 ? metricsInterval : 0);
+    }
+
+    initProgram(kernel);
+    Kernel_destroy(kernel);
 
     return 0;    
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+/*
+
+Filename: kernelsim_test.c
+
+Description: Checks of the values the embedding API returns, run against libkernelsim.a on
+             silent kernels. Each failed check is printed; the exit status is the number of
+             failures.
+
+Usage: ktest
+
+*/
+
+
+#include "KernelSim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SCRIPT_COMMANDS 3000
+#define SCRIPT_SPLIT 1500
+
+static int failures = 0;
+
+static void expect(bool ok, const char *what) {
+
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// KernelSim_new_sem and the N command return 1 when the semaphore is created, -1 otherwise
+static void testNewSem() {
+
+    Kernel *k = KernelSim_init(NULL, NULL);
+    if (k == NULL) {
+        expect(false, "KernelSim_init");
+        return;
+    }
+
+    expect(KernelSim_new_sem(k, 0, 1) == 1, "new_sem returns 1 on success");
+    expect(KernelSim_dispatch(k, "N\n1\n0\n") == 1, "N returns 1 on success");
+    expect(KernelSim_new_sem(k, 0, 1) == -1, "new_sem of an existing semaphore fails");
+    expect(KernelSim_new_sem(k, KERNELSIM_NUM_SEMAPHORES, 1) == -1, "new_sem of an invalid id fails");
+    expect(KernelSim_new_sem(k, -1, 1) == -1, "new_sem of a negative id fails");
+    expect(KernelSim_new_sem(k, 2, -1) == -1, "new_sem with a negative value fails");
+    expect(KernelSim_dispatch(k, "N\n3\n-1\n") == -1, "N with a negative value fails");
+    expect(KernelSim_sem_V(k, 3) == -1, "V on a semaphore N refused");
+    expect(KernelSim_new_sem(k, 2, 0) == 1, "new_sem with value 0");
+    expect(KernelSim_sem_V(k, 2) == 1, "V with no waiters");
+
+    // The semaphores really exist: a process can take the one with value 1
+    int pid = KernelSim_create(k, 0);
+    expect(pid > 0, "create");
+    expect(KernelSim_quantum(k) != -1, "quantum");
+    expect(KernelSim_sem_P(k, 0) == 1, "P on a created semaphore");
+    KernelSim_destroy(k);
+}
+
+// Append a pseudo-random command, in the text sim reads, to script
+static void randomCommand(char *script, size_t size, unsigned int *seed) {
+
+    char command[64];
+    *seed = *seed * 1103515245u + 12345u;
+    unsigned int r = *seed >> 8;
+    switch (r % 10) {
+        case 0:
+        case 1:
+            snprintf(command, sizeof(command), "C\n%u\n", r / 10 % 3);
+            break;
+        case 2:
+            snprintf(command, sizeof(command), "Q\n");
+            break;
+        case 3:
+            snprintf(command, sizeof(command), "A\n%u\n%u\n%c\n", r / 10 % 64 * 4096, 1 + r / 700 % 8, r & 1 ? 'w' : 'r');
+            break;
+        case 4:
+            snprintf(command, sizeof(command), "D\n%u\n%u\n%c\n", r / 10 % 4096, 1 + r / 50000 % 16, r & 1 ? 'w' : 'r');
+            break;
+        case 5:
+            snprintf(command, sizeof(command), "O\n%u\n%u\n%u\n%c\n", r / 10 % 8, r / 80 % 256, 1 + r / 20000 % 8, r & 1 ? 'w' : 'r');
+            break;
+        case 6:
+            snprintf(command, sizeof(command), "N\n%u\n%u\n", r / 10 % KERNELSIM_NUM_SEMAPHORES, r / 50 % 2);
+            break;
+        case 7:
+            snprintf(command, sizeof(command), "P\n%u\n", r / 10 % KERNELSIM_NUM_SEMAPHORES);
+            break;
+        case 8:
+            snprintf(command, sizeof(command), "V\n%u\n", r / 10 % KERNELSIM_NUM_SEMAPHORES);
+            break;
+        default:
+            snprintf(command, sizeof(command), "F\n");
+            break;
+    }
+    strncat(script, command, size - strlen(script) - 1);
+}
+
+// Everything written to f from offset on, as a string to be freed
+static char* readFrom(FILE *f, long offset) {
+
+    fflush(f);
+    long end = ftell(f);
+    char *text = calloc(end - offset + 1, 1);
+    fseek(f, offset, SEEK_SET);
+    if (fread(text, 1, end - offset, f) != (size_t)(end - offset))
+        text[0] = '\0';
+    fseek(f, end, SEEK_SET);
+    return text;
+}
+
+// A kernel restored from a W checkpoint prints exactly what the kernel that wrote it prints
+//  for the rest of a script
+static void testCheckpointResume() {
+
+    KernelConfig config;
+    KernelSim_default_config(&config);
+    config.max_nodes = 2000;
+    config.num_frames = 256;
+
+    size_t size = SCRIPT_COMMANDS * 64;
+    char *before = calloc(size, 1);
+    char *after = calloc(size, 1);
+    unsigned int seed = 42;
+    for (int i = 0; i < SCRIPT_COMMANDS; i++) {
+        randomCommand(i < SCRIPT_SPLIT ? before : after, size, &seed);
+    }
+
+    char path[] = "/tmp/ktestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd != -1)
+        close(fd);
+    char write[64];
+    snprintf(write, sizeof(write), "W\n%s\n", path);
+
+    FILE *fullOut = tmpfile();
+    FILE *restOut = tmpfile();
+    Kernel *full = KernelSim_init(&config, fullOut);
+    expect(full != NULL, "KernelSim_init for checkpoint");
+    if (full != NULL) {
+        KernelSim_dispatch(full, before);
+        expect(KernelSim_dispatch(full, write) != -1, "W writes a checkpoint");
+        long split = ftell(fullOut);
+        KernelSim_dispatch(full, after);
+
+        Kernel *rest = KernelSim_restore(path, NULL, restOut);
+        expect(rest != NULL, "KernelSim_restore");
+        if (rest != NULL) {
+            KernelSim_dispatch(rest, after);
+            char *expected = readFrom(fullOut, split);
+            char *actual = readFrom(restOut, 0);
+            expect(strcmp(expected, actual) == 0, "restored run prints the same as the original");
+            free(expected);
+            free(actual);
+            KernelSim_destroy(rest);
+        }
+        KernelSim_destroy(full);
+    }
+    fclose(fullOut);
+    fclose(restOut);
+    unlink(path);
+    free(before);
+    free(after);
+}
+
+// With every priority level and every semaphore in use, M prints a gauge for each queue
+static void testMetricsQueues() {
+
+    KernelConfig config;
+    KernelSim_default_config(&config);
+    config.num_priorities = KERNELSIM_MAX_PRIORITIES;
+
+    FILE *out = tmpfile();
+    Kernel *k = KernelSim_init(&config, out);
+    expect(k != NULL, "KernelSim_init for metrics");
+    if (k == NULL) {
+        fclose(out);
+        return;
+    }
+    for (int i = 0; i < KERNELSIM_NUM_SEMAPHORES; i++) {
+        KernelSim_new_sem(k, i, 1);
+    }
+    long start = ftell(out);
+    KernelSim_dispatch(k, "M\n");
+    char *text = readFrom(out, start);
+
+    int gauges = 0;
+    for (char *line = strstr(text, "Queue "); line != NULL; line = strstr(line + 1, "Queue ")) {
+        gauges++;
+    }
+    expect(gauges == KERNELSIM_MAX_PRIORITIES + 7 + KERNELSIM_NUM_SEMAPHORES, "M prints every queue gauge");
+    expect(strstr(text, "not shown") == NULL, "M drops no queue gauges");
+    free(text);
+    KernelSim_destroy(k);
+    fclose(out);
+}
+
+// A STOP that cannot get a node on the stopped queue leaves the process as it was
+static void testStopPoolFull() {
+
+    KernelConfig config;
+    KernelSim_default_config(&config);
+    config.max_nodes = 64;
+
+    Kernel *k = KernelSim_init(&config, NULL);
+    expect(k != NULL, "KernelSim_init for stop");
+    if (k == NULL)
+        return;
+
+    // Fill the pool with ready processes
+    int running = KernelSim_create(k, 1);
+    int ready = -1;
+    int pid;
+    while ((pid = KernelSim_create(k, 1)) > 0) {
+        ready = pid;
+    }
+    expect(running > 0 && ready > 0, "create until the pool is full");
+
+    KernelSimProc proc;
+    expect(KernelSim_signal(k, running, SIGNAL_STOP) == 0, "STOP of the running process with a full pool");
+    expect(KernelSim_query_proc(k, running, &proc) == 0 && proc.state == KERNELSIM_RUNNING, "it is still running");
+    expect(KernelSim_signal(k, ready, SIGNAL_STOP) == 0, "STOP of a ready process with a full pool");
+    expect(KernelSim_query_proc(k, ready, &proc) == 0 && proc.state == KERNELSIM_READY, "it is still ready");
+    expect(KernelSim_signal(k, ready, SIGNAL_KILL) == 1, "KILL frees a node");
+    expect(KernelSim_signal(k, running, SIGNAL_STOP) == 1, "STOP once there is room");
+    expect(KernelSim_query_proc(k, running, &proc) == 0 && proc.state == KERNELSIM_STOPPED, "it is stopped");
+    KernelSim_destroy(k);
+}
+
+// An exited child that has not been waited for can be queried as a zombie
+static void testQueryZombie() {
+
+    Kernel *k = KernelSim_init(NULL, NULL);
+    expect(k != NULL, "KernelSim_init for zombies");
+    if (k == NULL)
+        return;
+
+    int parent = KernelSim_create(k, 0);
+    int child = KernelSim_fork(k);
+    expect(parent > 0 && child > 0, "create and fork");
+    KernelSim_quantum(k);
+    expect(KernelSim_exit(k) != -1, "the child exits");
+
+    KernelSimProc proc;
+    expect(KernelSim_query_proc(k, child, &proc) == 0, "query a zombie");
+    expect(proc.state == KERNELSIM_ZOMBIE && proc.parent_pid == parent, "it is a zombie of its parent");
+    expect(KernelSim_query_proc(k, parent, &proc) == 0 && proc.num_zombies == 1, "the parent has one zombie");
+    KernelSim_destroy(k);
+}
+
+int main() {
+
+    testNewSem();
+    testCheckpointResume();
+    testMetricsQueues();
+    testStopPoolFull();
+    testQueryZombie();
+    if (failures == 0)
+        printf("All tests passed\n");
+    return failures;
+}
@@ -0,0 +1,414 @@
+/*
+
+Filename: sweep.c
+
+Description: Parameter-sweep driver. Runs one workload (a file of simulator commands, as
+             typed into sim) against every combination of the given kernel configurations.
+             Each run gets its own Kernel on a worker thread; the pool is sized to the core
+             count. The per-run metrics are merged into one CSV, one row per configuration.
+
+             With -r, every run starts from the given checkpoint instead of an empty kernel.
+             -m and -f compare page replacement policies across physical memory sizes; the
+             CSV then has the hit ratio, evictions and faults per second of wall time.
+             -i compares I/O schedulers on a disk of -d blocks, by disk throughput (blocks
+             per 1000 ticks of the virtual clock) and request latency. -c and -k compare page
+             cache policies and sizes, by hit ratio and write-back coalescing. -l compares
+             load control on and off, with a swap area of -x pages, by page accesses per
+             1000 ticks of the virtual clock and the pages and processes swapped.
+
+Usage: sweep -w <workload> [-o <csv>] [-j <threads>] [-p <priorities,...>]
+             [-q <quantum,...>] [-s <fifo|lifo|priority,...>] [-n <max nodes>]
+             [-m <clock|aging|arc,...>] [-f <frames,...>] [-i <fifo|scan|deadline,...>]
+             [-d <disk blocks>] [-c <lru|2q,...>] [-k <cache pages,...>] [-l <on|off,...>]
+             [-x <swap slots>] [-r <checkpoint>]
+
+*/
+
+
+#include "PCB.h"
+#include "Checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_GRID_VALUES 64
+
+typedef struct SweepRun_s SweepRun;
+struct SweepRun_s {
+    KernelConfig config;
+    bool ok;
+    double wall_ms;
+    Metrics metrics;
+    uint64_t ready_p50, ready_p99, ready_max;
+    uint64_t reply_p50, reply_p99;
+    uint64_t mailbox_p50, mailbox_p99;
+    uint64_t sem_p50, sem_p99;
+    uint64_t disk_p50, disk_p99;
+};
+
+typedef struct Sweep_s Sweep;
+struct Sweep_s {
+    const char *workload;       // Shared, read-only
+    const char *checkpoint;     // Starting state of every run, NULL for an empty kernel
+    size_t workloadLen;
+    SweepRun *runs;
+    unsigned int numRuns;
+    atomic_uint nextRun;
+};
+
+static const char *semWakeNames[] = { "fifo", "lifo", "priority" };
+static const char *replacementNames[] = { "clock", "aging", "arc" };
+static const char *ioSchedNames[] = { "fifo", "scan", "deadline" };
+static const char *cachePolicyNames[] = { "lru", "2q" };
+static const char *loadControlNames[] = { "off", "on" };
+
+
+// Parse a comma separated list of integers. Returns the number parsed, -1 on error.
+static int parseIntList(const char *arg, int *values) {
+
+    int count = 0;
+    char *copy = strdup(arg);
+    for (char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        char *end;
+        long value = strtol(tok, &end, 10);
+        if (*end != '\0' || value < 0 || count == MAX_GRID_VALUES) {
+            free(copy);
+            return -1;
+        }
+        values[count++] = (int)value;
+    }
+    free(copy);
+    return count;
+}
+
+// Parse a comma separated list of policy names, storing the index of each in names.
+// Returns the number parsed, -1 on error.
+static int parseNameList(const char *arg, const char **names, int numNames, int *values) {
+
+    int count = 0;
+    char *copy = strdup(arg);
+    for (char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int policy = -1;
+        for (int i = 0; i < numNames; i++) {
+            if (strcmp(tok, names[i]) == 0)
+                policy = i;
+        }
+        if (policy == -1 || count == MAX_GRID_VALUES) {
+            free(copy);
+            return -1;
+        }
+        values[count++] = policy;
+    }
+    free(copy);
+    return count;
+}
+
+static char* readFile(const char *path, size_t *len) {
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    size_t cap = 1 << 16;
+    char *buf = malloc(cap);
+    *len = 0;
+    size_t got;
+    while (buf != NULL && (got = fread(buf + *len, 1, cap - *len, file)) > 0) {
+        *len += got;
+        if (*len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    fclose(file);
+    return buf;
+}
+
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Run one configuration to completion. Everything the run touches is owned by this call.
+static void runOne(Sweep *sweep, SweepRun *run) {
+
+    // An empty workload still runs, it just ends immediately
+    FILE *in = sweep->workloadLen > 0
+        ? fmemopen((void *)sweep->workload, sweep->workloadLen, "r")
+        : fopen("/dev/null", "r");
+    if (in == NULL)
+        return;
+
+    Kernel *k = sweep->checkpoint != NULL
+        ? Checkpoint_restore(sweep->checkpoint, &run->config, in, NULL)
+        : Kernel_create(&run->config, in, NULL);
+    if (k == NULL) {
+        fclose(in);
+        return;
+    }
+
+    double start = nowMs();
+    initProgram(k);
+    run->wall_ms = nowMs() - start;
+
+    snapshotMetrics(k);
+    run->metrics = k->metrics;
+    run->ready_p50 = Histogram_percentile(&k->ready_hist, 50.0);
+    run->ready_p99 = Histogram_percentile(&k->ready_hist, 99.0);
+    run->ready_max = k->ready_hist.max;
+    run->reply_p50 = Histogram_percentile(&k->reply_hist, 50.0);
+    run->reply_p99 = Histogram_percentile(&k->reply_hist, 99.0);
+    run->mailbox_p50 = Histogram_percentile(&k->mailbox_hist, 50.0);
+    run->mailbox_p99 = Histogram_percentile(&k->mailbox_hist, 99.0);
+    run->disk_p50 = Histogram_percentile(&k->disk.latency, 50.0);
+    run->disk_p99 = Histogram_percentile(&k->disk.latency, 99.0);
+
+    // All semaphores together
+    Histogram *semWait = malloc(sizeof(Histogram));
+    if (semWait != NULL) {
+        Histogram_init(semWait, "sem wait");
+        for (int i = 0; i < NUM_SEMAPHORE; i++) {
+            Histogram_merge(semWait, &k->sem_array[i].wait_hist);
+        }
+        run->sem_p50 = Histogram_percentile(semWait, 50.0);
+        run->sem_p99 = Histogram_percentile(semWait, 99.0);
+        free(semWait);
+    }
+
+    Kernel_destroy(k);
+    fclose(in);
+    run->ok = true;
+}
+
+static void* worker(void *arg) {
+
+    Sweep *sweep = arg;
+    unsigned int i;
+    while ((i = atomic_fetch_add(&sweep->nextRun, 1)) < sweep->numRuns) {
+        runOne(sweep, &sweep->runs[i]);
+    }
+    return NULL;
+}
+
+static void writeCsv(Sweep *sweep, FILE *out) {
+
+    fprintf(out, "run,num_priorities,quantum,sem_wake,max_nodes,replacement,num_frames,ok,wall_ms,ticks,"
+                 "creates,forks,kills,context_switches,blocks_send,blocks_reply,blocks_sem,send_slot_busy,"
+                 "pool_exhaustions,ready_p50,ready_p99,ready_max,reply_p50,reply_p99,mailbox_p50,mailbox_p99,"
+                 "sem_wait_p50,sem_wait_p99,page_accesses,page_faults,hit_ratio,evictions,dirty_evictions,"
+                 "faults_per_sec,frames_free,largest_free_block,cow_faults,cow_copies,fork_shared,io_sched,disk_blocks,"
+                 "disk_reads,disk_writes,disk_blocks_read,disk_blocks_written,disk_throughput,disk_utilization,"
+                 "disk_p50,disk_p99,disk_expired,cache_policy,cache_pages,cache_hits,cache_misses,cache_hit_ratio,"
+                 "cache_writebacks,cache_blocks_per_writeback,cache_overwrites,cache_throttled,load_control,"
+                 "swap_slots,accesses_per_ktick,swap_outs,swap_ins,swap_full,process_swap_outs,process_swap_ins,"
+                 "swap_utilization\n");
+
+    for (unsigned int i = 0; i < sweep->numRuns; i++) {
+        SweepRun *run = &sweep->runs[i];
+        Metrics *m = &run->metrics;
+        double hitRatio = m->page_accesses > 0 ? 1.0 - (double)m->page_faults / (double)m->page_accesses : 0.0;
+        double faultsPerSec = run->wall_ms > 0 ? m->page_faults * 1000.0 / run->wall_ms : 0.0;
+        double diskThroughput = m->clock > 0 ? (m->disk_blocks_read + m->disk_blocks_written) * 1000.0 / m->clock : 0.0;
+        double diskUtilization = m->clock > 0 ? (double)m->disk_busy_ticks / m->clock : 0.0;
+        double cacheHitRatio = m->cache_hits + m->cache_misses > 0
+            ? (double)m->cache_hits / (double)(m->cache_hits + m->cache_misses) : 0.0;
+        double blocksPerWriteback = m->cache_writebacks > 0
+            ? (double)m->cache_writeback_blocks / (double)m->cache_writebacks : 0.0;
+        double accessesPerKtick = m->clock > 0 ? m->page_accesses * 1000.0 / m->clock : 0.0;
+        double swapUtilization = m->clock > 0 ? (double)m->swap_busy_ticks / m->clock : 0.0;
+        fprintf(out, "%u,%d,%u,%s,%u,%s,%u,%d,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,"
+                     "%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.4f,%llu,%llu,%.0f,%u,%u,%llu,%llu,%llu,"
+                     "%s,%u,%llu,%llu,%llu,%llu,%.2f,%.4f,%llu,%llu,%llu,%s,%u,%llu,%llu,%.4f,%llu,%.2f,%llu,%llu,"
+                     "%s,%u,%.2f,%llu,%llu,%llu,%llu,%llu,%.4f\n",
+                i, run->config.num_priorities, run->config.quantum, semWakeNames[run->config.sem_wake],
+                run->config.max_nodes, replacementNames[run->config.replacement], run->config.num_frames,
+                run->ok ? 1 : 0, run->wall_ms,
+                (unsigned long long)m->clock, (unsigned long long)m->creates,
+                (unsigned long long)m->forks, (unsigned long long)m->kills,
+                (unsigned long long)m->context_switches,
+                (unsigned long long)m->blocks[WAITING_SEND], (unsigned long long)m->blocks[WAITING_REPLY],
+                (unsigned long long)m->blocks[WAITING_SEM], (unsigned long long)m->send_slot_busy,
+                (unsigned long long)m->pool_exhaustions,
+                (unsigned long long)run->ready_p50, (unsigned long long)run->ready_p99,
+                (unsigned long long)run->ready_max,
+                (unsigned long long)run->reply_p50, (unsigned long long)run->reply_p99,
+                (unsigned long long)run->mailbox_p50, (unsigned long long)run->mailbox_p99,
+                (unsigned long long)run->sem_p50, (unsigned long long)run->sem_p99,
+                (unsigned long long)m->page_accesses, (unsigned long long)m->page_faults, hitRatio,
+                (unsigned long long)m->evictions, (unsigned long long)m->dirty_evictions, faultsPerSec,
+                m->frames_free, m->frames_largest_free, (unsigned long long)m->cow_faults,
+                (unsigned long long)m->cow_copies, (unsigned long long)m->fork_shared,
+                ioSchedNames[run->config.io_sched], run->config.disk_blocks,
+                (unsigned long long)m->disk_reads, (unsigned long long)m->disk_writes,
+                (unsigned long long)m->disk_blocks_read, (unsigned long long)m->disk_blocks_written,
+                diskThroughput, diskUtilization, (unsigned long long)run->disk_p50,
+                (unsigned long long)run->disk_p99, (unsigned long long)m->disk_expired,
+                cachePolicyNames[run->config.cache_policy], run->config.cache_pages,
+                (unsigned long long)m->cache_hits, (unsigned long long)m->cache_misses, cacheHitRatio,
+                (unsigned long long)m->cache_writebacks, blocksPerWriteback,
+                (unsigned long long)m->cache_overwrites, (unsigned long long)m->cache_throttled,
+                loadControlNames[run->config.load_control], run->config.swap_slots, accessesPerKtick,
+                (unsigned long long)m->swap_outs, (unsigned long long)m->swap_ins,
+                (unsigned long long)m->swap_full, (unsigned long long)m->swap_process_outs,
+                (unsigned long long)m->swap_process_ins, swapUtilization);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s -w <workload> [-o <csv>] [-j <threads>] [-p <priorities,...>]\n"
+                    "          [-q <quantum,...>] [-s <fifo|lifo|priority,...>] [-n <max nodes>]\n"
+                    "          [-m <clock|aging|arc,...>] [-f <frames,...>] [-i <fifo|scan|deadline,...>]\n"
+                    "          [-d <disk blocks>] [-c <lru|2q,...>] [-k <cache pages,...>] [-l <on|off,...>]\n"
+                    "          [-x <swap slots>] [-r <checkpoint>]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+
+    const char *workloadPath = NULL;
+    const char *outPath = NULL;
+    const char *checkpointPath = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int priorities[MAX_GRID_VALUES] = { NUM_READY_LIST };
+    int quanta[MAX_GRID_VALUES] = { 0 };
+    int semWakes[MAX_GRID_VALUES] = { SEM_WAKE_FIFO };
+    int replacements[MAX_GRID_VALUES] = { PAGE_REPLACE_CLOCK };
+    int frames[MAX_GRID_VALUES];
+    int ioScheds[MAX_GRID_VALUES] = { IO_SCHED_FIFO };
+    int cachePolicies[MAX_GRID_VALUES];
+    int cacheSizes[MAX_GRID_VALUES];
+    int loadControls[MAX_GRID_VALUES];
+    int numPriorities = 1, numQuanta = 1, numSemWakes = 1, numReplacements = 1, numFrames = 1, numIOScheds = 1;
+    int numCachePolicies = 1, numCacheSizes = 1, numLoadControls = 1;
+    unsigned int maxNodes = LIST_MAX_NUM_NODES;
+
+    KernelConfig defaults;
+    KernelConfig_default(&defaults);
+    frames[0] = (int)defaults.num_frames;
+    unsigned int diskBlocks = defaults.disk_blocks;
+    cachePolicies[0] = defaults.cache_policy;
+    cacheSizes[0] = (int)defaults.cache_pages;
+    loadControls[0] = defaults.load_control;
+    unsigned int swapSlots = defaults.swap_slots;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:o:j:p:q:s:n:m:f:i:d:c:k:l:x:r:")) != -1) {
+        switch (opt) {
+            case 'w': workloadPath = optarg; break;
+            case 'o': outPath = optarg; break;
+            case 'j': threads = atol(optarg); break;
+            case 'p': numPriorities = parseIntList(optarg, priorities); break;
+            case 'q': numQuanta = parseIntList(optarg, quanta); break;
+            case 's': numSemWakes = parseNameList(optarg, semWakeNames, 3, semWakes); break;
+            case 'n': maxNodes = (unsigned int)atol(optarg); break;
+            case 'm': numReplacements = parseNameList(optarg, replacementNames, 3, replacements); break;
+            case 'f': numFrames = parseIntList(optarg, frames); break;
+            case 'i': numIOScheds = parseNameList(optarg, ioSchedNames, 3, ioScheds); break;
+            case 'd': diskBlocks = (unsigned int)atol(optarg); break;
+            case 'c': numCachePolicies = parseNameList(optarg, cachePolicyNames, 2, cachePolicies); break;
+            case 'k': numCacheSizes = parseIntList(optarg, cacheSizes); break;
+            case 'l': numLoadControls = parseNameList(optarg, loadControlNames, 2, loadControls); break;
+            case 'x': swapSlots = (unsigned int)atol(optarg); break;
+            case 'r': checkpointPath = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (workloadPath == NULL || numPriorities <= 0 || numQuanta <= 0 || numSemWakes <= 0 || maxNodes == 0
+        || numReplacements <= 0 || numFrames <= 0 || numIOScheds <= 0
+        || numCachePolicies <= 0 || numCacheSizes <= 0 || numLoadControls <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    Sweep sweep;
+    sweep.checkpoint = checkpointPath;
+    sweep.workload = readFile(workloadPath, &sweep.workloadLen);
+    if (sweep.workload == NULL) {
+        fprintf(stderr, "Error: Could not read workload %s\n", workloadPath);
+        return 1;
+    }
+
+    // The grid is the cross product of every list of values
+    sweep.numRuns = numPriorities * numQuanta * numSemWakes * numReplacements * numFrames * numIOScheds
+        * numCachePolicies * numCacheSizes * numLoadControls;
+    sweep.runs = calloc(sweep.numRuns, sizeof(SweepRun));
+    if (sweep.runs == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
+    }
+    unsigned int r = 0;
+    for (int p = 0; p < numPriorities; p++) {
+        for (int q = 0; q < numQuanta; q++) {
+            for (int s = 0; s < numSemWakes; s++) {
+                for (int m = 0; m < numReplacements; m++) {
+                    for (int f = 0; f < numFrames; f++) {
+                        for (int d = 0; d < numIOScheds; d++) {
+                            for (int c = 0; c < numCachePolicies; c++) {
+                                for (int z = 0; z < numCacheSizes; z++) {
+                                    for (int l = 0; l < numLoadControls; l++) {
+                                        KernelConfig *config = &sweep.runs[r++].config;
+                                        KernelConfig_default(config);
+                                        config->num_priorities = priorities[p];
+                                        config->quantum = quanta[q];
+                                        config->sem_wake = semWakes[s];
+                                        config->max_nodes = maxNodes;
+                                        config->replacement = replacements[m];
+                                        config->num_frames = frames[f];
+                                        config->io_sched = ioScheds[d];
+                                        config->disk_blocks = diskBlocks;
+                                        config->cache_policy = cachePolicies[c];
+                                        config->cache_pages = cacheSizes[z];
+                                        config->load_control = loadControls[l] != 0;
+                                        config->swap_slots = swapSlots;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    atomic_init(&sweep.nextRun, 0);
+
+    if (threads > sweep.numRuns) {
+        threads = sweep.numRuns;
+    }
+    pthread_t *pool = malloc(threads * sizeof(pthread_t));
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&pool[i], NULL, worker, &sweep);
+    }
+    for (long i = 0; i < threads; i++) {
+        pthread_join(pool[i], NULL);
+    }
+    free(pool);
+
+    FILE *out = outPath != NULL ? fopen(outPath, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Error: Could not open %s\n", outPath);
+        return 1;
+    }
+    writeCsv(&sweep, out);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    int failed = 0;
+    for (unsigned int i = 0; i < sweep.numRuns; i++) {
+        if (!sweep.runs[i].ok) {
+            fprintf(stderr, "Error: Run %u could not be started (invalid configuration?)\n", i);
+            failed = 1;
+        }
+    }
+
+    free(sweep.runs);
+    free((void *)sweep.workload);
+    return failed;
+}
@@ -0,0 +1,809 @@
+/*
+
+Filename: wlgen.c
+
+Description: Seeded, reproducible workload generator. Emits a stream of simulator commands,
+             in exactly the text sim reads, that can be piped into sim or given to sweep.
+             Every command is also run on a silent shadow kernel (default configuration),
+             so each one is chosen for the state the simulator will really be in: receives
+             are issued by processes that have mail, replies go to processes that are waiting
+             for one, V operations release semaphores that are held, and so on.
+
+             Memory accesses touch a per-process working set with a hot subset; page faults
+             depend on the physical memory and replacement policy, so a workload with
+             accesses is replayed most faithfully with the same --frames it was generated for.
+             Disk requests either continue the issuing process's last one or go to a random
+             block; which blocks are waiting, and so the order the I/O scheduler serves them
+             in, depends on --io-sched and --disk-blocks. File requests go through the page
+             cache, and pick a file from the hottest fifth of them with the --locality
+             probability; whether they block depends on --cache-pages and --cache-policy.
+             Under memory pressure the shadow kernel swaps processes out and back in as the
+             simulator will, given the same --swap-slots, --swap-ticks and --load-control.
+
+Usage: wlgen [--preset server|batch|lockheavy|paging|disk|fileserver] [options] > workload.txt
+             Run with --help for the options.
+
+*/
+
+
+#include "KernelSim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+enum Topology {
+    TOPOLOGY_FANIN,     // Many clients send to a few servers
+    TOPOLOGY_FANOUT,    // A few sources send to many sinks
+    TOPOLOGY_MESH       // Everyone sends to everyone
+};
+
+enum Role {
+    ROLE_NONE,          // Not alive
+    ROLE_SERVER,        // Receives and replies
+    ROLE_CLIENT,        // Sends
+    ROLE_PEER           // Both
+};
+
+typedef struct GenConfig_s GenConfig;
+struct GenConfig_s {
+    uint64_t seed;
+    unsigned int commands;          // Commands to emit
+    unsigned int processes;         // Live processes to ramp up to and hold around
+    double priorityMix[3];          // Relative weight of each priority for new processes
+    double forkRate;                // Per-command probabilities for the running process
+    double exitRate;
+    double killRate;
+    double quantumRate;
+    double ipcRate;
+    enum Topology topology;
+    unsigned int fan;               // Clients per server (fan-in) or sinks per source (fan-out)
+    unsigned int semaphores;        // Semaphores used, 0-5; fewer means more contention
+    unsigned int semValue;          // Initial value of each semaphore
+    double semRate;                 // Probability of a P when holding nothing
+    double releaseRate;             // Probability of a V when holding a semaphore
+    double accessRate;              // Probability of a memory access
+    unsigned int workingSet;        // Pages each process touches
+    double locality;                // Probability an access goes to the hottest fifth of them
+    double writeRatio;              // Probability an access, disk or file request is a write
+    unsigned int frames;            // Physical memory of the shadow kernel
+    double diskRate;                // Probability of a disk request
+    double diskSeq;                 // Probability a disk request continues the last one
+    unsigned int diskBlocks;        // Size of the shadow kernel's disk
+    enum IOScheduler ioSched;       // And its I/O scheduler
+    double fileRate;                // Probability of a file request
+    unsigned int files;             // Files used
+    unsigned int cachePages;        // Page cache of the shadow kernel
+    enum CachePolicy cachePolicy;
+    unsigned int swapSlots;         // Swap area of the shadow kernel
+    unsigned int swapTicks;
+    bool loadControl;
+};
+
+#define WLGEN_MEMORY_BASE 0x400000u     // Virtual address of the first working set page
+#define WLGEN_MAX_DISK_BLOCKS 8         // Largest disk or file request
+#define WLGEN_FILE_BLOCKS 1024          // Blocks per file, as the page cache divides the disk
+
+// What the generator remembers about each pid
+typedef struct GenProc_s GenProc;
+struct GenProc_s {
+    enum Role role;
+    int owesReplyTo;                // Sender whose message was received but not replied to
+    int held[KERNELSIM_NUM_SEMAPHORES];     // Semaphore units held
+    unsigned int nextBlock;         // Block after the last disk request, 0 before the first
+    int file;                       // File of the last file request
+    unsigned int nextFileBlock;     // Block after it, 0 before the first
+};
+
+typedef struct Gen_s Gen;
+struct Gen_s {
+    GenConfig config;
+    Kernel *k;
+    FILE *out;
+    uint64_t rng;
+    GenProc *procs;                 // Indexed by pid
+    size_t procCap;
+    int *live;                      // Live pids (not init), unordered
+    size_t numLive;
+    int *servers;                   // Live pids with the server role
+    size_t numServers;
+    unsigned int msgSeq;
+    unsigned long long emitted;
+};
+
+
+// ---------- RANDOM NUMBERS ----------
+
+// splitmix64: small, fast and the same on every platform
+static uint64_t nextRandom(Gen *g) {
+    uint64_t z = (g->rng += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double randomUnit(Gen *g) {
+    return (nextRandom(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static bool chance(Gen *g, double p) {
+    return randomUnit(g) < p;
+}
+
+static size_t randomIndex(Gen *g, size_t n) {
+    return (size_t)(nextRandom(g) % n);
+}
+
+
+// ---------- BOOKKEEPING ----------
+
+static GenProc* proc(Gen *g, int pid) {
+
+    if ((size_t)pid >= g->procCap) {
+        size_t cap = g->procCap * 2;
+        while (cap <= (size_t)pid) {
+            cap *= 2;
+        }
+        g->procs = realloc(g->procs, cap * sizeof(GenProc));
+        memset(g->procs + g->procCap, 0, (cap - g->procCap) * sizeof(GenProc));
+        g->procCap = cap;
+    }
+    return &g->procs[pid];
+}
+
+static void removeFrom(int *pids, size_t *count, int pid) {
+
+    for (size_t i = 0; i < *count; i++) {
+        if (pids[i] == pid) {
+            pids[i] = pids[--(*count)];
+            return;
+        }
+    }
+}
+
+static void addLive(Gen *g, int pid) {
+
+    GenProc *p = proc(g, pid);
+    memset(p, 0, sizeof(GenProc));
+    p->owesReplyTo = -1;
+
+    // Roles follow the topology: in fan-in one process in fan+1 is a server, in fan-out
+    //  one in fan+1 is a client
+    if (g->config.topology == TOPOLOGY_MESH) {
+        p->role = ROLE_PEER;
+    }
+    else {
+        bool rare = randomIndex(g, g->config.fan + 1) == 0 || g->numServers == 0;
+        if (g->config.topology == TOPOLOGY_FANIN) {
+            p->role = rare ? ROLE_SERVER : ROLE_CLIENT;
+        }
+        else {
+            p->role = rare && g->numServers > 0 ? ROLE_CLIENT : ROLE_SERVER;
+        }
+    }
+
+    g->live = realloc(g->live, (g->numLive + 1) * sizeof(int));
+    g->live[g->numLive++] = pid;
+    if (p->role == ROLE_SERVER || p->role == ROLE_PEER) {
+        g->servers = realloc(g->servers, (g->numServers + 1) * sizeof(int));
+        g->servers[g->numServers++] = pid;
+    }
+}
+
+static void removeLive(Gen *g, int pid) {
+
+    proc(g, pid)->role = ROLE_NONE;
+    removeFrom(g->live, &g->numLive, pid);
+    removeFrom(g->servers, &g->numServers, pid);
+}
+
+static int runningPid(Gen *g) {
+
+    KernelSimState state;
+    KernelSim_query(g->k, &state);
+    return state.running_pid;
+}
+
+
+// ---------- COMMANDS ----------
+
+// Emit one command and run it on the shadow kernel. Returns the command's result.
+static int emit(Gen *g, const char *text) {
+
+    fputs(text, g->out);
+    g->emitted++;
+    return KernelSim_dispatch(g->k, text);
+}
+
+static int randomPriority(Gen *g) {
+
+    double total = g->config.priorityMix[0] + g->config.priorityMix[1] + g->config.priorityMix[2];
+    double r = randomUnit(g) * total;
+    if (r < g->config.priorityMix[0])
+        return 0;
+    if (r < g->config.priorityMix[0] + g->config.priorityMix[1])
+        return 1;
+    return 2;
+}
+
+static void doCreate(Gen *g) {
+
+    char text[32];
+    snprintf(text, sizeof(text), "C\n%d\n", randomPriority(g));
+    int pid = emit(g, text);
+    if (pid > 0) {
+        addLive(g, pid);
+    }
+}
+
+static void doFork(Gen *g) {
+
+    int pid = emit(g, "F\n");
+    if (pid > 0) {
+        addLive(g, pid);
+    }
+}
+
+static void doKill(Gen *g, int pid) {
+
+    char text[32];
+    snprintf(text, sizeof(text), "K\n%d\n", pid);
+    if (emit(g, text) != -1) {
+        removeLive(g, pid);
+    }
+}
+
+static void doExit(Gen *g, int pid) {
+
+    emit(g, "E\n");
+    removeLive(g, pid);
+}
+
+static void doSend(Gen *g, int to) {
+
+    char text[64];
+    snprintf(text, sizeof(text), "S\n%d\nm%u\n", to, g->msgSeq++);
+    emit(g, text);
+}
+
+static void doReply(Gen *g, int from) {
+
+    char text[64];
+    GenProc *p = proc(g, from);
+    int to = p->owesReplyTo;
+    p->owesReplyTo = -1;
+    if (proc(g, to)->role == ROLE_NONE)
+        return;
+    snprintf(text, sizeof(text), "Y\n%d\nr%u\n", to, g->msgSeq++);
+    emit(g, text);
+}
+
+static void doReceive(Gen *g, int pid) {
+
+    KernelSimProc info;
+    int src = -1;
+    if (KernelSim_query_proc(g->k, pid, &info) == 0) {
+        src = info.message_src;
+    }
+    emit(g, "R\n");
+
+    // Messages from init need no reply
+    if (src > 0) {
+        proc(g, pid)->owesReplyTo = src;
+    }
+}
+
+static void doSemP(Gen *g, int pid) {
+
+    char text[32];
+    int sem = (int)randomIndex(g, g->config.semaphores);
+    snprintf(text, sizeof(text), "P\n%d\n", sem);
+    if (emit(g, text) != -1) {
+        // Whether it blocked or not, once it runs again it holds a unit
+        proc(g, pid)->held[sem]++;
+    }
+}
+
+static void doAccess(Gen *g) {
+
+    const GenConfig *c = &g->config;
+    unsigned int hot = c->workingSet >= 5 ? c->workingSet / 5 : 1;
+    unsigned int page = chance(g, c->locality)
+        ? (unsigned int)randomIndex(g, hot)
+        : (unsigned int)randomIndex(g, c->workingSet);
+
+    char text[64];
+    snprintf(text, sizeof(text), "A\n0x%x\n1\n%c\n",
+             WLGEN_MEMORY_BASE + page * 4096u, chance(g, c->writeRatio) ? 'w' : 'r');
+    emit(g, text);
+}
+
+static void doDisk(Gen *g, int pid) {
+
+    const GenConfig *c = &g->config;
+    GenProc *p = proc(g, pid);
+    unsigned int count = 1 + (unsigned int)randomIndex(g, WLGEN_MAX_DISK_BLOCKS);
+    unsigned int block = p->nextBlock;
+    if (!chance(g, c->diskSeq) || block == 0 || block + count > c->diskBlocks) {
+        block = (unsigned int)randomIndex(g, c->diskBlocks - count + 1);
+    }
+
+    char text[64];
+    snprintf(text, sizeof(text), "D\n%u\n%u\n%c\n", block, count, chance(g, c->writeRatio) ? 'w' : 'r');
+    if (emit(g, text) != -1) {
+        p->nextBlock = block + count;
+    }
+}
+
+static void doFile(Gen *g, int pid) {
+
+    const GenConfig *c = &g->config;
+    GenProc *p = proc(g, pid);
+    unsigned int count = 1 + (unsigned int)randomIndex(g, WLGEN_MAX_DISK_BLOCKS);
+    int file = p->file;
+    unsigned int block = p->nextFileBlock;
+    if (!chance(g, c->diskSeq) || block == 0 || block + count > WLGEN_FILE_BLOCKS) {
+        unsigned int hot = c->files >= 5 ? c->files / 5 : 1;
+        file = chance(g, c->locality) ? (int)randomIndex(g, hot) : (int)randomIndex(g, c->files);
+        block = (unsigned int)randomIndex(g, WLGEN_FILE_BLOCKS - count + 1);
+    }
+
+    char text[64];
+    snprintf(text, sizeof(text), "O\n%d\n%u\n%u\n%c\n", file, block, count, chance(g, c->writeRatio) ? 'w' : 'r');
+    if (emit(g, text) != -1) {
+        p->file = file;
+        p->nextFileBlock = block + count;
+    }
+}
+
+static void doSemV(Gen *g, int pid, int sem) {
+
+    char text[32];
+    snprintf(text, sizeof(text), "V\n%d\n", sem);
+    emit(g, text);
+    proc(g, pid)->held[sem]--;
+}
+
+// Init runs when nothing else can: add processes, or wake something up
+static void stepInit(Gen *g) {
+
+    if (g->numLive < g->config.processes || g->numLive == 0) {
+        doCreate(g);
+        return;
+    }
+
+    // Page reads, disk requests and swap-ins complete on their own; give them a tick
+    KernelSimState state;
+    KernelSim_query(g->k, &state);
+    if (state.waiting_io_length > 0 || state.waiting_disk_length > 0 || state.swapped_length > 0) {
+        emit(g, "Q\n");
+        return;
+    }
+
+    // Release a semaphore on behalf of a blocked holder, reply to a waiting sender, or kill
+    //  a blocked process so the workload keeps moving
+    for (size_t i = 0; i < g->numLive; i++) {
+        KernelSimProc info;
+        int pid = g->live[(i + randomIndex(g, g->numLive)) % g->numLive];
+        if (KernelSim_query_proc(g->k, pid, &info) != 0 || info.state != KERNELSIM_BLOCKED)
+            continue;
+        if (info.wait_state == KERNELSIM_WAITING_REPLY) {
+            char text[64];
+            snprintf(text, sizeof(text), "Y\n%d\nr%u\n", pid, g->msgSeq++);
+            emit(g, text);
+            return;
+        }
+        if (info.wait_state == KERNELSIM_WAITING_SEM) {
+            for (int s = 0; s < (int)g->config.semaphores; s++) {
+                if (state.sem_waiting_length[s] > 0) {
+                    char text[32];
+                    snprintf(text, sizeof(text), "V\n%d\n", s);
+                    emit(g, text);
+                    return;
+                }
+            }
+        }
+    }
+
+    // Everyone left is waiting to receive
+    doKill(g, g->live[randomIndex(g, g->numLive)]);
+}
+
+static void stepProcess(Gen *g, int pid) {
+
+    GenProc *p = proc(g, pid);
+    const GenConfig *c = &g->config;
+
+    // Keep the population near the target
+    if (g->numLive < c->processes && chance(g, 0.5)) {
+        doCreate(g);
+        return;
+    }
+    if (chance(g, c->exitRate)) {
+        doExit(g, pid);
+        return;
+    }
+    if (g->numLive > 1 && chance(g, c->killRate)) {
+        int victim = g->live[randomIndex(g, g->numLive)];
+        if (victim != pid) {
+            doKill(g, victim);
+            return;
+        }
+    }
+    if (g->numLive < c->processes * 2 && chance(g, c->forkRate)) {
+        doFork(g);
+        return;
+    }
+
+    // Release what is held before doing anything that might block
+    for (int s = 0; s < (int)c->semaphores; s++) {
+        if (p->held[s] > 0 && chance(g, c->releaseRate)) {
+            doSemV(g, pid, s);
+            return;
+        }
+    }
+
+    if (chance(g, c->ipcRate)) {
+        KernelSimProc info;
+        if (KernelSim_query_proc(g->k, pid, &info) == 0 && info.has_message) {
+            doReceive(g, pid);
+            return;
+        }
+        if (p->owesReplyTo != -1) {
+            doReply(g, pid);
+            return;
+        }
+        if (p->role == ROLE_SERVER || (p->role == ROLE_PEER && chance(g, 0.5))) {
+            doReceive(g, pid);
+            return;
+        }
+        // A server holds one unread message at a time, so look for one with room
+        for (int tries = 0; tries < 4 && g->numServers > 0; tries++) {
+            KernelSimProc target;
+            int to = g->servers[randomIndex(g, g->numServers)];
+            if (to != pid && KernelSim_query_proc(g->k, to, &target) == 0 && !target.has_message) {
+                doSend(g, to);
+                return;
+            }
+        }
+    }
+
+    if (c->semaphores > 0 && chance(g, c->semRate)) {
+        doSemP(g, pid);
+        return;
+    }
+    if (c->workingSet > 0 && chance(g, c->accessRate)) {
+        doAccess(g);
+        return;
+    }
+    if (chance(g, c->diskRate)) {
+        doDisk(g, pid);
+        return;
+    }
+    if (c->files > 0 && chance(g, c->fileRate)) {
+        doFile(g, pid);
+        return;
+    }
+    if (chance(g, c->quantumRate)) {
+        emit(g, "Q\n");
+        return;
+    }
+
+    // Nothing else was picked: let the quantum expire so the others get a turn
+    emit(g, "Q\n");
+}
+
+
+// ---------- CONFIGURATION ----------
+
+static void presetDefaults(GenConfig *c) {
+
+    c->seed = 1;
+    c->commands = 10000;
+    c->processes = 50;
+    c->priorityMix[0] = 1;
+    c->priorityMix[1] = 1;
+    c->priorityMix[2] = 1;
+    c->forkRate = 0.02;
+    c->exitRate = 0.02;
+    c->killRate = 0.005;
+    c->quantumRate = 0.2;
+    c->ipcRate = 0.3;
+    c->topology = TOPOLOGY_MESH;
+    c->fan = 4;
+    c->semaphores = 1;
+    c->semValue = 1;
+    c->semRate = 0.1;
+    c->releaseRate = 0.5;
+    c->accessRate = 0;
+    c->workingSet = 16;
+    c->locality = 0.8;
+    c->writeRatio = 0.3;
+    KernelConfig kconfig;
+    KernelSim_default_config(&kconfig);
+    c->frames = kconfig.num_frames;
+    c->diskRate = 0;
+    c->diskSeq = 0.5;
+    c->diskBlocks = kconfig.disk_blocks;
+    c->ioSched = kconfig.io_sched;
+    c->fileRate = 0;
+    c->files = 8;
+    c->cachePages = kconfig.cache_pages;
+    c->cachePolicy = kconfig.cache_policy;
+    c->swapSlots = kconfig.swap_slots;
+    c->swapTicks = kconfig.swap_ticks;
+    c->loadControl = kconfig.load_control;
+}
+
+static int applyPreset(GenConfig *c, const char *name) {
+
+    presetDefaults(c);
+    if (strcmp(name, "server") == 0) {
+        // Request/response: many clients over a few high-priority servers, little locking
+        c->priorityMix[0] = 0.2; c->priorityMix[1] = 0.6; c->priorityMix[2] = 0.2;
+        c->topology = TOPOLOGY_FANIN;
+        c->fan = 8;
+        c->ipcRate = 0.8;
+        c->quantumRate = 0.1;
+        c->forkRate = 0.01;
+        c->exitRate = 0.01;
+        c->semaphores = 1;
+        c->semValue = 4;
+        c->semRate = 0.05;
+    }
+    else if (strcmp(name, "batch") == 0) {
+        // Long CPU-bound jobs: mostly low priority, frequent preemption, process churn
+        c->priorityMix[0] = 0; c->priorityMix[1] = 0.2; c->priorityMix[2] = 0.8;
+        c->topology = TOPOLOGY_FANOUT;
+        c->fan = 16;
+        c->ipcRate = 0.05;
+        c->quantumRate = 0.6;
+        c->forkRate = 0.05;
+        c->exitRate = 0.05;
+        c->semaphores = 0;
+    }
+    else if (strcmp(name, "lockheavy") == 0) {
+        // Everyone fights over two mutexes
+        c->priorityMix[0] = 0.1; c->priorityMix[1] = 0.8; c->priorityMix[2] = 0.1;
+        c->topology = TOPOLOGY_MESH;
+        c->ipcRate = 0.05;
+        c->quantumRate = 0.2;
+        c->semaphores = 2;
+        c->semValue = 1;
+        c->semRate = 0.6;
+        c->releaseRate = 0.6;
+    }
+    else if (strcmp(name, "paging") == 0) {
+        // Working sets that together are twice physical memory, so replacement matters
+        c->processes = 8;
+        c->ipcRate = 0.05;
+        c->quantumRate = 0.1;
+        c->forkRate = 0.005;
+        c->exitRate = 0.005;
+        c->semaphores = 0;
+        c->accessRate = 0.7;
+        c->workingSet = c->frames * 2 / c->processes;
+        c->locality = 0.9;
+    }
+    else if (strcmp(name, "disk") == 0) {
+        // I/O-bound: a mix of sequential streams and random requests keeps the disk queue
+        //  deep enough for the I/O scheduler to matter
+        c->processes = 32;
+        c->ipcRate = 0.05;
+        c->quantumRate = 0.1;
+        c->forkRate = 0.005;
+        c->exitRate = 0.005;
+        c->semaphores = 0;
+        c->diskRate = 0.8;
+        c->diskSeq = 0.5;
+    }
+    else if (strcmp(name, "fileserver") == 0) {
+        // File reads and writes through the page cache, over a hot set that mostly fits in it
+        c->processes = 32;
+        c->ipcRate = 0.05;
+        c->quantumRate = 0.1;
+        c->forkRate = 0.005;
+        c->exitRate = 0.005;
+        c->semaphores = 0;
+        c->fileRate = 0.8;
+        c->files = 16;
+        c->diskSeq = 0.7;
+        c->locality = 0.8;
+    }
+    else {
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [--preset server|batch|lockheavy|paging|disk|fileserver] [options] > workload.txt\n"
+        "  --seed N               random seed (default 1)\n"
+        "  --commands N           commands to emit (default 10000)\n"
+        "  --processes N          live processes to hold around (default 50)\n"
+        "  --priority-mix H,N,L   relative weights of priorities 0,1,2\n"
+        "  --fork-rate P          probability the running process forks\n"
+        "  --exit-rate P          probability the running process exits\n"
+        "  --kill-rate P          probability the running process kills another\n"
+        "  --quantum-rate P       probability of a quantum expiry\n"
+        "  --ipc-rate P           probability of a send/receive/reply\n"
+        "  --topology fanin|fanout|mesh\n"
+        "  --fan N                clients per server (fanin) or sinks per source (fanout)\n"
+        "  --semaphores N         semaphores in use, 0-5 (fewer = more contention)\n"
+        "  --sem-value N          initial semaphore value\n"
+        "  --sem-rate P           probability of a P operation\n"
+        "  --release-rate P       probability a holder does its V\n"
+        "  --access-rate P        probability of a memory access\n"
+        "  --working-set N        pages each process touches (default 16)\n"
+        "  --locality P           probability an access goes to the hottest fifth of them\n"
+        "  --write-ratio P        probability an access, disk or file request is a write\n"
+        "  --frames N             physical memory of the shadow kernel; replay with sim --frames N\n"
+        "  --disk-rate P          probability of a disk request\n"
+        "  --disk-seq P           probability a disk or file request continues the process's last one\n"
+        "  --disk-blocks N        disk size of the shadow kernel; replay with sim --disk-blocks N\n"
+        "  --io-sched fifo|scan|deadline\n"
+        "                         I/O scheduler of the shadow kernel; replay with sim --io-sched\n"
+        "  --file-rate P          probability of a file request through the page cache\n"
+        "  --files N              files used (default 8); --locality picks the hottest fifth\n"
+        "  --cache-pages N        page cache of the shadow kernel; replay with sim --cache-pages N\n"
+        "  --cache-policy lru|2q  its eviction policy; replay with sim --cache-policy\n"
+        "  --swap-slots N         swap area of the shadow kernel; replay with sim --swap-slots N\n"
+        "  --swap-ticks N         its cost per page; replay with sim --swap-ticks N\n"
+        "  --load-control on|off  whether it swaps out processes; replay with sim --load-control\n"
+        "  -o FILE                write to FILE instead of stdout\n"
+        "Use sim --max-nodes at least 2x --processes when replaying large workloads.\n",
+        prog);
+}
+
+int main(int argc, char *argv[]) {
+
+    GenConfig config;
+    presetDefaults(&config);
+    const char *outPath = NULL;
+
+    // A preset sets the baseline, so it is applied before any other option
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--preset") == 0 && applyPreset(&config, argv[i + 1]) == -1) {
+            fprintf(stderr, "Error: Unknown preset %s\n", argv[i + 1]);
+            return 1;
+        }
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (val == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+        if (strcmp(opt, "--preset") == 0) {
+            // Already applied
+        }
+        else if (strcmp(opt, "--seed") == 0) config.seed = strtoull(val, NULL, 10);
+        else if (strcmp(opt, "--commands") == 0) config.commands = (unsigned int)atol(val);
+        else if (strcmp(opt, "--processes") == 0) config.processes = (unsigned int)atol(val);
+        else if (strcmp(opt, "--priority-mix") == 0) {
+            if (sscanf(val, "%lf,%lf,%lf", &config.priorityMix[0], &config.priorityMix[1], &config.priorityMix[2]) != 3) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "--fork-rate") == 0) config.forkRate = atof(val);
+        else if (strcmp(opt, "--exit-rate") == 0) config.exitRate = atof(val);
+        else if (strcmp(opt, "--kill-rate") == 0) config.killRate = atof(val);
+        else if (strcmp(opt, "--quantum-rate") == 0) config.quantumRate = atof(val);
+        else if (strcmp(opt, "--ipc-rate") == 0) config.ipcRate = atof(val);
+        else if (strcmp(opt, "--topology") == 0) {
+            if (strcmp(val, "fanin") == 0) config.topology = TOPOLOGY_FANIN;
+            else if (strcmp(val, "fanout") == 0) config.topology = TOPOLOGY_FANOUT;
+            else if (strcmp(val, "mesh") == 0) config.topology = TOPOLOGY_MESH;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (strcmp(opt, "--fan") == 0) config.fan = (unsigned int)atol(val);
+        else if (strcmp(opt, "--semaphores") == 0) config.semaphores = (unsigned int)atol(val);
+        else if (strcmp(opt, "--sem-value") == 0) config.semValue = (unsigned int)atol(val);
+        else if (strcmp(opt, "--sem-rate") == 0) config.semRate = atof(val);
+        else if (strcmp(opt, "--release-rate") == 0) config.releaseRate = atof(val);
+        else if (strcmp(opt, "--access-rate") == 0) config.accessRate = atof(val);
+        else if (strcmp(opt, "--working-set") == 0) config.workingSet = (unsigned int)atol(val);
+        else if (strcmp(opt, "--locality") == 0) config.locality = atof(val);
+        else if (strcmp(opt, "--write-ratio") == 0) config.writeRatio = atof(val);
+        else if (strcmp(opt, "--frames") == 0) config.frames = (unsigned int)atol(val);
+        else if (strcmp(opt, "--disk-rate") == 0) config.diskRate = atof(val);
+        else if (strcmp(opt, "--disk-seq") == 0) config.diskSeq = atof(val);
+        else if (strcmp(opt, "--disk-blocks") == 0) config.diskBlocks = (unsigned int)atol(val);
+        else if (strcmp(opt, "--io-sched") == 0) {
+            if (strcmp(val, "fifo") == 0) config.ioSched = IO_SCHED_FIFO;
+            else if (strcmp(val, "scan") == 0) config.ioSched = IO_SCHED_SCAN;
+            else if (strcmp(val, "deadline") == 0) config.ioSched = IO_SCHED_DEADLINE;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (strcmp(opt, "--file-rate") == 0) config.fileRate = atof(val);
+        else if (strcmp(opt, "--files") == 0) config.files = (unsigned int)atol(val);
+        else if (strcmp(opt, "--cache-pages") == 0) config.cachePages = (unsigned int)atol(val);
+        else if (strcmp(opt, "--cache-policy") == 0) {
+            if (strcmp(val, "lru") == 0) config.cachePolicy = CACHE_LRU;
+            else if (strcmp(val, "2q") == 0) config.cachePolicy = CACHE_2Q;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (strcmp(opt, "--swap-slots") == 0) config.swapSlots = (unsigned int)atol(val);
+        else if (strcmp(opt, "--swap-ticks") == 0) config.swapTicks = (unsigned int)atol(val);
+        else if (strcmp(opt, "--load-control") == 0) {
+            if (strcmp(val, "on") == 0) config.loadControl = true;
+            else if (strcmp(val, "off") == 0) config.loadControl = false;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (strcmp(opt, "-o") == 0) outPath = val;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.semaphores > KERNELSIM_NUM_SEMAPHORES || config.processes == 0 || config.fan == 0
+        || config.diskBlocks < WLGEN_MAX_DISK_BLOCKS || config.files > config.diskBlocks / WLGEN_FILE_BLOCKS
+        || (uint64_t)config.workingSet * 4096u + WLGEN_MEMORY_BASE > UINT32_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Gen g;
+    memset(&g, 0, sizeof(Gen));
+    g.config = config;
+    g.rng = config.seed;
+    g.out = outPath != NULL ? fopen(outPath, "w") : stdout;
+    if (g.out == NULL) {
+        fprintf(stderr, "Error: Could not open %s\n", outPath);
+        return 1;
+    }
+    g.procCap = 64;
+    g.procs = calloc(g.procCap, sizeof(GenProc));
+
+    // The shadow kernel needs room for everything the workload can create
+    KernelConfig kconfig;
+    KernelSim_default_config(&kconfig);
+    kconfig.max_nodes = config.processes * 4 + 64;
+    kconfig.num_frames = config.frames;
+    kconfig.disk_blocks = config.diskBlocks;
+    kconfig.io_sched = config.ioSched;
+    kconfig.cache_pages = config.cachePages;
+    kconfig.cache_policy = config.cachePolicy;
+    kconfig.swap_slots = config.swapSlots;
+    kconfig.swap_ticks = config.swapTicks;
+    kconfig.load_control = config.loadControl;
+    g.k = KernelSim_init(&kconfig, NULL);
+    if (g.k == NULL || g.procs == NULL) {
+        fprintf(stderr, "Error: Could not allocate the shadow kernel\n");
+        return 1;
+    }
+
+    for (unsigned int s = 0; s < config.semaphores; s++) {
+        char text[32];
+        snprintf(text, sizeof(text), "N\n%u\n%u\n", s, config.semValue);
+        emit(&g, text);
+    }
+
+    while (g.emitted < config.commands) {
+        int pid = runningPid(&g);
+        if (pid == -1)
+            break;
+        if (pid == 0) {
+            stepInit(&g);
+        }
+        else {
+            stepProcess(&g, pid);
+        }
+    }
+
+    fprintf(stderr, "wlgen: %llu commands, %zu live processes at the end\n", g.emitted, g.numLive);
+
+    KernelSim_destroy(g.k);
+    free(g.procs);
+    free(g.live);
+    free(g.servers);
+    if (g.out != stdout) {
+        fclose(g.out);
+    }
+    return 0;
+}